@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Actuator layout of each robot variant. Everything here is constexpr so the
+// Robot template can bake pins, channels and limits straight into the
+// generated drive code. Select a variant with -D ROBOT_TOPOLOGY_4WD; the
+// default is the original two-motor, two-servo build.
+namespace topology {
+constexpr uint32_t PWM_FREQ = 20000;
+constexpr uint8_t PWM_RES = 8;
+
+enum class Side : uint8_t { Left, Right };
+enum class ServoMode : uint8_t { Position, Spin };
+
+struct MotorSpec {
+  uint8_t pinIn1;
+  uint8_t pinIn2;
+  uint8_t pinPwm;
+  uint8_t pwmChannel;
+  Side side;
+  uint8_t maxDuty;
+};
+
+// One calibration point of a wheel's steady-state speed against PWM duty on
+// the 0..255 scale. Points rise in both fields; the first is the deadband
+// edge (the lowest duty that turns the wheel) with speed 0, the last the top
+// speed.
+struct WheelCurvePoint {
+  uint8_t duty;
+  uint16_t speedMmS;
+};
+
+struct DriveSpec {
+  // Distance between the left and right wheel contact lines.
+  uint16_t trackWidthMm;
+};
+
+struct ServoSpec {
+  uint8_t pin;
+  uint8_t minAngle;
+  uint8_t maxAngle;
+  uint8_t homeAngle;
+  ServoMode mode;
+};
+
+struct TwoWheelDrive {
+  static constexpr MotorSpec motors[] = {
+      {27, 33, 32, 0, Side::Left, 255},  // in1 moved from 34 (input only) to 27
+      {14, 13, 12, 1, Side::Right, 255},
+  };
+  static constexpr ServoSpec servos[] = {
+      {25, 0, 180, 90, ServoMode::Position},
+      {26, 0, 180, 90, ServoMode::Spin},
+  };
+  static constexpr DriveSpec drive = {150};
+  static constexpr WheelCurvePoint wheelCurve[] = {
+      {38, 0}, {64, 140}, {96, 280}, {128, 390}, {176, 510}, {255, 600},
+  };
+};
+
+struct FourWheelDrive {
+  static constexpr MotorSpec motors[] = {
+      {27, 33, 32, 0, Side::Left, 255},
+      {14, 13, 12, 1, Side::Right, 255},
+      {4, 16, 17, 2, Side::Left, 255},
+      {18, 19, 23, 3, Side::Right, 255},
+  };
+  static constexpr ServoSpec servos[] = {
+      {25, 0, 180, 90, ServoMode::Position},
+      {26, 0, 180, 90, ServoMode::Spin},
+      {5, 0, 180, 90, ServoMode::Position},
+  };
+  static constexpr DriveSpec drive = {190};
+  static constexpr WheelCurvePoint wheelCurve[] = {
+      {46, 0}, {72, 120}, {104, 250}, {140, 360}, {190, 470}, {255, 540},
+  };
+};
+
+#if defined(ROBOT_TOPOLOGY_4WD)
+using Active = FourWheelDrive;
+#else
+using Active = TwoWheelDrive;
+#endif
+
+template <typename Topology>
+constexpr size_t motorCount() {
+  return sizeof(Topology::motors) / sizeof(Topology::motors[0]);
+}
+
+template <typename Topology>
+constexpr size_t servoCount() {
+  return sizeof(Topology::servos) / sizeof(Topology::servos[0]);
+}
+
+template <typename Topology>
+constexpr size_t wheelCurveCount() {
+  return sizeof(Topology::wheelCurve) / sizeof(Topology::wheelCurve[0]);
+}
+
+template <typename Topology>
+constexpr bool wheelCurveIsMonotonic() {
+  if (wheelCurveCount<Topology>() < 2 || Topology::wheelCurve[0].speedMmS != 0) {
+    return false;
+  }
+  for (size_t i = 1; i < wheelCurveCount<Topology>(); ++i) {
+    if (Topology::wheelCurve[i].duty <= Topology::wheelCurve[i - 1].duty ||
+        Topology::wheelCurve[i].speedMmS <= Topology::wheelCurve[i - 1].speedMmS) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Topology>
+constexpr bool channelsAreUnique() {
+  for (size_t i = 0; i < motorCount<Topology>(); ++i) {
+    for (size_t j = i + 1; j < motorCount<Topology>(); ++j) {
+      if (Topology::motors[i].pwmChannel == Topology::motors[j].pwmChannel) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+}  // namespace topology
@@ -16,6 +16,63 @@
 #define MQTT_PORT 1883
 #endif
 
+// Fallback brokers, tried alongside the primary. All share MQTT_PORT until
+// MQTT_PORT_2/MQTT_PORT_3 are provisioned.
+#ifndef MQTT_HOST_2
+#define MQTT_HOST_2 ""
+#endif
+
+#ifndef MQTT_HOST_3
+#define MQTT_HOST_3 ""
+#endif
+
+// Delay before the next broker joins a connection race, unless the earlier
+// attempts have already failed.
+#ifndef MQTT_RACE_STAGGER_MS
+#define MQTT_RACE_STAGGER_MS 300
+#endif
+
+// While on a fallback broker, the primary is probed this often and taken
+// back as soon as a probe session is up.
+#ifndef MQTT_FAILBACK_PROBE_MS
+#define MQTT_FAILBACK_PROBE_MS 30000
+#endif
+
+// Broker TLS. MQTT_TLS_CA_PEM is the only CA trusted for the broker;
+// MQTT_TLS_PIN (hex SHA-256 of a DER certificate) can be provisioned instead
+// or on top. With TLS on, at least one of the two must be set.
+#ifndef MQTT_TLS
+#define MQTT_TLS 0
+#endif
+
+#ifndef MQTT_TLS_CA_PEM
+#define MQTT_TLS_CA_PEM ""
+#endif
+
+#ifndef MQTT_TLS_PIN
+#define MQTT_TLS_PIN ""
+#endif
+
+// MQTT 5 instead of 3.1.1. Publish topics are replaced by topic aliases after
+// their first use, subscriptions are taken at QoS 1 with at most
+// MQTT_RECEIVE_MAXIMUM messages in flight, and whatever the device publishes
+// expires after MQTT_MESSAGE_EXPIRY_S (0 keeps it until delivered).
+#ifndef MQTT_V5
+#define MQTT_V5 0
+#endif
+
+#ifndef MQTT_TOPIC_ALIASES
+#define MQTT_TOPIC_ALIASES 8
+#endif
+
+#ifndef MQTT_RECEIVE_MAXIMUM
+#define MQTT_RECEIVE_MAXIMUM 4
+#endif
+
+#ifndef MQTT_MESSAGE_EXPIRY_S
+#define MQTT_MESSAGE_EXPIRY_S 30
+#endif
+
 #ifndef MQTT_CLIENT_ID
 #define MQTT_CLIENT_ID "RobotA"
 #endif
@@ -40,10 +97,225 @@
 #define MQTT_HEARTBEAT_TOPIC "esp32/commrobot/heartbeat"
 #endif
 
+#ifndef MQTT_ACK_TOPIC
+#define MQTT_ACK_TOPIC "esp32/commrobot/ack"
+#endif
+
+#ifndef MQTT_CONFIG_TOPIC
+#define MQTT_CONFIG_TOPIC "esp32/commrobot/config"
+#endif
+
+// Any message on the stop topic, or an ESP-NOW frame starting with
+// ESPNOW_STOP_OPCODE, cuts the motors ahead of everything queued.
+#ifndef MQTT_STOP_TOPIC
+#define MQTT_STOP_TOPIC "esp32/commrobot/stop"
+#endif
+
+#ifndef ESPNOW_STOP_OPCODE
+#define ESPNOW_STOP_OPCODE 0x18
+#endif
+
+// Commands on the group topic carrying `at=` are held and run when the
+// controller's clock reaches that time. The clock is tracked by timestamp
+// exchanges: requests go to MQTT_SYNC_TOPIC, replies come back on
+// MQTT_SYNC_TOPIC/<client id>. An empty topic turns the feature off.
+#ifndef MQTT_GROUP_TOPIC
+#define MQTT_GROUP_TOPIC "esp32/commrobot/group"
+#endif
+
+#ifndef MQTT_SYNC_TOPIC
+#define MQTT_SYNC_TOPIC "esp32/commrobot/sync"
+#endif
+
+#ifndef MQTT_SYNC_INTERVAL_MS
+#define MQTT_SYNC_INTERVAL_MS 2000
+#endif
+
+// A scheduled command found this late is dropped rather than run out of step.
+#ifndef SCHEDULE_LATE_LIMIT_MS
+#define SCHEDULE_LATE_LIMIT_MS 20
+#endif
+
+#ifndef SCHEDULE_HORIZON_MS
+#define SCHEDULE_HORIZON_MS 60000
+#endif
+
 #ifndef MQTT_RETRY_DELAY_MS
 #define MQTT_RETRY_DELAY_MS 3000
 #endif
 
+#ifndef MQTT_HEARTBEAT_INTERVAL_MS
+#define MQTT_HEARTBEAT_INTERVAL_MS 5000
+#endif
+
+#ifndef WIFI_RETRY_DELAY_MS
+#define WIFI_RETRY_DELAY_MS 5000
+#endif
+
+// Extra networks (WIFI_SSID_2/_3) can be provisioned at runtime. While the
+// smoothed RSSI is below WIFI_ROAM_RSSI_DBM the station scans one cached
+// channel every WIFI_ROAM_SCAN_INTERVAL_MS and moves to an access point at
+// least WIFI_ROAM_HYSTERESIS_DB stronger.
+#ifndef WIFI_ROAM_RSSI_DBM
+#define WIFI_ROAM_RSSI_DBM -70
+#endif
+
+#ifndef WIFI_ROAM_HYSTERESIS_DB
+#define WIFI_ROAM_HYSTERESIS_DB 8
+#endif
+
+#ifndef WIFI_ROAM_SCAN_INTERVAL_MS
+#define WIFI_ROAM_SCAN_INTERVAL_MS 3000
+#endif
+
+#ifndef WIFI_ROAM_FULL_SCAN_EVERY
+#define WIFI_ROAM_FULL_SCAN_EVERY 8
+#endif
+
+#ifndef WIFI_ROAM_MIN_INTERVAL_MS
+#define WIFI_ROAM_MIN_INTERVAL_MS 15000
+#endif
+
+#ifndef WIFI_ROAM_CACHE_TTL_MS
+#define WIFI_ROAM_CACHE_TTL_MS 30000
+#endif
+
+#ifndef WIFI_SCAN_DWELL_MS
+#define WIFI_SCAN_DWELL_MS 60
+#endif
+
 #ifndef MQTT_SERIAL_BUFFER
 #define MQTT_SERIAL_BUFFER 128
 #endif
+
+#ifndef MQTT_TX_BUFFER
+#define MQTT_TX_BUFFER 1024
+#endif
+
+#ifndef MQTT_RX_BUFFER
+#define MQTT_RX_BUFFER 512
+#endif
+
+#ifndef MQTT_KEEPALIVE_S
+#define MQTT_KEEPALIVE_S 15
+#endif
+
+#ifndef MQTT_DNS_TIMEOUT_MS
+#define MQTT_DNS_TIMEOUT_MS 2000
+#endif
+
+#ifndef MQTT_TCP_TIMEOUT_MS
+#define MQTT_TCP_TIMEOUT_MS 3000
+#endif
+
+// A full handshake includes the ECDHE/RSA math on the ESP32 itself.
+#ifndef MQTT_TLS_TIMEOUT_MS
+#define MQTT_TLS_TIMEOUT_MS 10000
+#endif
+
+#ifndef MQTT_CONNACK_TIMEOUT_MS
+#define MQTT_CONNACK_TIMEOUT_MS 3000
+#endif
+
+#ifndef MQTT_SUBACK_TIMEOUT_MS
+#define MQTT_SUBACK_TIMEOUT_MS 3000
+#endif
+
+#ifndef EVENT_LOOP_MAX_SLEEP_MS
+#define EVENT_LOOP_MAX_SLEEP_MS 1000
+#endif
+
+// Actuator state is sampled at STATE_STREAM_HZ (at most 100, 0 for off) and
+// published on MQTT_STATE_TOPIC in binary batches every STATE_BATCH_MS.
+#ifndef MQTT_STATE_TOPIC
+#define MQTT_STATE_TOPIC "esp32/commrobot/state"
+#endif
+
+#ifndef STATE_STREAM_HZ
+#define STATE_STREAM_HZ 20
+#endif
+
+#ifndef STATE_BATCH_MS
+#define STATE_BATCH_MS 500
+#endif
+
+#ifndef STATE_BATCH_BYTES
+#define STATE_BATCH_BYTES 256
+#endif
+
+// A loop() pass running longer than this is captured as a stall.
+#ifndef LOOP_STALL_BUDGET_MS
+#define LOOP_STALL_BUDGET_MS 100
+#endif
+
+// Adds a `stall:<ms>` command that blocks the loop, for testing the detector.
+#ifndef DIAG_STALL_INJECT
+#define DIAG_STALL_INJECT 0
+#endif
+
+// Raw serial tunnel to an attached microcontroller on UART2. Independent of
+// the USB console bridge on Serial.
+#ifndef SERIAL_TUNNEL_ENABLED
+#define SERIAL_TUNNEL_ENABLED 0
+#endif
+
+#ifndef SERIAL_TUNNEL_BAUD
+#define SERIAL_TUNNEL_BAUD 921600
+#endif
+
+#ifndef SERIAL_TUNNEL_RX_PIN
+#define SERIAL_TUNNEL_RX_PIN 22
+#endif
+
+#ifndef SERIAL_TUNNEL_TX_PIN
+#define SERIAL_TUNNEL_TX_PIN 21
+#endif
+
+// Hardware RTS/CTS is used when both pins are set (>= 0).
+#ifndef SERIAL_TUNNEL_RTS_PIN
+#define SERIAL_TUNNEL_RTS_PIN -1
+#endif
+
+#ifndef SERIAL_TUNNEL_CTS_PIN
+#define SERIAL_TUNNEL_CTS_PIN -1
+#endif
+
+#ifndef SERIAL_TUNNEL_UART_BUFFER
+#define SERIAL_TUNNEL_UART_BUFFER 4096
+#endif
+
+// Bytes the host may have in flight towards the UART (the downlink credit).
+#ifndef SERIAL_TUNNEL_DOWN_BUFFER
+#define SERIAL_TUNNEL_DOWN_BUFFER 4096
+#endif
+
+// Unacknowledged uplink bytes the device may have published.
+#ifndef SERIAL_TUNNEL_UP_WINDOW
+#define SERIAL_TUNNEL_UP_WINDOW 4096
+#endif
+
+#ifndef SERIAL_TUNNEL_UP_CHUNK
+#define SERIAL_TUNNEL_UP_CHUNK 512
+#endif
+
+#ifndef SERIAL_TUNNEL_FLUSH_MS
+#define SERIAL_TUNNEL_FLUSH_MS 2
+#endif
+
+#ifndef MQTT_TUNNEL_DOWN_TOPIC
+#define MQTT_TUNNEL_DOWN_TOPIC "esp32/commrobot/tunnel/down"
+#endif
+
+#ifndef MQTT_TUNNEL_UP_TOPIC
+#define MQTT_TUNNEL_UP_TOPIC "esp32/commrobot/tunnel/up"
+#endif
+
+// host -> device: "epoch=<e>,up_acked=<bytes>"
+#ifndef MQTT_TUNNEL_HOST_CREDIT_TOPIC
+#define MQTT_TUNNEL_HOST_CREDIT_TOPIC "esp32/commrobot/tunnel/host_credit"
+#endif
+
+// device -> host: "epoch=<e>,down_acked=<bytes>,up_sent=<bytes>,overruns=<n>"
+#ifndef MQTT_TUNNEL_DEVICE_CREDIT_TOPIC
+#define MQTT_TUNNEL_DEVICE_CREDIT_TOPIC "esp32/commrobot/tunnel/device_credit"
+#endif
@@ -1,34 +1,113 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace provisioning {
-struct WifiCredentials {
+constexpr size_t WIFI_NETWORK_SLOTS = 3;
+
+struct WifiNetwork {
   char ssid[33];
   char password[65];
+};
+
+// Slot order is priority order; empty slots are skipped.
+struct WifiCredentials {
+  WifiNetwork networks[WIFI_NETWORK_SLOTS];
   bool valid;
 };
 
-struct MqttInitParams {
+constexpr size_t MQTT_BROKER_SLOTS = 3;
+
+struct MqttBroker {
   char host[65];
   uint16_t port;
+};
+
+struct MqttInitParams {
+  // Slot 0 is the primary; empty slots are skipped.
+  MqttBroker brokers[MQTT_BROKER_SLOTS];
   char clientId[33];
   char username[33];
   char password[65];
   char publishTopic[65];
   char commandTopic[65];
   char heartbeatTopic[65];
+  char ackTopic[65];
+  char configTopic[65];
+  bool tls;
+  char tlsPin[96];
+  // MQTT 5 instead of 3.1.1.
+  bool v5;
+  bool valid;
+};
+
+// Performance knobs that can be changed at runtime without reflashing.
+struct Tuning {
+  uint32_t heartbeatIntervalMs;
+  uint32_t mqttRetryDelayMs;
+  uint32_t wifiRetryDelayMs;
+  uint32_t serialBufferBytes;
+  uint32_t loopMaxSleepMs;
+  uint32_t loopStallBudgetMs;
+  uint32_t pwmFrequency;
+  // 0 turns the actuator state stream off.
+  uint32_t stateStreamHz;
+  uint32_t stateBatchMs;
+};
+
+// Every key belongs to exactly one owner, and each owner has its own version
+// counter, so a subsystem only reacts to the keys it cares about.
+enum class Owner : uint8_t {
+  WifiLink,
+  WifiTiming,
+  MqttLink,
+  MqttTiming,
+  EventLoop,
+  Actuators,
+  Telemetry,
+  COUNT
+};
+
+// Which keys an update may set. Anything published to the MQTT config topic
+// may come from any client of the broker, so it only gets the tuning keys;
+// WiFi, broker, credential and TLS keys stay on the serial/NVS and ESP-NOW
+// provisioning paths.
+enum class KeyScope : uint8_t { All, TuningOnly };
+
+// Field-level difference between two snapshots, so a subsystem redoes only
+// the step an update actually touched. Publish-side topics are not tracked:
+// they are read afresh on every publish.
+struct WifiChanges {
+  bool networks[WIFI_NETWORK_SLOTS];
   bool valid;
 };
 
+struct MqttChanges {
+  bool brokers[MQTT_BROKER_SLOTS];
+  // Client id, credentials, TLS settings or protocol version; sessions must
+  // be rebuilt.
+  bool session;
+  // Command or config topic; a live session only resubscribes.
+  bool subscriptions;
+  bool valid;
+};
+
+WifiChanges diff(const WifiCredentials &before, const WifiCredentials &after);
+MqttChanges diff(const MqttInitParams &before, const MqttInitParams &after);
+
 void initDefaults();
 
 WifiCredentials wifi();
 MqttInitParams mqtt();
+Tuning tuning();
 
 bool hasWifiCredentials();
 bool hasMqttParams();
-bool applyKeyValue(const char *key, const char *value);
+bool applyKeyValue(const char *key, const char *value, KeyScope scope = KeyScope::All);
+// Applies newline separated KEY=VALUE lines in place; returns how many took.
+size_t applyConfigText(char *text, KeyScope scope = KeyScope::All);
+uint32_t version(Owner owner);
 uint32_t wifiVersion();
 uint32_t mqttVersion();
 }  // namespace provisioning
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifndef DIAG_ALLOC_COUNT
+#define DIAG_ALLOC_COUNT 0
+#endif
+
+// Counts heap allocations made by the loop task inside a scope, to check the
+// command path stays allocation free. Needs a build with DIAG_ALLOC_COUNT=1
+// linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc (see the
+// *_alloccheck environment in platformio.ini); otherwise everything here
+// compiles to nothing.
+namespace diag::alloc {
+constexpr bool ENABLED = DIAG_ALLOC_COUNT != 0;
+
+void beginScope();
+void endScope();
+// Allocations seen inside scopes since boot.
+uint32_t scopedAllocations();
+
+struct Scope {
+  Scope() { beginScope(); }
+  ~Scope() { endScope(); }
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+};
+}  // namespace diag::alloc
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Boot timeline. Each stage from setup() to the first actuated command is
+// stamped with micros() the first time it is reached, so the report shows
+// where time-to-first-command goes. The report goes out on the heartbeat
+// topic once MQTT is up, and once more when a later stage lands.
+namespace diag::boot {
+enum class Stage : uint8_t {
+  Setup,
+  Provisioned,
+  WifiStarted,
+  ActuatorsReady,
+  EspNowReady,
+  SetupDone,
+  WifiConnected,
+  MqttConnected,
+  FirstCommand,
+  COUNT
+};
+
+// Later calls for a stage already reached are ignored; cheap enough for the
+// actuation path.
+void mark(Stage stage);
+// Microseconds since reset at which `stage` was reached; 0 while it is not.
+uint32_t at(Stage stage);
+
+// Formats the stages reached so far when some were not reported yet; false
+// otherwise.
+bool peekReport(char *buffer, size_t size);
+// Marks the stages peekReport() formatted as delivered.
+void popReport();
+}  // namespace diag::boot
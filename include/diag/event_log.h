@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef DIAG_LOG_LEVEL
+#define DIAG_LOG_LEVEL 1
+#endif
+
+#ifndef DIAG_LOG_BINARY
+#define DIAG_LOG_BINARY 0
+#endif
+
+#ifndef DIAG_LOG_CAPACITY
+#define DIAG_LOG_CAPACITY 64
+#endif
+
+// Deferred structured logging. Call sites store a fixed-size record in a
+// lock-free ring; text formatting and UART output happen later in drain(),
+// which the main loop runs once the real work for the iteration is done.
+//
+// Each entry is X(name, level, format). Formats only take %ld arguments (at
+// most MAX_ARGS). tools/log_decode.py parses this table, so keep one entry
+// per line and only ever append.
+#define DIAG_EVENTS(X)                                                             \
+  X(ROBOT_MOVE, 1, "Robot Move: L=%ld(%ld) R=%ld(%ld)")                           \
+  X(ROBOT_SPEED_ADJUST, 1, "Speed Adjust: %ld -> L=%ld R=%ld")                    \
+  X(ROBOT_SERVO, 1, "Servo%ld: %ld")                                              \
+  X(ROBOT_SERVO_SPIN, 1, "Servo%ld: Spin")                                        \
+  X(MQTT_COMMAND, 0, "MQTT command id=%ld len=%ld")                               \
+  X(MQTT_IGNORED, 1, "MQTT message ignored (%ld bytes)")                          \
+  X(MQTT_ENVELOPE_MALFORMED, 2, "MQTT command envelope malformed (%ld bytes)") \
+  X(MQTT_COMMAND_REJECTED, 1, "MQTT command src=%ld seq=%ld rejected, verdict=%ld") \
+  X(ROBOT_TWIST, 1, "Robot Twist: v=%ld w=%ld -> L=%ld R=%ld")                    \
+  X(SCHEDULE_FIRED, 0, "Scheduled command id=%ld ran %ld us late")                \
+  X(SCHEDULE_REJECTED, 1, "Scheduled command id=%ld rejected, due in %ld ms")
+
+namespace diag::log {
+constexpr uint8_t LEVEL_DEBUG = 0;
+constexpr uint8_t LEVEL_INFO = 1;
+constexpr uint8_t LEVEL_WARN = 2;
+constexpr size_t MAX_ARGS = 4;
+
+enum class Event : uint16_t {
+#define DIAG_EVENT_ENUM(name, level, format) name,
+  DIAG_EVENTS(DIAG_EVENT_ENUM)
+#undef DIAG_EVENT_ENUM
+      COUNT
+};
+
+constexpr uint8_t EVENT_LEVELS[] = {
+#define DIAG_EVENT_LEVEL(name, level, format) level,
+    DIAG_EVENTS(DIAG_EVENT_LEVEL)
+#undef DIAG_EVENT_LEVEL
+};
+
+// Motor direction as carried in log arguments.
+constexpr int32_t DIR_BACKWARD = -1;
+constexpr int32_t DIR_STOP = 0;
+constexpr int32_t DIR_FORWARD = 1;
+
+struct Stats {
+  uint32_t written;
+  uint32_t dropped;
+  uint32_t drained;
+};
+
+void write(Event event, const int32_t *args, size_t count);
+
+// Emits at most `maxRecords` records, and only as many as the UART can take
+// without blocking. Returns the number of records emitted.
+size_t drain(size_t maxRecords);
+bool pending();
+Stats stats();
+
+template <Event E, typename... Args>
+inline void emit(Args... args) {
+  static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+  if constexpr (EVENT_LEVELS[static_cast<size_t>(E)] >= DIAG_LOG_LEVEL) {
+    const int32_t values[MAX_ARGS] = {static_cast<int32_t>(args)...};
+    write(E, values, sizeof...(Args));
+  }
+}
+}  // namespace diag::log
+
+#define DIAG_LOG(event, ...) ::diag::log::emit<::diag::log::Event::event>(__VA_ARGS__)
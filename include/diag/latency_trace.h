@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tasks/command_envelope.h"
+
+namespace diag::trace {
+constexpr size_t HISTOGRAM_BUCKETS = 16;
+
+// Receive-to-actuate latency in microseconds, bucketed by powers of two:
+// bucket i counts samples in [2^(i-1), 2^i), the last bucket is open ended.
+struct LatencyHistogram {
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint32_t maxUs;
+};
+
+void beginCommand(const tasks::envelope::CommandEnvelope &envelope, uint32_t receivedUs);
+void markDispatch();
+void markActuate();
+void endCommand();
+// Envelope id of the most recent command that carried one; 0 before any.
+uint32_t lastCommandId();
+
+// Formats the oldest pending acknowledgement as
+//   <id>,<senderTs>,<receiveUs>,<dispatchDeltaUs>,<actuateDeltaUs>
+// Deltas are relative to receive; an actuate delta of 0 means nothing moved.
+bool popAck(char *buffer, size_t size);
+
+const LatencyHistogram &histogram();
+// Formats the histogram as hist,<count>,<maxUs>,<acksDropped>,<bucket0>,...
+size_t formatHistogram(char *buffer, size_t size);
+}  // namespace diag::trace
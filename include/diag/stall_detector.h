@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Loop stall detector. The main loop brackets its work with beginPass() and
+// endPass() and drops a marker before each stage; a low rate esp_timer on
+// the other core notices a pass running past LOOP_STALL_BUDGET_MS and copies
+// the pass's marker trail and the latest command IDs into a ring in RTC
+// memory. The ring survives the watchdog or panic reset a hard stall ends
+// in, and is published once MQTT is up again.
+namespace diag::stall {
+enum class Marker : uint8_t {
+  Estop,
+  Wifi,
+  WifiBegin,
+  Mqtt,
+  MqttIo,
+  MqttConnect,
+  MqttPublish,
+  Schedule,
+  Tunnel,
+  EspNow,
+  Actuators,
+  Command,
+  LogDrain,
+  Telemetry,
+  COUNT
+};
+
+void init();
+void beginPass();
+void endPass();
+// Cheap enough for the hot path: one byte and one timestamp into a ring.
+void mark(Marker marker);
+void noteCommand(uint32_t id);
+
+// Formats the oldest record not yet published; false when there is none.
+bool peekReport(char *buffer, size_t size);
+// Drops the record peekReport() returned, once it has been delivered.
+void popReport();
+// Stalls captured since boot.
+uint32_t stalls();
+}  // namespace diag::stall
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net {
+// NTP-style estimate of a remote clock from request/response timestamp
+// quadruples, all in microseconds:
+//   t1 local send, t2 remote receive, t3 remote send, t4 local receive.
+// Of the recent exchanges, the one with the shortest round trip carries the
+// least queueing noise and is taken as the offset; a line fitted through the
+// successive best exchanges gives the drift. No clocks are read here, so a
+// simulation can feed it any pair of virtual clocks.
+class ClockSync {
+ public:
+  static constexpr size_t WINDOW = 8;
+
+  void reset();
+  // Returns false when the exchange is inconsistent and was dropped.
+  bool addExchange(int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+  bool synced() const { return hasBest_; }
+  int64_t toRemote(int64_t localUs) const;
+  int64_t toLocal(int64_t remoteUs) const;
+  // Half the round trip of the exchange in use: the offset can be off by at
+  // most this much, plus drift since that exchange.
+  int64_t errorBoundUs() const { return hasBest_ ? best_.delayUs / 2 : 0; }
+  // Remote clock rate relative to ours, in parts per billion.
+  int32_t driftPpb() const { return static_cast<int32_t>(drift_ * 1e9); }
+  uint32_t exchanges() const { return exchanges_; }
+
+ private:
+  struct Sample {
+    int64_t localUs;
+    int64_t offsetUs;
+    int64_t delayUs;
+  };
+
+  void fitDrift();
+
+  Sample samples_[WINDOW] = {};
+  size_t sampleCount_ = 0;
+  size_t sampleNext_ = 0;
+  // Successive best exchanges, the input to the drift fit.
+  Sample filtered_[WINDOW] = {};
+  size_t filteredCount_ = 0;
+  size_t filteredNext_ = 0;
+  Sample best_{};
+  bool hasBest_ = false;
+  double drift_ = 0.0;
+  uint32_t exchanges_ = 0;
+};
+}  // namespace net
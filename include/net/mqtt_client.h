@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config/defaults.h"
+#include "net/mqtt_codec.h"
+#include "net/socket.h"
+#include "net/tls_session.h"
+
+namespace net {
+// Asynchronous MQTT 3.1.1 / 5 client. Every call returns without waiting on
+// the network: `loop()` advances DNS -> TCP -> [TLS] -> CONNECT/CONNACK ->
+// SUBSCRIBE/SUBACK one non-blocking step at a time and abandons any stage that
+// outlives its timeout.
+//
+// In MQTT 5 mode publish topics are bound to topic aliases as the broker
+// allows, so repeat publishes carry a two byte alias instead of the topic,
+// and the broker may do the same for inbound topics. Subscriptions are taken
+// at QoS 1 and the broker keeps at most MQTT_RECEIVE_MAXIMUM of them
+// unacknowledged; publishes carry MQTT_MESSAGE_EXPIRY_S.
+class MqttClient {
+ public:
+  enum class State : uint8_t {
+    Idle,
+    Resolving,
+    TcpConnecting,
+    TlsHandshake,
+    MqttConnecting,
+    Subscribing,
+    Connected
+  };
+
+  using MessageCallback = void (*)(const char *topic, const uint8_t *payload, size_t length);
+  // `arrivedUs` is micros() right after the bytes were read off the socket.
+  using PriorityCallback = void (*)(uint32_t arrivedUs);
+
+  struct Session {
+    const char *host;
+    uint16_t port;
+    const char *clientId;
+    const char *username;
+    const char *password;
+    const char *const *topics;
+    size_t topicCount;
+    // nullptr for plain TCP.
+    const TlsOptions *tls;
+    bool v5;
+  };
+
+  // MQTT bytes through the transport, before any TLS framing.
+  struct WireStats {
+    uint32_t txBytes;
+    uint32_t rxBytes;
+    // Publishes sent with only a topic alias in place of the topic.
+    uint32_t aliasedPublishes;
+  };
+
+  void setCallback(MessageCallback callback) { callback_ = callback; }
+  // PUBLISH packets on `topic` are announced as soon as they are complete in
+  // the receive buffer, ahead of the packets queued before them. They are
+  // still delivered to the regular callback in order afterwards.
+  void setPriorityTopic(const char *topic, PriorityCallback callback) {
+    priorityTopic_ = topic;
+    priorityCallback_ = callback;
+  }
+
+  // The strings referenced by `session` must stay valid until the client
+  // returns to Idle.
+  bool beginConnect(const Session &session, uint32_t nowMs);
+  void loop(uint32_t nowMs);
+  // Pushes queued packets to the socket without waiting for the next loop().
+  void flush(uint32_t nowMs);
+  void disconnect();
+
+  bool publish(const char *topic, const uint8_t *payload, size_t length);
+  bool publish(const char *topic, const char *payload);
+  // Topic changes on a live session; neither waits for the broker's ack.
+  bool subscribe(const char *topic);
+  bool unsubscribe(const char *topic);
+
+  bool connected() const { return state_ == State::Connected; }
+  bool idle() const { return state_ == State::Idle; }
+  State state() const { return state_; }
+  // Stage in which the most recent attempt failed; Idle if it never did.
+  State lastFailedStage() const { return lastFailedStage_; }
+  int fd() const { return socket_.fd(); }
+  const TlsSession::Stats &tlsStats() const { return tls_.stats(); }
+  const WireStats &wireStats() const { return wire_; }
+  // What the caller may sleep on: the socket becoming writable, and the
+  // time by which loop() must run again even if no I/O happens.
+  bool wantsWrite() const {
+    return state_ == State::TcpConnecting || txLength_ > 0 || (usingTls() && tls_.wantsWrite());
+  }
+  uint32_t nextDeadlineMs(uint32_t nowMs);
+
+  static const char *stateName(State state);
+
+ private:
+  // Long enough for any provisioned topic.
+  static constexpr size_t ALIAS_TOPIC_BYTES = 65;
+
+  bool usingTls() const { return session_.tls != nullptr; }
+  codec::Version version() const {
+    return session_.v5 ? codec::Version::V5 : codec::Version::V311;
+  }
+  int transportRead(uint8_t *buffer, size_t size);
+  int transportWrite(const uint8_t *data, size_t length);
+  void closeTransport();
+  void enterState(State state, uint32_t nowMs);
+  void fail();
+  uint32_t stageTimeoutMs() const;
+  bool sendConnect(uint32_t nowMs);
+  bool sendSubscribe(const char *const *topics, size_t count);
+  uint16_t takePacketId();
+  bool enqueue(size_t length);
+  void resetSessionState();
+  uint16_t outboundAlias(const char *topic, bool *bound);
+  const char *resolveInbound(const codec::Publish &message, char *topic, size_t size);
+  bool acknowledge(uint16_t packetId);
+  void flushPendingAcks();
+  bool flushOutput(uint32_t nowMs);
+  bool pumpInput(uint32_t nowMs);
+  void scanForPriority(uint32_t arrivedUs);
+  void consumeInput(size_t length);
+  void handlePacket(uint8_t type, uint8_t flags, const uint8_t *body, size_t length, uint32_t nowMs);
+  void serviceKeepAlive(uint32_t nowMs);
+
+  Socket socket_;
+  TlsSession tls_;
+  Session session_{};
+  MessageCallback callback_ = nullptr;
+  const char *priorityTopic_ = nullptr;
+  PriorityCallback priorityCallback_ = nullptr;
+  State state_ = State::Idle;
+  State lastFailedStage_ = State::Idle;
+  uint32_t stageStartMs_ = 0;
+  uint32_t lastSendMs_ = 0;
+  uint32_t pingSentMs_ = 0;
+  bool pingOutstanding_ = false;
+  uint16_t nextPacketId_ = 1;
+  uint16_t pendingSubscribeId_ = 0;
+  uint32_t keepAliveMs_ = static_cast<uint32_t>(MQTT_KEEPALIVE_S) * 1000;
+  WireStats wire_{};
+
+  // Topic aliases live for one connection. Outbound aliases are handed out
+  // in order, so alias N is outboundAliases_[N - 1].
+  char outboundAliases_[MQTT_TOPIC_ALIASES][ALIAS_TOPIC_BYTES];
+  uint16_t outboundAliasCount_ = 0;
+  uint16_t outboundAliasLimit_ = 0;
+  char inboundAliases_[MQTT_TOPIC_ALIASES][ALIAS_TOPIC_BYTES];
+  // Alias the broker bound to the priority topic; 0 while there is none.
+  uint16_t priorityAlias_ = 0;
+  // Inbound QoS 1 packet ids whose PUBACK did not fit in txBuffer_ yet.
+  uint16_t pendingAcks_[MQTT_RECEIVE_MAXIMUM];
+  size_t pendingAckCount_ = 0;
+
+  uint8_t txBuffer_[MQTT_TX_BUFFER];
+  size_t txLength_ = 0;
+  uint8_t rxBuffer_[MQTT_RX_BUFFER];
+  size_t rxLength_ = 0;
+  size_t rxDiscard_ = 0;
+  // Prefix of rxBuffer_ already checked for priority packets.
+  size_t rxScanned_ = 0;
+};
+}  // namespace net
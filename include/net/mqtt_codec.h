@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MQTT 3.1.1 and 5 packet encoding and decoding over caller-owned buffers.
+// Every encoder returns the number of bytes written, or 0 when the packet
+// does not fit into the supplied capacity.
+namespace net::codec {
+constexpr uint8_t PACKET_CONNECT = 1;
+constexpr uint8_t PACKET_CONNACK = 2;
+constexpr uint8_t PACKET_PUBLISH = 3;
+constexpr uint8_t PACKET_PUBACK = 4;
+constexpr uint8_t PACKET_SUBSCRIBE = 8;
+constexpr uint8_t PACKET_SUBACK = 9;
+constexpr uint8_t PACKET_UNSUBSCRIBE = 10;
+constexpr uint8_t PACKET_UNSUBACK = 11;
+constexpr uint8_t PACKET_PINGREQ = 12;
+constexpr uint8_t PACKET_PINGRESP = 13;
+constexpr uint8_t PACKET_DISCONNECT = 14;
+
+// Values are the CONNECT protocol level.
+enum class Version : uint8_t { V311 = 4, V5 = 5 };
+
+struct ConnectOptions {
+  const char *clientId;
+  const char *username;
+  const char *password;
+  uint16_t keepAliveSeconds;
+  bool cleanSession;
+  Version version;
+  // MQTT 5 only; 0 leaves the property out.
+  uint16_t receiveMaximum;
+  uint16_t topicAliasMaximum;
+  uint32_t maximumPacketSize;
+};
+
+struct Connack {
+  uint8_t reasonCode;
+  bool sessionPresent;
+  // MQTT 5 properties; 0 when the broker sent none.
+  uint16_t topicAliasMaximum;
+  uint16_t serverKeepAliveSeconds;
+};
+
+struct Suback {
+  uint16_t packetId;
+  const uint8_t *reasonCodes;
+  size_t reasonCodeCount;
+};
+
+// MQTT 5 only. A zero topic alias or expiry leaves the property out.
+struct PublishProperties {
+  uint16_t topicAlias;
+  uint32_t messageExpirySeconds;
+};
+
+struct PacketHeader {
+  uint8_t type;
+  uint8_t flags;
+  size_t remainingLength;
+  size_t headerLength;
+};
+
+struct Publish {
+  const char *topic;
+  size_t topicLength;
+  const uint8_t *payload;
+  size_t payloadLength;
+  uint16_t packetId;
+  uint8_t qos;
+  bool retain;
+  // MQTT 5: non-zero when the broker set or used a topic alias. The topic is
+  // empty when only the alias was sent.
+  uint16_t topicAlias;
+};
+
+enum class DecodeResult : uint8_t { Incomplete, Complete, Malformed };
+
+size_t encodeConnect(uint8_t *buffer, size_t capacity, const ConnectOptions &options);
+size_t encodeSubscribe(uint8_t *buffer, size_t capacity, Version version, uint16_t packetId,
+                       const char *const *topics, size_t topicCount, uint8_t qos);
+size_t encodeUnsubscribe(uint8_t *buffer, size_t capacity, Version version, uint16_t packetId,
+                         const char *topic);
+size_t encodePublish(uint8_t *buffer, size_t capacity, const char *topic, const uint8_t *payload,
+                     size_t length, uint8_t qos, uint16_t packetId, bool retain);
+// MQTT 5 PUBLISH; `topic` may be empty when `properties.topicAlias` is already
+// bound on this connection.
+size_t encodePublish5(uint8_t *buffer, size_t capacity, const char *topic,
+                      const PublishProperties &properties, const uint8_t *payload, size_t length,
+                      uint8_t qos, uint16_t packetId, bool retain);
+size_t encodePubAck(uint8_t *buffer, size_t capacity, uint16_t packetId);
+size_t encodePingReq(uint8_t *buffer, size_t capacity);
+size_t encodeDisconnect(uint8_t *buffer, size_t capacity);
+
+DecodeResult decodeHeader(const uint8_t *buffer, size_t length, PacketHeader *out);
+// `body` points just past the fixed header and holds `header.remainingLength` bytes.
+bool decodePublish(const PacketHeader &header, const uint8_t *body, Version version, Publish *out);
+bool decodeConnack(const uint8_t *body, size_t length, Version version, Connack *out);
+bool decodeSuback(const uint8_t *body, size_t length, Version version, Suback *out);
+}  // namespace net::codec
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net {
+// Non-blocking TCP socket on top of lwIP. Resolution and connection are split
+// into begin/poll pairs so the caller can bound every stage with its own
+// timeout and never wait inside the network stack.
+class Socket {
+ public:
+  enum class Progress : uint8_t { Pending, Done, Failed };
+
+  bool beginResolve(const char *host);
+  Progress pollResolve();
+  bool beginConnect(uint16_t port);
+  Progress pollConnect();
+
+  // Returns bytes transferred, 0 when the call would block, -1 on error or EOF.
+  int read(uint8_t *buffer, size_t size);
+  int write(const uint8_t *data, size_t length);
+
+  void close();
+  int fd() const { return fd_; }
+  bool isOpen() const { return fd_ >= 0; }
+
+ private:
+  void releaseDnsSlot();
+
+  int fd_ = -1;
+  int dnsSlot_ = -1;
+  uint32_t address_ = 0;
+};
+}  // namespace net
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net {
+// Packs fixed-rate samples of a small vector of integer channels into one
+// batch. A batch is
+//   u8 version, varint channels, varint periodMs, varint startMs, varint seq,
+//   keyframe: one zigzag varint per channel,
+//   tokens:   varint t; odd t is a run of t >> 1 unchanged samples, even t is
+//             a sample with the channels in bitmask t >> 1 changed, followed
+//             by a zigzag varint delta per changed channel.
+// A steady second of samples thus costs a byte or two. tools/state_dash.py
+// decodes it.
+class StateEncoder {
+ public:
+  static constexpr uint8_t VERSION = 1;
+  static constexpr size_t MAX_CHANNELS = 16;
+
+  void begin(uint8_t *buffer, size_t capacity, size_t channels, uint16_t periodMs,
+             uint32_t startMs, uint32_t sequence);
+  // False when the sample no longer fits; finish the batch and start another.
+  bool add(const int32_t *values);
+  // Closes the batch and returns its length.
+  size_t finish();
+
+  size_t samples() const { return samples_; }
+  size_t length() const { return length_; }
+
+ private:
+  bool putVarint(uint32_t value);
+  bool putSigned(int32_t value) {
+    return putVarint((static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+  }
+  bool flushRun();
+
+  uint8_t *buffer_ = nullptr;
+  size_t capacity_ = 0;
+  size_t length_ = 0;
+  size_t channels_ = 0;
+  size_t samples_ = 0;
+  uint32_t run_ = 0;
+  int32_t last_[MAX_CHANNELS] = {};
+};
+}  // namespace net
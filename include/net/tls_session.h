@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+
+#include "net/socket.h"
+
+namespace net {
+struct TlsOptions {
+  // PEM trust anchor; when set it is the only CA accepted for the broker.
+  const char *caPem;
+  // Hex SHA-256 of a DER certificate: the broker's own certificate, or a CA
+  // in its chain when `caPem` makes the chain verifiable.
+  const char *pinSha256;
+};
+
+// Non-blocking TLS client over a connected `Socket`. The negotiated session
+// is kept across close(), so the next handshake to the same broker offers it
+// (ticket or session ID) and skips the certificate exchange.
+class TlsSession {
+ public:
+  struct Stats {
+    uint32_t fullHandshakes;
+    uint32_t resumedHandshakes;
+    uint32_t lastFullMs;
+    uint32_t lastResumedMs;
+    bool lastResumed;
+  };
+
+  TlsSession();
+  ~TlsSession();
+  TlsSession(const TlsSession &) = delete;
+  TlsSession &operator=(const TlsSession &) = delete;
+
+  bool begin(Socket *socket, const char *host, const TlsOptions &options);
+  Socket::Progress pollHandshake();
+
+  // Same contract as Socket: bytes moved, 0 on would-block, -1 on error.
+  int read(uint8_t *buffer, size_t size);
+  int write(const uint8_t *data, size_t length);
+  // Plaintext mbedTLS already pulled off the socket; select() cannot see it.
+  bool hasBufferedInput();
+  bool wantsWrite() const { return wantWrite_; }
+
+  void close();
+  void forgetSession();
+  const Stats &stats() const { return stats_; }
+
+ private:
+  bool configure(const TlsOptions &options);
+  void releaseConfig();
+  static int sendCallback(void *context, const unsigned char *data, size_t length);
+  static int recvCallback(void *context, unsigned char *buffer, size_t size);
+  static int verifyCallback(void *context, mbedtls_x509_crt *certificate, int depth, uint32_t *flags);
+
+  Socket *socket_ = nullptr;
+  mbedtls_ssl_context ssl_;
+  mbedtls_ssl_config config_;
+  mbedtls_ctr_drbg_context drbg_;
+  mbedtls_entropy_context entropy_;
+  mbedtls_x509_crt ca_;
+  mbedtls_ssl_session cachedSession_;
+  bool configured_ = false;
+  bool active_ = false;
+  bool hasCachedSession_ = false;
+  bool offeredSession_ = false;
+  bool certificateSeen_ = false;
+  bool pinMatched_ = false;
+  bool hasCa_ = false;
+  bool hasPin_ = false;
+  bool wantWrite_ = false;
+  const char *configuredCa_ = nullptr;
+  uint8_t pin_[32];
+  char sessionHost_[65];
+  size_t pendingWrite_ = 0;
+  uint32_t handshakeStartMs_ = 0;
+  Stats stats_{};
+};
+}  // namespace net
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace net {
+// Roaming policy for a station with several provisioned networks. It never
+// touches the radio: the owner feeds it RSSI samples and scan results and
+// carries out the Decision returned by poll(), which keeps the policy
+// drivable from a scripted fake radio.
+class WifiRoamer {
+ public:
+  static constexpr size_t CACHE_SIZE = 8;
+
+  struct Config {
+    // Below this smoothed RSSI the link counts as weak and scanning starts.
+    int8_t weakRssiDbm;
+    // A candidate must beat the current link by this much to be worth a roam.
+    uint8_t hysteresisDb;
+    uint32_t scanIntervalMs;
+    // Every this many scans is a full sweep instead of one cached channel.
+    uint8_t fullScanEvery;
+    uint32_t minRoamIntervalMs;
+    // Cached access points older than this are not roamed to.
+    uint32_t cacheTtlMs;
+  };
+
+  struct AccessPoint {
+    uint8_t bssid[6];
+    int8_t rssi;
+    uint8_t channel;
+    // Index into the provisioned network list.
+    uint8_t slot;
+  };
+
+  enum class Action : uint8_t { None, Scan, Roam };
+
+  struct Decision {
+    Action action;
+    // For Scan: the channel to probe, 0 for every channel.
+    uint8_t channel;
+    // For Roam: where to go.
+    AccessPoint target;
+  };
+
+  struct Stats {
+    uint32_t channelScans;
+    uint32_t fullScans;
+    uint32_t roams;
+  };
+
+  explicit WifiRoamer(const Config &config);
+
+  void reset();
+  void onConnected(const uint8_t bssid[6], uint32_t now);
+  void onDisconnected();
+  void onRssi(int8_t rssi, uint32_t now);
+  void onScanResult(const AccessPoint &ap, uint32_t now);
+  void onScanDone(uint32_t now);
+
+  Decision poll(uint32_t now);
+  // Strongest fresh cached access point other than the current one.
+  bool bestCandidate(uint32_t now, AccessPoint *out) const;
+
+  bool connected() const { return connected_; }
+  int8_t smoothedRssi() const;
+  const Stats &stats() const { return stats_; }
+
+ private:
+  struct Entry {
+    AccessPoint ap;
+    uint32_t seenMs;
+    bool used;
+  };
+
+  Entry *find(const uint8_t bssid[6]);
+  uint8_t nextScanChannel(uint32_t now);
+
+  Config config_;
+  Entry cache_[CACHE_SIZE];
+  uint8_t current_[6];
+  // RSSI in 1/16 dBm, smoothed over roughly four samples.
+  int32_t rssiQ4_ = 0;
+  bool haveRssi_ = false;
+  bool connected_ = false;
+  bool scanInFlight_ = false;
+  uint32_t lastScanMs_ = 0;
+  uint32_t lastRoamMs_ = 0;
+  bool roamed_ = false;
+  uint8_t scanCount_ = 0;
+  size_t scanCursor_ = 0;
+  Stats stats_{};
+};
+}  // namespace net
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tasks::envelope {
+// Optional header carried in front of a plain command, e.g.
+//   @id=42,ts=1700000123,src=7,seq=1031,age=150;forward:200
+// `src`/`seq` identify the controller and its per-source sequence number,
+// `age` is the maximum age in milliseconds the sender will tolerate and `at`
+// asks for execution when the controller's clock reads that many
+// milliseconds (taken modulo 2^32).
+// Payloads that do not start with '@' are passed through untouched.
+struct CommandEnvelope {
+  uint32_t id;
+  uint32_t senderTs;
+  uint32_t sourceId;
+  uint32_t sequence;
+  uint32_t maxAgeMs;
+  uint32_t executeAtMs;
+  bool hasId;
+  bool hasSenderTs;
+  bool hasSequence;
+  bool hasMaxAge;
+  bool hasExecuteAt;
+  const char *body;
+  size_t bodyLength;
+};
+
+bool parse(const char *payload, size_t length, CommandEnvelope *out);
+}  // namespace tasks::envelope
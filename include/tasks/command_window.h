@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "tasks/command_envelope.h"
+
+namespace tasks::command_window {
+enum class Verdict : uint8_t { Accept, Duplicate, Stale, Expired };
+
+struct Counters {
+  uint32_t accepted;
+  uint32_t duplicate;
+  uint32_t stale;
+  uint32_t expired;
+};
+
+// Screens a command before it reaches the robot. Per source, only sequence
+// numbers above the highest one seen are accepted: motion commands are only
+// meaningful in order, so a late packet is dropped even if it was never
+// executed. Commands without `seq` bypass the window. `age` is judged
+// against the smallest clock offset seen from the source, which outlives the
+// window, so the replay burst after an outage still reads as old.
+Verdict check(const envelope::CommandEnvelope &envelope, uint32_t nowMs);
+Counters counters();
+}  // namespace tasks::command_window
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config/actuator_topology.h"
+#include "diag/event_log.h"
+
+// Differential-drive kinematics in integer math. A twist (linear mm/s,
+// angular mrad/s) becomes a signed speed per side, and each speed is turned
+// into PWM duty through a table built at compile time from the topology's
+// wheel calibration curve, so the deadband and the motor's non-linear
+// response are folded into one lookup.
+namespace tasks::drive {
+// Duty on the 0..255 scale for wheel speeds 0..top speed in even steps.
+constexpr size_t DUTY_TABLE_SIZE = 256;
+static_assert(topology::PWM_RES == 8, "the duty table is on the 8-bit PWM scale");
+
+struct DutyTable {
+  uint8_t duty[DUTY_TABLE_SIZE];
+};
+
+struct WheelCommand {
+  // diag::log direction: -1, 0 or 1.
+  int8_t direction;
+  uint8_t duty;
+  // Signed speed after saturation, kept for logging.
+  int16_t speedMmS;
+};
+
+struct WheelPair {
+  WheelCommand left;
+  WheelCommand right;
+};
+
+template <typename Topology>
+constexpr uint16_t topSpeedMmS() {
+  return Topology::wheelCurve[topology::wheelCurveCount<Topology>() - 1].speedMmS;
+}
+
+// Inverts the calibration curve by linear interpolation between its points.
+// Entry 0 is a stopped wheel; every other entry starts at or above the
+// deadband duty so slow requests still turn the wheel.
+template <typename Topology>
+constexpr DutyTable buildDutyTable() {
+  constexpr size_t points = topology::wheelCurveCount<Topology>();
+  constexpr uint32_t top = topSpeedMmS<Topology>();
+  DutyTable table{};
+  size_t segment = 0;
+  for (size_t i = 1; i < DUTY_TABLE_SIZE; ++i) {
+    // Speeds are compared scaled by (DUTY_TABLE_SIZE - 1) to stay integral.
+    const uint32_t target = static_cast<uint32_t>(i) * top;
+    while (segment + 2 < points &&
+           Topology::wheelCurve[segment + 1].speedMmS * (DUTY_TABLE_SIZE - 1) < target) {
+      ++segment;
+    }
+    const topology::WheelCurvePoint &lo = Topology::wheelCurve[segment];
+    const topology::WheelCurvePoint &hi = Topology::wheelCurve[segment + 1];
+    const uint32_t from = lo.speedMmS * (DUTY_TABLE_SIZE - 1);
+    const uint32_t span = (hi.speedMmS - lo.speedMmS) * (DUTY_TABLE_SIZE - 1);
+    const uint32_t rise = hi.duty - lo.duty;
+    table.duty[i] = static_cast<uint8_t>(lo.duty + (rise * (target - from) + span / 2) / span);
+  }
+  return table;
+}
+
+template <typename Topology>
+inline constexpr DutyTable DUTY_TABLE = buildDutyTable<Topology>();
+
+// Every calibration point must come back out of the table within one duty
+// step, and duty must never fall as speed rises.
+template <typename Topology>
+constexpr bool dutyTableMatchesCurve() {
+  constexpr uint32_t top = topSpeedMmS<Topology>();
+  for (size_t i = 2; i < DUTY_TABLE_SIZE; ++i) {
+    if (DUTY_TABLE<Topology>.duty[i] < DUTY_TABLE<Topology>.duty[i - 1]) return false;
+  }
+  for (size_t k = 0; k < topology::wheelCurveCount<Topology>(); ++k) {
+    const topology::WheelCurvePoint &point = Topology::wheelCurve[k];
+    size_t index = (point.speedMmS * (DUTY_TABLE_SIZE - 1) + top / 2) / top;
+    if (index == 0) index = 1;
+    const int error = static_cast<int>(DUTY_TABLE<Topology>.duty[index]) - point.duty;
+    if (error > 1 || error < -1) return false;
+  }
+  return true;
+}
+
+template <typename Topology>
+WheelCommand wheelCommand(int32_t speedMmS) {
+  // Q16 reciprocal of the top speed: the index needs no division.
+  constexpr uint32_t SPEED_TO_INDEX = ((DUTY_TABLE_SIZE - 1) << 16) / topSpeedMmS<Topology>();
+  WheelCommand command{};
+  command.speedMmS = static_cast<int16_t>(speedMmS);
+  const uint32_t magnitude = static_cast<uint32_t>(speedMmS < 0 ? -speedMmS : speedMmS);
+  uint32_t index = (magnitude * SPEED_TO_INDEX + (1u << 15)) >> 16;
+  if (index == 0) {
+    command.direction = diag::log::DIR_STOP;
+    return command;
+  }
+  if (index >= DUTY_TABLE_SIZE) index = DUTY_TABLE_SIZE - 1;
+  command.direction = speedMmS < 0 ? diag::log::DIR_BACKWARD : diag::log::DIR_FORWARD;
+  command.duty = DUTY_TABLE<Topology>.duty[index];
+  return command;
+}
+
+// Wheel speeds for a twist. When either side would exceed the top speed both
+// are scaled down together, which keeps the turning radius.
+template <typename Topology>
+WheelPair fromTwist(int32_t linearMmS, int32_t angularMradS) {
+  static_assert(topology::wheelCurveIsMonotonic<Topology>(),
+                "wheelCurve must start at speed 0 and rise in duty and speed");
+  static_assert(dutyTableMatchesCurve<Topology>(), "duty table does not reproduce wheelCurve");
+  constexpr int32_t LIMIT = 32767;
+  constexpr int32_t top = topSpeedMmS<Topology>();
+
+  linearMmS = linearMmS > LIMIT ? LIMIT : (linearMmS < -LIMIT ? -LIMIT : linearMmS);
+  angularMradS = angularMradS > LIMIT ? LIMIT : (angularMradS < -LIMIT ? -LIMIT : angularMradS);
+  const int32_t turn = angularMradS * Topology::drive.trackWidthMm / 2000;
+  int32_t left = linearMmS - turn;
+  int32_t right = linearMmS + turn;
+
+  const int32_t leftMagnitude = left < 0 ? -left : left;
+  const int32_t rightMagnitude = right < 0 ? -right : right;
+  const int32_t peak = leftMagnitude > rightMagnitude ? leftMagnitude : rightMagnitude;
+  if (peak > top) {
+    left = left * top / peak;
+    right = right * top / peak;
+  }
+  return {wheelCommand<Topology>(left), wheelCommand<Topology>(right)};
+}
+}  // namespace tasks::drive
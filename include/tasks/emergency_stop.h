@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config/defaults.h"
+
+// Emergency stop lane. trigger() cuts the motors on the spot, from whatever
+// task saw the stop; loop() then finishes the job on the main loop by
+// dropping timed actuator work and resetting the robot state.
+namespace tasks::estop {
+enum class Origin : uint8_t { Mqtt, EspNow };
+
+struct Stats {
+  uint32_t stops;
+  // Arrival of the stop bytes to motors cut, in microseconds.
+  uint32_t lastLatencyUs;
+  uint32_t maxLatencyUs;
+  // Commands received ahead of a stop and discarded because of it.
+  uint32_t flushedCommands;
+};
+
+inline bool isStopFrame(const uint8_t *data, size_t length) {
+  return length > 0 && data[0] == ESPNOW_STOP_OPCODE;
+}
+
+// `arrivedUs` is the micros() at which the bytes were first seen. Also cancels
+// every scheduled command and starts flushing the motion commands received
+// ahead of the stop, until endFlush() for the same origin.
+void trigger(Origin origin, uint32_t arrivedUs);
+// True while a stop from any origin is still flushing.
+bool flushing();
+bool flushing(Origin origin);
+void endFlush(Origin origin);
+void noteFlushedCommand();
+void loop();
+Stats stats();
+}  // namespace tasks::estop
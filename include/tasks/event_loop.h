@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace tasks::event_loop {
+// Timers a subsystem can arm for the next wait. Deadlines and watched
+// sockets are one-shot: every subsystem re-arms what it needs on each pass
+// through loop(), and waitForWork() clears them once it has slept.
+enum class Source : uint8_t {
+  MqttClient,
+  MqttRetry,
+  MqttHeartbeat,
+  WifiRetry,
+  WifiRoam,
+  SerialOutput,
+  SerialTunnel,
+  Actuators,
+  Schedule,
+  Telemetry,
+  COUNT
+};
+
+void init();
+void setDeadline(Source source, uint32_t atMs);
+// Up to four sockets per wait; more are ignored.
+void watchSocket(int fd, bool wantWrite);
+
+// Wakes a pending or upcoming waitForWork(). Safe to call from the WiFi and
+// UART event tasks.
+void wake();
+
+// Blocks until the earliest deadline, socket readiness or wake().
+void waitForWork();
+
+uint32_t wakeupsPerSecond();
+}  // namespace tasks::event_loop
@@ -1,2 +1,14 @@
 #include <Arduino.h>
-void onMessage(String);
\ No newline at end of file
+// `text` need not be NUL terminated; it is parsed in place and not kept.
+void onMessage(const char* text, size_t length);
+// Called once from setup(): pins, PWM channels and servos, homed.
+void initActuators();
+// Drives every motor to zero without touching robot state; safe from any task.
+void cutMotors();
+// Main loop only: drops timed actuator work and records the robot as stopped.
+void haltActuators();
+// Main loop only: completes timed actuator work that is due.
+void serviceActuators(uint32_t nowMs);
+// Main loop only: signed duty per motor (negative is backward), then servo
+// angles. Returns how many values were written.
+size_t sampleActuators(int32_t* out, size_t capacity);
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 namespace tasks::mqtt {
 void init();
 void loop();
 bool isConnected();
+// Queues a QoS 0 publish and pushes it to the socket without waiting; false
+// when disconnected or the transmit buffer is full, so the caller can retry.
+bool publish(const char *topic, const uint8_t *payload, size_t length);
 }
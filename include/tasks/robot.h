@@ -0,0 +1,225 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESP32Servo.h>
+
+#include <utility>
+
+#include "config/actuator_topology.h"
+#include "diag/event_log.h"
+#include "diag/latency_trace.h"
+#include "tasks/diff_drive.h"
+
+namespace tasks {
+enum class Direction : int8_t {
+  Backward = diag::log::DIR_BACKWARD,
+  Stop = diag::log::DIR_STOP,
+  Forward = diag::log::DIR_FORWARD,
+};
+
+// One H-bridge channel whose pins come from the topology table at compile
+// time.
+template <typename Topology, size_t Index>
+struct Motor {
+  static constexpr const topology::MotorSpec &spec = Topology::motors[Index];
+
+  static void begin(uint32_t pwmFrequency) {
+    pinMode(spec.pinIn1, OUTPUT);
+    pinMode(spec.pinIn2, OUTPUT);
+    ledcSetup(spec.pwmChannel, pwmFrequency, topology::PWM_RES);
+    ledcAttachPin(spec.pinPwm, spec.pwmChannel);
+  }
+
+  static void changeFrequency(uint32_t pwmFrequency) {
+    ledcChangeFrequency(spec.pwmChannel, pwmFrequency, topology::PWM_RES);
+  }
+
+  static void drive(Direction dir, int speed) {
+    if (dir == Direction::Forward) {
+      digitalWrite(spec.pinIn1, HIGH);
+      digitalWrite(spec.pinIn2, LOW);
+    } else if (dir == Direction::Backward) {
+      digitalWrite(spec.pinIn1, LOW);
+      digitalWrite(spec.pinIn2, HIGH);
+    } else {
+      digitalWrite(spec.pinIn1, LOW);
+      digitalWrite(spec.pinIn2, LOW);
+      speed = 0;
+    }
+    ledcWrite(spec.pwmChannel, constrain(speed, 0, static_cast<int>(spec.maxDuty)));
+    diag::trace::markActuate();
+  }
+
+  // Emergency path: PWM first, then the bridge inputs. Touches registers
+  // only, so it is safe from any task.
+  static void cut() {
+    ledcWrite(spec.pwmChannel, 0);
+    digitalWrite(spec.pinIn1, LOW);
+    digitalWrite(spec.pinIn2, LOW);
+  }
+};
+
+template <typename Topology>
+class Robot {
+ public:
+  static constexpr size_t MOTOR_COUNT = topology::motorCount<Topology>();
+  static constexpr size_t SERVO_COUNT = topology::servoCount<Topology>();
+  // How long a spin servo holds its end angle before returning home.
+  static constexpr uint32_t SPIN_HOLD_MS = 800;
+  static_assert(topology::channelsAreUnique<Topology>(), "motor PWM channels must be unique");
+
+  void begin() {
+    if (initialized_) return;
+
+    forEachMotor([this](auto motor) { decltype(motor)::type::begin(pwmFrequency_); });
+    for (size_t i = 0; i < SERVO_COUNT; ++i) {
+      servoAngles_[i] = Topology::servos[i].homeAngle;
+      servos_[i].attach(Topology::servos[i].pin);
+      servos_[i].write(servoAngles_[i]);
+    }
+
+    initialized_ = true;
+  }
+
+  // Takes effect immediately on running channels; duty is kept as is.
+  void setPwmFrequency(uint32_t hz) {
+    if (hz == pwmFrequency_) return;
+
+    pwmFrequency_ = hz;
+    if (!initialized_) return;
+    forEachMotor([hz](auto motor) { decltype(motor)::type::changeFrequency(hz); });
+  }
+
+  void move(Direction left, Direction right, int leftSpeed, int rightSpeed) {
+    DIAG_LOG(ROBOT_MOVE, static_cast<int32_t>(left), leftSpeed, static_cast<int32_t>(right),
+             rightSpeed);
+    forEachMotor([&](auto motor) {
+      using M = typename decltype(motor)::type;
+      const bool isLeft = M::spec.side == topology::Side::Left;
+      directions_[M::INDEX] = isLeft ? left : right;
+      speeds_[M::INDEX] = isLeft ? leftSpeed : rightSpeed;
+      M::drive(directions_[M::INDEX], speeds_[M::INDEX]);
+    });
+  }
+
+  // Linear velocity in mm/s, angular in mrad/s (positive turns left).
+  void twist(int32_t linearMmS, int32_t angularMradS) {
+    const drive::WheelPair wheels = drive::fromTwist<Topology>(linearMmS, angularMradS);
+    DIAG_LOG(ROBOT_TWIST, linearMmS, angularMradS, wheels.left.speedMmS, wheels.right.speedMmS);
+    forEachMotor([&](auto motor) {
+      using M = typename decltype(motor)::type;
+      const drive::WheelCommand &wheel =
+          M::spec.side == topology::Side::Left ? wheels.left : wheels.right;
+      directions_[M::INDEX] = static_cast<Direction>(wheel.direction);
+      // The table is on the full 8-bit scale; rescale to this motor's cap.
+      speeds_[M::INDEX] = (wheel.duty * M::spec.maxDuty + 127) / 255;
+      M::drive(directions_[M::INDEX], speeds_[M::INDEX]);
+    });
+  }
+
+  void adjustSpeed(int delta) {
+    forEachMotor([&](auto motor) {
+      using M = typename decltype(motor)::type;
+      speeds_[M::INDEX] = constrain(speeds_[M::INDEX] + delta, 0, static_cast<int>(M::spec.maxDuty));
+      M::drive(directions_[M::INDEX], speeds_[M::INDEX]);
+    });
+    DIAG_LOG(ROBOT_SPEED_ADJUST, delta, speeds_[0], speeds_[MOTOR_COUNT - 1]);
+  }
+
+  // `index` is zero based; "servo1" on the wire is index 0.
+  void commandServo(size_t index, int param) {
+    if (index >= SERVO_COUNT) return;
+
+    if (Topology::servos[index].mode == topology::ServoMode::Spin) {
+      spinServo(index);
+    } else {
+      setServo(index, param);
+    }
+  }
+
+  void setServo(size_t index, int angle) {
+    const topology::ServoSpec &spec = Topology::servos[index];
+    DIAG_LOG(ROBOT_SERVO, index + 1, angle);
+    angle = constrain(angle, static_cast<int>(spec.minAngle), static_cast<int>(spec.maxAngle));
+    servoAngles_[index] = angle;
+    servos_[index].write(angle);
+    diag::trace::markActuate();
+  }
+
+  // The return home is timed by service(); a new spin restarts the hold.
+  void spinServo(size_t index) {
+    const topology::ServoSpec &spec = Topology::servos[index];
+    DIAG_LOG(ROBOT_SERVO_SPIN, index + 1);
+    servoAngles_[index] = spec.maxAngle;
+    servos_[index].write(spec.maxAngle);
+    diag::trace::markActuate();
+    spinReturnMs_[index] = millis() + SPIN_HOLD_MS;
+    spinning_[index] = true;
+  }
+
+  // Finishes timed servo moves that are due. Returns true with the next due
+  // time in `nextMs` while any are still pending.
+  bool service(uint32_t nowMs, uint32_t *nextMs) {
+    bool pending = false;
+    for (size_t i = 0; i < SERVO_COUNT; ++i) {
+      if (!spinning_[i]) continue;
+      if (static_cast<int32_t>(nowMs - spinReturnMs_[i]) >= 0) {
+        servoAngles_[i] = Topology::servos[i].homeAngle;
+        servos_[i].write(servoAngles_[i]);
+        spinning_[i] = false;
+      } else if (!pending || static_cast<int32_t>(spinReturnMs_[i] - *nextMs) < 0) {
+        *nextMs = spinReturnMs_[i];
+        pending = true;
+      }
+    }
+    return pending;
+  }
+
+  // Drops timed servo moves, sends spinning servos home and records every
+  // motor as stopped. The motors themselves are expected to be cut already.
+  void halt() {
+    for (size_t i = 0; i < SERVO_COUNT; ++i) {
+      if (!spinning_[i]) continue;
+      spinning_[i] = false;
+      servoAngles_[i] = Topology::servos[i].homeAngle;
+      servos_[i].write(servoAngles_[i]);
+    }
+    move(Direction::Stop, Direction::Stop, 0, 0);
+  }
+
+  static void cutMotors() {
+    forEachMotor([](auto motor) { decltype(motor)::type::cut(); });
+  }
+
+  Direction direction(size_t motor) const { return directions_[motor]; }
+  int speed(size_t motor) const { return speeds_[motor]; }
+  int servoAngle(size_t servo) const { return servoAngles_[servo]; }
+
+ private:
+  template <size_t I>
+  struct MotorTag {
+    struct type : Motor<Topology, I> {
+      static constexpr size_t INDEX = I;
+    };
+  };
+
+  template <typename Fn, size_t... I>
+  static void forEachMotorImpl(Fn &&fn, std::index_sequence<I...>) {
+    (fn(MotorTag<I>{}), ...);
+  }
+
+  template <typename Fn>
+  static void forEachMotor(Fn &&fn) {
+    forEachMotorImpl(fn, std::make_index_sequence<MOTOR_COUNT>{});
+  }
+
+  Servo servos_[SERVO_COUNT];
+  Direction directions_[MOTOR_COUNT] = {};
+  int speeds_[MOTOR_COUNT] = {};
+  int servoAngles_[SERVO_COUNT] = {};
+  uint32_t spinReturnMs_[SERVO_COUNT] = {};
+  bool spinning_[SERVO_COUNT] = {};
+  uint32_t pwmFrequency_ = topology::PWM_FREQ;
+  bool initialized_ = false;
+};
+}  // namespace tasks
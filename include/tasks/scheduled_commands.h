@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tasks/command_envelope.h"
+
+// Commands that run at an agreed time on the controller's clock, so a fleet
+// listening on one group topic moves together instead of whenever each
+// packet happens to land. The controller's clock is tracked with NTP-style
+// exchanges over MQTT:
+//   request  MQTT_SYNC_TOPIC          "<reply topic>,<seq>,<t1>"
+//   reply    MQTT_SYNC_TOPIC/<client> "<seq>,<t1>,<t2>,<t3>"
+// with t1 the device's send time and t2/t3 the controller's receive and
+// send times, all in microseconds.
+namespace tasks::schedule {
+struct Stats {
+  // Worst case offset error of the clock estimate, in microseconds; 0 until
+  // the first exchange.
+  uint32_t syncErrorUs;
+  int32_t driftPpb;
+  uint32_t syncExchanges;
+  uint32_t fired;
+  // Arrived too late, beyond SCHEDULE_HORIZON_MS, before the clock was
+  // synced, or with the queue full.
+  uint32_t rejected;
+  // Found past SCHEDULE_LATE_LIMIT_MS when their turn came.
+  uint32_t missed;
+  // Dropped from the queue by an emergency stop.
+  uint32_t cancelled;
+  // How far past its due time on our own clock a command actually ran.
+  uint32_t lastLateUs;
+  uint32_t maxLateUs;
+};
+
+void loop();
+
+// Consumes sync replies; false for any other topic.
+bool handleMessage(const char *topic, const uint8_t *payload, size_t length);
+// Topics the MQTT session must subscribe to; the sync reply topic is derived
+// from `clientId`.
+size_t subscriptions(const char *clientId, const char **out, size_t capacity);
+
+// Copies the command and queues it for envelope.executeAtMs. Returns false,
+// and counts the rejection, when it cannot be run on time.
+bool enqueue(const envelope::CommandEnvelope &envelope);
+// Drops every queued command. Safe from any task: the queue is emptied on the
+// main loop before anything in it runs or anything new is queued.
+void cancelAll();
+Stats stats();
+}  // namespace tasks::schedule
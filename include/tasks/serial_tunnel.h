@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Transparent byte pipe between MQTT and UART2 with credit based flow control
+// in both directions. Counters are cumulative byte offsets, so a lost credit
+// message is repaired by the next one; every new MQTT session starts a new
+// epoch with all counters back at zero.
+namespace tasks::tunnel {
+struct Stats {
+  uint32_t epoch;
+  uint32_t downAccepted;
+  uint32_t downWritten;
+  uint32_t downOverruns;
+  uint32_t upSent;
+  uint32_t upAcked;
+};
+
+void init();
+void loop();
+
+// Consumes messages on the tunnel topics; false for any other topic.
+bool handleMessage(const char *topic, const uint8_t *payload, size_t length);
+// Topics the MQTT session must subscribe to; none when the tunnel is off.
+size_t subscriptions(const char **out, size_t capacity);
+Stats stats();
+}  // namespace tasks::tunnel
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// Live actuator state for dashboards. Each sample is the signed duty of every
+// motor, every servo angle and the id of the last enveloped command; samples
+// are taken at STATE_STREAM_HZ and published on MQTT_STATE_TOPIC as
+// net::StateEncoder batches, one every STATE_BATCH_MS.
+namespace tasks::telemetry {
+struct Stats {
+  uint32_t samples;
+  uint32_t batches;
+  // Payload bytes published; divide by uptime for the stream's bandwidth.
+  uint32_t bytes;
+};
+
+void loop();
+Stats stats();
+}  // namespace tasks::telemetry
@@ -1,8 +1,21 @@
 #pragma once
 
+#include <stdint.h>
+
 namespace tasks::wifi {
+struct Stats {
+  // Last RSSI sample of the serving access point.
+  int8_t rssi;
+  uint32_t roams;
+  // Time without a link across the last roam or reconnect.
+  uint32_t lastGapMs;
+  uint32_t channelScans;
+  uint32_t fullScans;
+};
+
 void init();
 void loop();
 bool isConnected();
 void requestReconnect();
+Stats stats();
 }
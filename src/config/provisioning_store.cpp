@@ -1,65 +1,289 @@
 #include "config/provisioning_store.h"
 
+#include <cctype>
 #include <cstdlib>
 #include <cstring>
 #include <strings.h>
 
+#include "config/actuator_topology.h"
 #include "config/defaults.h"
 
 namespace {
 using provisioning::MqttInitParams;
+using provisioning::Owner;
+using provisioning::Tuning;
 using provisioning::WifiCredentials;
 
+constexpr size_t OWNER_COUNT = static_cast<size_t>(Owner::COUNT);
+
 WifiCredentials g_wifi{};
 MqttInitParams g_mqtt{};
-uint32_t g_wifiVersion = 0;
-uint32_t g_mqttVersion = 0;
+Tuning g_tuning{};
+uint32_t g_versions[OWNER_COUNT];
 
-template <size_t N>
-void copyBounded(char (&dest)[N], const char *src) {
+void copyBounded(char *dest, size_t size, const char *src) {
   if (src == nullptr) {
     dest[0] = '\0';
     return;
   }
 
-  strncpy(dest, src, N - 1);
-  dest[N - 1] = '\0';
+  strncpy(dest, src, size - 1);
+  dest[size - 1] = '\0';
+}
+
+template <size_t N>
+void copyBounded(char (&dest)[N], const char *src) {
+  copyBounded(dest, N, src);
+}
+
+void markUpdated(Owner owner) {
+  ++g_versions[static_cast<size_t>(owner)];
+  g_wifi.valid = false;
+  for (const provisioning::WifiNetwork &network : g_wifi.networks) {
+    g_wifi.valid |= network.ssid[0] != '\0';
+  }
+  g_mqtt.valid = false;
+  for (const provisioning::MqttBroker &broker : g_mqtt.brokers) {
+    g_mqtt.valid |= broker.host[0] != '\0';
+  }
+}
+
+// ----------------- Key registry -----------------
+
+enum class FieldType : uint8_t { Text, Flag, U16, U32 };
+
+struct Field {
+  const char *name;
+  Owner owner;
+  FieldType type;
+  void *storage;
+  size_t capacity;
+  uint32_t minValue;
+  uint32_t maxValue;
+};
+
+#define TEXT_FIELD(name, owner, member) \
+  { name, owner, FieldType::Text, member, sizeof(member), 0, 0 }
+
+constexpr Field FIELDS[] = {
+    TEXT_FIELD("WIFI_SSID", Owner::WifiLink, g_wifi.networks[0].ssid),
+    TEXT_FIELD("WIFI_PASSWORD", Owner::WifiLink, g_wifi.networks[0].password),
+    TEXT_FIELD("WIFI_SSID_2", Owner::WifiLink, g_wifi.networks[1].ssid),
+    TEXT_FIELD("WIFI_PASSWORD_2", Owner::WifiLink, g_wifi.networks[1].password),
+    TEXT_FIELD("WIFI_SSID_3", Owner::WifiLink, g_wifi.networks[2].ssid),
+    TEXT_FIELD("WIFI_PASSWORD_3", Owner::WifiLink, g_wifi.networks[2].password),
+    TEXT_FIELD("MQTT_HOST", Owner::MqttLink, g_mqtt.brokers[0].host),
+    {"MQTT_PORT", Owner::MqttLink, FieldType::U16, &g_mqtt.brokers[0].port, 0, 1, 65535},
+    TEXT_FIELD("MQTT_HOST_2", Owner::MqttLink, g_mqtt.brokers[1].host),
+    {"MQTT_PORT_2", Owner::MqttLink, FieldType::U16, &g_mqtt.brokers[1].port, 0, 1, 65535},
+    TEXT_FIELD("MQTT_HOST_3", Owner::MqttLink, g_mqtt.brokers[2].host),
+    {"MQTT_PORT_3", Owner::MqttLink, FieldType::U16, &g_mqtt.brokers[2].port, 0, 1, 65535},
+    TEXT_FIELD("MQTT_CLIENT_ID", Owner::MqttLink, g_mqtt.clientId),
+    TEXT_FIELD("MQTT_USERNAME", Owner::MqttLink, g_mqtt.username),
+    TEXT_FIELD("MQTT_PASSWORD", Owner::MqttLink, g_mqtt.password),
+    TEXT_FIELD("MQTT_PUB_TOPIC", Owner::MqttLink, g_mqtt.publishTopic),
+    TEXT_FIELD("MQTT_CMD_TOPIC", Owner::MqttLink, g_mqtt.commandTopic),
+    TEXT_FIELD("MQTT_HEARTBEAT_TOPIC", Owner::MqttLink, g_mqtt.heartbeatTopic),
+    TEXT_FIELD("MQTT_ACK_TOPIC", Owner::MqttLink, g_mqtt.ackTopic),
+    TEXT_FIELD("MQTT_CONFIG_TOPIC", Owner::MqttLink, g_mqtt.configTopic),
+    {"MQTT_TLS", Owner::MqttLink, FieldType::Flag, &g_mqtt.tls, 0, 0, 1},
+    TEXT_FIELD("MQTT_TLS_PIN", Owner::MqttLink, g_mqtt.tlsPin),
+    {"MQTT_V5", Owner::MqttLink, FieldType::Flag, &g_mqtt.v5, 0, 0, 1},
+    {"MQTT_HEARTBEAT_INTERVAL_MS", Owner::MqttTiming, FieldType::U32, &g_tuning.heartbeatIntervalMs,
+     0, 500, 600000},
+    {"MQTT_RETRY_DELAY_MS", Owner::MqttTiming, FieldType::U32, &g_tuning.mqttRetryDelayMs, 0, 100,
+     600000},
+    {"MQTT_SERIAL_BUFFER", Owner::MqttTiming, FieldType::U32, &g_tuning.serialBufferBytes, 0, 16,
+     MQTT_SERIAL_BUFFER},
+    {"WIFI_RETRY_DELAY_MS", Owner::WifiTiming, FieldType::U32, &g_tuning.wifiRetryDelayMs, 0, 500,
+     600000},
+    {"LOOP_MAX_SLEEP_MS", Owner::EventLoop, FieldType::U32, &g_tuning.loopMaxSleepMs, 0, 1, 10000},
+    {"LOOP_STALL_BUDGET_MS", Owner::EventLoop, FieldType::U32, &g_tuning.loopStallBudgetMs, 0, 5,
+     60000},
+    {"PWM_FREQ", Owner::Actuators, FieldType::U32, &g_tuning.pwmFrequency, 0, 100, 40000},
+    {"STATE_STREAM_HZ", Owner::Telemetry, FieldType::U32, &g_tuning.stateStreamHz, 0, 0, 100},
+    {"STATE_BATCH_MS", Owner::Telemetry, FieldType::U32, &g_tuning.stateBatchMs, 0, 50, 10000},
+};
+
+#undef TEXT_FIELD
+
+constexpr size_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+constexpr uint32_t HASH_BITS = 7;
+constexpr size_t HASH_TABLE_SIZE = size_t{1} << HASH_BITS;
+constexpr uint8_t EMPTY_SLOT = 0xFF;
+static_assert(FIELD_COUNT < HASH_TABLE_SIZE, "grow HASH_TABLE_SIZE");
+
+constexpr uint32_t keyHash(const char *key, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (; *key != '\0'; ++key) {
+    const char c = (*key >= 'a' && *key <= 'z') ? static_cast<char>(*key - 'a' + 'A') : *key;
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash;
 }
 
-bool strEqualsIgnoreCase(const char *lhs, const char *rhs) {
-  if (lhs == nullptr || rhs == nullptr) {
+// FNV's low bits only depend on the low bits of its inputs, so the slot is
+// taken from the top of the hash where the seed has been mixed in.
+constexpr size_t slotFor(const char *key, uint32_t seed) {
+  return keyHash(key, seed) >> (32 - HASH_BITS);
+}
+
+constexpr bool seedIsPerfect(uint32_t seed) {
+  bool used[HASH_TABLE_SIZE] = {};
+  for (size_t i = 0; i < FIELD_COUNT; ++i) {
+    const size_t slot = slotFor(FIELDS[i].name, seed);
+    if (used[slot]) {
+      return false;
+    }
+    used[slot] = true;
+  }
+  return true;
+}
+
+constexpr uint32_t findPerfectSeed() {
+  for (uint32_t seed = 0; seed < 4096; ++seed) {
+    if (seedIsPerfect(seed)) {
+      return seed;
+    }
+  }
+  return UINT32_MAX;
+}
+
+constexpr uint32_t HASH_SEED = findPerfectSeed();
+static_assert(HASH_SEED != UINT32_MAX, "no collision-free seed for the key registry");
+
+struct SlotTable {
+  uint8_t fieldIndex[HASH_TABLE_SIZE];
+};
+
+constexpr SlotTable buildSlotTable() {
+  SlotTable table{};
+  for (size_t i = 0; i < HASH_TABLE_SIZE; ++i) {
+    table.fieldIndex[i] = EMPTY_SLOT;
+  }
+  for (size_t i = 0; i < FIELD_COUNT; ++i) {
+    table.fieldIndex[slotFor(FIELDS[i].name, HASH_SEED)] = static_cast<uint8_t>(i);
+  }
+  return table;
+}
+
+constexpr SlotTable SLOTS = buildSlotTable();
+
+const Field *findField(const char *key) {
+  const uint8_t index = SLOTS.fieldIndex[slotFor(key, HASH_SEED)];
+  if (index == EMPTY_SLOT || strcasecmp(FIELDS[index].name, key) != 0) {
+    return nullptr;
+  }
+  return &FIELDS[index];
+}
+
+bool parseUnsigned(const char *text, uint32_t *out) {
+  if (text == nullptr || *text == '\0') {
+    return false;
+  }
+  char *end = nullptr;
+  const unsigned long value = strtoul(text, &end, 10);
+  if (*end != '\0' || value > UINT32_MAX || text[0] == '-') {
     return false;
   }
-  return strcasecmp(lhs, rhs) == 0;
+  *out = static_cast<uint32_t>(value);
+  return true;
 }
 
-void markWifiUpdated() {
-  ++g_wifiVersion;
-  g_wifi.valid = g_wifi.ssid[0] != '\0';
+bool applyField(const Field &field, const char *value) {
+  if (field.type == FieldType::Text) {
+    copyBounded(static_cast<char *>(field.storage), field.capacity, value);
+    return true;
+  }
+
+  uint32_t number = 0;
+  if (!parseUnsigned(value, &number) || number < field.minValue || number > field.maxValue) {
+    return false;
+  }
+  if (field.type == FieldType::Flag) {
+    *static_cast<bool *>(field.storage) = number != 0;
+  } else if (field.type == FieldType::U16) {
+    *static_cast<uint16_t *>(field.storage) = static_cast<uint16_t>(number);
+  } else {
+    *static_cast<uint32_t *>(field.storage) = number;
+  }
+  return true;
 }
 
-void markMqttUpdated() {
-  ++g_mqttVersion;
-  g_mqtt.valid = g_mqtt.host[0] != '\0';
+void trimWhitespace(char **start, char **end) {
+  while (*start <= *end && isspace(static_cast<unsigned char>(**start))) {
+    ++(*start);
+  }
+  while (*end >= *start && isspace(static_cast<unsigned char>(**end))) {
+    **end = '\0';
+    --(*end);
+  }
+}
+
+bool processLine(char *line, provisioning::KeyScope scope) {
+  char *eq = strchr(line, '=');
+  if (eq == nullptr) {
+    return false;
+  }
+
+  char *value = eq + 1;
+  char *keyEnd = eq - 1;
+  *eq = '\0';
+
+  char *keyStart = line;
+  char *valueEnd = value + strlen(value);
+  if (valueEnd != value) {
+    --valueEnd;
+  }
+
+  trimWhitespace(&keyStart, &keyEnd);
+  trimWhitespace(&value, &valueEnd);
+
+  if (*keyStart == '\0') {
+    return false;
+  }
+
+  return provisioning::applyKeyValue(keyStart, value, scope);
 }
 
 }  // namespace
 
 namespace provisioning {
 void initDefaults() {
-  copyBounded(g_wifi.ssid, WIFI_DEFAULT_SSID);
-  copyBounded(g_wifi.password, WIFI_DEFAULT_PASSWORD);
-  markWifiUpdated();
+  copyBounded(g_wifi.networks[0].ssid, WIFI_DEFAULT_SSID);
+  copyBounded(g_wifi.networks[0].password, WIFI_DEFAULT_PASSWORD);
 
-  copyBounded(g_mqtt.host, MQTT_HOST);
-  g_mqtt.port = MQTT_PORT;
+  copyBounded(g_mqtt.brokers[0].host, MQTT_HOST);
+  copyBounded(g_mqtt.brokers[1].host, MQTT_HOST_2);
+  copyBounded(g_mqtt.brokers[2].host, MQTT_HOST_3);
+  for (provisioning::MqttBroker &broker : g_mqtt.brokers) {
+    broker.port = MQTT_PORT;
+  }
   copyBounded(g_mqtt.clientId, MQTT_CLIENT_ID);
   copyBounded(g_mqtt.username, MQTT_USERNAME);
   copyBounded(g_mqtt.password, MQTT_PASSWORD);
   copyBounded(g_mqtt.publishTopic, MQTT_PUB_TOPIC);
   copyBounded(g_mqtt.commandTopic, MQTT_CMD_TOPIC);
   copyBounded(g_mqtt.heartbeatTopic, MQTT_HEARTBEAT_TOPIC);
-  markMqttUpdated();
+  copyBounded(g_mqtt.ackTopic, MQTT_ACK_TOPIC);
+  copyBounded(g_mqtt.configTopic, MQTT_CONFIG_TOPIC);
+  g_mqtt.tls = MQTT_TLS != 0;
+  copyBounded(g_mqtt.tlsPin, MQTT_TLS_PIN);
+  g_mqtt.v5 = MQTT_V5 != 0;
+
+  g_tuning.heartbeatIntervalMs = MQTT_HEARTBEAT_INTERVAL_MS;
+  g_tuning.mqttRetryDelayMs = MQTT_RETRY_DELAY_MS;
+  g_tuning.wifiRetryDelayMs = WIFI_RETRY_DELAY_MS;
+  g_tuning.serialBufferBytes = MQTT_SERIAL_BUFFER;
+  g_tuning.loopMaxSleepMs = EVENT_LOOP_MAX_SLEEP_MS;
+  g_tuning.loopStallBudgetMs = LOOP_STALL_BUDGET_MS;
+  g_tuning.pwmFrequency = topology::PWM_FREQ;
+  g_tuning.stateStreamHz = STATE_STREAM_HZ;
+  g_tuning.stateBatchMs = STATE_BATCH_MS;
+
+  for (size_t i = 0; i < OWNER_COUNT; ++i) {
+    markUpdated(static_cast<Owner>(i));
+  }
 }
 
 WifiCredentials wifi() {
@@ -74,6 +298,12 @@ MqttInitParams mqtt() {
   return snapshot;
 }
 
+Tuning tuning() {
+  Tuning snapshot;
+  snapshot = g_tuning;
+  return snapshot;
+}
+
 bool hasWifiCredentials() {
   bool valid = false;
   valid = g_wifi.valid;
@@ -86,77 +316,75 @@ bool hasMqttParams() {
   return valid;
 }
 
-uint32_t wifiVersion() {
+uint32_t version(Owner owner) {
   uint32_t version = 0;
-  version = g_wifiVersion;
+  version = g_versions[static_cast<size_t>(owner)];
   return version;
 }
 
-uint32_t mqttVersion() {
-  uint32_t version = 0;
-  version = g_mqttVersion;
-  return version;
+WifiChanges diff(const WifiCredentials &before, const WifiCredentials &after) {
+  WifiChanges changes{};
+  for (size_t slot = 0; slot < WIFI_NETWORK_SLOTS; ++slot) {
+    changes.networks[slot] = strcmp(before.networks[slot].ssid, after.networks[slot].ssid) != 0 ||
+                             strcmp(before.networks[slot].password, after.networks[slot].password) != 0;
+  }
+  changes.valid = before.valid != after.valid;
+  return changes;
 }
 
-bool applyKeyValue(const char *key, const char *value) {
+MqttChanges diff(const MqttInitParams &before, const MqttInitParams &after) {
+  MqttChanges changes{};
+  for (size_t slot = 0; slot < MQTT_BROKER_SLOTS; ++slot) {
+    changes.brokers[slot] = strcmp(before.brokers[slot].host, after.brokers[slot].host) != 0 ||
+                            before.brokers[slot].port != after.brokers[slot].port;
+  }
+  changes.session = strcmp(before.clientId, after.clientId) != 0 ||
+                    strcmp(before.username, after.username) != 0 ||
+                    strcmp(before.password, after.password) != 0 || before.tls != after.tls ||
+                    strcmp(before.tlsPin, after.tlsPin) != 0 || before.v5 != after.v5;
+  changes.subscriptions = strcmp(before.commandTopic, after.commandTopic) != 0 ||
+                          strcmp(before.configTopic, after.configTopic) != 0;
+  changes.valid = before.valid != after.valid;
+  return changes;
+}
+
+uint32_t wifiVersion() { return version(Owner::WifiLink); }
+
+uint32_t mqttVersion() { return version(Owner::MqttLink); }
+
+bool applyKeyValue(const char *key, const char *value, KeyScope scope) {
   if (key == nullptr || value == nullptr) {
     return false;
   }
 
-  bool handled = false;
-  bool wifiTouched = false;
-  bool mqttTouched = false;
-
-  if (strEqualsIgnoreCase(key, "WIFI_SSID")) {
-    copyBounded(g_wifi.ssid, value);
-    wifiTouched = true;
-    handled = true;
-  } else if (strEqualsIgnoreCase(key, "WIFI_PASSWORD")) {
-    copyBounded(g_wifi.password, value);
-    wifiTouched = true;
-    handled = true;
-  } else if (strEqualsIgnoreCase(key, "MQTT_HOST")) {
-    copyBounded(g_mqtt.host, value);
-    mqttTouched = true;
-    handled = true;
-  } else if (strEqualsIgnoreCase(key, "MQTT_PORT")) {
-    g_mqtt.port = static_cast<uint16_t>(atoi(value));
-    mqttTouched = true;
-    handled = true;
-  } else if (strEqualsIgnoreCase(key, "MQTT_CLIENT_ID")) {
-    copyBounded(g_mqtt.clientId, value);
-    mqttTouched = true;
-    handled = true;
-  } else if (strEqualsIgnoreCase(key, "MQTT_USERNAME")) {
-    copyBounded(g_mqtt.username, value);
-    mqttTouched = true;
-    handled = true;
-  } else if (strEqualsIgnoreCase(key, "MQTT_PASSWORD")) {
-    copyBounded(g_mqtt.password, value);
-    mqttTouched = true;
-    handled = true;
-  } else if (strEqualsIgnoreCase(key, "MQTT_PUB_TOPIC")) {
-    copyBounded(g_mqtt.publishTopic, value);
-    mqttTouched = true;
-    handled = true;
-  } else if (strEqualsIgnoreCase(key, "MQTT_CMD_TOPIC")) {
-    copyBounded(g_mqtt.commandTopic, value);
-    mqttTouched = true;
-    handled = true;
-  } else if (strEqualsIgnoreCase(key, "MQTT_HEARTBEAT_TOPIC")) {
-    copyBounded(g_mqtt.heartbeatTopic, value);
-    mqttTouched = true;
-    handled = true;
-  }
-
-  if (wifiTouched) {
-    markWifiUpdated();
-  }
-  if (mqttTouched) {
-    markMqttUpdated();
-  }
-
-  return handled;
+  const Field *field = findField(key);
+  if (field == nullptr) {
+    return false;
+  }
+  const bool linkKey = field->owner == Owner::WifiLink || field->owner == Owner::MqttLink;
+  if ((scope == KeyScope::TuningOnly && linkKey) || !applyField(*field, value)) {
+    return false;
+  }
+
+  markUpdated(field->owner);
+  return true;
+}
+
+size_t applyConfigText(char *text, KeyScope scope) {
+  if (text == nullptr) {
+    return 0;
+  }
+
+  size_t applied = 0;
+  char *savePtr = nullptr;
+  char *line = strtok_r(text, "\n\r", &savePtr);
+  while (line != nullptr) {
+    if (processLine(line, scope)) {
+      ++applied;
+    }
+    line = strtok_r(nullptr, "\n\r", &savePtr);
+  }
+  return applied;
 }
 
 }  // namespace provisioning
@@ -0,0 +1,64 @@
+#include "diag/alloc_counter.h"
+
+#if DIAG_ALLOC_COUNT
+#include <stddef.h>
+
+#include <atomic>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+}
+
+namespace {
+// Other tasks (WiFi, lwIP) allocate all the time; only the task that opened
+// the scope is counted.
+std::atomic<TaskHandle_t> g_scopeTask{nullptr};
+std::atomic<uint32_t> g_scopedAllocations{0};
+
+void countAllocation() {
+  const TaskHandle_t owner = g_scopeTask.load(std::memory_order_relaxed);
+  if (owner != nullptr && owner == xTaskGetCurrentTaskHandle()) {
+    g_scopedAllocations.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+}  // namespace
+
+extern "C" {
+void *__wrap_malloc(size_t size) {
+  countAllocation();
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  countAllocation();
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+  countAllocation();
+  return __real_realloc(pointer, size);
+}
+}
+
+namespace diag::alloc {
+void beginScope() { g_scopeTask.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed); }
+
+void endScope() { g_scopeTask.store(nullptr, std::memory_order_relaxed); }
+
+uint32_t scopedAllocations() { return g_scopedAllocations.load(std::memory_order_relaxed); }
+}  // namespace diag::alloc
+
+#else
+
+namespace diag::alloc {
+void beginScope() {}
+void endScope() {}
+uint32_t scopedAllocations() { return 0; }
+}  // namespace diag::alloc
+
+#endif
@@ -0,0 +1,56 @@
+#include "diag/boot_timeline.h"
+
+#include <Arduino.h>
+#include <stdio.h>
+
+namespace diag::boot {
+namespace {
+constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::COUNT);
+
+const char *const STAGE_NAMES[] = {"setup",      "provisioned", "wifi_started",
+                                   "actuators",  "espnow",      "setup_done",
+                                   "wifi_up",    "mqtt_up",     "first_cmd"};
+static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == STAGE_COUNT, "one name per stage");
+
+uint32_t g_stageUs[STAGE_COUNT] = {};
+uint16_t g_reached = 0;
+uint16_t g_reported = 0;
+uint16_t g_peeked = 0;
+static_assert(STAGE_COUNT <= 16, "stages are tracked in a 16-bit mask");
+}  // namespace
+
+void mark(Stage stage) {
+  const uint16_t bit = static_cast<uint16_t>(1u << static_cast<uint8_t>(stage));
+  if ((g_reached & bit) != 0) {
+    return;
+  }
+  g_stageUs[static_cast<size_t>(stage)] = micros();
+  g_reached |= bit;
+}
+
+uint32_t at(Stage stage) {
+  return (g_reached & (1u << static_cast<uint8_t>(stage))) != 0
+             ? g_stageUs[static_cast<size_t>(stage)]
+             : 0;
+}
+
+bool peekReport(char *buffer, size_t size) {
+  g_peeked = g_reached;
+  if (g_peeked == g_reported || size == 0) {
+    return false;
+  }
+
+  int used = snprintf(buffer, size, "comm-robot boot");
+  for (size_t i = 0; i < STAGE_COUNT && used >= 0 && static_cast<size_t>(used) < size; ++i) {
+    if ((g_peeked & (1u << i)) == 0) {
+      continue;
+    }
+    used += snprintf(buffer + used, size - static_cast<size_t>(used), " %s_us=%lu", STAGE_NAMES[i],
+                     static_cast<unsigned long>(g_stageUs[i]));
+  }
+  return true;
+}
+
+void popReport() { g_reported = g_peeked; }
+
+}  // namespace diag::boot
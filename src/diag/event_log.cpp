@@ -0,0 +1,192 @@
+#include "diag/event_log.h"
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+
+namespace diag::log {
+namespace {
+static_assert((DIAG_LOG_CAPACITY & (DIAG_LOG_CAPACITY - 1)) == 0,
+              "DIAG_LOG_CAPACITY must be a power of two");
+
+constexpr uint8_t FRAME_SYNC_0 = 0xA5;
+constexpr uint8_t FRAME_SYNC_1 = 0x5A;
+constexpr size_t TEXT_LINE_MAX = 96;
+
+const char *const EVENT_FORMATS[] = {
+#define DIAG_EVENT_FORMAT(name, level, format) format,
+    DIAG_EVENTS(DIAG_EVENT_FORMAT)
+#undef DIAG_EVENT_FORMAT
+};
+
+const char *const LEVEL_TAGS[] = {"D", "I", "W"};
+
+// Wire layout of one binary frame (little endian):
+//   A5 5A | timestampUs:u32 | event:u16 | level:u8 | argc:u8 | args:i32[4] | sum:u8
+struct __attribute__((packed)) Record {
+  uint32_t timestampUs;
+  uint16_t event;
+  uint8_t level;
+  uint8_t argCount;
+  int32_t args[MAX_ARGS];
+};
+
+// Bounded multi-producer ring (Vyukov): each cell carries a sequence number
+// so producers in the loop task and the WiFi callback never take a lock.
+struct Cell {
+  std::atomic<uint32_t> sequence;
+  Record record;
+};
+
+Cell g_cells[DIAG_LOG_CAPACITY];
+std::atomic<uint32_t> g_enqueuePos{0};
+uint32_t g_dequeuePos = 0;
+
+std::atomic<uint32_t> g_written{0};
+std::atomic<uint32_t> g_dropped{0};
+uint32_t g_drained = 0;
+
+// Runs during static initialisation, before any producer can exist.
+struct CellSequenceInit {
+  CellSequenceInit() {
+    for (uint32_t i = 0; i < DIAG_LOG_CAPACITY; ++i) {
+      g_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+} g_cellSequenceInit;
+
+bool peek(Record *out) {
+  Cell &cell = g_cells[g_dequeuePos & (DIAG_LOG_CAPACITY - 1)];
+  const uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+  if (static_cast<int32_t>(sequence - (g_dequeuePos + 1)) < 0) {
+    return false;
+  }
+  *out = cell.record;
+  return true;
+}
+
+void release() {
+  Cell &cell = g_cells[g_dequeuePos & (DIAG_LOG_CAPACITY - 1)];
+  cell.sequence.store(g_dequeuePos + DIAG_LOG_CAPACITY, std::memory_order_release);
+  ++g_dequeuePos;
+}
+
+#if !DIAG_LOG_BINARY
+size_t formatText(const Record &record, char *line, size_t size) {
+  const char *format = record.event < static_cast<uint16_t>(Event::COUNT) ? EVENT_FORMATS[record.event]
+                                                                          : "unknown event";
+  const char *tag = record.level < sizeof(LEVEL_TAGS) / sizeof(LEVEL_TAGS[0]) ? LEVEL_TAGS[record.level]
+                                                                              : "?";
+  int written = snprintf(line, size, "[%lu %s] ", static_cast<unsigned long>(record.timestampUs), tag);
+  if (written < 0 || static_cast<size_t>(written) >= size) {
+    return 0;
+  }
+
+  long args[MAX_ARGS];
+  for (size_t i = 0; i < MAX_ARGS; ++i) {
+    args[i] = record.args[i];
+  }
+
+  const int body = snprintf(line + written, size - static_cast<size_t>(written), format, args[0],
+                            args[1], args[2], args[3]);
+  if (body < 0) {
+    return 0;
+  }
+  written += body;
+  if (static_cast<size_t>(written) >= size - 1) {
+    written = static_cast<int>(size) - 2;
+  }
+  line[written++] = '\n';
+  line[written] = '\0';
+  return static_cast<size_t>(written);
+}
+
+#else
+size_t formatBinary(const Record &record, uint8_t *frame) {
+  frame[0] = FRAME_SYNC_0;
+  frame[1] = FRAME_SYNC_1;
+  memcpy(frame + 2, &record, sizeof(record));
+  uint8_t sum = 0;
+  for (size_t i = 0; i < sizeof(record); ++i) {
+    sum = static_cast<uint8_t>(sum + frame[2 + i]);
+  }
+  frame[2 + sizeof(record)] = sum;
+  return sizeof(record) + 3;
+}
+#endif
+
+}  // namespace
+
+void write(Event event, const int32_t *args, size_t count) {
+  uint32_t position = g_enqueuePos.load(std::memory_order_relaxed);
+  Cell *cell = nullptr;
+  while (true) {
+    cell = &g_cells[position & (DIAG_LOG_CAPACITY - 1)];
+    const uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+    const int32_t diff = static_cast<int32_t>(sequence - position);
+    if (diff == 0) {
+      if (g_enqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      g_dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = g_enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  Record &record = cell->record;
+  record.timestampUs = micros();
+  record.event = static_cast<uint16_t>(event);
+  record.level = EVENT_LEVELS[static_cast<size_t>(event)];
+  record.argCount = static_cast<uint8_t>(count < MAX_ARGS ? count : MAX_ARGS);
+  for (size_t i = 0; i < MAX_ARGS; ++i) {
+    record.args[i] = i < count ? args[i] : 0;
+  }
+  cell->sequence.store(position + 1, std::memory_order_release);
+  g_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t drain(size_t maxRecords) {
+  size_t emitted = 0;
+  Record record;
+  while (emitted < maxRecords && peek(&record)) {
+#if DIAG_LOG_BINARY
+    uint8_t frame[sizeof(Record) + 3];
+    const size_t length = formatBinary(record, frame);
+    if (static_cast<size_t>(Serial.availableForWrite()) < length) {
+      break;
+    }
+    Serial.write(frame, length);
+#else
+    char line[TEXT_LINE_MAX];
+    const size_t length = formatText(record, line, sizeof(line));
+    if (static_cast<size_t>(Serial.availableForWrite()) < length) {
+      break;
+    }
+    Serial.write(reinterpret_cast<const uint8_t *>(line), length);
+#endif
+    release();
+    ++g_drained;
+    ++emitted;
+  }
+  return emitted;
+}
+
+bool pending() {
+  Record record;
+  return peek(&record);
+}
+
+Stats stats() {
+  Stats snapshot{};
+  snapshot.written = g_written.load(std::memory_order_relaxed);
+  snapshot.dropped = g_dropped.load(std::memory_order_relaxed);
+  snapshot.drained = g_drained;
+  return snapshot;
+}
+
+}  // namespace diag::log
@@ -0,0 +1,146 @@
+#include "diag/latency_trace.h"
+
+#include <Arduino.h>
+#include <stdio.h>
+
+#include "diag/boot_timeline.h"
+#include "diag/stall_detector.h"
+
+namespace diag::trace {
+namespace {
+constexpr size_t ACK_QUEUE_DEPTH = 8;
+
+struct CommandTrace {
+  uint32_t id;
+  uint32_t senderTs;
+  uint32_t receivedUs;
+  uint32_t dispatchUs;
+  uint32_t actuateUs;
+  bool hasId;
+};
+
+CommandTrace g_active{};
+bool g_inFlight = false;
+uint32_t g_lastCommandId = 0;
+
+CommandTrace g_ackQueue[ACK_QUEUE_DEPTH];
+size_t g_ackHead = 0;
+size_t g_ackCount = 0;
+uint32_t g_acksDropped = 0;
+
+LatencyHistogram g_histogram{};
+
+size_t bucketFor(uint32_t us) {
+  size_t bucket = 0;
+  while (us != 0 && bucket < HISTOGRAM_BUCKETS - 1) {
+    us >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+void recordLatency(uint32_t us) {
+  ++g_histogram.buckets[bucketFor(us)];
+  ++g_histogram.count;
+  if (us > g_histogram.maxUs) {
+    g_histogram.maxUs = us;
+  }
+}
+
+void queueAck(const CommandTrace &trace) {
+  if (g_ackCount == ACK_QUEUE_DEPTH) {
+    // Keep the newest acks; the oldest are the least useful to the sender.
+    g_ackHead = (g_ackHead + 1) % ACK_QUEUE_DEPTH;
+    --g_ackCount;
+    ++g_acksDropped;
+  }
+  g_ackQueue[(g_ackHead + g_ackCount) % ACK_QUEUE_DEPTH] = trace;
+  ++g_ackCount;
+}
+
+}  // namespace
+
+void beginCommand(const tasks::envelope::CommandEnvelope &envelope, uint32_t receivedUs) {
+  diag::stall::noteCommand(envelope.id);
+  g_active = CommandTrace{};
+  g_active.id = envelope.id;
+  g_active.senderTs = envelope.senderTs;
+  g_active.hasId = envelope.hasId;
+  g_active.receivedUs = receivedUs;
+  g_inFlight = true;
+  if (envelope.hasId) {
+    g_lastCommandId = envelope.id;
+  }
+}
+
+uint32_t lastCommandId() { return g_lastCommandId; }
+
+void markDispatch() {
+  if (g_inFlight && g_active.dispatchUs == 0) {
+    g_active.dispatchUs = micros();
+  }
+}
+
+void markActuate() {
+  if (g_inFlight) {
+    g_active.actuateUs = micros();
+    diag::boot::mark(diag::boot::Stage::FirstCommand);
+  }
+}
+
+void endCommand() {
+  if (!g_inFlight) {
+    return;
+  }
+  g_inFlight = false;
+
+  const uint32_t doneUs = g_active.actuateUs != 0 ? g_active.actuateUs : g_active.dispatchUs;
+  if (doneUs != 0) {
+    recordLatency(doneUs - g_active.receivedUs);
+  }
+
+  if (g_active.hasId) {
+    queueAck(g_active);
+  }
+}
+
+bool popAck(char *buffer, size_t size) {
+  if (g_ackCount == 0 || buffer == nullptr || size == 0) {
+    return false;
+  }
+
+  const CommandTrace &trace = g_ackQueue[g_ackHead];
+  const uint32_t dispatchDelta = trace.dispatchUs != 0 ? trace.dispatchUs - trace.receivedUs : 0;
+  const uint32_t actuateDelta = trace.actuateUs != 0 ? trace.actuateUs - trace.receivedUs : 0;
+  snprintf(buffer, size, "%lu,%lu,%lu,%lu,%lu", static_cast<unsigned long>(trace.id),
+           static_cast<unsigned long>(trace.senderTs), static_cast<unsigned long>(trace.receivedUs),
+           static_cast<unsigned long>(dispatchDelta), static_cast<unsigned long>(actuateDelta));
+
+  g_ackHead = (g_ackHead + 1) % ACK_QUEUE_DEPTH;
+  --g_ackCount;
+  return true;
+}
+
+const LatencyHistogram &histogram() { return g_histogram; }
+
+size_t formatHistogram(char *buffer, size_t size) {
+  if (buffer == nullptr || size == 0) {
+    return 0;
+  }
+
+  int written = snprintf(buffer, size, "hist,%lu,%lu,%lu", static_cast<unsigned long>(g_histogram.count),
+                         static_cast<unsigned long>(g_histogram.maxUs),
+                         static_cast<unsigned long>(g_acksDropped));
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS && written > 0 && static_cast<size_t>(written) < size; ++i) {
+    written += snprintf(buffer + written, size - static_cast<size_t>(written), ",%lu",
+                        static_cast<unsigned long>(g_histogram.buckets[i]));
+  }
+
+  if (written < 0) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  return static_cast<size_t>(written) < size ? static_cast<size_t>(written) : size - 1;
+}
+
+}  // namespace diag::trace
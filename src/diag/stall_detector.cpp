@@ -0,0 +1,291 @@
+#include "diag/stall_detector.h"
+
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+
+namespace diag::stall {
+namespace {
+constexpr size_t TRAIL_DEPTH = 8;
+constexpr size_t COMMAND_DEPTH = 8;
+constexpr size_t RECORD_DEPTH = 4;
+static_assert((TRAIL_DEPTH & (TRAIL_DEPTH - 1)) == 0 && (COMMAND_DEPTH & (COMMAND_DEPTH - 1)) == 0,
+              "rings are indexed by mask");
+constexpr uint32_t RETAINED_MAGIC = 0x53544C31;
+// A stall is caught at most a quarter of the budget late.
+constexpr uint32_t CHECKS_PER_BUDGET = 4;
+
+const char *const MARKER_NAMES[] = {
+    "estop", "wifi", "wifi.begin", "mqtt", "mqtt.io", "mqtt.connect", "mqtt.publish",
+    "schedule", "tunnel", "espnow", "actuators", "command", "log", "telemetry"};
+static_assert(sizeof(MARKER_NAMES) / sizeof(MARKER_NAMES[0]) == static_cast<size_t>(Marker::COUNT),
+              "one name per marker");
+
+struct Step {
+  uint8_t marker;
+  // Since the start of the pass.
+  uint32_t atUs;
+};
+
+struct Record {
+  uint32_t boot;
+  uint32_t elapsedUs;
+  uint32_t budgetMs;
+  // Oldest first, ending with the stage the loop was stuck in.
+  Step trail[TRAIL_DEPTH];
+  uint32_t commands[COMMAND_DEPTH];
+  uint8_t trailCount;
+  uint8_t commandCount;
+  bool reported;
+};
+
+struct Retained {
+  uint32_t magic;
+  uint32_t boot;
+  // Slot the next capture goes to; the oldest record is overwritten.
+  uint32_t next;
+  uint32_t count;
+  Record records[RECORD_DEPTH];
+};
+
+RTC_NOINIT_ATTR Retained g_retained;
+
+// Written by the loop and read by the watcher on the other core. A torn read
+// can only garble one entry of a diagnostic record, so only the pass state
+// itself is atomic.
+std::atomic<bool> g_inPass{false};
+std::atomic<uint32_t> g_passStartUs{0};
+Step g_trail[TRAIL_DEPTH];
+uint32_t g_marks = 0;
+uint32_t g_commands[COMMAND_DEPTH];
+uint32_t g_commandsSeen = 0;
+
+// Held while a record is written. The watcher only ever tries it, so it can
+// never spin against the loop it preempted on a single core.
+std::atomic<bool> g_busy{false};
+Record *g_open = nullptr;
+Record *g_peeked = nullptr;
+std::atomic<uint32_t> g_stalls{0};
+
+esp_timer_handle_t g_watcher = nullptr;
+uint32_t g_budgetUs = LOOP_STALL_BUDGET_MS * 1000;
+uint32_t g_lastTuningVersion = 0;
+esp_reset_reason_t g_resetReason = ESP_RST_UNKNOWN;
+
+void captureLocked(uint32_t nowUs) {
+  if (g_open == nullptr) {
+    g_open = &g_retained.records[g_retained.next];
+    g_retained.next = (g_retained.next + 1) % RECORD_DEPTH;
+    if (g_retained.count < RECORD_DEPTH) {
+      ++g_retained.count;
+    }
+    *g_open = Record{};
+    g_open->boot = g_retained.boot;
+    g_open->budgetMs = g_budgetUs / 1000;
+    g_stalls.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Refreshed on every check while the stall lasts, so a reset mid-stall
+  // still leaves the latest stage behind.
+  g_open->elapsedUs = nowUs - g_passStartUs.load(std::memory_order_relaxed);
+  const uint32_t marks = g_marks;
+  const uint32_t trailCount = marks < TRAIL_DEPTH ? marks : TRAIL_DEPTH;
+  for (uint32_t i = 0; i < trailCount; ++i) {
+    g_open->trail[i] = g_trail[(marks - trailCount + i) & (TRAIL_DEPTH - 1)];
+  }
+  g_open->trailCount = static_cast<uint8_t>(trailCount);
+  const uint32_t seen = g_commandsSeen;
+  const uint32_t commandCount = seen < COMMAND_DEPTH ? seen : COMMAND_DEPTH;
+  for (uint32_t i = 0; i < commandCount; ++i) {
+    g_open->commands[i] = g_commands[(seen - commandCount + i) & (COMMAND_DEPTH - 1)];
+  }
+  g_open->commandCount = static_cast<uint8_t>(commandCount);
+}
+
+void onWatch(void *) {
+  if (!g_inPass.load(std::memory_order_acquire)) {
+    return;
+  }
+  const uint32_t now = micros();
+  if ((now - g_passStartUs.load(std::memory_order_relaxed)) < g_budgetUs) {
+    return;
+  }
+  if (g_busy.exchange(true, std::memory_order_acquire)) {
+    return;
+  }
+  if (g_inPass.load(std::memory_order_relaxed)) {
+    captureLocked(now);
+  }
+  g_busy.store(false, std::memory_order_release);
+}
+
+void startWatcher() {
+  if (g_watcher == nullptr) {
+    return;
+  }
+  esp_timer_stop(g_watcher);
+  esp_timer_start_periodic(g_watcher, g_budgetUs / CHECKS_PER_BUDGET);
+}
+
+void refreshTuning() {
+  const uint32_t version = provisioning::version(provisioning::Owner::EventLoop);
+  if (version == g_lastTuningVersion) {
+    return;
+  }
+  g_lastTuningVersion = version;
+  g_budgetUs = provisioning::tuning().loopStallBudgetMs * 1000;
+  startWatcher();
+}
+
+const char *resetName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_TASK_WDT:
+      return "task_wdt";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_WDT:
+      return "wdt";
+    case ESP_RST_PANIC:
+      return "panic";
+    case ESP_RST_SW:
+      return "sw";
+    case ESP_RST_POWERON:
+      return "poweron";
+    default:
+      return "other";
+  }
+}
+
+void append(char *buffer, size_t size, size_t *used, const char *format, ...) {
+  if (*used >= size) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  const int written = vsnprintf(buffer + *used, size - *used, format, args);
+  va_end(args);
+  if (written > 0) {
+    *used += static_cast<size_t>(written);
+    if (*used >= size) {
+      *used = size - 1;
+    }
+  }
+}
+
+}  // namespace
+
+void init() {
+  if (g_retained.magic != RETAINED_MAGIC || g_retained.next >= RECORD_DEPTH ||
+      g_retained.count > RECORD_DEPTH) {
+    memset(&g_retained, 0, sizeof(g_retained));
+    g_retained.magic = RETAINED_MAGIC;
+  } else {
+    ++g_retained.boot;
+  }
+  g_resetReason = esp_reset_reason();
+  // Of a pass cut short by a reset only its record is left.
+  g_inPass.store(false, std::memory_order_relaxed);
+  g_open = nullptr;
+
+  const esp_timer_create_args_t args = {onWatch, nullptr, ESP_TIMER_TASK, "stall", true};
+  if (esp_timer_create(&args, &g_watcher) != ESP_OK) {
+    g_watcher = nullptr;
+    Serial.println("Stall detector: timer unavailable");
+    return;
+  }
+  g_lastTuningVersion = provisioning::version(provisioning::Owner::EventLoop);
+  g_budgetUs = provisioning::tuning().loopStallBudgetMs * 1000;
+  startWatcher();
+}
+
+void beginPass() {
+  refreshTuning();
+  g_marks = 0;
+  g_passStartUs.store(micros(), std::memory_order_relaxed);
+  g_inPass.store(true, std::memory_order_release);
+}
+
+void endPass() {
+  const uint32_t now = micros();
+  while (g_busy.exchange(true, std::memory_order_acquire)) {
+  }
+  g_inPass.store(false, std::memory_order_relaxed);
+  // Covers stalls the watcher missed, e.g. with its own core held up too, and
+  // records the final length of the ones it caught.
+  if (g_open != nullptr || (now - g_passStartUs.load(std::memory_order_relaxed)) >= g_budgetUs) {
+    captureLocked(now);
+    g_open = nullptr;
+  }
+  g_busy.store(false, std::memory_order_release);
+}
+
+void mark(Marker marker) {
+  g_trail[g_marks & (TRAIL_DEPTH - 1)] = {static_cast<uint8_t>(marker),
+                                          micros() - g_passStartUs.load(std::memory_order_relaxed)};
+  ++g_marks;
+}
+
+void noteCommand(uint32_t id) {
+  g_commands[g_commandsSeen & (COMMAND_DEPTH - 1)] = id;
+  ++g_commandsSeen;
+  mark(Marker::Command);
+}
+
+bool peekReport(char *buffer, size_t size) {
+  g_peeked = nullptr;
+  for (uint32_t i = 0; i < g_retained.count; ++i) {
+    const uint32_t slot = (g_retained.next + RECORD_DEPTH - g_retained.count + i) % RECORD_DEPTH;
+    Record &record = g_retained.records[slot];
+    if (!record.reported && &record != g_open) {
+      g_peeked = &record;
+      break;
+    }
+  }
+  if (g_peeked == nullptr) {
+    return false;
+  }
+
+  const Record &record = *g_peeked;
+  // Only the reset straight after the stall's boot can be blamed on it.
+  const char *reset = "none";
+  if (record.boot != g_retained.boot) {
+    reset = record.boot + 1 == g_retained.boot ? resetName(g_resetReason) : "unknown";
+  }
+  size_t used = 0;
+  append(buffer, size, &used,
+         "comm-robot stall boots_ago=%lu reset=%s elapsed_us=%lu budget_ms=%lu trail=",
+         static_cast<unsigned long>(g_retained.boot - record.boot), reset,
+         static_cast<unsigned long>(record.elapsedUs), static_cast<unsigned long>(record.budgetMs));
+  for (uint8_t i = 0; i < record.trailCount && i < TRAIL_DEPTH; ++i) {
+    const Step &step = record.trail[i];
+    const char *name =
+        step.marker < static_cast<uint8_t>(Marker::COUNT) ? MARKER_NAMES[step.marker] : "?";
+    append(buffer, size, &used, "%s%s@%lu", i == 0 ? "" : ",", name,
+           static_cast<unsigned long>(step.atUs));
+  }
+  append(buffer, size, &used, " cmds=");
+  for (uint8_t i = 0; i < record.commandCount && i < COMMAND_DEPTH; ++i) {
+    append(buffer, size, &used, "%s%lu", i == 0 ? "" : ",",
+           static_cast<unsigned long>(record.commands[i]));
+  }
+  return true;
+}
+
+void popReport() {
+  if (g_peeked != nullptr) {
+    g_peeked->reported = true;
+    g_peeked = nullptr;
+  }
+}
+
+uint32_t stalls() { return g_stalls.load(std::memory_order_relaxed); }
+
+}  // namespace diag::stall
@@ -7,24 +7,77 @@
 #endif
 
 #include "config/provisioning_store.h"
+#include "diag/boot_timeline.h"
+#include "diag/event_log.h"
+#include "diag/stall_detector.h"
+#include "tasks/emergency_stop.h"
 #include "tasks/espnow_listener.h"
+#include "tasks/event_loop.h"
+#include "tasks/message_handler.h"
 #include "tasks/mqtt_task.h"
+#include "tasks/scheduled_commands.h"
+#include "tasks/serial_tunnel.h"
+#include "tasks/telemetry.h"
 #include "tasks/wifi_task.h"
 
 void setup() {
+  using diag::boot::Stage;
+
+  diag::boot::mark(Stage::Setup);
   Serial.begin(115200);
   Serial.println();
   Serial.println("=== Communication Robot ===");
 
+  tasks::event_loop::init();
+#if !defined(ESP8266)
+  Serial.onReceive(tasks::event_loop::wake);
+#endif
+
   provisioning::initDefaults();
+  diag::stall::init();
+  diag::boot::mark(Stage::Provisioned);
+
+  // The association runs in the WiFi driver once begun, so the radio comes
+  // up first and the rest of the setup happens while it connects. Actuators
+  // are set up here rather than on the first command, which would otherwise
+  // pay for the PWM and servo attach.
   tasks::wifi::init();
-  tasks::mqtt::init();
+  diag::boot::mark(Stage::WifiStarted);
+  initActuators();
+  diag::boot::mark(Stage::ActuatorsReady);
   tasks::espnow::init();
+  diag::boot::mark(Stage::EspNowReady);
+  tasks::mqtt::init();
+  tasks::tunnel::init();
+  diag::boot::mark(Stage::SetupDone);
 }
 
 void loop() {
+  using diag::stall::Marker;
+
+  diag::stall::beginPass();
+  diag::stall::mark(Marker::Estop);
+  tasks::estop::loop();
+  diag::stall::mark(Marker::Wifi);
   tasks::wifi::loop();
+  diag::stall::mark(Marker::Mqtt);
   tasks::mqtt::loop();
+  diag::stall::mark(Marker::Schedule);
+  tasks::schedule::loop();
+  diag::stall::mark(Marker::Tunnel);
+  tasks::tunnel::loop();
+  diag::stall::mark(Marker::EspNow);
   tasks::espnow::loop();
-  delay(10);
+  diag::stall::mark(Marker::Actuators);
+  serviceActuators(millis());
+  // Last, so it samples the state this pass leaves behind.
+  diag::stall::mark(Marker::Telemetry);
+  tasks::telemetry::loop();
+  diag::stall::mark(Marker::LogDrain);
+  diag::log::drain(8);
+  if (diag::log::pending()) {
+    tasks::event_loop::setDeadline(tasks::event_loop::Source::SerialOutput, millis() + 2);
+  }
+  diag::stall::endPass();
+  tasks::event_loop::waitForWork();
 }
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "net/clock_sync.h"
+
+namespace net {
+namespace {
+// Drift is only fitted over a span long enough for round-trip noise not to
+// swamp it.
+constexpr int64_t MIN_DRIFT_SPAN_US = 10 * 1000 * 1000;
+// Anything beyond this is a broken clock, not drift.
+constexpr double MAX_DRIFT = 500e-6;
+}  // namespace
+
+void ClockSync::reset() { *this = ClockSync{}; }
+
+bool ClockSync::addExchange(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+  const int64_t delay = (t4 - t1) - (t3 - t2);
+  if (delay < 0 || t3 < t2 || t4 < t1) {
+    return false;
+  }
+  ++exchanges_;
+
+  Sample sample{t4, ((t2 - t1) + (t3 - t4)) / 2, delay};
+  samples_[sampleNext_] = sample;
+  sampleNext_ = (sampleNext_ + 1) % WINDOW;
+  if (sampleCount_ < WINDOW) {
+    ++sampleCount_;
+  }
+
+  const Sample *best = &samples_[0];
+  for (size_t i = 1; i < sampleCount_; ++i) {
+    if (samples_[i].delayUs < best->delayUs) {
+      best = &samples_[i];
+    }
+  }
+  if (hasBest_ && best->localUs == best_.localUs) {
+    return true;
+  }
+
+  best_ = *best;
+  hasBest_ = true;
+  filtered_[filteredNext_] = best_;
+  filteredNext_ = (filteredNext_ + 1) % WINDOW;
+  if (filteredCount_ < WINDOW) {
+    ++filteredCount_;
+  }
+  fitDrift();
+  return true;
+}
+
+// Least squares slope of offset over local time through the filtered points.
+void ClockSync::fitDrift() {
+  if (filteredCount_ < 3) {
+    return;
+  }
+  const int64_t x0 = best_.localUs;
+  const int64_t y0 = best_.offsetUs;
+  int64_t minX = 0;
+  double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+  for (size_t i = 0; i < filteredCount_; ++i) {
+    const int64_t dx = filtered_[i].localUs - x0;
+    if (dx < minX) minX = dx;
+    const double x = static_cast<double>(dx);
+    const double y = static_cast<double>(filtered_[i].offsetUs - y0);
+    sumX += x;
+    sumY += y;
+    sumXX += x * x;
+    sumXY += x * y;
+  }
+  if (-minX < MIN_DRIFT_SPAN_US) {
+    return;
+  }
+  const double n = static_cast<double>(filteredCount_);
+  const double denominator = n * sumXX - sumX * sumX;
+  if (denominator <= 0) {
+    return;
+  }
+  const double slope = (n * sumXY - sumX * sumY) / denominator;
+  drift_ = slope > MAX_DRIFT ? MAX_DRIFT : (slope < -MAX_DRIFT ? -MAX_DRIFT : slope);
+}
+
+int64_t ClockSync::toRemote(int64_t localUs) const {
+  const double elapsed = static_cast<double>(localUs - best_.localUs);
+  return localUs + best_.offsetUs + static_cast<int64_t>(elapsed * drift_);
+}
+
+int64_t ClockSync::toLocal(int64_t remoteUs) const {
+  // The drift term is tiny, so evaluating it at the uncorrected guess is
+  // exact to well under a microsecond.
+  const int64_t guess = remoteUs - best_.offsetUs;
+  const double elapsed = static_cast<double>(guess - best_.localUs);
+  return guess - static_cast<int64_t>(elapsed * drift_);
+}
+}  // namespace net
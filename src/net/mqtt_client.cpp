@@ -0,0 +1,639 @@
+#include "net/mqtt_client.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "net/mqtt_codec.h"
+
+namespace net {
+namespace {
+constexpr size_t MAX_TOPIC_LENGTH = 128;
+constexpr uint8_t CONNACK_ACCEPTED = 0;
+constexpr uint8_t SUBACK_FAILURE = 0x80;
+// lwIP does not signal DNS completion on any descriptor, so resolution is polled.
+constexpr uint32_t DNS_POLL_INTERVAL_MS = 10;
+}  // namespace
+
+const char *MqttClient::stateName(State state) {
+  switch (state) {
+    case State::Idle:
+      return "idle";
+    case State::Resolving:
+      return "dns";
+    case State::TcpConnecting:
+      return "tcp";
+    case State::TlsHandshake:
+      return "tls";
+    case State::MqttConnecting:
+      return "connack";
+    case State::Subscribing:
+      return "suback";
+    case State::Connected:
+      return "connected";
+  }
+  return "?";
+}
+
+bool MqttClient::beginConnect(const Session &session, uint32_t nowMs) {
+  disconnect();
+  session_ = session;
+  lastFailedStage_ = State::Idle;
+
+  if (!socket_.beginResolve(session_.host)) {
+    lastFailedStage_ = State::Resolving;
+    return false;
+  }
+  enterState(State::Resolving, nowMs);
+  return true;
+}
+
+void MqttClient::disconnect() {
+  if (state_ == State::Connected) {
+    const size_t length = codec::encodeDisconnect(txBuffer_, sizeof(txBuffer_));
+    // Best effort only: whatever the socket takes right now.
+    const int written = transportWrite(txBuffer_, length);
+    if (written > 0) {
+      wire_.txBytes += static_cast<uint32_t>(written);
+    }
+  }
+  closeTransport();
+  txLength_ = 0;
+  rxLength_ = 0;
+  rxDiscard_ = 0;
+  rxScanned_ = 0;
+  pingOutstanding_ = false;
+  state_ = State::Idle;
+}
+
+int MqttClient::transportRead(uint8_t *buffer, size_t size) {
+  return usingTls() ? tls_.read(buffer, size) : socket_.read(buffer, size);
+}
+
+int MqttClient::transportWrite(const uint8_t *data, size_t length) {
+  return usingTls() ? tls_.write(data, length) : socket_.write(data, length);
+}
+
+void MqttClient::closeTransport() {
+  tls_.close();
+  socket_.close();
+}
+
+void MqttClient::enterState(State state, uint32_t nowMs) {
+  state_ = state;
+  stageStartMs_ = nowMs;
+}
+
+void MqttClient::fail() {
+  const State failedStage = state_;
+  closeTransport();
+  txLength_ = 0;
+  rxLength_ = 0;
+  rxDiscard_ = 0;
+  rxScanned_ = 0;
+  pingOutstanding_ = false;
+  state_ = State::Idle;
+  lastFailedStage_ = failedStage;
+}
+
+uint32_t MqttClient::stageTimeoutMs() const {
+  switch (state_) {
+    case State::Resolving:
+      return MQTT_DNS_TIMEOUT_MS;
+    case State::TcpConnecting:
+      return MQTT_TCP_TIMEOUT_MS;
+    case State::TlsHandshake:
+      return MQTT_TLS_TIMEOUT_MS;
+    case State::MqttConnecting:
+      return MQTT_CONNACK_TIMEOUT_MS;
+    case State::Subscribing:
+      return MQTT_SUBACK_TIMEOUT_MS;
+    default:
+      return 0;
+  }
+}
+
+uint32_t MqttClient::nextDeadlineMs(uint32_t nowMs) {
+  if (state_ == State::Resolving) {
+    return nowMs + DNS_POLL_INTERVAL_MS;
+  }
+  if (usingTls() && tls_.hasBufferedInput()) {
+    return nowMs;
+  }
+  if (state_ != State::Connected) {
+    return stageStartMs_ + stageTimeoutMs();
+  }
+
+  return pingOutstanding_ ? pingSentMs_ + keepAliveMs_ / 2 : lastSendMs_ + keepAliveMs_ / 2;
+}
+
+void MqttClient::loop(uint32_t nowMs) {
+  if (state_ == State::Idle) {
+    return;
+  }
+
+  const uint32_t timeout = stageTimeoutMs();
+  if (timeout != 0 && (nowMs - stageStartMs_) >= timeout) {
+    fail();
+    return;
+  }
+
+  switch (state_) {
+    case State::Resolving:
+      switch (socket_.pollResolve()) {
+        case Socket::Progress::Pending:
+          return;
+        case Socket::Progress::Failed:
+          fail();
+          return;
+        case Socket::Progress::Done:
+          if (!socket_.beginConnect(session_.port)) {
+            enterState(State::TcpConnecting, nowMs);
+            fail();
+            return;
+          }
+          enterState(State::TcpConnecting, nowMs);
+          return;
+      }
+      return;
+
+    case State::TcpConnecting:
+      switch (socket_.pollConnect()) {
+        case Socket::Progress::Pending:
+          return;
+        case Socket::Progress::Failed:
+          fail();
+          return;
+        case Socket::Progress::Done:
+          if (usingTls()) {
+            enterState(State::TlsHandshake, nowMs);
+            if (!tls_.begin(&socket_, session_.host, *session_.tls)) {
+              fail();
+            }
+            return;
+          }
+          enterState(State::MqttConnecting, nowMs);
+          if (!sendConnect(nowMs)) {
+            fail();
+          }
+          return;
+      }
+      return;
+
+    case State::TlsHandshake:
+      switch (tls_.pollHandshake()) {
+        case Socket::Progress::Pending:
+          return;
+        case Socket::Progress::Failed:
+          fail();
+          return;
+        case Socket::Progress::Done:
+          enterState(State::MqttConnecting, nowMs);
+          if (!sendConnect(nowMs)) {
+            fail();
+          }
+          return;
+      }
+      return;
+
+    case State::MqttConnecting:
+    case State::Subscribing:
+    case State::Connected:
+      if (!flushOutput(nowMs)) {
+        fail();
+        return;
+      }
+      flushPendingAcks();
+      if (!pumpInput(nowMs)) {
+        fail();
+        return;
+      }
+      if (state_ == State::Connected) {
+        serviceKeepAlive(nowMs);
+      }
+      return;
+
+    case State::Idle:
+      return;
+  }
+}
+
+void MqttClient::flush(uint32_t nowMs) {
+  if (state_ == State::Idle || state_ == State::Resolving || state_ == State::TcpConnecting ||
+      state_ == State::TlsHandshake) {
+    return;
+  }
+  if (!flushOutput(nowMs)) {
+    fail();
+  }
+}
+
+bool MqttClient::sendConnect(uint32_t nowMs) {
+  codec::ConnectOptions options{};
+  options.clientId = session_.clientId;
+  options.username = session_.username;
+  options.password = session_.password;
+  options.keepAliveSeconds = MQTT_KEEPALIVE_S;
+  options.cleanSession = true;
+  options.version = version();
+  options.receiveMaximum = MQTT_RECEIVE_MAXIMUM;
+  options.topicAliasMaximum = MQTT_TOPIC_ALIASES;
+  // The broker drops what would not fit instead of sending it to be skipped.
+  options.maximumPacketSize = MQTT_RX_BUFFER;
+  resetSessionState();
+
+  const size_t length =
+      codec::encodeConnect(txBuffer_ + txLength_, sizeof(txBuffer_) - txLength_, options);
+  return enqueue(length) && flushOutput(nowMs);
+}
+
+uint16_t MqttClient::takePacketId() {
+  const uint16_t packetId = nextPacketId_++;
+  if (nextPacketId_ == 0) {
+    nextPacketId_ = 1;
+  }
+  return packetId;
+}
+
+bool MqttClient::sendSubscribe(const char *const *topics, size_t count) {
+  const uint16_t packetId = takePacketId();
+
+  // QoS 1 is what lets MQTT 5 brokers hold commands back under the receive
+  // maximum and expire them there.
+  const uint8_t qos = session_.v5 ? 1 : 0;
+  const size_t length = codec::encodeSubscribe(txBuffer_ + txLength_, sizeof(txBuffer_) - txLength_,
+                                               version(), packetId, topics, count, qos);
+  if (!enqueue(length)) {
+    return false;
+  }
+  pendingSubscribeId_ = packetId;
+  return true;
+}
+
+bool MqttClient::enqueue(size_t length) {
+  if (length == 0) {
+    return false;
+  }
+  txLength_ += length;
+  return true;
+}
+
+void MqttClient::resetSessionState() {
+  keepAliveMs_ = static_cast<uint32_t>(MQTT_KEEPALIVE_S) * 1000;
+  outboundAliasCount_ = 0;
+  outboundAliasLimit_ = 0;
+  for (char *topic : inboundAliases_) {
+    topic[0] = '\0';
+  }
+  priorityAlias_ = 0;
+  pendingAckCount_ = 0;
+}
+
+// Returns the alias bound to `topic`, or the next free one with `*fresh` set,
+// or 0 once the broker's limit is used up.
+uint16_t MqttClient::outboundAlias(const char *topic, bool *fresh) {
+  *fresh = false;
+  for (uint16_t i = 0; i < outboundAliasCount_; ++i) {
+    if (strcmp(outboundAliases_[i], topic) == 0) {
+      return i + 1;
+    }
+  }
+  if (outboundAliasCount_ >= outboundAliasLimit_ || strlen(topic) >= ALIAS_TOPIC_BYTES) {
+    return 0;
+  }
+  *fresh = true;
+  return outboundAliasCount_ + 1;
+}
+
+bool MqttClient::publish(const char *topic, const uint8_t *payload, size_t length) {
+  if (state_ != State::Connected || topic == nullptr || topic[0] == '\0') {
+    return false;
+  }
+
+  if (!session_.v5) {
+    return enqueue(codec::encodePublish(txBuffer_ + txLength_, sizeof(txBuffer_) - txLength_, topic,
+                                        payload, length, 0, 0, false));
+  }
+
+  bool fresh = false;
+  codec::PublishProperties properties{};
+  properties.topicAlias = outboundAlias(topic, &fresh);
+  properties.messageExpirySeconds = MQTT_MESSAGE_EXPIRY_S;
+  const bool aliasOnly = properties.topicAlias != 0 && !fresh;
+  const size_t encoded =
+      codec::encodePublish5(txBuffer_ + txLength_, sizeof(txBuffer_) - txLength_,
+                            aliasOnly ? "" : topic, properties, payload, length, 0, 0, false);
+  if (!enqueue(encoded)) {
+    return false;
+  }
+  // Bound only once the packet carrying the binding is queued.
+  if (fresh) {
+    strcpy(outboundAliases_[outboundAliasCount_++], topic);
+  }
+  if (aliasOnly) {
+    ++wire_.aliasedPublishes;
+  }
+  return true;
+}
+
+bool MqttClient::publish(const char *topic, const char *payload) {
+  return publish(topic, reinterpret_cast<const uint8_t *>(payload), strlen(payload));
+}
+
+bool MqttClient::subscribe(const char *topic) {
+  if (state_ != State::Connected || topic == nullptr || topic[0] == '\0') {
+    return false;
+  }
+  const char *topics[] = {topic};
+  return sendSubscribe(topics, 1);
+}
+
+bool MqttClient::unsubscribe(const char *topic) {
+  if (state_ != State::Connected || topic == nullptr || topic[0] == '\0') {
+    return false;
+  }
+  return enqueue(codec::encodeUnsubscribe(txBuffer_ + txLength_, sizeof(txBuffer_) - txLength_,
+                                          version(), takePacketId(), topic));
+}
+
+bool MqttClient::flushOutput(uint32_t nowMs) {
+  if (txLength_ == 0) {
+    return true;
+  }
+
+  const int written = transportWrite(txBuffer_, txLength_);
+  if (written < 0) {
+    return false;
+  }
+  if (written > 0) {
+    const size_t sent = static_cast<size_t>(written);
+    memmove(txBuffer_, txBuffer_ + sent, txLength_ - sent);
+    txLength_ -= sent;
+    lastSendMs_ = nowMs;
+    wire_.txBytes += static_cast<uint32_t>(sent);
+  }
+  return true;
+}
+
+bool MqttClient::pumpInput(uint32_t nowMs) {
+  // One read per loop keeps the time spent here bounded by the buffer size.
+  const int received = transportRead(rxBuffer_ + rxLength_, sizeof(rxBuffer_) - rxLength_);
+  if (received < 0) {
+    return false;
+  }
+  rxLength_ += static_cast<size_t>(received);
+  wire_.rxBytes += static_cast<uint32_t>(received);
+
+  if (rxDiscard_ > 0) {
+    const size_t dropped = rxDiscard_ < rxLength_ ? rxDiscard_ : rxLength_;
+    consumeInput(dropped);
+    rxDiscard_ -= dropped;
+  }
+  if (received > 0 && priorityCallback_ != nullptr) {
+    scanForPriority(micros());
+  }
+
+  while (rxLength_ > 0 && state_ != State::Idle) {
+    codec::PacketHeader header{};
+    const codec::DecodeResult result = codec::decodeHeader(rxBuffer_, rxLength_, &header);
+    if (result == codec::DecodeResult::Malformed) {
+      return false;
+    }
+    if (result == codec::DecodeResult::Incomplete) {
+      break;
+    }
+
+    const size_t total = header.headerLength + header.remainingLength;
+    if (total > sizeof(rxBuffer_)) {
+      // Too large to ever hold: skip it as it streams past.
+      rxDiscard_ = total;
+      const size_t dropped = rxDiscard_ < rxLength_ ? rxDiscard_ : rxLength_;
+      consumeInput(dropped);
+      rxDiscard_ -= dropped;
+      continue;
+    }
+    if (total > rxLength_) {
+      break;
+    }
+
+    handlePacket(header.type, header.flags, rxBuffer_ + header.headerLength, header.remainingLength,
+                 nowMs);
+    if (state_ == State::Idle) {
+      return true;
+    }
+
+    consumeInput(total);
+  }
+
+  return true;
+}
+
+// Walks the complete packets not looked at yet and compares PUBLISH topics
+// byte for byte; in 3.1.1 nothing is decoded beyond the fixed header and the
+// topic length. MQTT 5 packets may carry only an alias for the topic, so
+// their properties are read too, and the alias bound to the priority topic is
+// tracked here: the scan runs ahead of handlePacket().
+void MqttClient::scanForPriority(uint32_t arrivedUs) {
+  const size_t topicLength = strlen(priorityTopic_);
+  while (rxScanned_ < rxLength_) {
+    codec::PacketHeader header{};
+    const uint8_t *packet = rxBuffer_ + rxScanned_;
+    const size_t available = rxLength_ - rxScanned_;
+    if (codec::decodeHeader(packet, available, &header) != codec::DecodeResult::Complete) {
+      return;
+    }
+    const size_t total = header.headerLength + header.remainingLength;
+    if (total > available) {
+      return;
+    }
+
+    const uint8_t *body = packet + header.headerLength;
+    if (header.type == codec::PACKET_PUBLISH && header.remainingLength >= 2) {
+      const size_t length = static_cast<size_t>((body[0] << 8) | body[1]);
+      bool match = length == topicLength && header.remainingLength >= 2 + topicLength &&
+                   memcmp(body + 2, priorityTopic_, topicLength) == 0;
+      codec::Publish message{};
+      if (session_.v5 && codec::decodePublish(header, body, codec::Version::V5, &message) &&
+          message.topicAlias != 0) {
+        if (match) {
+          priorityAlias_ = message.topicAlias;
+        } else if (length == 0) {
+          match = message.topicAlias == priorityAlias_;
+        } else if (message.topicAlias == priorityAlias_) {
+          priorityAlias_ = 0;
+        }
+      }
+      if (match) {
+        priorityCallback_(arrivedUs);
+      }
+    }
+    rxScanned_ += total;
+  }
+}
+
+void MqttClient::consumeInput(size_t length) {
+  memmove(rxBuffer_, rxBuffer_ + length, rxLength_ - length);
+  rxLength_ -= length;
+  rxScanned_ = rxScanned_ > length ? rxScanned_ - length : 0;
+}
+
+void MqttClient::handlePacket(uint8_t type, uint8_t flags, const uint8_t *body, size_t length,
+                              uint32_t nowMs) {
+  switch (type) {
+    case codec::PACKET_CONNACK: {
+      codec::Connack connack{};
+      if (state_ != State::MqttConnecting ||
+          !codec::decodeConnack(body, length, version(), &connack) ||
+          connack.reasonCode != CONNACK_ACCEPTED) {
+        fail();
+        return;
+      }
+      outboundAliasLimit_ = connack.topicAliasMaximum < MQTT_TOPIC_ALIASES
+                                ? connack.topicAliasMaximum
+                                : MQTT_TOPIC_ALIASES;
+      if (connack.serverKeepAliveSeconds != 0) {
+        keepAliveMs_ = static_cast<uint32_t>(connack.serverKeepAliveSeconds) * 1000;
+      }
+      if (session_.topicCount == 0) {
+        enterState(State::Connected, nowMs);
+        return;
+      }
+      enterState(State::Subscribing, nowMs);
+      if (!sendSubscribe(session_.topics, session_.topicCount)) {
+        fail();
+      }
+      return;
+    }
+
+    case codec::PACKET_SUBACK: {
+      codec::Suback suback{};
+      if (!codec::decodeSuback(body, length, version(), &suback) ||
+          suback.packetId != pendingSubscribeId_) {
+        return;
+      }
+      for (size_t i = 0; i < suback.reasonCodeCount; ++i) {
+        // 0x80 in 3.1.1; every MQTT 5 reason code from 0x80 up is a refusal.
+        if (suback.reasonCodes[i] >= SUBACK_FAILURE) {
+          // Treat a refused subscription like a broken session so the next
+          // attempt retries it instead of silently running deaf.
+          fail();
+          return;
+        }
+      }
+      pendingSubscribeId_ = 0;
+      if (state_ == State::Subscribing) {
+        enterState(State::Connected, nowMs);
+      }
+      return;
+    }
+
+    case codec::PACKET_PUBLISH: {
+      codec::PacketHeader header{type, flags, length, 0};
+      codec::Publish message{};
+      if (!codec::decodePublish(header, body, version(), &message)) {
+        return;
+      }
+
+      char buffer[MAX_TOPIC_LENGTH];
+      const char *topic = resolveInbound(message, buffer, sizeof(buffer));
+      if (topic != nullptr && callback_ != nullptr) {
+        callback_(topic, message.payload, message.payloadLength);
+      }
+      // Acknowledged even when it could not be delivered, so it does not hold
+      // a slot of the broker's in-flight window for good.
+      if (message.qos == 1 && !acknowledge(message.packetId)) {
+        fail();
+      }
+      return;
+    }
+
+    case codec::PACKET_DISCONNECT:
+      // Only MQTT 5 brokers send one, always ahead of closing the connection.
+      fail();
+      return;
+
+    case codec::PACKET_PINGRESP:
+      pingOutstanding_ = false;
+      return;
+
+    default:
+      return;
+  }
+}
+
+// Copies the topic of `message` into `buffer` and binds any alias it sets, or
+// looks up the topic of an alias-only message. nullptr when the topic does
+// not fit or the alias was never bound.
+const char *MqttClient::resolveInbound(const codec::Publish &message, char *buffer, size_t size) {
+  const uint16_t alias = message.topicAlias;
+  const bool aliasKnown = alias != 0 && alias <= MQTT_TOPIC_ALIASES;
+  if (message.topicLength == 0) {
+    const bool bound = aliasKnown && inboundAliases_[alias - 1][0] != '\0';
+    return bound ? inboundAliases_[alias - 1] : nullptr;
+  }
+  if (message.topicLength >= size) {
+    return nullptr;
+  }
+
+  memcpy(buffer, message.topic, message.topicLength);
+  buffer[message.topicLength] = '\0';
+  if (aliasKnown) {
+    // The broker may rebind an alias; a topic too long to keep unbinds it.
+    char *bound = inboundAliases_[alias - 1];
+    if (message.topicLength < ALIAS_TOPIC_BYTES) {
+      memcpy(bound, buffer, message.topicLength + 1);
+    } else {
+      bound[0] = '\0';
+    }
+  }
+  return buffer;
+}
+
+// PUBACKs go out in the order the PUBLISHes came in. One that does not fit
+// in txBuffer_ waits in pendingAcks_; the broker keeps at most
+// MQTT_RECEIVE_MAXIMUM messages unacknowledged, so running out of room there
+// means it broke the limit.
+bool MqttClient::acknowledge(uint16_t packetId) {
+  if (pendingAckCount_ == 0 &&
+      enqueue(codec::encodePubAck(txBuffer_ + txLength_, sizeof(txBuffer_) - txLength_,
+                                  packetId))) {
+    return true;
+  }
+  if (pendingAckCount_ == MQTT_RECEIVE_MAXIMUM) {
+    return false;
+  }
+  pendingAcks_[pendingAckCount_++] = packetId;
+  return true;
+}
+
+void MqttClient::flushPendingAcks() {
+  size_t sent = 0;
+  while (sent < pendingAckCount_ &&
+         enqueue(codec::encodePubAck(txBuffer_ + txLength_, sizeof(txBuffer_) - txLength_,
+                                     pendingAcks_[sent]))) {
+    ++sent;
+  }
+  if (sent > 0) {
+    memmove(pendingAcks_, pendingAcks_ + sent, (pendingAckCount_ - sent) * sizeof(pendingAcks_[0]));
+    pendingAckCount_ -= sent;
+  }
+}
+
+void MqttClient::serviceKeepAlive(uint32_t nowMs) {
+  if (pingOutstanding_) {
+    if ((nowMs - pingSentMs_) >= keepAliveMs_ / 2) {
+      fail();
+    }
+    return;
+  }
+
+  // Ping at half the interval so one lost PINGRESP still fits inside the
+  // broker's 1.5x grace period.
+  if ((nowMs - lastSendMs_) >= keepAliveMs_ / 2) {
+    if (enqueue(codec::encodePingReq(txBuffer_ + txLength_, sizeof(txBuffer_) - txLength_))) {
+      pingOutstanding_ = true;
+      pingSentMs_ = nowMs;
+    }
+  }
+}
+
+}  // namespace net
@@ -0,0 +1,457 @@
+#include "net/mqtt_codec.h"
+
+#include <string.h>
+
+namespace net::codec {
+namespace {
+constexpr size_t MAX_REMAINING_LENGTH_BYTES = 4;
+constexpr uint8_t CONNECT_FLAG_CLEAN_SESSION = 0x02;
+constexpr uint8_t CONNECT_FLAG_PASSWORD = 0x40;
+constexpr uint8_t CONNECT_FLAG_USERNAME = 0x80;
+
+// MQTT 5 property identifiers this codec writes or reads.
+constexpr uint8_t PROPERTY_MESSAGE_EXPIRY = 0x02;
+constexpr uint8_t PROPERTY_SERVER_KEEP_ALIVE = 0x13;
+constexpr uint8_t PROPERTY_RECEIVE_MAXIMUM = 0x21;
+constexpr uint8_t PROPERTY_TOPIC_ALIAS_MAXIMUM = 0x22;
+constexpr uint8_t PROPERTY_TOPIC_ALIAS = 0x23;
+constexpr uint8_t PROPERTY_MAXIMUM_PACKET_SIZE = 0x27;
+
+// Properties a decoder cares about; everything else is skipped by type.
+struct Properties {
+  uint16_t topicAlias;
+  uint16_t topicAliasMaximum;
+  uint16_t serverKeepAlive;
+};
+
+size_t remainingLengthSize(size_t length) {
+  size_t bytes = 1;
+  while (length >= 128) {
+    length /= 128;
+    ++bytes;
+  }
+  return bytes;
+}
+
+size_t writeRemainingLength(uint8_t *out, size_t length) {
+  size_t written = 0;
+  do {
+    uint8_t encoded = static_cast<uint8_t>(length % 128);
+    length /= 128;
+    if (length > 0) {
+      encoded |= 0x80;
+    }
+    out[written++] = encoded;
+  } while (length > 0);
+  return written;
+}
+
+bool hasText(const char *text) { return text != nullptr && text[0] != '\0'; }
+
+// Writes the fixed header for a packet with `remaining` bytes of body and
+// returns the offset at which the body starts, or 0 if it cannot fit.
+size_t beginPacket(uint8_t *buffer, size_t capacity, uint8_t typeAndFlags, size_t remaining) {
+  const size_t total = 1 + remainingLengthSize(remaining) + remaining;
+  if (buffer == nullptr || total > capacity) {
+    return 0;
+  }
+  buffer[0] = typeAndFlags;
+  return 1 + writeRemainingLength(buffer + 1, remaining);
+}
+
+size_t writeU16(uint8_t *out, uint16_t value) {
+  out[0] = static_cast<uint8_t>(value >> 8);
+  out[1] = static_cast<uint8_t>(value & 0xFF);
+  return 2;
+}
+
+size_t writeString(uint8_t *out, const char *text, size_t length) {
+  writeU16(out, static_cast<uint16_t>(length));
+  memcpy(out + 2, text, length);
+  return 2 + length;
+}
+
+size_t writeU32(uint8_t *out, uint32_t value) {
+  writeU16(out, static_cast<uint16_t>(value >> 16));
+  writeU16(out + 2, static_cast<uint16_t>(value & 0xFFFF));
+  return 4;
+}
+
+uint16_t readU16(const uint8_t *in) {
+  return static_cast<uint16_t>((static_cast<uint16_t>(in[0]) << 8) | in[1]);
+}
+
+// Reads a variable byte integer; returns the bytes it took, 0 if malformed or
+// cut short.
+size_t readVarint(const uint8_t *in, size_t available, size_t *value) {
+  *value = 0;
+  size_t multiplier = 1;
+  for (size_t index = 0; index < MAX_REMAINING_LENGTH_BYTES && index < available; ++index) {
+    *value += static_cast<size_t>(in[index] & 0x7F) * multiplier;
+    if ((in[index] & 0x80) == 0) {
+      return index + 1;
+    }
+    multiplier *= 128;
+  }
+  return 0;
+}
+
+// Size of the value that follows a property identifier; 0 for an unknown
+// identifier or a length prefix that runs past `left`.
+size_t propertySize(uint8_t id, const uint8_t *value, size_t left) {
+  switch (id) {
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+      return 1;
+    case 0x13: case 0x21: case 0x22: case 0x23:
+      return 2;
+    case 0x02: case 0x11: case 0x18: case 0x27:
+      return 4;
+    case 0x0B: {
+      size_t ignored = 0;
+      return readVarint(value, left, &ignored);
+    }
+    case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C:
+    case 0x1F:
+      return left >= 2 ? 2 + readU16(value) : 0;
+    case 0x26: {
+      // User property: a pair of strings.
+      if (left < 2) {
+        return 0;
+      }
+      const size_t first = 2 + readU16(value);
+      return left >= first + 2 ? first + 2 + readU16(value + first) : 0;
+    }
+    default:
+      return 0;
+  }
+}
+
+// Walks a property block, its length prefix included, and returns the bytes
+// it took, or 0 if it is malformed.
+size_t readProperties(const uint8_t *in, size_t available, Properties *out) {
+  size_t length = 0;
+  const size_t prefix = readVarint(in, available, &length);
+  if (prefix == 0 || length > available - prefix) {
+    return 0;
+  }
+
+  *out = Properties{};
+  const uint8_t *cursor = in + prefix;
+  const uint8_t *end = cursor + length;
+  while (cursor < end) {
+    const uint8_t id = *cursor++;
+    const size_t left = static_cast<size_t>(end - cursor);
+    const size_t size = propertySize(id, cursor, left);
+    if (size == 0 || size > left) {
+      return 0;
+    }
+
+    if (id == PROPERTY_TOPIC_ALIAS) {
+      out->topicAlias = readU16(cursor);
+    } else if (id == PROPERTY_TOPIC_ALIAS_MAXIMUM) {
+      out->topicAliasMaximum = readU16(cursor);
+    } else if (id == PROPERTY_SERVER_KEEP_ALIVE) {
+      out->serverKeepAlive = readU16(cursor);
+    }
+    cursor += size;
+  }
+  return prefix + length;
+}
+
+}  // namespace
+
+size_t encodeConnect(uint8_t *buffer, size_t capacity, const ConnectOptions &options) {
+  static constexpr char kProtocolName[] = "MQTT";
+  const size_t clientIdLength = options.clientId != nullptr ? strlen(options.clientId) : 0;
+  const bool withUsername = hasText(options.username);
+  const bool withPassword = withUsername && hasText(options.password);
+
+  const bool v5 = options.version == Version::V5;
+  size_t properties = 0;
+  if (v5) {
+    properties += options.receiveMaximum != 0 ? 1 + 2 : 0;
+    properties += options.topicAliasMaximum != 0 ? 1 + 2 : 0;
+    properties += options.maximumPacketSize != 0 ? 1 + 4 : 0;
+  }
+
+  size_t remaining = 2 + (sizeof(kProtocolName) - 1) + 1 + 1 + 2 + 2 + clientIdLength;
+  if (v5) {
+    remaining += remainingLengthSize(properties) + properties;
+  }
+  if (withUsername) {
+    remaining += 2 + strlen(options.username);
+  }
+  if (withPassword) {
+    remaining += 2 + strlen(options.password);
+  }
+
+  size_t offset = beginPacket(buffer, capacity, PACKET_CONNECT << 4, remaining);
+  if (offset == 0) {
+    return 0;
+  }
+
+  uint8_t flags = 0;
+  if (options.cleanSession) {
+    flags |= CONNECT_FLAG_CLEAN_SESSION;
+  }
+  if (withUsername) {
+    flags |= CONNECT_FLAG_USERNAME;
+  }
+  if (withPassword) {
+    flags |= CONNECT_FLAG_PASSWORD;
+  }
+
+  offset += writeString(buffer + offset, kProtocolName, sizeof(kProtocolName) - 1);
+  buffer[offset++] = static_cast<uint8_t>(options.version);
+  buffer[offset++] = flags;
+  offset += writeU16(buffer + offset, options.keepAliveSeconds);
+  if (v5) {
+    offset += writeRemainingLength(buffer + offset, properties);
+    if (options.receiveMaximum != 0) {
+      buffer[offset++] = PROPERTY_RECEIVE_MAXIMUM;
+      offset += writeU16(buffer + offset, options.receiveMaximum);
+    }
+    if (options.topicAliasMaximum != 0) {
+      buffer[offset++] = PROPERTY_TOPIC_ALIAS_MAXIMUM;
+      offset += writeU16(buffer + offset, options.topicAliasMaximum);
+    }
+    if (options.maximumPacketSize != 0) {
+      buffer[offset++] = PROPERTY_MAXIMUM_PACKET_SIZE;
+      offset += writeU32(buffer + offset, options.maximumPacketSize);
+    }
+  }
+  offset += writeString(buffer + offset, options.clientId != nullptr ? options.clientId : "",
+                        clientIdLength);
+  if (withUsername) {
+    offset += writeString(buffer + offset, options.username, strlen(options.username));
+  }
+  if (withPassword) {
+    offset += writeString(buffer + offset, options.password, strlen(options.password));
+  }
+  return offset;
+}
+
+size_t encodeSubscribe(uint8_t *buffer, size_t capacity, Version version, uint16_t packetId,
+                       const char *const *topics, size_t topicCount, uint8_t qos) {
+  const bool v5 = version == Version::V5;
+  // MQTT 5 adds an empty property block.
+  size_t remaining = v5 ? 2 + 1 : 2;
+  for (size_t i = 0; i < topicCount; ++i) {
+    remaining += 2 + strlen(topics[i]) + 1;
+  }
+
+  // SUBSCRIBE carries the reserved flag bits 0b0010.
+  size_t offset = beginPacket(buffer, capacity, (PACKET_SUBSCRIBE << 4) | 0x02, remaining);
+  if (offset == 0) {
+    return 0;
+  }
+
+  offset += writeU16(buffer + offset, packetId);
+  if (v5) {
+    buffer[offset++] = 0;
+  }
+  for (size_t i = 0; i < topicCount; ++i) {
+    offset += writeString(buffer + offset, topics[i], strlen(topics[i]));
+    buffer[offset++] = qos;
+  }
+  return offset;
+}
+
+size_t encodeUnsubscribe(uint8_t *buffer, size_t capacity, Version version, uint16_t packetId,
+                         const char *topic) {
+  const bool v5 = version == Version::V5;
+  const size_t topicLength = strlen(topic);
+  const size_t remaining = 2 + (v5 ? 1 : 0) + 2 + topicLength;
+  // UNSUBSCRIBE carries the same reserved flag bits as SUBSCRIBE.
+  size_t offset = beginPacket(buffer, capacity, (PACKET_UNSUBSCRIBE << 4) | 0x02, remaining);
+  if (offset == 0) {
+    return 0;
+  }
+
+  offset += writeU16(buffer + offset, packetId);
+  if (v5) {
+    buffer[offset++] = 0;
+  }
+  offset += writeString(buffer + offset, topic, topicLength);
+  return offset;
+}
+
+size_t encodePublish(uint8_t *buffer, size_t capacity, const char *topic, const uint8_t *payload,
+                     size_t length, uint8_t qos, uint16_t packetId, bool retain) {
+  const size_t topicLength = strlen(topic);
+  const size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+  const uint8_t flags = static_cast<uint8_t>((qos & 0x03) << 1) | (retain ? 0x01 : 0x00);
+
+  size_t offset = beginPacket(buffer, capacity, (PACKET_PUBLISH << 4) | flags, remaining);
+  if (offset == 0) {
+    return 0;
+  }
+
+  offset += writeString(buffer + offset, topic, topicLength);
+  if (qos > 0) {
+    offset += writeU16(buffer + offset, packetId);
+  }
+  if (length > 0) {
+    memcpy(buffer + offset, payload, length);
+    offset += length;
+  }
+  return offset;
+}
+
+size_t encodePublish5(uint8_t *buffer, size_t capacity, const char *topic,
+                      const PublishProperties &properties, const uint8_t *payload, size_t length,
+                      uint8_t qos, uint16_t packetId, bool retain) {
+  const size_t topicLength = strlen(topic);
+  const size_t propertyLength = (properties.topicAlias != 0 ? 1 + 2 : 0) +
+                                (properties.messageExpirySeconds != 0 ? 1 + 4 : 0);
+  const size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) +
+                           remainingLengthSize(propertyLength) + propertyLength + length;
+  const uint8_t flags = static_cast<uint8_t>((qos & 0x03) << 1) | (retain ? 0x01 : 0x00);
+
+  size_t offset = beginPacket(buffer, capacity, (PACKET_PUBLISH << 4) | flags, remaining);
+  if (offset == 0) {
+    return 0;
+  }
+
+  offset += writeString(buffer + offset, topic, topicLength);
+  if (qos > 0) {
+    offset += writeU16(buffer + offset, packetId);
+  }
+  offset += writeRemainingLength(buffer + offset, propertyLength);
+  if (properties.messageExpirySeconds != 0) {
+    buffer[offset++] = PROPERTY_MESSAGE_EXPIRY;
+    offset += writeU32(buffer + offset, properties.messageExpirySeconds);
+  }
+  if (properties.topicAlias != 0) {
+    buffer[offset++] = PROPERTY_TOPIC_ALIAS;
+    offset += writeU16(buffer + offset, properties.topicAlias);
+  }
+  if (length > 0) {
+    memcpy(buffer + offset, payload, length);
+    offset += length;
+  }
+  return offset;
+}
+
+size_t encodePubAck(uint8_t *buffer, size_t capacity, uint16_t packetId) {
+  size_t offset = beginPacket(buffer, capacity, PACKET_PUBACK << 4, 2);
+  if (offset == 0) {
+    return 0;
+  }
+  return offset + writeU16(buffer + offset, packetId);
+}
+
+size_t encodePingReq(uint8_t *buffer, size_t capacity) {
+  return beginPacket(buffer, capacity, PACKET_PINGREQ << 4, 0);
+}
+
+size_t encodeDisconnect(uint8_t *buffer, size_t capacity) {
+  return beginPacket(buffer, capacity, PACKET_DISCONNECT << 4, 0);
+}
+
+DecodeResult decodeHeader(const uint8_t *buffer, size_t length, PacketHeader *out) {
+  if (length < 2) {
+    return DecodeResult::Incomplete;
+  }
+
+  size_t remaining = 0;
+  size_t multiplier = 1;
+  size_t index = 1;
+  while (true) {
+    if (index > MAX_REMAINING_LENGTH_BYTES) {
+      return DecodeResult::Malformed;
+    }
+    if (index >= length) {
+      return DecodeResult::Incomplete;
+    }
+    const uint8_t encoded = buffer[index++];
+    remaining += static_cast<size_t>(encoded & 0x7F) * multiplier;
+    if ((encoded & 0x80) == 0) {
+      break;
+    }
+    multiplier *= 128;
+  }
+
+  out->type = buffer[0] >> 4;
+  out->flags = buffer[0] & 0x0F;
+  out->remainingLength = remaining;
+  out->headerLength = index;
+  return DecodeResult::Complete;
+}
+
+bool decodePublish(const PacketHeader &header, const uint8_t *body, Version version, Publish *out) {
+  if (header.type != PACKET_PUBLISH || header.remainingLength < 2) {
+    return false;
+  }
+
+  const size_t topicLength = readU16(body);
+  const uint8_t qos = (header.flags >> 1) & 0x03;
+  size_t offset = 2 + topicLength;
+  if (qos > 0) {
+    offset += 2;
+  }
+  if (qos > 2 || offset > header.remainingLength) {
+    return false;
+  }
+
+  Properties properties{};
+  if (version == Version::V5) {
+    const size_t remaining = header.remainingLength - offset;
+    const size_t taken = readProperties(body + offset, remaining, &properties);
+    if (taken == 0) {
+      return false;
+    }
+    offset += taken;
+  }
+
+  out->topic = reinterpret_cast<const char *>(body + 2);
+  out->topicLength = topicLength;
+  out->qos = qos;
+  out->retain = (header.flags & 0x01) != 0;
+  out->packetId = qos > 0 ? readU16(body + 2 + topicLength) : 0;
+  out->topicAlias = properties.topicAlias;
+  out->payload = body + offset;
+  out->payloadLength = header.remainingLength - offset;
+  return true;
+}
+
+bool decodeConnack(const uint8_t *body, size_t length, Version version, Connack *out) {
+  if (length < 2) {
+    return false;
+  }
+  *out = Connack{};
+  out->sessionPresent = (body[0] & 0x01) != 0;
+  out->reasonCode = body[1];
+  if (version != Version::V5 || length == 2) {
+    return true;
+  }
+
+  Properties properties{};
+  if (readProperties(body + 2, length - 2, &properties) == 0) {
+    return false;
+  }
+  out->topicAliasMaximum = properties.topicAliasMaximum;
+  out->serverKeepAliveSeconds = properties.serverKeepAlive;
+  return true;
+}
+
+bool decodeSuback(const uint8_t *body, size_t length, Version version, Suback *out) {
+  if (length < 2) {
+    return false;
+  }
+  size_t offset = 2;
+  if (version == Version::V5) {
+    Properties ignored{};
+    const size_t taken = readProperties(body + offset, length - offset, &ignored);
+    if (taken == 0) {
+      return false;
+    }
+    offset += taken;
+  }
+  out->packetId = readU16(body);
+  out->reasonCodes = body + offset;
+  out->reasonCodeCount = length - offset;
+  return true;
+}
+
+}  // namespace net::codec
@@ -0,0 +1,219 @@
+#include "net/socket.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "lwip/dns.h"
+#include "lwip/ip_addr.h"
+#include "lwip/sockets.h"
+#include "lwip/tcpip.h"
+
+namespace net {
+namespace {
+constexpr size_t DNS_SLOT_COUNT = 4;
+
+enum DnsState : uint8_t { DNS_FREE, DNS_PENDING, DNS_DONE, DNS_FAILED, DNS_ABANDONED };
+
+// lwIP may deliver a DNS answer long after the caller gave up on it, so each
+// lookup owns a slot that is only recycled once its callback has fired. The
+// host name is copied in because the lookup starts later, on the tcpip
+// thread.
+struct DnsSlot {
+  std::atomic<uint8_t> state{DNS_FREE};
+  uint32_t address = 0;
+  char host[65];
+};
+
+DnsSlot g_dnsSlots[DNS_SLOT_COUNT];
+
+int acquireDnsSlot() {
+  for (size_t i = 0; i < DNS_SLOT_COUNT; ++i) {
+    uint8_t expected = DNS_FREE;
+    if (g_dnsSlots[i].state.compare_exchange_strong(expected, DNS_PENDING)) {
+      g_dnsSlots[i].address = 0;
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+void onDnsFound(const char *name, const ip_addr_t *address, void *arg) {
+  (void)name;
+  DnsSlot *slot = static_cast<DnsSlot *>(arg);
+  if (address != nullptr && IP_IS_V4(address)) {
+    slot->address = ip_2_ip4(address)->addr;
+  }
+
+  uint8_t expected = DNS_PENDING;
+  const uint8_t result = address != nullptr ? DNS_DONE : DNS_FAILED;
+  if (!slot->state.compare_exchange_strong(expected, result)) {
+    // The owner timed out and left; nobody will read this answer.
+    slot->state.store(DNS_FREE);
+  }
+}
+
+// Runs on the tcpip thread: lwIP's DNS client is not thread safe and must not
+// be called from the loop task.
+void startLookup(void *arg) {
+  DnsSlot *slot = static_cast<DnsSlot *>(arg);
+  ip_addr_t resolved;
+  const err_t err = dns_gethostbyname_addrtype(slot->host, &resolved, onDnsFound, slot,
+                                               LWIP_DNS_ADDRTYPE_IPV4);
+  if (err == ERR_OK) {
+    // Literal address or cache hit: no callback will follow.
+    onDnsFound(slot->host, &resolved, slot);
+  } else if (err != ERR_INPROGRESS) {
+    onDnsFound(slot->host, nullptr, slot);
+  }
+}
+
+}  // namespace
+
+bool Socket::beginResolve(const char *host) {
+  close();
+  releaseDnsSlot();
+
+  dnsSlot_ = acquireDnsSlot();
+  if (dnsSlot_ < 0) {
+    return false;
+  }
+
+  DnsSlot &slot = g_dnsSlots[dnsSlot_];
+  const size_t length = strlen(host);
+  if (length >= sizeof(slot.host)) {
+    slot.state.store(DNS_FAILED);
+    return true;
+  }
+  memcpy(slot.host, host, length + 1);
+  if (tcpip_callback(startLookup, &slot) != ERR_OK) {
+    slot.state.store(DNS_FAILED);
+  }
+  return true;
+}
+
+Socket::Progress Socket::pollResolve() {
+  if (dnsSlot_ < 0) {
+    return Progress::Failed;
+  }
+
+  DnsSlot &slot = g_dnsSlots[dnsSlot_];
+  switch (slot.state.load()) {
+    case DNS_PENDING:
+      return Progress::Pending;
+    case DNS_DONE:
+      address_ = slot.address;
+      releaseDnsSlot();
+      return Progress::Done;
+    default:
+      releaseDnsSlot();
+      return Progress::Failed;
+  }
+}
+
+bool Socket::beginConnect(uint16_t port) {
+  close();
+
+  fd_ = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  const int flags = lwip_fcntl(fd_, F_GETFL, 0);
+  lwip_fcntl(fd_, F_SETFL, flags | O_NONBLOCK);
+  const int noDelay = 1;
+  lwip_setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+  sockaddr_in target{};
+  target.sin_family = AF_INET;
+  target.sin_port = htons(port);
+  target.sin_addr.s_addr = address_;
+
+  if (lwip_connect(fd_, reinterpret_cast<sockaddr *>(&target), sizeof(target)) == 0) {
+    return true;
+  }
+  if (errno != EINPROGRESS) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+Socket::Progress Socket::pollConnect() {
+  if (fd_ < 0) {
+    return Progress::Failed;
+  }
+
+  fd_set writable;
+  FD_ZERO(&writable);
+  FD_SET(fd_, &writable);
+  timeval noWait{0, 0};
+  const int ready = lwip_select(fd_ + 1, nullptr, &writable, nullptr, &noWait);
+  if (ready == 0) {
+    return Progress::Pending;
+  }
+  if (ready < 0) {
+    return Progress::Failed;
+  }
+
+  int error = 0;
+  socklen_t length = sizeof(error);
+  if (lwip_getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+    return Progress::Failed;
+  }
+  return Progress::Done;
+}
+
+int Socket::read(uint8_t *buffer, size_t size) {
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  const int received = lwip_recv(fd_, buffer, size, MSG_DONTWAIT);
+  if (received > 0) {
+    return received;
+  }
+  if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return 0;
+  }
+  return -1;
+}
+
+int Socket::write(const uint8_t *data, size_t length) {
+  if (fd_ < 0) {
+    return -1;
+  }
+
+  const int sent = lwip_send(fd_, data, length, MSG_DONTWAIT);
+  if (sent >= 0) {
+    return sent;
+  }
+  if (errno == EAGAIN || errno == EWOULDBLOCK) {
+    return 0;
+  }
+  return -1;
+}
+
+void Socket::close() {
+  if (fd_ >= 0) {
+    lwip_close(fd_);
+    fd_ = -1;
+  }
+}
+
+void Socket::releaseDnsSlot() {
+  if (dnsSlot_ < 0) {
+    return;
+  }
+
+  DnsSlot &slot = g_dnsSlots[dnsSlot_];
+  uint8_t expected = DNS_PENDING;
+  if (!slot.state.compare_exchange_strong(expected, DNS_ABANDONED)) {
+    slot.state.store(DNS_FREE);
+  }
+  dnsSlot_ = -1;
+}
+
+}  // namespace net
@@ -0,0 +1,113 @@
+#include "net/state_stream.h"
+
+namespace net {
+namespace {
+constexpr size_t MAX_VARINT = 5;
+
+size_t varintLength(uint32_t value) {
+  size_t length = 1;
+  while (value > 0x7F) {
+    value >>= 7;
+    ++length;
+  }
+  return length;
+}
+}  // namespace
+
+void StateEncoder::begin(uint8_t *buffer, size_t capacity, size_t channels, uint16_t periodMs,
+                         uint32_t startMs, uint32_t sequence) {
+  buffer_ = buffer;
+  capacity_ = capacity;
+  length_ = 0;
+  channels_ = channels < MAX_CHANNELS ? channels : MAX_CHANNELS;
+  samples_ = 0;
+  run_ = 0;
+  if (capacity_ == 0) {
+    return;
+  }
+  buffer_[length_++] = VERSION;
+  putVarint(static_cast<uint32_t>(channels_));
+  putVarint(periodMs);
+  putVarint(startMs);
+  putVarint(sequence);
+}
+
+bool StateEncoder::putVarint(uint32_t value) {
+  if (capacity_ - length_ < varintLength(value)) {
+    return false;
+  }
+  while (value > 0x7F) {
+    buffer_[length_++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  buffer_[length_++] = static_cast<uint8_t>(value);
+  return true;
+}
+
+bool StateEncoder::flushRun() {
+  if (run_ == 0) {
+    return true;
+  }
+  if (!putVarint((run_ << 1) | 1)) {
+    return false;
+  }
+  run_ = 0;
+  return true;
+}
+
+bool StateEncoder::add(const int32_t *values) {
+  if (samples_ == 0) {
+    // Keyframe: the header plus every channel in full.
+    if (capacity_ - length_ < channels_ * MAX_VARINT) {
+      return false;
+    }
+    for (size_t i = 0; i < channels_; ++i) {
+      putSigned(values[i]);
+      last_[i] = values[i];
+    }
+    ++samples_;
+    return true;
+  }
+
+  uint32_t mask = 0;
+  size_t changed = 0;
+  for (size_t i = 0; i < channels_; ++i) {
+    if (values[i] != last_[i]) {
+      mask |= 1u << i;
+      ++changed;
+    }
+  }
+  if (mask == 0) {
+    // The pending run is flushed on the next change or in finish(); keep room
+    // for it.
+    if (capacity_ - length_ < MAX_VARINT) {
+      return false;
+    }
+    ++run_;
+    ++samples_;
+    return true;
+  }
+
+  if (capacity_ - length_ < MAX_VARINT * (2 + changed)) {
+    return false;
+  }
+  flushRun();
+  putVarint(mask << 1);
+  for (size_t i = 0; i < channels_; ++i) {
+    if ((mask & (1u << i)) != 0) {
+      // Wrapping difference, so any pair of values has a delta.
+      putSigned(static_cast<int32_t>(static_cast<uint32_t>(values[i]) -
+                                     static_cast<uint32_t>(last_[i])));
+      last_[i] = values[i];
+    }
+  }
+  ++samples_;
+  return true;
+}
+
+size_t StateEncoder::finish() {
+  flushRun();
+  return length_;
+}
+
+}  // namespace net
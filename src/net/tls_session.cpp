@@ -0,0 +1,314 @@
+#include "net/tls_session.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/version.h"
+
+namespace net {
+namespace {
+constexpr char DRBG_PERSONALIZATION[] = "comm-robot-mqtt";
+constexpr size_t PIN_BYTES = 32;
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// mbedTLS 3 renamed the int-returning one-shot hash back to mbedtls_sha256();
+// in 2.x that name is the deprecated void version.
+int sha256(const unsigned char *data, size_t length, uint8_t (&digest)[PIN_BYTES]) {
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+  return mbedtls_sha256(data, length, digest, 0);
+#else
+  return mbedtls_sha256_ret(data, length, digest, 0);
+#endif
+}
+
+// Accepts 64 hex digits, optionally separated by ':' as openssl prints them.
+bool parsePin(const char *text, uint8_t (&out)[PIN_BYTES]) {
+  size_t count = 0;
+  for (const char *p = text; *p != '\0'; ++p) {
+    if (*p == ':') {
+      continue;
+    }
+    const int high = hexValue(p[0]);
+    const int low = p[1] != '\0' ? hexValue(p[1]) : -1;
+    if (high < 0 || low < 0 || count >= PIN_BYTES) {
+      return false;
+    }
+    out[count++] = static_cast<uint8_t>((high << 4) | low);
+    ++p;
+  }
+  return count == PIN_BYTES;
+}
+
+}  // namespace
+
+TlsSession::TlsSession() {
+  mbedtls_ssl_init(&ssl_);
+  mbedtls_ssl_session_init(&cachedSession_);
+  sessionHost_[0] = '\0';
+}
+
+TlsSession::~TlsSession() {
+  close();
+  forgetSession();
+  releaseConfig();
+}
+
+bool TlsSession::configure(const TlsOptions &options) {
+  uint8_t pin[PIN_BYTES] = {};
+  const bool hasPin = options.pinSha256 != nullptr && options.pinSha256[0] != '\0';
+  if (hasPin && !parsePin(options.pinSha256, pin)) {
+    return false;
+  }
+
+  const bool unchanged = configured_ && configuredCa_ == options.caPem && hasPin == hasPin_ &&
+                         memcmp(pin, pin_, sizeof(pin_)) == 0;
+  if (unchanged) {
+    return true;
+  }
+
+  // New trust settings: a session negotiated under the old ones must not be
+  // resumed, since resumption skips certificate checks.
+  forgetSession();
+  releaseConfig();
+
+  mbedtls_ssl_config_init(&config_);
+  mbedtls_ctr_drbg_init(&drbg_);
+  mbedtls_entropy_init(&entropy_);
+  mbedtls_x509_crt_init(&ca_);
+  configured_ = true;
+
+  hasCa_ = options.caPem != nullptr && options.caPem[0] != '\0';
+  hasPin_ = hasPin;
+  memcpy(pin_, pin, sizeof(pin_));
+  configuredCa_ = options.caPem;
+  if (!hasCa_ && !hasPin_) {
+    // Refuse rather than silently talk to whoever answers.
+    releaseConfig();
+    return false;
+  }
+
+  if (mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_,
+                            reinterpret_cast<const unsigned char *>(DRBG_PERSONALIZATION),
+                            sizeof(DRBG_PERSONALIZATION) - 1) != 0 ||
+      mbedtls_ssl_config_defaults(&config_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                  MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+    releaseConfig();
+    return false;
+  }
+
+  if (hasCa_) {
+    if (mbedtls_x509_crt_parse(&ca_, reinterpret_cast<const unsigned char *>(options.caPem),
+                               strlen(options.caPem) + 1) != 0) {
+      releaseConfig();
+      return false;
+    }
+    mbedtls_ssl_conf_ca_chain(&config_, &ca_, nullptr);
+    mbedtls_ssl_conf_authmode(&config_, MBEDTLS_SSL_VERIFY_REQUIRED);
+  } else {
+    // Pin only: the chain cannot be verified, so the pin alone decides.
+    mbedtls_ssl_conf_authmode(&config_, MBEDTLS_SSL_VERIFY_OPTIONAL);
+  }
+
+  mbedtls_ssl_conf_rng(&config_, mbedtls_ctr_drbg_random, &drbg_);
+  mbedtls_ssl_conf_verify(&config_, verifyCallback, this);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_conf_session_tickets(&config_, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+  return true;
+}
+
+void TlsSession::releaseConfig() {
+  if (!configured_) {
+    return;
+  }
+  mbedtls_x509_crt_free(&ca_);
+  mbedtls_entropy_free(&entropy_);
+  mbedtls_ctr_drbg_free(&drbg_);
+  mbedtls_ssl_config_free(&config_);
+  configured_ = false;
+  configuredCa_ = nullptr;
+}
+
+bool TlsSession::begin(Socket *socket, const char *host, const TlsOptions &options) {
+  close();
+  if (socket == nullptr || !configure(options)) {
+    return false;
+  }
+
+  if (strncmp(sessionHost_, host, sizeof(sessionHost_)) != 0) {
+    forgetSession();
+    strncpy(sessionHost_, host, sizeof(sessionHost_) - 1);
+    sessionHost_[sizeof(sessionHost_) - 1] = '\0';
+  }
+
+  mbedtls_ssl_init(&ssl_);
+  if (mbedtls_ssl_setup(&ssl_, &config_) != 0 || mbedtls_ssl_set_hostname(&ssl_, host) != 0) {
+    mbedtls_ssl_free(&ssl_);
+    return false;
+  }
+  socket_ = socket;
+  mbedtls_ssl_set_bio(&ssl_, this, sendCallback, recvCallback, nullptr);
+
+  offeredSession_ = hasCachedSession_ && mbedtls_ssl_set_session(&ssl_, &cachedSession_) == 0;
+  certificateSeen_ = false;
+  pinMatched_ = false;
+  wantWrite_ = false;
+  pendingWrite_ = 0;
+  active_ = true;
+  handshakeStartMs_ = millis();
+  return true;
+}
+
+Socket::Progress TlsSession::pollHandshake() {
+  if (!active_) {
+    return Socket::Progress::Failed;
+  }
+
+  // Each call runs until the next record is needed; the key exchange math of
+  // a full handshake happens inside one of these calls.
+  const int result = mbedtls_ssl_handshake(&ssl_);
+  wantWrite_ = result == MBEDTLS_ERR_SSL_WANT_WRITE;
+  if (result == MBEDTLS_ERR_SSL_WANT_READ || result == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    return Socket::Progress::Pending;
+  }
+  if (result != 0) {
+    forgetSession();
+    return Socket::Progress::Failed;
+  }
+
+  // A resumed handshake never carries a certificate: it was checked when the
+  // cached session was first negotiated.
+  const bool resumed = offeredSession_ && !certificateSeen_;
+  if (!resumed && hasPin_ && !pinMatched_) {
+    forgetSession();
+    return Socket::Progress::Failed;
+  }
+
+  const uint32_t elapsedMs = millis() - handshakeStartMs_;
+  stats_.lastResumed = resumed;
+  if (resumed) {
+    ++stats_.resumedHandshakes;
+    stats_.lastResumedMs = elapsedMs;
+  } else {
+    ++stats_.fullHandshakes;
+    stats_.lastFullMs = elapsedMs;
+  }
+
+  mbedtls_ssl_session_free(&cachedSession_);
+  mbedtls_ssl_session_init(&cachedSession_);
+  hasCachedSession_ = mbedtls_ssl_get_session(&ssl_, &cachedSession_) == 0;
+  return Socket::Progress::Done;
+}
+
+int TlsSession::read(uint8_t *buffer, size_t size) {
+  if (!active_) {
+    return -1;
+  }
+
+  const int result = mbedtls_ssl_read(&ssl_, buffer, size);
+  if (result > 0) {
+    return result;
+  }
+  if (result == MBEDTLS_ERR_SSL_WANT_READ || result == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    return 0;
+  }
+  return -1;
+}
+
+int TlsSession::write(const uint8_t *data, size_t length) {
+  if (!active_) {
+    return -1;
+  }
+
+  // After WANT_WRITE mbedTLS holds an encrypted record and reports the
+  // caller's length once it drains, so it must be retried with exactly the
+  // length it was first given.
+  const size_t chunk = pendingWrite_ != 0 ? pendingWrite_ : length;
+  const int result = mbedtls_ssl_write(&ssl_, data, chunk);
+  if (result >= 0) {
+    pendingWrite_ = 0;
+    wantWrite_ = false;
+    return result;
+  }
+  if (result == MBEDTLS_ERR_SSL_WANT_WRITE || result == MBEDTLS_ERR_SSL_WANT_READ) {
+    pendingWrite_ = chunk;
+    wantWrite_ = result == MBEDTLS_ERR_SSL_WANT_WRITE;
+    return 0;
+  }
+  return -1;
+}
+
+bool TlsSession::hasBufferedInput() { return active_ && mbedtls_ssl_get_bytes_avail(&ssl_) > 0; }
+
+void TlsSession::close() {
+  if (!active_) {
+    return;
+  }
+  // Best effort, like the MQTT DISCONNECT before it.
+  mbedtls_ssl_close_notify(&ssl_);
+  mbedtls_ssl_free(&ssl_);
+  socket_ = nullptr;
+  active_ = false;
+  wantWrite_ = false;
+  pendingWrite_ = 0;
+}
+
+void TlsSession::forgetSession() {
+  if (!hasCachedSession_) {
+    return;
+  }
+  mbedtls_ssl_session_free(&cachedSession_);
+  mbedtls_ssl_session_init(&cachedSession_);
+  hasCachedSession_ = false;
+}
+
+int TlsSession::sendCallback(void *context, const unsigned char *data, size_t length) {
+  TlsSession *self = static_cast<TlsSession *>(context);
+  const int sent = self->socket_->write(data, length);
+  if (sent == 0) {
+    return MBEDTLS_ERR_SSL_WANT_WRITE;
+  }
+  return sent > 0 ? sent : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+int TlsSession::recvCallback(void *context, unsigned char *buffer, size_t size) {
+  TlsSession *self = static_cast<TlsSession *>(context);
+  const int received = self->socket_->read(buffer, size);
+  if (received == 0) {
+    return MBEDTLS_ERR_SSL_WANT_READ;
+  }
+  return received > 0 ? received : MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+int TlsSession::verifyCallback(void *context, mbedtls_x509_crt *certificate, int depth,
+                               uint32_t *flags) {
+  (void)flags;
+  TlsSession *self = static_cast<TlsSession *>(context);
+  self->certificateSeen_ = true;
+  if (!self->hasPin_ || self->pinMatched_) {
+    return 0;
+  }
+
+  // Without a trust anchor only the leaf can be pinned: anyone can append a
+  // copy of a CA certificate to the chain they present.
+  if (depth != 0 && !self->hasCa_) {
+    return 0;
+  }
+
+  uint8_t digest[PIN_BYTES];
+  if (sha256(certificate->raw.p, certificate->raw.len, digest) == 0 &&
+      memcmp(digest, self->pin_, sizeof(digest)) == 0) {
+    self->pinMatched_ = true;
+  }
+  return 0;
+}
+
+}  // namespace net
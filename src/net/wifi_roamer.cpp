@@ -0,0 +1,169 @@
+#include "net/wifi_roamer.h"
+
+#include <string.h>
+
+namespace net {
+namespace {
+constexpr int32_t RSSI_SCALE = 16;
+
+bool sameBssid(const uint8_t *a, const uint8_t *b) { return memcmp(a, b, 6) == 0; }
+}  // namespace
+
+WifiRoamer::WifiRoamer(const Config &config) : config_(config) { reset(); }
+
+void WifiRoamer::reset() {
+  memset(cache_, 0, sizeof(cache_));
+  memset(current_, 0, sizeof(current_));
+  haveRssi_ = false;
+  connected_ = false;
+  scanInFlight_ = false;
+  roamed_ = false;
+  scanCount_ = 0;
+  scanCursor_ = 0;
+}
+
+void WifiRoamer::onConnected(const uint8_t bssid[6], uint32_t now) {
+  memcpy(current_, bssid, sizeof(current_));
+  connected_ = true;
+  haveRssi_ = false;
+  // Give the new link a full scan interval before judging it.
+  lastScanMs_ = now;
+}
+
+void WifiRoamer::onDisconnected() {
+  connected_ = false;
+  haveRssi_ = false;
+}
+
+void WifiRoamer::onRssi(int8_t rssi, uint32_t now) {
+  const int32_t sample = static_cast<int32_t>(rssi) * RSSI_SCALE;
+  rssiQ4_ = haveRssi_ ? rssiQ4_ + (sample - rssiQ4_) / 4 : sample;
+  haveRssi_ = true;
+
+  Entry *entry = find(current_);
+  if (entry != nullptr) {
+    entry->ap.rssi = smoothedRssi();
+    entry->seenMs = now;
+  }
+}
+
+void WifiRoamer::onScanResult(const AccessPoint &ap, uint32_t now) {
+  Entry *entry = find(ap.bssid);
+  if (entry == nullptr) {
+    // Replace a free slot, else the entry seen longest ago.
+    entry = &cache_[0];
+    for (Entry &candidate : cache_) {
+      if (!candidate.used) {
+        entry = &candidate;
+        break;
+      }
+      if (static_cast<int32_t>(candidate.seenMs - entry->seenMs) < 0) {
+        entry = &candidate;
+      }
+    }
+  }
+  entry->ap = ap;
+  entry->seenMs = now;
+  entry->used = true;
+}
+
+void WifiRoamer::onScanDone(uint32_t now) {
+  scanInFlight_ = false;
+  lastScanMs_ = now;
+}
+
+WifiRoamer::Decision WifiRoamer::poll(uint32_t now) {
+  Decision decision{};
+  if (!connected_ || !haveRssi_ || scanInFlight_) {
+    return decision;
+  }
+  if (smoothedRssi() >= config_.weakRssiDbm) {
+    return decision;
+  }
+
+  AccessPoint candidate{};
+  const bool roamAllowed = !roamed_ || (now - lastRoamMs_) >= config_.minRoamIntervalMs;
+  if (roamAllowed && bestCandidate(now, &candidate) &&
+      candidate.rssi >= smoothedRssi() + config_.hysteresisDb) {
+    decision.action = Action::Roam;
+    decision.target = candidate;
+    lastRoamMs_ = now;
+    roamed_ = true;
+    ++stats_.roams;
+    return decision;
+  }
+
+  if ((now - lastScanMs_) >= config_.scanIntervalMs) {
+    decision.action = Action::Scan;
+    decision.channel = nextScanChannel(now);
+    scanInFlight_ = true;
+    if (decision.channel == 0) {
+      ++stats_.fullScans;
+    } else {
+      ++stats_.channelScans;
+    }
+  }
+  return decision;
+}
+
+bool WifiRoamer::bestCandidate(uint32_t now, AccessPoint *out) const {
+  const Entry *best = nullptr;
+  for (const Entry &entry : cache_) {
+    if (!entry.used || (now - entry.seenMs) > config_.cacheTtlMs) {
+      continue;
+    }
+    if (connected_ && sameBssid(entry.ap.bssid, current_)) {
+      continue;
+    }
+    // Equal signal goes to the higher priority network.
+    if (best == nullptr || entry.ap.rssi > best->ap.rssi ||
+        (entry.ap.rssi == best->ap.rssi && entry.ap.slot < best->ap.slot)) {
+      best = &entry;
+    }
+  }
+  if (best == nullptr) {
+    return false;
+  }
+  *out = best->ap;
+  return true;
+}
+
+int8_t WifiRoamer::smoothedRssi() const {
+  if (!haveRssi_) {
+    return -127;
+  }
+  return static_cast<int8_t>(rssiQ4_ / RSSI_SCALE);
+}
+
+WifiRoamer::Entry *WifiRoamer::find(const uint8_t bssid[6]) {
+  for (Entry &entry : cache_) {
+    if (entry.used && sameBssid(entry.ap.bssid, bssid)) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+// Probes the channel of one cached access point per scan, round robin, so the
+// radio leaves the serving channel for a single dwell at a time. With nothing
+// worth a dwell cached, or every `fullScanEvery` scans, the whole band is
+// swept to find new access points. An entry past its TTL, or last heard no
+// stronger than the current link, is not worth a dwell.
+uint8_t WifiRoamer::nextScanChannel(uint32_t now) {
+  ++scanCount_;
+  if (config_.fullScanEvery != 0 && scanCount_ >= config_.fullScanEvery) {
+    scanCount_ = 0;
+    return 0;
+  }
+  for (size_t step = 0; step < CACHE_SIZE; ++step) {
+    const Entry &entry = cache_[(scanCursor_ + step) % CACHE_SIZE];
+    if (entry.used && (now - entry.seenMs) <= config_.cacheTtlMs &&
+        entry.ap.rssi > smoothedRssi() && !sameBssid(entry.ap.bssid, current_)) {
+      scanCursor_ = (scanCursor_ + step + 1) % CACHE_SIZE;
+      return entry.ap.channel;
+    }
+  }
+  scanCount_ = 0;
+  return 0;
+}
+}  // namespace net
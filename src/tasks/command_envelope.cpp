@@ -0,0 +1,103 @@
+#include "tasks/command_envelope.h"
+
+#include <string.h>
+
+namespace tasks::envelope {
+namespace {
+constexpr char ENVELOPE_MARKER = '@';
+constexpr char ENVELOPE_END = ';';
+constexpr char FIELD_SEPARATOR = ',';
+
+bool parseUnsigned(const char *begin, const char *end, uint32_t *out) {
+  if (begin == end) {
+    return false;
+  }
+
+  uint32_t value = 0;
+  for (const char *p = begin; p < end; ++p) {
+    if (*p < '0' || *p > '9') {
+      return false;
+    }
+    value = value * 10 + static_cast<uint32_t>(*p - '0');
+  }
+  *out = value;
+  return true;
+}
+
+bool keyEquals(const char *begin, const char *end, const char *key) {
+  const size_t length = static_cast<size_t>(end - begin);
+  return strlen(key) == length && strncmp(begin, key, length) == 0;
+}
+
+bool applyField(const char *begin, const char *end, CommandEnvelope *out) {
+  const char *eq = static_cast<const char *>(memchr(begin, '=', static_cast<size_t>(end - begin)));
+  if (eq == nullptr) {
+    return false;
+  }
+
+  uint32_t value = 0;
+  if (!parseUnsigned(eq + 1, end, &value)) {
+    return false;
+  }
+
+  if (keyEquals(begin, eq, "id")) {
+    out->id = value;
+    out->hasId = true;
+  } else if (keyEquals(begin, eq, "ts")) {
+    out->senderTs = value;
+    out->hasSenderTs = true;
+  } else if (keyEquals(begin, eq, "src")) {
+    out->sourceId = value;
+  } else if (keyEquals(begin, eq, "seq")) {
+    out->sequence = value;
+    out->hasSequence = true;
+  } else if (keyEquals(begin, eq, "age")) {
+    out->maxAgeMs = value;
+    out->hasMaxAge = true;
+  } else if (keyEquals(begin, eq, "at")) {
+    out->executeAtMs = value;
+    out->hasExecuteAt = true;
+  }
+  // Unknown fields are skipped so newer controllers stay compatible.
+  return true;
+}
+
+}  // namespace
+
+bool parse(const char *payload, size_t length, CommandEnvelope *out) {
+  if (payload == nullptr || out == nullptr) {
+    return false;
+  }
+
+  *out = CommandEnvelope{};
+  out->body = payload;
+  out->bodyLength = length;
+
+  if (length == 0 || payload[0] != ENVELOPE_MARKER) {
+    return true;
+  }
+
+  const char *end = static_cast<const char *>(memchr(payload, ENVELOPE_END, length));
+  if (end == nullptr) {
+    return false;
+  }
+
+  const char *field = payload + 1;
+  while (field < end) {
+    const char *fieldEnd =
+        static_cast<const char *>(memchr(field, FIELD_SEPARATOR, static_cast<size_t>(end - field)));
+    if (fieldEnd == nullptr) {
+      fieldEnd = end;
+    }
+    if (!applyField(field, fieldEnd, out)) {
+      return false;
+    }
+    field = fieldEnd + 1;
+  }
+
+  out->body = end + 1;
+  out->bodyLength = length - static_cast<size_t>(out->body - payload);
+  return true;
+}
+
+}  // namespace tasks::envelope
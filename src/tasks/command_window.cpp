@@ -0,0 +1,144 @@
+#include "tasks/command_window.h"
+
+#include <stddef.h>
+
+namespace tasks::command_window {
+namespace {
+constexpr size_t SOURCE_SLOTS = 4;
+constexpr uint32_t WINDOW_BITS = 32;
+// A source silent for this long (controller restart, link outage) starts a
+// fresh window instead of having every new command rejected as stale.
+constexpr uint32_t SOURCE_IDLE_RESET_MS = 10000;
+// The clock baseline creeps up by 1 ms per interval (100 ppm), faster than
+// two crystals drift apart, so a slow sender clock never reads as growing
+// delay.
+constexpr uint32_t BASELINE_AGE_INTERVAL_MS = 10000;
+
+struct SourceWindow {
+  uint32_t sourceId;
+  uint32_t highestSeq;
+  uint32_t seenMask;  // bit i set: highestSeq - i was accepted
+  uint32_t lastSeenMs;
+  // Smallest (local - sender) clock difference observed; the excess over it
+  // is how long a command spent in flight beyond the best case.
+  int32_t offsetBaseline;
+  uint32_t baselineAgedMs;
+  bool hasBaseline;
+  bool inUse;
+};
+
+SourceWindow g_windows[SOURCE_SLOTS];
+Counters g_counters{};
+
+SourceWindow &windowFor(uint32_t sourceId, uint32_t nowMs) {
+  SourceWindow *oldest = &g_windows[0];
+  for (SourceWindow &window : g_windows) {
+    if (window.inUse && window.sourceId == sourceId) {
+      if ((nowMs - window.lastSeenMs) >= SOURCE_IDLE_RESET_MS) {
+        // Only the sequence window starts over. The clock baseline stays:
+        // learnt afresh from the first command after an outage, it would take
+        // the oldest command of the replay burst for the fastest delivery.
+        window.seenMask = 0;
+      }
+      return window;
+    }
+    if (!window.inUse) {
+      oldest = &window;
+    } else if (oldest->inUse && static_cast<int32_t>(window.lastSeenMs - oldest->lastSeenMs) < 0) {
+      oldest = &window;
+    }
+  }
+
+  *oldest = SourceWindow{};
+  oldest->sourceId = sourceId;
+  oldest->inUse = true;
+  return *oldest;
+}
+
+bool isExpired(SourceWindow &window, const envelope::CommandEnvelope &envelope, uint32_t nowMs) {
+  if (!envelope.hasSenderTs) {
+    return false;
+  }
+
+  const int32_t offset = static_cast<int32_t>(nowMs - envelope.senderTs);
+  if (window.hasBaseline) {
+    const uint32_t steps = (nowMs - window.baselineAgedMs) / BASELINE_AGE_INTERVAL_MS;
+    window.offsetBaseline += static_cast<int32_t>(steps);
+    window.baselineAgedMs += steps * BASELINE_AGE_INTERVAL_MS;
+  }
+  if (!window.hasBaseline || offset < window.offsetBaseline) {
+    window.offsetBaseline = offset;
+    window.baselineAgedMs = nowMs;
+    window.hasBaseline = true;
+  }
+  if (!envelope.hasMaxAge) {
+    return false;
+  }
+
+  const uint32_t age = static_cast<uint32_t>(offset - window.offsetBaseline);
+  return age > envelope.maxAgeMs;
+}
+
+Verdict classify(SourceWindow &window, uint32_t sequence) {
+  if (window.seenMask == 0) {
+    window.highestSeq = sequence;
+    window.seenMask = 1;
+    return Verdict::Accept;
+  }
+
+  const int32_t ahead = static_cast<int32_t>(sequence - window.highestSeq);
+  if (ahead > 0) {
+    window.seenMask = static_cast<uint32_t>(ahead) >= WINDOW_BITS ? 0 : window.seenMask << ahead;
+    window.seenMask |= 1;
+    window.highestSeq = sequence;
+    return Verdict::Accept;
+  }
+
+  const uint32_t behind = static_cast<uint32_t>(-ahead);
+  if (behind < WINDOW_BITS && (window.seenMask & (1u << behind)) != 0) {
+    return Verdict::Duplicate;
+  }
+  return Verdict::Stale;
+}
+
+}  // namespace
+
+Verdict check(const envelope::CommandEnvelope &envelope, uint32_t nowMs) {
+  if (!envelope.hasSequence) {
+    ++g_counters.accepted;
+    return Verdict::Accept;
+  }
+
+  SourceWindow &window = windowFor(envelope.sourceId, nowMs);
+  window.lastSeenMs = nowMs;
+  if (window.seenMask == 0 && static_cast<int32_t>(envelope.sequence - window.highestSeq) <= 0) {
+    // Sequence numbers went back across the silence: the controller
+    // restarted, and its clock with it.
+    window.hasBaseline = false;
+  }
+
+  Verdict verdict = classify(window, envelope.sequence);
+  if (verdict == Verdict::Accept && isExpired(window, envelope, nowMs)) {
+    verdict = Verdict::Expired;
+  }
+
+  switch (verdict) {
+    case Verdict::Accept:
+      ++g_counters.accepted;
+      break;
+    case Verdict::Duplicate:
+      ++g_counters.duplicate;
+      break;
+    case Verdict::Stale:
+      ++g_counters.stale;
+      break;
+    case Verdict::Expired:
+      ++g_counters.expired;
+      break;
+  }
+  return verdict;
+}
+
+Counters counters() { return g_counters; }
+
+}  // namespace tasks::command_window
@@ -0,0 +1,75 @@
+#include "tasks/emergency_stop.h"
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "tasks/event_loop.h"
+#include "tasks/message_handler.h"
+#include "tasks/scheduled_commands.h"
+
+namespace tasks::estop {
+namespace {
+// Bit per Origin; set by trigger(), consumed by loop().
+std::atomic<uint32_t> g_pending{0};
+// Bit per Origin; set by trigger(), cleared by endFlush().
+std::atomic<uint32_t> g_flushing{0};
+std::atomic<uint32_t> g_stops{0};
+std::atomic<uint32_t> g_lastLatencyUs{0};
+std::atomic<uint32_t> g_maxLatencyUs{0};
+uint32_t g_flushedCommands = 0;
+
+const char *originName(uint32_t pending) {
+  return (pending & (1u << static_cast<uint8_t>(Origin::EspNow))) != 0 ? "ESP-NOW" : "MQTT";
+}
+}  // namespace
+
+void trigger(Origin origin, uint32_t arrivedUs) {
+  cutMotors();
+  // A command queued with `at=` must not start the motors again once due.
+  tasks::schedule::cancelAll();
+  const uint32_t latencyUs = micros() - arrivedUs;
+
+  g_lastLatencyUs.store(latencyUs, std::memory_order_relaxed);
+  uint32_t max = g_maxLatencyUs.load(std::memory_order_relaxed);
+  while (latencyUs > max &&
+         !g_maxLatencyUs.compare_exchange_weak(max, latencyUs, std::memory_order_relaxed)) {
+  }
+  g_stops.fetch_add(1, std::memory_order_relaxed);
+  g_flushing.fetch_or(1u << static_cast<uint8_t>(origin), std::memory_order_release);
+  g_pending.fetch_or(1u << static_cast<uint8_t>(origin), std::memory_order_release);
+  tasks::event_loop::wake();
+}
+
+bool flushing() { return g_flushing.load(std::memory_order_acquire) != 0; }
+
+bool flushing(Origin origin) {
+  return (g_flushing.load(std::memory_order_acquire) & (1u << static_cast<uint8_t>(origin))) != 0;
+}
+
+void endFlush(Origin origin) {
+  g_flushing.fetch_and(~(1u << static_cast<uint8_t>(origin)), std::memory_order_release);
+}
+
+void noteFlushedCommand() { ++g_flushedCommands; }
+
+void loop() {
+  const uint32_t pending = g_pending.exchange(0, std::memory_order_acquire);
+  if (pending == 0) {
+    return;
+  }
+  haltActuators();
+  Serial.printf("Emergency stop via %s, motors cut in %lu us\n", originName(pending),
+                static_cast<unsigned long>(g_lastLatencyUs.load(std::memory_order_relaxed)));
+}
+
+Stats stats() {
+  Stats snapshot{};
+  snapshot.stops = g_stops.load(std::memory_order_relaxed);
+  snapshot.lastLatencyUs = g_lastLatencyUs.load(std::memory_order_relaxed);
+  snapshot.maxLatencyUs = g_maxLatencyUs.load(std::memory_order_relaxed);
+  snapshot.flushedCommands = g_flushedCommands;
+  return snapshot;
+}
+
+}  // namespace tasks::estop
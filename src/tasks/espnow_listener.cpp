@@ -1,7 +1,6 @@
 #include "tasks/espnow_listener.h"
 
 #include <Arduino.h>
-#include <ctype.h>
 #include <string.h>
 
 #if defined(ESP8266)
@@ -15,52 +14,14 @@ extern "C" {
 #endif
 
 #include "config/provisioning_store.h"
+#include "tasks/emergency_stop.h"
+#include "tasks/event_loop.h"
 
 namespace tasks::espnow {
 namespace {
 bool g_initialized = false;
 uint32_t g_messagesHandled = 0;
 
-void trimWhitespace(char **start, char **end) {
-  while (*start <= *end && isspace(static_cast<unsigned char>(**start))) {
-    ++(*start);
-  }
-  while (*end >= *start && isspace(static_cast<unsigned char>(**end))) {
-    **end = '\0';
-    --(*end);
-  }
-}
-
-bool processLine(char *line) {
-  if (line == nullptr) {
-    return false;
-  }
-
-  char *eq = strchr(line, '=');
-  if (eq == nullptr) {
-    return false;
-  }
-
-  char *value = eq + 1;
-  char *keyEnd = eq - 1;
-  *eq = '\0';
-
-  char *keyStart = line;
-  char *valueEnd = value + strlen(value);
-  if (valueEnd != value) {
-    --valueEnd;
-  }
-
-  trimWhitespace(&keyStart, &keyEnd);
-  trimWhitespace(&value, &valueEnd);
-
-  if (*keyStart == '\0') {
-    return false;
-  }
-
-  return provisioning::applyKeyValue(keyStart, value);
-}
-
 void parseMessage(const uint8_t *data, int len) {
   if (data == nullptr || len <= 0) {
     return;
@@ -72,29 +33,32 @@ void parseMessage(const uint8_t *data, int len) {
   memcpy(buffer, data, copyLen);
   buffer[copyLen] = '\0';
 
-  char *savePtr = nullptr;
-  char *line = strtok_r(buffer, "\n\r", &savePtr);
-  bool handled = false;
-
-  while (line != nullptr) {
-    handled |= processLine(line);
-    line = strtok_r(nullptr, "\n\r", &savePtr);
-  }
-
-  if (handled) {
+  if (provisioning::applyConfigText(buffer) > 0) {
     ++g_messagesHandled;
     Serial.printf("ESP-NOW provisioning update #%lu applied\n",
                   static_cast<unsigned long>(g_messagesHandled));
+    tasks::event_loop::wake();
   }
 }
 
+// Runs on the WiFi task. The stop check is the first thing done with the
+// frame; everything else goes through the text parser.
+void dispatchFrame(const uint8_t *data, int len) {
+  const uint32_t arrivedUs = micros();
+  if (data != nullptr && len > 0 && tasks::estop::isStopFrame(data, static_cast<size_t>(len))) {
+    tasks::estop::trigger(tasks::estop::Origin::EspNow, arrivedUs);
+    return;
+  }
+  parseMessage(data, len);
+}
+
 #if defined(ESP8266)
 void onReceive(uint8_t *mac, uint8_t *data, uint8_t len) {
-  parseMessage(data, static_cast<int>(len));
+  dispatchFrame(data, static_cast<int>(len));
 }
 #else
 void onReceive(const uint8_t *mac, const uint8_t *data, int len) {
-  parseMessage(data, len);
+  dispatchFrame(data, len);
 }
 #endif
 
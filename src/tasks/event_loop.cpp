@@ -0,0 +1,165 @@
+#include "tasks/event_loop.h"
+
+#include <Arduino.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#include "esp_vfs_eventfd.h"
+#include <sys/eventfd.h>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+
+namespace tasks::event_loop {
+namespace {
+constexpr size_t SOURCE_COUNT = static_cast<size_t>(Source::COUNT);
+constexpr uint32_t FALLBACK_POLL_MS = 10;
+constexpr uint32_t RATE_WINDOW_MS = 1000;
+constexpr size_t MAX_WATCHED_SOCKETS = 4;
+
+struct WatchedSocket {
+  int fd;
+  bool wantWrite;
+};
+
+uint32_t g_deadlines[SOURCE_COUNT];
+bool g_armed[SOURCE_COUNT];
+WatchedSocket g_sockets[MAX_WATCHED_SOCKETS];
+size_t g_socketCount = 0;
+int g_wakeFd = -1;
+
+uint32_t g_maxSleepMs = EVENT_LOOP_MAX_SLEEP_MS;
+uint32_t g_lastTuningVersion = 0;
+
+uint32_t g_windowStartMs = 0;
+uint32_t g_windowWakeups = 0;
+uint32_t g_wakeupsPerSecond = 0;
+
+void refreshTuning() {
+  const uint32_t version = provisioning::version(provisioning::Owner::EventLoop);
+  if (version == g_lastTuningVersion) {
+    return;
+  }
+
+  g_lastTuningVersion = version;
+  g_maxSleepMs = provisioning::tuning().loopMaxSleepMs;
+}
+
+uint32_t computeTimeoutMs(uint32_t now) {
+  uint32_t timeout = g_maxSleepMs;
+  for (size_t i = 0; i < SOURCE_COUNT; ++i) {
+    if (!g_armed[i]) {
+      continue;
+    }
+    const int32_t remaining = static_cast<int32_t>(g_deadlines[i] - now);
+    if (remaining <= 0) {
+      return 0;
+    }
+    if (static_cast<uint32_t>(remaining) < timeout) {
+      timeout = static_cast<uint32_t>(remaining);
+    }
+  }
+  return timeout;
+}
+
+void disarmAll() {
+  for (size_t i = 0; i < SOURCE_COUNT; ++i) {
+    g_armed[i] = false;
+  }
+  g_socketCount = 0;
+}
+
+void countWakeup() {
+  const uint32_t now = millis();
+  ++g_windowWakeups;
+  const uint32_t elapsed = now - g_windowStartMs;
+  if (elapsed >= RATE_WINDOW_MS) {
+    // Rounded: an idle loop wakes about once per window, just over a second
+    // apart, and truncating would report that as 0.
+    g_wakeupsPerSecond = (g_windowWakeups * RATE_WINDOW_MS + elapsed / 2) / elapsed;
+    g_windowWakeups = 0;
+    g_windowStartMs = now;
+  }
+}
+
+}  // namespace
+
+void init() {
+  const esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+  if (esp_vfs_eventfd_register(&config) == ESP_OK) {
+    g_wakeFd = eventfd(0, 0);
+  }
+  if (g_wakeFd < 0) {
+    Serial.println("Event loop: eventfd unavailable, falling back to polling");
+  }
+  g_windowStartMs = millis();
+}
+
+void setDeadline(Source source, uint32_t atMs) {
+  const size_t index = static_cast<size_t>(source);
+  if (g_armed[index] && static_cast<int32_t>(atMs - g_deadlines[index]) >= 0) {
+    return;
+  }
+  g_deadlines[index] = atMs;
+  g_armed[index] = true;
+}
+
+void watchSocket(int fd, bool wantWrite) {
+  if (fd < 0 || g_socketCount == MAX_WATCHED_SOCKETS) {
+    return;
+  }
+  g_sockets[g_socketCount++] = {fd, wantWrite};
+}
+
+void wake() {
+  if (g_wakeFd < 0) {
+    return;
+  }
+  const uint64_t one = 1;
+  ::write(g_wakeFd, &one, sizeof(one));
+}
+
+void waitForWork() {
+  refreshTuning();
+  const uint32_t timeout = computeTimeoutMs(millis());
+
+  if (g_wakeFd < 0) {
+    disarmAll();
+    delay(timeout < FALLBACK_POLL_MS ? timeout : FALLBACK_POLL_MS);
+    countWakeup();
+    return;
+  }
+
+  fd_set readable;
+  fd_set writable;
+  FD_ZERO(&readable);
+  FD_ZERO(&writable);
+  FD_SET(g_wakeFd, &readable);
+  int maxFd = g_wakeFd;
+  for (size_t i = 0; i < g_socketCount; ++i) {
+    const WatchedSocket &socket = g_sockets[i];
+    FD_SET(socket.fd, &readable);
+    if (socket.wantWrite) {
+      FD_SET(socket.fd, &writable);
+    }
+    if (socket.fd > maxFd) {
+      maxFd = socket.fd;
+    }
+  }
+  disarmAll();
+
+  timeval wait{};
+  wait.tv_sec = static_cast<time_t>(timeout / 1000);
+  wait.tv_usec = static_cast<suseconds_t>((timeout % 1000) * 1000);
+  const int ready = select(maxFd + 1, &readable, &writable, nullptr, &wait);
+
+  if (ready > 0 && FD_ISSET(g_wakeFd, &readable)) {
+    uint64_t drained = 0;
+    ::read(g_wakeFd, &drained, sizeof(drained));
+  }
+  countWakeup();
+}
+
+uint32_t wakeupsPerSecond() { return g_wakeupsPerSecond; }
+
+}  // namespace tasks::event_loop
@@ -1,165 +1,175 @@
 #include <Arduino.h>
-#include <ESP32Servo.h>
 
-// ----------------- Pins & Config -----------------
-const int in1 = 27; // Changed from 34 (Input Only) to 27
-const int in2 = 33;
-const int pwm1 = 32;
+#include "config/actuator_topology.h"
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "diag/latency_trace.h"
+#include "tasks/event_loop.h"
+#include "tasks/robot.h"
 
-const int in3 = 14;
-const int in4 = 13;
-const int pwm2 = 12;
+using tasks::Direction;
 
-const int servo1Pin = 25;
-const int servo2Pin = 26;
+// ----------------- Command mapping -----------------
 
-const int PWM_CHANNEL_LEFT = 0;
-const int PWM_CHANNEL_RIGHT = 1;
-const int PWM_FREQ = 20000;
-const int PWM_RES = 8;
-
-// ----------------- Classes -----------------
-
-class Motor {
-private:
-    int pinIn1, pinIn2, pinPwm, pwmChannel;
-
-public:
-    Motor(int in1, int in2, int pwm, int channel) 
-        : pinIn1(in1), pinIn2(in2), pinPwm(pwm), pwmChannel(channel) {}
-
-    void begin() {
-        pinMode(pinIn1, OUTPUT);
-        pinMode(pinIn2, OUTPUT);
-        ledcSetup(pwmChannel, PWM_FREQ, PWM_RES);
-        ledcAttachPin(pinPwm, pwmChannel);
+// Command names are hashed at compile time so dispatch is a single switch
+// instead of a chain of string compares.
+constexpr uint32_t commandHash(const char* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619u;
     }
-
-    void drive(const char* dir, int speed) {
-        if (strcmp(dir, "forward") == 0) {
-            digitalWrite(pinIn1, HIGH); digitalWrite(pinIn2, LOW);
-        } else if (strcmp(dir, "backward") == 0) {
-            digitalWrite(pinIn1, LOW); digitalWrite(pinIn2, HIGH);
-        } else {
-            digitalWrite(pinIn1, LOW); digitalWrite(pinIn2, LOW);
-            speed = 0;
-        }
-        ledcWrite(pwmChannel, constrain(speed, 0, 255));
+    return hash;
+}
+
+template <size_t N>
+constexpr uint32_t commandHash(const char (&name)[N]) {
+    return commandHash(name, N - 1);
+}
+
+template <size_t N>
+bool isCommand(const char* cmd, size_t length, const char (&name)[N]) {
+    return length == N - 1 && memcmp(cmd, name, N - 1) == 0;
+}
+
+// The hash only picks the case; the name is still compared so that a payload
+// which merely collides with a command cannot run it.
+#define COMMAND_CASE(name) \
+    case commandHash(name): \
+        if (!isCommand(text, cmdLength, name)) break;
+
+constexpr char kServoPrefix[] = "servo";
+constexpr size_t kServoPrefixLength = sizeof(kServoPrefix) - 1;
+
+// Returns the zero-based servo index for "servo<N>", or -1.
+int servoIndex(const char* cmd, size_t length) {
+    if (length <= kServoPrefixLength || strncmp(cmd, kServoPrefix, kServoPrefixLength) != 0) {
+        return -1;
     }
-};
-
-class Robot {
-private:
-    Motor leftMotor;
-    Motor rightMotor;
-    Servo servo1;
-    Servo servo2;
-    int servo1Angle;
-    bool initialized;
-
-    // State for speed_up
-    String currentLDir;
-    String currentRDir;
-    int currentLSpeed;
-    int currentRSpeed;
-
-public:
-    Robot() : leftMotor(in1, in2, pwm1, PWM_CHANNEL_LEFT),
-              rightMotor(in3, in4, pwm2, PWM_CHANNEL_RIGHT),
-              servo1Angle(90), initialized(false),
-              currentLDir("stop"), currentRDir("stop"),
-              currentLSpeed(0), currentRSpeed(0) {}
-
-    void begin() {
-        if (initialized) return;
-        
-        leftMotor.begin();
-        rightMotor.begin();
-        
-        servo1.attach(servo1Pin);
-        servo1.write(servo1Angle);
-        
-        servo2.attach(servo2Pin);
-        servo2.write(90);
-        
-        initialized = true;
+    int number = 0;
+    for (size_t i = kServoPrefixLength; i < length; ++i) {
+        if (cmd[i] < '0' || cmd[i] > '9') return -1;
+        number = number * 10 + (cmd[i] - '0');
     }
-
-    void move(const char* ldir, const char* rdir, int lspeed, int rspeed) {
-        Serial.printf("Robot Move: L=%s(%d) R=%s(%d)\n", ldir, lspeed, rdir, rspeed);
-        currentLDir = ldir;
-        currentRDir = rdir;
-        currentLSpeed = lspeed;
-        currentRSpeed = rspeed;
-
-        leftMotor.drive(ldir, lspeed);
-        rightMotor.drive(rdir, rspeed);
+    return number - 1;
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Like atoi, but bounded by `end` instead of a terminator.
+int parseParam(const char* begin, const char* end) {
+    bool negative = false;
+    if (begin < end && (*begin == '-' || *begin == '+')) {
+        negative = *begin == '-';
+        ++begin;
     }
-
-    void adjustSpeed(int delta) {
-        int newLSpeed = constrain(currentLSpeed + delta, 0, 255);
-        int newRSpeed = constrain(currentRSpeed + delta, 0, 255);
-        
-        Serial.printf("Speed Adjust: %d -> L=%d R=%d\n", delta, newLSpeed, newRSpeed);
-
-        // Update state and motors
-        currentLSpeed = newLSpeed;
-        currentRSpeed = newRSpeed;
-        
-        leftMotor.drive(currentLDir.c_str(), currentLSpeed);
-        rightMotor.drive(currentRDir.c_str(), currentRSpeed);
+    int value = 0;
+    for (; begin < end && *begin >= '0' && *begin <= '9'; ++begin) {
+        value = value * 10 + (*begin - '0');
     }
+    return negative ? -value : value;
+}
 
-    void setServo1(int angle) {
-        Serial.printf("Servo1: %d\n", angle);
-        angle = constrain(angle, 0, 180);
-        servo1Angle = angle;
-        servo1.write(angle);
+// Global robot instance
+tasks::Robot<topology::Active> robot;
+uint32_t actuatorTuningVersion = 0;
+
+// Actuator tunables are picked up lazily, right before the next command
+// touches the motors.
+void refreshActuatorTuning() {
+    const uint32_t version = provisioning::version(provisioning::Owner::Actuators);
+    if (version == actuatorTuningVersion) return;
+
+    actuatorTuningVersion = version;
+    robot.setPwmFrequency(provisioning::tuning().pwmFrequency);
+}
+
+void onMessage(const char* text, size_t length) {
+    diag::trace::markDispatch();
+    refreshActuatorTuning();
+
+    const char* end = text + length;
+    while (text < end && isSpace(*text)) ++text;
+    while (end > text && isSpace(end[-1])) --end;
+
+    const char* separator = static_cast<const char*>(memchr(text, ':', static_cast<size_t>(end - text)));
+    const size_t cmdLength = static_cast<size_t>((separator == nullptr ? end : separator) - text);
+    const int param = separator == nullptr ? 0 : parseParam(separator + 1, end);
+
+    switch (commandHash(text, cmdLength)) {
+    COMMAND_CASE("forward")
+        robot.move(Direction::Forward, Direction::Forward, param, param);
+        return;
+    COMMAND_CASE("backward")
+        robot.move(Direction::Backward, Direction::Backward, param, param);
+        return;
+    COMMAND_CASE("left")
+        robot.move(Direction::Backward, Direction::Forward, param, param);
+        return;
+    COMMAND_CASE("right")
+        robot.move(Direction::Forward, Direction::Backward, param, param);
+        return;
+    COMMAND_CASE("stop")
+        robot.move(Direction::Stop, Direction::Stop, 0, 0);
+        return;
+    COMMAND_CASE("speed_up")
+        robot.adjustSpeed(param);
+        return;
+    COMMAND_CASE("twist") {
+        // twist:<linear mm/s>,<angular mrad/s>
+        const char* comma = separator == nullptr
+            ? nullptr
+            : static_cast<const char*>(memchr(separator + 1, ',', static_cast<size_t>(end - separator - 1)));
+        const int angular = comma == nullptr ? 0 : parseParam(comma + 1, end);
+        robot.twist(param, angular);
+        return;
+    }
+#if DIAG_STALL_INJECT
+    COMMAND_CASE("stall")
+        // Test hook: holds the loop so the stall detector has something to catch.
+        delay(static_cast<uint32_t>(param));
+        return;
+#endif
+    default:
+        break;
     }
+#undef COMMAND_CASE
 
-    void spinServo2() {
-        Serial.println("Servo2: Spin");
-        servo2.write(180);
-        delay(800);
-        servo2.write(90);
-        delay(100);
+    const int servo = servoIndex(text, cmdLength);
+    if (servo >= 0) {
+        robot.commandServo(static_cast<size_t>(servo), param);
     }
-};
+}
 
-// Global robot instance
-Robot robot;
-
-void onMessage(String message) {
-    robot.begin(); // Ensure initialized on first message
-
-    message.trim();
-    int separatorIndex = message.indexOf(':');
-    
-    String cmd;
-    int param = 0;
-
-    if (separatorIndex == -1) {
-        cmd = message;
-    } else {
-        cmd = message.substring(0, separatorIndex);
-        param = message.substring(separatorIndex + 1).toInt();
+void cutMotors() {
+    tasks::Robot<topology::Active>::cutMotors();
+}
+
+void initActuators() {
+    refreshActuatorTuning();
+    robot.begin();
+}
+
+void haltActuators() {
+    robot.halt();
+}
+
+void serviceActuators(uint32_t nowMs) {
+    uint32_t nextMs = 0;
+    if (robot.service(nowMs, &nextMs)) {
+        tasks::event_loop::setDeadline(tasks::event_loop::Source::Actuators, nextMs);
     }
+}
 
-    if (cmd == "forward") {
-        robot.move("forward", "forward", param, param);
-    } else if (cmd == "backward") {
-        robot.move("backward", "backward", param, param);
-    } else if (cmd == "left") {
-        robot.move("backward", "forward", param, param);
-    } else if (cmd == "right") {
-        robot.move("forward", "backward", param, param);
-    } else if (cmd == "stop") {
-        robot.move("stop", "stop", 0, 0);
-    } else if (cmd == "speed_up") {
-        robot.adjustSpeed(param);
-    } else if (cmd == "servo1") {
-        robot.setServo1(param);
-    } else if (cmd == "servo2") {
-        robot.spinServo2();
+size_t sampleActuators(int32_t* out, size_t capacity) {
+    using ActiveRobot = tasks::Robot<topology::Active>;
+    size_t count = 0;
+    for (size_t i = 0; i < ActiveRobot::MOTOR_COUNT && count < capacity; ++i) {
+        out[count++] = static_cast<int32_t>(robot.direction(i)) * robot.speed(i);
+    }
+    for (size_t i = 0; i < ActiveRobot::SERVO_COUNT && count < capacity; ++i) {
+        out[count++] = robot.servoAngle(i);
     }
-}
\ No newline at end of file
+    return count;
+}
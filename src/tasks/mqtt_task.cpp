@@ -1,7 +1,6 @@
 #include "tasks/mqtt_task.h"
 
 #include <Arduino.h>
-#include <PubSubClient.h>
 #include "tasks/message_handler.h"
 #if defined(ESP8266)
 #include <ESP8266WiFi.h>
@@ -10,26 +9,87 @@
 #include <esp_system.h>
 #endif
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "config/defaults.h"
 #include "config/provisioning_store.h"
+#include "diag/alloc_counter.h"
+#include "diag/boot_timeline.h"
+#include "diag/event_log.h"
+#include "diag/latency_trace.h"
+#include "diag/stall_detector.h"
+#include "net/mqtt_client.h"
+#include "tasks/command_envelope.h"
+#include "tasks/command_window.h"
+#include "tasks/emergency_stop.h"
+#include "tasks/event_loop.h"
+#include "tasks/scheduled_commands.h"
+#include "tasks/serial_tunnel.h"
+#include "tasks/telemetry.h"
 #include "tasks/wifi_task.h"
 
 namespace tasks::mqtt {
 namespace {
-constexpr uint32_t MQTT_RECONNECT_DELAY_MS = MQTT_RETRY_DELAY_MS;
-constexpr uint32_t MQTT_HEARTBEAT_INTERVAL_MS = 5000;
+constexpr uint32_t SERIAL_OUTPUT_RETRY_MS = 2;
+constexpr size_t CONFIG_PAYLOAD_MAX = 256;
 
 provisioning::MqttInitParams g_params{};
 uint32_t g_lastConfigVersion = 0;
+uint32_t g_lastTimingVersion = 0;
+uint32_t g_reconnectDelayMs = MQTT_RETRY_DELAY_MS;
+uint32_t g_heartbeatIntervalMs = MQTT_HEARTBEAT_INTERVAL_MS;
+size_t g_serialFlushBytes = MQTT_SERIAL_BUFFER;
 uint32_t g_lastReconnectAttempt = 0;
+// The retry delay paces attempts; the first after boot goes out as soon as
+// WiFi is up.
+bool g_reconnectAttempted = false;
 uint32_t g_lastHeartbeat = 0;
-
-WiFiClient g_netClient;
-PubSubClient g_client(g_netClient);
+uint32_t g_lastHistogramCount = 0;
+uint32_t g_loopMaxUs = 0;
+bool g_wasConnected = false;
+
+constexpr size_t BROKER_SLOTS = provisioning::MQTT_BROKER_SLOTS;
+constexpr size_t NO_SLOT = BROKER_SLOTS;
+
+struct FailoverStats {
+  uint32_t failovers;
+  uint32_t failbacks;
+  // From noticing the lost session to the next one being up.
+  uint32_t lastFailoverMs;
+};
+
+// Provisioning updates that cost the live session, and those carried out on it.
+struct ConfigStats {
+  uint32_t reconnects;
+  uint32_t resubscribes;
+};
+
+// One client per broker slot, so every broker keeps its own TLS session.
+net::MqttClient g_clients[BROKER_SLOTS];
+// The session everything is published on: the current broker's client.
+net::MqttClient *g_client = &g_clients[0];
+size_t g_activeSlot = NO_SLOT;
+size_t g_lastActiveSlot = NO_SLOT;
+// The last winner goes first in the next race.
+size_t g_preferredSlot = 0;
+bool g_racing = false;
+uint8_t g_launchedSlots = 0;
+uint32_t g_nextLaunchMs = 0;
+size_t g_probeSlot = NO_SLOT;
+uint32_t g_lastProbeMs = 0;
+bool g_sessionLost = false;
+uint32_t g_sessionLostMs = 0;
+FailoverStats g_failover{};
+ConfigStats g_config{};
+net::TlsOptions g_tlsOptions{};
+char g_clientIds[BROKER_SLOTS][48];
+const char *g_subscriptions[7];
 uint8_t g_serialTxBuffer[MQTT_SERIAL_BUFFER];
 size_t g_serialTxLength = 0;
+uint8_t g_serialEchoBuffer[MQTT_SERIAL_BUFFER];
+size_t g_serialEchoLength = 0;
 
 uint32_t randomSuffix() {
 #if defined(ESP32)
@@ -39,20 +99,13 @@ uint32_t randomSuffix() {
 #endif
 }
 
-void applyMqttServer() {
-  if (!g_params.valid || g_params.host[0] == '\0') {
-    return;
-  }
-  g_client.setServer(g_params.host, g_params.port);
-}
-
 void flushSerialBridgeBuffer() {
-  if (g_serialTxLength == 0 || !g_client.connected() || g_params.publishTopic[0] == '\0') {
+  if (g_serialTxLength == 0 || !g_client->connected() || g_params.publishTopic[0] == '\0') {
     g_serialTxLength = 0;
     return;
   }
 
-  if (!g_client.publish(g_params.publishTopic, g_serialTxBuffer, g_serialTxLength)) {
+  if (!g_client->publish(g_params.publishTopic, g_serialTxBuffer, g_serialTxLength)) {
     Serial.println("MQTT serial publish failed");
   }
   g_serialTxLength = 0;
@@ -65,7 +118,7 @@ void pumpSerialToMqtt() {
       break;
     }
 
-    if (g_serialTxLength >= sizeof(g_serialTxBuffer)) {
+    if (g_serialTxLength >= g_serialFlushBytes) {
       flushSerialBridgeBuffer();
     }
 
@@ -77,21 +130,244 @@ void pumpSerialToMqtt() {
   }
 }
 
-void mqttMessageCallback(char *topic, uint8_t *payload, unsigned int length) {
-  if (g_params.commandTopic[0] != '\0' && strcmp(topic, g_params.commandTopic) == 0) {
-    String message;
-    message.reserve(length + 1);
-    for (unsigned int i = 0; i < length; ++i) {
-      message += static_cast<char>(payload[i]);
+// Commands are echoed to the attached serial device, but only as fast as the
+// UART FIFO drains; the callback itself never waits on Serial.
+void queueSerialEcho(const char *text, size_t length) {
+  if (g_serialEchoLength + length + 2 > sizeof(g_serialEchoBuffer)) {
+    return;
+  }
+  memcpy(g_serialEchoBuffer + g_serialEchoLength, text, length);
+  g_serialEchoLength += length;
+  g_serialEchoBuffer[g_serialEchoLength++] = '\r';
+  g_serialEchoBuffer[g_serialEchoLength++] = '\n';
+}
+
+void flushSerialEcho() {
+  if (g_serialEchoLength == 0) {
+    return;
+  }
+
+  const int room = Serial.availableForWrite();
+  if (room <= 0) {
+    return;
+  }
+  const size_t chunk =
+      static_cast<size_t>(room) < g_serialEchoLength ? static_cast<size_t>(room) : g_serialEchoLength;
+  Serial.write(g_serialEchoBuffer, chunk);
+  memmove(g_serialEchoBuffer, g_serialEchoBuffer + chunk, g_serialEchoLength - chunk);
+  g_serialEchoLength -= chunk;
+}
+
+// snprintf at `*used`, keeping `*used` inside the buffer on truncation.
+void appendf(char *buffer, size_t size, size_t *used, const char *format, ...) {
+  if (*used >= size) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  const int written = vsnprintf(buffer + *used, size - *used, format, args);
+  va_end(args);
+  if (written > 0) {
+    *used += static_cast<size_t>(written);
+    if (*used >= size) {
+      *used = size - 1;
     }
-    onMessage(message);
-    Serial.println(message);
+  }
+}
+
+// Runs as soon as the stop is in the receive buffer. The flush it starts
+// drops the commands queued ahead of the stop and ends when the stop itself
+// is delivered in order.
+void onStopArrived(uint32_t arrivedUs) {
+  tasks::estop::trigger(tasks::estop::Origin::Mqtt, arrivedUs);
+}
+
+void mqttMessageCallback(const char *topic, const uint8_t *payload, size_t length) {
+  const uint32_t receivedUs = micros();
+  if (strcmp(topic, MQTT_STOP_TOPIC) == 0) {
+    // Already acted on by onStopArrived().
+    tasks::estop::endFlush(tasks::estop::Origin::Mqtt);
     return;
   }
+  if (tasks::tunnel::handleMessage(topic, payload, length) ||
+      tasks::schedule::handleMessage(topic, payload, length)) {
+    return;
+  }
+  if ((g_params.commandTopic[0] != '\0' && strcmp(topic, g_params.commandTopic) == 0) ||
+      (MQTT_GROUP_TOPIC[0] != '\0' && strcmp(topic, MQTT_GROUP_TOPIC) == 0)) {
+    if (tasks::estop::flushing()) {
+      tasks::estop::noteFlushedCommand();
+      return;
+    }
+    // The command is dispatched straight out of the client's receive buffer;
+    // nothing on this path may touch the heap.
+    const diag::alloc::Scope noAllocations;
+    tasks::envelope::CommandEnvelope envelope{};
+    if (!tasks::envelope::parse(reinterpret_cast<const char *>(payload), length, &envelope)) {
+      DIAG_LOG(MQTT_ENVELOPE_MALFORMED, length);
+      return;
+    }
+
+    const tasks::command_window::Verdict verdict = tasks::command_window::check(envelope, millis());
+    if (verdict != tasks::command_window::Verdict::Accept) {
+      DIAG_LOG(MQTT_COMMAND_REJECTED, envelope.sourceId, envelope.sequence, static_cast<int32_t>(verdict));
+      return;
+    }
+    if (envelope.hasExecuteAt) {
+      tasks::schedule::enqueue(envelope);
+      return;
+    }
+
+    DIAG_LOG(MQTT_COMMAND, envelope.id, envelope.bodyLength);
+    diag::trace::beginCommand(envelope, receivedUs);
+    onMessage(envelope.body, envelope.bodyLength);
+    diag::trace::endCommand();
+    queueSerialEcho(envelope.body, envelope.bodyLength);
+    return;
+  }
+
+  if (g_params.configTopic[0] != '\0' && strcmp(topic, g_params.configTopic) == 0) {
+    char text[CONFIG_PAYLOAD_MAX];
+    const size_t copyLen = length < sizeof(text) - 1 ? length : sizeof(text) - 1;
+    memcpy(text, payload, copyLen);
+    text[copyLen] = '\0';
+    const size_t applied =
+        provisioning::applyConfigText(text, provisioning::KeyScope::TuningOnly);
+    Serial.printf("MQTT config update: %u key(s) applied\n", static_cast<unsigned>(applied));
+    return;
+  }
+
+  DIAG_LOG(MQTT_IGNORED, length);
+}
+
+// A failback probe runs alongside the live session. What reaches it before
+// it is adopted is either on the live session too, e.g. through a bridge, or
+// meant for a broker the robot is not following yet; acting on it could run
+// a command twice.
+void ignoreWhileProbing(const char *, const uint8_t *, size_t length) {
+  DIAG_LOG(MQTT_IGNORED, length);
+}
+
+// Points a client's delivery at the command path, or away from it.
+void routeMessages(net::MqttClient &client, bool live) {
+  client.setCallback(live ? mqttMessageCallback : ignoreWhileProbing);
+  client.setPriorityTopic(live ? MQTT_STOP_TOPIC : nullptr, live ? onStopArrived : nullptr);
+}
+
+void handleTimingUpdates() {
+  const uint32_t version = provisioning::version(provisioning::Owner::MqttTiming);
+  if (version == g_lastTimingVersion) {
+    return;
+  }
+
+  g_lastTimingVersion = version;
+  const provisioning::Tuning tuning = provisioning::tuning();
+  g_reconnectDelayMs = tuning.mqttRetryDelayMs;
+  g_heartbeatIntervalMs = tuning.heartbeatIntervalMs;
+  g_serialFlushBytes = tuning.serialBufferBytes;
+}
+
+bool slotConfigured(size_t slot) { return g_params.brokers[slot].host[0] != '\0'; }
+
+void buildSubscriptions() {
+  size_t topicCount = 0;
+  for (const char *&topic : g_subscriptions) {
+    topic = nullptr;
+  }
+  g_subscriptions[topicCount++] = MQTT_STOP_TOPIC;
+  if (g_params.commandTopic[0] != '\0') {
+    g_subscriptions[topicCount++] = g_params.commandTopic;
+  }
+  if (g_params.configTopic[0] != '\0') {
+    g_subscriptions[topicCount++] = g_params.configTopic;
+  }
+  if (MQTT_GROUP_TOPIC[0] != '\0') {
+    g_subscriptions[topicCount++] = MQTT_GROUP_TOPIC;
+  }
+  constexpr size_t CAPACITY = sizeof(g_subscriptions) / sizeof(g_subscriptions[0]);
+  topicCount += tasks::schedule::subscriptions(g_params.clientId, g_subscriptions + topicCount,
+                                               CAPACITY - topicCount);
+  tasks::tunnel::subscriptions(g_subscriptions + topicCount, CAPACITY - topicCount);
+}
+
+size_t subscriptionCount() {
+  size_t count = 0;
+  while (count < sizeof(g_subscriptions) / sizeof(g_subscriptions[0]) &&
+         g_subscriptions[count] != nullptr) {
+    ++count;
+  }
+  return count;
+}
+
+void disconnectAll() {
+  for (net::MqttClient &client : g_clients) {
+    client.disconnect();
+  }
+  g_activeSlot = NO_SLOT;
+  g_probeSlot = NO_SLOT;
+  g_racing = false;
+}
+
+bool startAttempt(size_t slot, uint32_t now) {
+  const char *baseId = g_params.clientId[0] != '\0' ? g_params.clientId : "mqtt-client";
+  snprintf(g_clientIds[slot], sizeof(g_clientIds[slot]), "%s-%04X", baseId,
+           static_cast<unsigned>(randomSuffix() & 0xFFFF));
+
+  net::MqttClient::Session session{};
+  session.host = g_params.brokers[slot].host;
+  session.port = g_params.brokers[slot].port;
+  session.clientId = g_clientIds[slot];
+  session.username = g_params.username;
+  session.password = g_params.password;
+  session.topics = g_subscriptions;
+  session.topicCount = subscriptionCount();
+  g_tlsOptions.caPem = MQTT_TLS_CA_PEM;
+  g_tlsOptions.pinSha256 = g_params.tlsPin;
+  session.tls = g_params.tls ? &g_tlsOptions : nullptr;
+  session.v5 = g_params.v5;
+
+  if (!g_clients[slot].beginConnect(session, now)) {
+    Serial.printf("MQTT connect to broker %u could not start\n", static_cast<unsigned>(slot));
+    return false;
+  }
+  return true;
+}
 
-  Serial.printf("MQTT message on %s (%u bytes) ignored\n", topic, length);
+bool subscribedTo(const char *topic) {
+  for (const char *subscribed : g_subscriptions) {
+    if (subscribed != nullptr && strcmp(subscribed, topic) == 0) {
+      return true;
+    }
+  }
+  return false;
 }
 
+// Moves the live session from the previous command/config topics to the
+// current ones. False when the packets did not fit, so the caller falls back
+// to a reconnect.
+bool resubscribe(const provisioning::MqttInitParams &previous) {
+  const char *const before[] = {previous.commandTopic, previous.configTopic};
+  const char *const after[] = {g_params.commandTopic, g_params.configTopic};
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(before) / sizeof(before[0]); ++i) {
+    if (strcmp(before[i], after[i]) == 0) {
+      continue;
+    }
+    if (before[i][0] != '\0' && !subscribedTo(before[i])) {
+      ok &= g_client->unsubscribe(before[i]);
+    }
+    if (after[i][0] != '\0') {
+      ok &= g_client->subscribe(after[i]);
+    }
+  }
+  return ok;
+}
+
+// Only what an update touched is redone: new client identity, credentials or
+// TLS settings, or a new address for the serving broker, rebuild the
+// session; other broker slots only lose an attempt in flight to them; topic
+// changes are carried out on the live session. Publish topics are read on
+// every publish and need nothing.
 void handleConfigUpdates() {
   const uint32_t version = provisioning::mqttVersion();
   if (version == g_lastConfigVersion) {
@@ -99,105 +375,488 @@ void handleConfigUpdates() {
   }
 
   g_lastConfigVersion = version;
+  const provisioning::MqttInitParams previous = g_params;
   g_params = provisioning::mqtt();
-  applyMqttServer();
-  if (g_client.connected()) {
-    g_client.disconnect();
+  const provisioning::MqttChanges changes = provisioning::diff(previous, g_params);
+
+  bool brokersChanged = false;
+  for (bool changed : changes.brokers) {
+    brokersChanged |= changed;
   }
+  const bool live = g_activeSlot != NO_SLOT && g_client->connected();
+  const bool rebuild = changes.session || changes.valid ||
+                       (live && changes.brokers[g_activeSlot]) ||
+                       (!live && (brokersChanged || changes.subscriptions));
+  if (rebuild) {
+    // Without a live session there is nothing to lose by starting over.
+    if (live) {
+      ++g_config.reconnects;
+      Serial.println("MQTT config update: reconnecting");
+    }
+    disconnectAll();
+    buildSubscriptions();
+    g_preferredSlot = 0;
+    return;
+  }
+
+  for (size_t slot = 0; slot < BROKER_SLOTS; ++slot) {
+    if (changes.brokers[slot] && slot != g_activeSlot) {
+      g_clients[slot].disconnect();
+      if (slot == g_probeSlot) {
+        g_probeSlot = NO_SLOT;
+      }
+    }
+  }
+  if (!changes.subscriptions) {
+    return;
+  }
+
+  buildSubscriptions();
+  // A failback probe may already have subscribed to the old topics.
+  if (g_probeSlot != NO_SLOT) {
+    g_clients[g_probeSlot].disconnect();
+    g_probeSlot = NO_SLOT;
+  }
+  if (!resubscribe(previous)) {
+    ++g_config.reconnects;
+    Serial.println("MQTT config update: resubscribe did not fit, reconnecting");
+    disconnectAll();
+    return;
+  }
+  ++g_config.resubscribes;
+  Serial.println("MQTT config update: resubscribed");
 }
 
-bool mqttEnsureConnected() {
-  if (!g_params.valid || g_params.host[0] == '\0') {
-    return false;
+void reportConnectionChanges(uint32_t now) {
+  if (g_client->connected()) {
+    if (!g_wasConnected) {
+      g_wasConnected = true;
+      // Whatever a stop was flushing went with the previous session.
+      tasks::estop::endFlush(tasks::estop::Origin::Mqtt);
+      tasks::estop::endFlush(tasks::estop::Origin::EspNow);
+      diag::boot::mark(diag::boot::Stage::MqttConnected);
+      if (g_sessionLost) {
+        g_sessionLost = false;
+        g_failover.lastFailoverMs = now - g_sessionLostMs;
+      }
+      const provisioning::MqttBroker &broker = g_params.brokers[g_activeSlot];
+      if (g_params.tls) {
+        const net::TlsSession::Stats &tls = g_client->tlsStats();
+        Serial.printf("MQTT connected to %s:%u over TLS (%s handshake, %lu ms)\n", broker.host,
+                      broker.port, tls.lastResumed ? "resumed" : "full",
+                      static_cast<unsigned long>(tls.lastResumed ? tls.lastResumedMs : tls.lastFullMs));
+      } else {
+        Serial.printf("MQTT connected to %s:%u\n", broker.host, broker.port);
+      }
+      for (const char *topic : g_subscriptions) {
+        if (topic != nullptr) {
+          Serial.printf("Subscribed to %s\n", topic);
+        }
+      }
+    }
+    return;
   }
 
-  if (g_client.connected()) {
-    return true;
+  if (g_wasConnected) {
+    g_wasConnected = false;
+    g_sessionLost = true;
+    g_sessionLostMs = now;
+    Serial.println("MQTT connection lost");
   }
+}
 
-  const uint32_t now = millis();
-  if ((now - g_lastReconnectAttempt) < MQTT_RECONNECT_DELAY_MS) {
-    return false;
+// Makes `slot` the session everything runs on and drops every other client.
+void adopt(size_t slot) {
+  for (size_t i = 0; i < BROKER_SLOTS; ++i) {
+    if (i != slot) {
+      g_clients[i].disconnect();
+    }
+  }
+  if (g_lastActiveSlot != NO_SLOT && g_lastActiveSlot != slot) {
+    ++g_failover.failovers;
   }
+  routeMessages(g_clients[slot], true);
+  g_client = &g_clients[slot];
+  g_activeSlot = slot;
+  g_lastActiveSlot = slot;
+  g_preferredSlot = slot;
+  g_probeSlot = NO_SLOT;
+  g_racing = false;
+}
+
+// The last winner first, then the rest in priority order.
+size_t nextRaceSlot() {
+  if (slotConfigured(g_preferredSlot) && (g_launchedSlots & (1u << g_preferredSlot)) == 0) {
+    return g_preferredSlot;
+  }
+  for (size_t slot = 0; slot < BROKER_SLOTS; ++slot) {
+    if (slotConfigured(slot) && (g_launchedSlots & (1u << slot)) == 0) {
+      return slot;
+    }
+  }
+  return NO_SLOT;
+}
+
+void launchNextRacer(uint32_t now) {
+  for (size_t slot = nextRaceSlot(); slot != NO_SLOT; slot = nextRaceSlot()) {
+    g_launchedSlots |= static_cast<uint8_t>(1u << slot);
+    if (startAttempt(slot, now)) {
+      g_nextLaunchMs = now + MQTT_RACE_STAGGER_MS;
+      return;
+    }
+  }
+}
+
+// Happy-eyeballs style: brokers join the race one stagger apart, or at once
+// when every earlier attempt has already failed, and the first CONNACK wins.
+void serviceRace(uint32_t now) {
+  bool inFlight = false;
+  for (size_t slot = 0; slot < BROKER_SLOTS; ++slot) {
+    if ((g_launchedSlots & (1u << slot)) == 0) {
+      continue;
+    }
+    const net::MqttClient::State state = g_clients[slot].state();
+    if (state == net::MqttClient::State::Subscribing || state == net::MqttClient::State::Connected) {
+      adopt(slot);
+      return;
+    }
+    inFlight |= state != net::MqttClient::State::Idle;
+  }
+
+  const bool moreToLaunch = nextRaceSlot() != NO_SLOT;
+  if (moreToLaunch && (!inFlight || static_cast<int32_t>(now - g_nextLaunchMs) >= 0)) {
+    launchNextRacer(now);
+    return;
+  }
+  if (inFlight || moreToLaunch) {
+    return;
+  }
+
+  g_racing = false;
   g_lastReconnectAttempt = now;
+  for (size_t slot = 0; slot < BROKER_SLOTS; ++slot) {
+    if ((g_launchedSlots & (1u << slot)) != 0) {
+      Serial.printf("MQTT connect to %s failed at %s stage\n", g_params.brokers[slot].host,
+                    net::MqttClient::stateName(g_clients[slot].lastFailedStage()));
+    }
+  }
+  Serial.printf("MQTT: no broker reachable, loop max %lu us\n", static_cast<unsigned long>(g_loopMaxUs));
+  g_loopMaxUs = 0;
+}
 
-  char clientId[48];
-  const char *baseId = g_params.clientId[0] != '\0' ? g_params.clientId : "mqtt-client";
-  snprintf(clientId, sizeof(clientId), "%s-%04X", baseId,
-           static_cast<unsigned>(randomSuffix() & 0xFFFF));
+void startRace(uint32_t now) {
+  g_racing = true;
+  g_launchedSlots = 0;
+  launchNextRacer(now);
+}
 
-  const char *username = g_params.username[0] == '\0' ? nullptr : g_params.username;
-  const char *password = g_params.password[0] == '\0' ? nullptr : g_params.password;
+// On a fallback broker, a full session to a higher priority broker is
+// brought up alongside the current one and taken over once subscribed, so
+// failing back loses no messages to a reconnect gap.
+void serviceFailback(uint32_t now) {
+  if (g_probeSlot != NO_SLOT) {
+    net::MqttClient &probe = g_clients[g_probeSlot];
+    if (probe.connected()) {
+      Serial.printf("MQTT failing back to %s\n", g_params.brokers[g_probeSlot].host);
+      ++g_failover.failbacks;
+      const size_t slot = g_probeSlot;
+      g_lastActiveSlot = slot;
+      adopt(slot);
+    } else if (probe.idle()) {
+      g_probeSlot = NO_SLOT;
+    }
+    return;
+  }
 
-  const bool connected = username == nullptr ? g_client.connect(clientId)
-                                             : g_client.connect(clientId, username, password);
-  if (connected) {
-    Serial.println("MQTT connected");
-    if (g_params.commandTopic[0] != '\0') {
-      if (!g_client.subscribe(g_params.commandTopic)) {
-        Serial.println("MQTT subscribe failed");
-      } else {
-        Serial.printf("Subscribed to %s\n", g_params.commandTopic);
+  if ((now - g_lastProbeMs) < MQTT_FAILBACK_PROBE_MS) {
+    return;
+  }
+  for (size_t slot = 0; slot < g_activeSlot; ++slot) {
+    if (slotConfigured(slot)) {
+      g_lastProbeMs = now;
+      routeMessages(g_clients[slot], false);
+      if (startAttempt(slot, now)) {
+        g_probeSlot = slot;
       }
+      return;
+    }
+  }
+}
+
+bool mqttEnsureConnected(uint32_t now) {
+  if (!g_params.valid) {
+    return false;
+  }
+
+  reportConnectionChanges(now);
+  if (g_activeSlot != NO_SLOT) {
+    if (g_client->connected()) {
+      serviceFailback(now);
+      return true;
+    }
+    if (!g_client->idle()) {
+      // Won the race, still subscribing.
+      return false;
     }
-  } else {
-    Serial.printf("MQTT connect failed, rc=%d\n", g_client.state());
+    disconnectAll();
   }
 
-  return connected;
+  if (g_racing) {
+    serviceRace(now);
+    return false;
+  }
+  if (g_reconnectAttempted && (now - g_lastReconnectAttempt) < g_reconnectDelayMs) {
+    return false;
+  }
+  g_reconnectAttempted = true;
+  g_lastReconnectAttempt = now;
+  startRace(now);
+  return false;
 }
 
 void publishHeartbeat(uint32_t now) {
-  constexpr char kHeartbeatPayload[] = "comm-robot heartbeat";
+  const tasks::command_window::Counters commands = tasks::command_window::counters();
+  char heartbeat[832];
+  size_t used = 0;
+  appendf(heartbeat, sizeof(heartbeat), &used,
+          "comm-robot heartbeat loop_max_us=%lu wakeups_per_s=%lu cmd_ok=%lu cmd_dup=%lu "
+          "cmd_stale=%lu cmd_expired=%lu stalls=%lu",
+          static_cast<unsigned long>(g_loopMaxUs),
+          static_cast<unsigned long>(tasks::event_loop::wakeupsPerSecond()),
+          static_cast<unsigned long>(commands.accepted), static_cast<unsigned long>(commands.duplicate),
+          static_cast<unsigned long>(commands.stale), static_cast<unsigned long>(commands.expired),
+          static_cast<unsigned long>(diag::stall::stalls()));
+  // A shrinking max block with a steady heap_free is fragmentation.
+  appendf(heartbeat, sizeof(heartbeat), &used, " heap_free=%lu heap_min=%lu heap_max_block=%lu",
+          static_cast<unsigned long>(ESP.getFreeHeap()), static_cast<unsigned long>(ESP.getMinFreeHeap()),
+          static_cast<unsigned long>(ESP.getMaxAllocHeap()));
+  appendf(heartbeat, sizeof(heartbeat), &used,
+          " broker=%u failovers=%lu failbacks=%lu failover_ms=%lu",
+          static_cast<unsigned>(g_activeSlot), static_cast<unsigned long>(g_failover.failovers),
+          static_cast<unsigned long>(g_failover.failbacks),
+          static_cast<unsigned long>(g_failover.lastFailoverMs));
+  // Summed over every broker slot; compare across MQTT_V5 settings.
+  net::MqttClient::WireStats wire{};
+  for (const net::MqttClient &client : g_clients) {
+    wire.txBytes += client.wireStats().txBytes;
+    wire.rxBytes += client.wireStats().rxBytes;
+    wire.aliasedPublishes += client.wireStats().aliasedPublishes;
+  }
+  appendf(heartbeat, sizeof(heartbeat), &used, " mqtt_v5=%u wire_tx=%lu wire_rx=%lu aliased=%lu",
+          g_params.v5 ? 1u : 0u, static_cast<unsigned long>(wire.txBytes),
+          static_cast<unsigned long>(wire.rxBytes),
+          static_cast<unsigned long>(wire.aliasedPublishes));
+  appendf(heartbeat, sizeof(heartbeat), &used, " cfg_reconnects=%lu cfg_resubscribes=%lu",
+          static_cast<unsigned long>(g_config.reconnects),
+          static_cast<unsigned long>(g_config.resubscribes));
+  const tasks::estop::Stats stops = tasks::estop::stats();
+  appendf(heartbeat, sizeof(heartbeat), &used,
+          " estop=%lu estop_us=%lu estop_max_us=%lu estop_flushed=%lu",
+          static_cast<unsigned long>(stops.stops), static_cast<unsigned long>(stops.lastLatencyUs),
+          static_cast<unsigned long>(stops.maxLatencyUs),
+          static_cast<unsigned long>(stops.flushedCommands));
+  const tasks::wifi::Stats wifi = tasks::wifi::stats();
+  appendf(heartbeat, sizeof(heartbeat), &used, " wifi_rssi=%d wifi_roams=%lu wifi_gap_ms=%lu",
+          static_cast<int>(wifi.rssi), static_cast<unsigned long>(wifi.roams),
+          static_cast<unsigned long>(wifi.lastGapMs));
+  const tasks::schedule::Stats schedule = tasks::schedule::stats();
+  appendf(heartbeat, sizeof(heartbeat), &used,
+          " sync_err_us=%lu sync_drift_ppb=%ld sched_fired=%lu sched_rejected=%lu sched_missed=%lu "
+          "sched_late_us=%lu sched_late_max_us=%lu",
+          static_cast<unsigned long>(schedule.syncErrorUs), static_cast<long>(schedule.driftPpb),
+          static_cast<unsigned long>(schedule.fired), static_cast<unsigned long>(schedule.rejected),
+          static_cast<unsigned long>(schedule.missed), static_cast<unsigned long>(schedule.lastLateUs),
+          static_cast<unsigned long>(schedule.maxLateUs));
+  const tasks::telemetry::Stats state = tasks::telemetry::stats();
+  appendf(heartbeat, sizeof(heartbeat), &used, " state_samples=%lu state_bytes=%lu",
+          static_cast<unsigned long>(state.samples), static_cast<unsigned long>(state.bytes));
+  if (diag::alloc::ENABLED) {
+    appendf(heartbeat, sizeof(heartbeat), &used, " cmd_allocs=%lu",
+            static_cast<unsigned long>(diag::alloc::scopedAllocations()));
+  }
+  if (g_params.tls) {
+    const net::TlsSession::Stats &tls = g_client->tlsStats();
+    appendf(heartbeat, sizeof(heartbeat), &used,
+            " tls_full=%lu tls_full_ms=%lu tls_resumed=%lu tls_resumed_ms=%lu",
+            static_cast<unsigned long>(tls.fullHandshakes), static_cast<unsigned long>(tls.lastFullMs),
+            static_cast<unsigned long>(tls.resumedHandshakes),
+            static_cast<unsigned long>(tls.lastResumedMs));
+  }
+  g_loopMaxUs = 0;
   if (g_params.publishTopic[0] != '\0') {
-    if (!g_client.publish(g_params.publishTopic, kHeartbeatPayload)) {
+    if (!g_client->publish(g_params.publishTopic, heartbeat)) {
       Serial.println("MQTT publish failed");
     }
   }
 
   if (g_params.heartbeatTopic[0] != '\0' &&
       strcmp(g_params.heartbeatTopic, g_params.publishTopic) != 0) {
-    if (!g_client.publish(g_params.heartbeatTopic, kHeartbeatPayload)) {
+    // The heartbeat fills most of the client's TX buffer; each publish after
+    // the first goes out on its own.
+    g_client->flush(now);
+    if (!g_client->publish(g_params.heartbeatTopic, heartbeat)) {
       Serial.println("MQTT heartbeat publish failed");
     }
   }
 
+  if (g_params.ackTopic[0] != '\0' && diag::trace::histogram().count != g_lastHistogramCount) {
+    char histogram[160];
+    diag::trace::formatHistogram(histogram, sizeof(histogram));
+    g_client->flush(now);
+    if (g_client->publish(g_params.ackTopic, histogram)) {
+      g_lastHistogramCount = diag::trace::histogram().count;
+    }
+  }
+
   g_lastHeartbeat = now;
 }
 
-}  // namespace
+void publishPendingAcks() {
+  char ack[64];
+  while (diag::trace::popAck(ack, sizeof(ack))) {
+    if (g_params.ackTopic[0] == '\0') {
+      continue;
+    }
+    if (!g_client->publish(g_params.ackTopic, ack)) {
+      Serial.println("MQTT ack publish failed");
+    }
+  }
+}
 
-void init() {
-  g_client.setBufferSize(MQTT_SERIAL_BUFFER);
-  g_client.setCallback(mqttMessageCallback);
-  g_params = provisioning::mqtt();
-  g_lastConfigVersion = provisioning::mqttVersion();
-  applyMqttServer();
+// The boot timeline goes out with the first session, and again if the first
+// command lands after it.
+void publishBootReport() {
+  const char *topic =
+      g_params.heartbeatTopic[0] != '\0' ? g_params.heartbeatTopic : g_params.publishTopic;
+  char report[320];
+  if (topic[0] == '\0' || !diag::boot::peekReport(report, sizeof(report))) {
+    return;
+  }
+  if (g_client->publish(topic, report)) {
+    diag::boot::popReport();
+  }
 }
 
-void loop() {
+// Stalls captured before a reset are still in RTC memory and go out on the
+// first session after it.
+void publishStallReports() {
+  const char *topic =
+      g_params.heartbeatTopic[0] != '\0' ? g_params.heartbeatTopic : g_params.publishTopic;
+  if (topic[0] == '\0') {
+    return;
+  }
+  char report[320];
+  while (diag::stall::peekReport(report, sizeof(report))) {
+    if (!g_client->publish(topic, report)) {
+      return;
+    }
+    diag::stall::popReport();
+  }
+}
+
+void recordLoopTime(uint32_t startUs) {
+  const uint32_t elapsed = micros() - startUs;
+  if (elapsed > g_loopMaxUs) {
+    g_loopMaxUs = elapsed;
+  }
+}
+
+void runOnce() {
+  handleTimingUpdates();
   handleConfigUpdates();
 
   if (!tasks::wifi::isConnected()) {
-    if (g_client.connected()) {
-      g_client.disconnect();
-    }
+    disconnectAll();
+    // The session was lost with the link, not when the link comes back.
+    reportConnectionChanges(millis());
     return;
   }
 
-  if (!mqttEnsureConnected()) {
+  const uint32_t now = millis();
+  diag::stall::mark(diag::stall::Marker::MqttIo);
+  const bool espNowFlush = tasks::estop::flushing(tasks::estop::Origin::EspNow);
+  const uint32_t rxBefore = g_client->wireStats().rxBytes;
+  for (net::MqttClient &client : g_clients) {
+    client.loop(now);
+  }
+  // An ESP-NOW stop has no place in the MQTT stream to end its flush at; it
+  // ends with the first pass, begun after the stop, that reads nothing new.
+  if (espNowFlush && g_client->wireStats().rxBytes == rxBefore) {
+    tasks::estop::endFlush(tasks::estop::Origin::EspNow);
+  }
+  diag::stall::mark(diag::stall::Marker::MqttConnect);
+  if (!mqttEnsureConnected(now)) {
     return;
   }
 
-  g_client.loop();
+  diag::stall::mark(diag::stall::Marker::MqttPublish);
+  publishBootReport();
+  publishStallReports();
+  publishPendingAcks();
+  flushSerialEcho();
   pumpSerialToMqtt();
 
-  const uint32_t now = millis();
-  if ((now - g_lastHeartbeat) >= MQTT_HEARTBEAT_INTERVAL_MS) {
+  if ((now - g_lastHeartbeat) >= g_heartbeatIntervalMs) {
     publishHeartbeat(now);
   }
+  g_client->flush(now);
 }
 
-bool isConnected() { return g_client.connected(); }
+void armWakeups(uint32_t now) {
+  using tasks::event_loop::Source;
+
+  for (net::MqttClient &client : g_clients) {
+    if (!client.idle()) {
+      tasks::event_loop::watchSocket(client.fd(), client.wantsWrite());
+      tasks::event_loop::setDeadline(Source::MqttClient, client.nextDeadlineMs(now));
+    }
+  }
+  if (g_params.valid && tasks::wifi::isConnected()) {
+    if (g_racing) {
+      tasks::event_loop::setDeadline(Source::MqttRetry, g_nextLaunchMs);
+    } else if (g_activeSlot == NO_SLOT) {
+      const uint32_t retryMs =
+          g_reconnectAttempted ? g_lastReconnectAttempt + g_reconnectDelayMs : now;
+      tasks::event_loop::setDeadline(Source::MqttRetry, retryMs);
+    } else if (g_activeSlot > 0 && g_probeSlot == NO_SLOT) {
+      tasks::event_loop::setDeadline(Source::MqttRetry, g_lastProbeMs + MQTT_FAILBACK_PROBE_MS);
+    }
+  }
+
+  if (g_client->connected()) {
+    tasks::event_loop::setDeadline(Source::MqttHeartbeat, g_lastHeartbeat + g_heartbeatIntervalMs);
+  }
+  if (g_serialEchoLength > 0) {
+    tasks::event_loop::setDeadline(Source::SerialOutput, now + SERIAL_OUTPUT_RETRY_MS);
+  }
+}
+
+}  // namespace
+
+void init() {
+  for (net::MqttClient &client : g_clients) {
+    routeMessages(client, true);
+  }
+  g_params = provisioning::mqtt();
+  g_lastConfigVersion = provisioning::mqttVersion();
+  buildSubscriptions();
+}
+
+void loop() {
+  const uint32_t startUs = micros();
+  runOnce();
+  armWakeups(millis());
+  recordLoopTime(startUs);
+}
+
+bool isConnected() { return g_client->connected(); }
+
+bool publish(const char *topic, const uint8_t *payload, size_t length) {
+  if (!g_client->publish(topic, payload, length)) {
+    return false;
+  }
+  g_client->flush(millis());
+  return true;
+}
 
 }  // namespace tasks::mqtt
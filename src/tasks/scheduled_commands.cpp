@@ -0,0 +1,241 @@
+#include "tasks/scheduled_commands.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "config/defaults.h"
+#include "diag/event_log.h"
+#include "diag/latency_trace.h"
+#include "net/clock_sync.h"
+#include "tasks/event_loop.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+
+namespace tasks::schedule {
+namespace {
+constexpr size_t QUEUE_DEPTH = 8;
+constexpr size_t BODY_MAX = 64;
+// Until the estimator has a full window, exchanges run this often.
+constexpr uint32_t FAST_SYNC_INTERVAL_MS = 250;
+// The event loop only wakes to the millisecond (and a tick late at worst), so
+// the last stretch before a due time is spun out on the microsecond clock.
+constexpr int64_t SPIN_WINDOW_US = 2000;
+constexpr int64_t LATE_LIMIT_US = static_cast<int64_t>(SCHEDULE_LATE_LIMIT_MS) * 1000;
+
+struct Pending {
+  envelope::CommandEnvelope envelope;
+  // On the controller's clock; converted to ours each pass so a refined
+  // estimate also moves commands already queued.
+  int64_t dueRemoteUs;
+  char body[BODY_MAX];
+  bool used;
+};
+
+net::ClockSync g_sync;
+Pending g_queue[QUEUE_DEPTH];
+Stats g_stats{};
+char g_replyTopic[96];
+uint32_t g_requestSeq = 0;
+int64_t g_requestT1 = 0;
+uint32_t g_lastRequestMs = 0;
+bool g_requestSent = false;
+// Set by cancelAll() from whichever task saw the stop.
+std::atomic<bool> g_cancelRequested{false};
+
+constexpr bool enabled() { return MQTT_SYNC_TOPIC[0] != '\0'; }
+
+int64_t localUs() { return esp_timer_get_time(); }
+
+void reject(const envelope::CommandEnvelope &envelope, int32_t dueInMs) {
+  ++g_stats.rejected;
+  DIAG_LOG(SCHEDULE_REJECTED, envelope.id, dueInMs);
+}
+
+void applyCancel() {
+  if (!g_cancelRequested.exchange(false, std::memory_order_acquire)) {
+    return;
+  }
+  for (Pending &pending : g_queue) {
+    if (pending.used) {
+      pending.used = false;
+      ++g_stats.cancelled;
+    }
+  }
+}
+
+void requestSync() {
+  if (g_replyTopic[0] == '\0' || !tasks::mqtt::isConnected()) {
+    g_requestSent = false;
+    return;
+  }
+  const uint32_t now = millis();
+  const uint32_t interval =
+      g_sync.exchanges() < net::ClockSync::WINDOW ? FAST_SYNC_INTERVAL_MS : MQTT_SYNC_INTERVAL_MS;
+  if (g_requestSent && (now - g_lastRequestMs) < interval) {
+    tasks::event_loop::setDeadline(tasks::event_loop::Source::Schedule, g_lastRequestMs + interval);
+    return;
+  }
+
+  char request[160];
+  ++g_requestSeq;
+  g_requestT1 = localUs();
+  const int length = snprintf(request, sizeof(request), "%s,%lu,%lld", g_replyTopic,
+                              static_cast<unsigned long>(g_requestSeq),
+                              static_cast<long long>(g_requestT1));
+  g_lastRequestMs = now;
+  g_requestSent = true;
+  if (length > 0 && static_cast<size_t>(length) < sizeof(request)) {
+    tasks::mqtt::publish(MQTT_SYNC_TOPIC, reinterpret_cast<const uint8_t *>(request),
+                         static_cast<size_t>(length));
+  }
+  tasks::event_loop::setDeadline(tasks::event_loop::Source::Schedule, now + interval);
+}
+
+void run(Pending &pending, int64_t lateUs) {
+  pending.envelope.body = pending.body;
+  g_stats.lastLateUs = static_cast<uint32_t>(lateUs);
+  if (g_stats.lastLateUs > g_stats.maxLateUs) {
+    g_stats.maxLateUs = g_stats.lastLateUs;
+  }
+  ++g_stats.fired;
+  DIAG_LOG(SCHEDULE_FIRED, pending.envelope.id, static_cast<int32_t>(lateUs));
+  // Traced from the due time, so the ack reports dispatch cost rather than
+  // how long the command was held.
+  diag::trace::beginCommand(pending.envelope, micros());
+  onMessage(pending.body, pending.envelope.bodyLength);
+  diag::trace::endCommand();
+}
+
+Pending *earliest() {
+  Pending *first = nullptr;
+  for (Pending &pending : g_queue) {
+    if (pending.used && (first == nullptr || pending.dueRemoteUs < first->dueRemoteUs)) {
+      first = &pending;
+    }
+  }
+  return first;
+}
+
+void fireDue() {
+  for (Pending *pending = earliest(); pending != nullptr; pending = earliest()) {
+    const int64_t dueUs = g_sync.toLocal(pending->dueRemoteUs);
+    int64_t now = localUs();
+    if (dueUs - now > SPIN_WINDOW_US) {
+      const uint32_t sleepMs = static_cast<uint32_t>((dueUs - now - SPIN_WINDOW_US) / 1000);
+      tasks::event_loop::setDeadline(tasks::event_loop::Source::Schedule, millis() + sleepMs);
+      return;
+    }
+    while (now < dueUs) {
+      now = localUs();
+    }
+
+    pending->used = false;
+    const int64_t lateUs = now - dueUs;
+    if (lateUs > LATE_LIMIT_US) {
+      ++g_stats.missed;
+      DIAG_LOG(SCHEDULE_REJECTED, pending->envelope.id, static_cast<int32_t>(-lateUs / 1000));
+      continue;
+    }
+    run(*pending, lateUs);
+  }
+}
+
+}  // namespace
+
+void loop() {
+  if (!enabled()) {
+    return;
+  }
+  applyCancel();
+  requestSync();
+  fireDue();
+}
+
+bool handleMessage(const char *topic, const uint8_t *payload, size_t length) {
+  const int64_t t4 = localUs();
+  if (g_replyTopic[0] == '\0' || strcmp(topic, g_replyTopic) != 0) {
+    return false;
+  }
+
+  char text[96];
+  const size_t copyLen = length < sizeof(text) - 1 ? length : sizeof(text) - 1;
+  memcpy(text, payload, copyLen);
+  text[copyLen] = '\0';
+
+  unsigned long seq = 0;
+  long long t1 = 0;
+  long long t2 = 0;
+  long long t3 = 0;
+  if (sscanf(text, "%lu,%lld,%lld,%lld", &seq, &t1, &t2, &t3) != 4) {
+    return true;
+  }
+  // Replies to anything but the outstanding request, including ones
+  // addressed to a previous boot, are ignored.
+  if (static_cast<uint32_t>(seq) != g_requestSeq || t1 != g_requestT1) {
+    return true;
+  }
+
+  const bool wasSynced = g_sync.synced();
+  if (g_sync.addExchange(t1, t2, t3, t4)) {
+    g_stats.syncErrorUs = static_cast<uint32_t>(g_sync.errorBoundUs());
+    g_stats.driftPpb = g_sync.driftPpb();
+    g_stats.syncExchanges = g_sync.exchanges();
+    if (!wasSynced) {
+      Serial.printf("Clock synced to controller, error bound %lu us\n",
+                    static_cast<unsigned long>(g_stats.syncErrorUs));
+    }
+  }
+  return true;
+}
+
+size_t subscriptions(const char *clientId, const char **out, size_t capacity) {
+  if (!enabled() || capacity == 0) {
+    g_replyTopic[0] = '\0';
+    return 0;
+  }
+  snprintf(g_replyTopic, sizeof(g_replyTopic), "%s/%s", MQTT_SYNC_TOPIC,
+           clientId[0] != '\0' ? clientId : "mqtt-client");
+  out[0] = g_replyTopic;
+  return 1;
+}
+
+bool enqueue(const envelope::CommandEnvelope &envelope) {
+  // Only what was queued ahead of a stop goes with it.
+  applyCancel();
+  if (!g_sync.synced() || envelope.bodyLength > BODY_MAX) {
+    reject(envelope, 0);
+    return false;
+  }
+
+  // `at` is the controller's milliseconds modulo 2^32; unwrap it next to the
+  // controller's current time.
+  const int64_t remoteNowMs = g_sync.toRemote(localUs()) / 1000;
+  const int32_t dueInMs = static_cast<int32_t>(envelope.executeAtMs - static_cast<uint32_t>(remoteNowMs));
+  if (dueInMs < -static_cast<int32_t>(SCHEDULE_LATE_LIMIT_MS) || dueInMs > SCHEDULE_HORIZON_MS) {
+    reject(envelope, dueInMs);
+    return false;
+  }
+
+  for (Pending &pending : g_queue) {
+    if (pending.used) {
+      continue;
+    }
+    pending.envelope = envelope;
+    memcpy(pending.body, envelope.body, envelope.bodyLength);
+    pending.dueRemoteUs = (remoteNowMs + dueInMs) * 1000;
+    pending.used = true;
+    return true;
+  }
+  reject(envelope, dueInMs);
+  return false;
+}
+
+void cancelAll() { g_cancelRequested.store(true, std::memory_order_release); }
+
+Stats stats() { return g_stats; }
+
+}  // namespace tasks::schedule
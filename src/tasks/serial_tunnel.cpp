@@ -0,0 +1,254 @@
+#include "tasks/serial_tunnel.h"
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config/defaults.h"
+#include "tasks/event_loop.h"
+#include "tasks/mqtt_task.h"
+
+namespace tasks::tunnel {
+namespace {
+Stats g_stats{};
+
+#if SERIAL_TUNNEL_ENABLED
+constexpr size_t DOWN_CAPACITY = SERIAL_TUNNEL_DOWN_BUFFER;
+static_assert((DOWN_CAPACITY & (DOWN_CAPACITY - 1)) == 0,
+              "SERIAL_TUNNEL_DOWN_BUFFER must be a power of two");
+// Credits are returned once a quarter of the window drained, or after this
+// long if the host is trickling.
+constexpr uint32_t CREDIT_BATCH_BYTES = DOWN_CAPACITY / 4;
+constexpr uint32_t CREDIT_IDLE_MS = 20;
+constexpr uint32_t UART_RETRY_MS = 2;
+
+HardwareSerial &g_uart = Serial2;
+
+uint8_t g_down[DOWN_CAPACITY];
+uint8_t g_up[SERIAL_TUNNEL_UP_CHUNK];
+size_t g_upLength = 0;
+uint32_t g_upFirstByteMs = 0;
+uint32_t g_creditedDown = 0;
+uint32_t g_lastCreditMs = 0;
+bool g_creditDue = false;
+bool g_wasConnected = false;
+
+bool topicIs(const char *topic, const char *expected) { return strcmp(topic, expected) == 0; }
+
+uint32_t downUsed() { return g_stats.downAccepted - g_stats.downWritten; }
+
+void acceptDown(const uint8_t *payload, size_t length) {
+  if (length > DOWN_CAPACITY - downUsed()) {
+    // The host ignored its credit; dropping the whole chunk keeps the byte
+    // stream aligned with what the host will see acknowledged.
+    ++g_stats.downOverruns;
+    g_creditDue = true;
+    return;
+  }
+
+  const size_t offset = g_stats.downAccepted & (DOWN_CAPACITY - 1);
+  const size_t first = length < DOWN_CAPACITY - offset ? length : DOWN_CAPACITY - offset;
+  memcpy(g_down + offset, payload, first);
+  memcpy(g_down, payload + first, length - first);
+  g_stats.downAccepted += static_cast<uint32_t>(length);
+}
+
+void acceptHostCredit(const uint8_t *payload, size_t length) {
+  char text[48];
+  const size_t copyLen = length < sizeof(text) - 1 ? length : sizeof(text) - 1;
+  memcpy(text, payload, copyLen);
+  text[copyLen] = '\0';
+
+  unsigned long epoch = 0;
+  unsigned long acked = 0;
+  if (sscanf(text, "epoch=%lu,up_acked=%lu", &epoch, &acked) != 2 || epoch != g_stats.epoch) {
+    return;
+  }
+  const uint32_t value = static_cast<uint32_t>(acked);
+  // Only move forward, and never past what was actually sent.
+  if (static_cast<int32_t>(value - g_stats.upAcked) > 0 &&
+      static_cast<int32_t>(g_stats.upSent - value) >= 0) {
+    g_stats.upAcked = value;
+  }
+}
+
+// Bytes still queued from the previous session are dropped with it: the host
+// counts everything it did not see acknowledged as lost.
+void startSession() {
+  ++g_stats.epoch;
+  g_stats.downAccepted = 0;
+  g_stats.downWritten = 0;
+  g_stats.upSent = 0;
+  g_stats.upAcked = 0;
+  g_upLength = 0;
+  g_creditedDown = 0;
+  g_creditDue = true;
+}
+
+void drainDown() {
+  while (downUsed() > 0) {
+    const int room = g_uart.availableForWrite();
+    if (room <= 0) {
+      return;
+    }
+    const size_t offset = g_stats.downWritten & (DOWN_CAPACITY - 1);
+    size_t chunk = downUsed();
+    if (chunk > DOWN_CAPACITY - offset) chunk = DOWN_CAPACITY - offset;
+    if (chunk > static_cast<size_t>(room)) chunk = static_cast<size_t>(room);
+    const size_t written = g_uart.write(g_down + offset, chunk);
+    if (written == 0) {
+      return;
+    }
+    g_stats.downWritten += static_cast<uint32_t>(written);
+  }
+}
+
+void pumpUp(uint32_t now) {
+  const uint32_t inFlight = g_stats.upSent - g_stats.upAcked;
+  if (inFlight >= SERIAL_TUNNEL_UP_WINDOW) {
+    // Window closed: leave the bytes in the UART buffer (and, with RTS wired,
+    // hold off the sender) until the host acknowledges.
+    return;
+  }
+
+  // What is already coalesced in g_up goes out against the same window.
+  size_t room = sizeof(g_up) - g_upLength;
+  const uint32_t windowLeft = SERIAL_TUNNEL_UP_WINDOW - inFlight;
+  if (room > windowLeft - g_upLength) room = windowLeft - g_upLength;
+  const int available = g_uart.available();
+  if (available > 0 && room > 0) {
+    const size_t want =
+        static_cast<size_t>(available) < room ? static_cast<size_t>(available) : room;
+    if (g_upLength == 0) {
+      g_upFirstByteMs = now;
+    }
+    g_upLength += g_uart.read(g_up + g_upLength, want);
+  }
+
+  if (g_upLength == 0) {
+    return;
+  }
+  // Coalesce a few milliseconds of UART input into one publish.
+  const bool full = g_upLength == sizeof(g_up) || g_upLength >= windowLeft;
+  if (!full && (now - g_upFirstByteMs) < SERIAL_TUNNEL_FLUSH_MS) {
+    return;
+  }
+  if (tasks::mqtt::publish(MQTT_TUNNEL_UP_TOPIC, g_up, g_upLength)) {
+    g_stats.upSent += static_cast<uint32_t>(g_upLength);
+    g_upLength = 0;
+  }
+}
+
+void publishCredit(uint32_t now) {
+  const uint32_t progress = g_stats.downWritten - g_creditedDown;
+  const bool batchReady = progress >= CREDIT_BATCH_BYTES;
+  const bool idleReady = progress > 0 && (now - g_lastCreditMs) >= CREDIT_IDLE_MS;
+  if (!g_creditDue && !batchReady && !idleReady) {
+    return;
+  }
+
+  char text[96];
+  const int length =
+      snprintf(text, sizeof(text), "epoch=%lu,down_acked=%lu,up_sent=%lu,overruns=%lu",
+               static_cast<unsigned long>(g_stats.epoch),
+               static_cast<unsigned long>(g_stats.downWritten),
+               static_cast<unsigned long>(g_stats.upSent),
+               static_cast<unsigned long>(g_stats.downOverruns));
+  if (length > 0 &&
+      tasks::mqtt::publish(MQTT_TUNNEL_DEVICE_CREDIT_TOPIC, reinterpret_cast<const uint8_t *>(text),
+                           static_cast<size_t>(length))) {
+    g_creditedDown = g_stats.downWritten;
+    g_lastCreditMs = now;
+    g_creditDue = false;
+  }
+}
+
+void armWakeups(uint32_t now) {
+  using tasks::event_loop::Source;
+  if (g_upLength > 0) {
+    tasks::event_loop::setDeadline(Source::SerialTunnel, g_upFirstByteMs + SERIAL_TUNNEL_FLUSH_MS);
+  }
+  if (downUsed() > 0) {
+    tasks::event_loop::setDeadline(Source::SerialTunnel, now + UART_RETRY_MS);
+  }
+  if (g_stats.downWritten != g_creditedDown) {
+    tasks::event_loop::setDeadline(Source::SerialTunnel, g_lastCreditMs + CREDIT_IDLE_MS);
+  }
+}
+#endif
+
+}  // namespace
+
+void init() {
+#if SERIAL_TUNNEL_ENABLED
+  // Buffer sizes must be set before begin(); the IDF UART driver then fills
+  // them from the RX/TX interrupts.
+  g_uart.setRxBufferSize(SERIAL_TUNNEL_UART_BUFFER);
+  g_uart.setTxBufferSize(SERIAL_TUNNEL_UART_BUFFER);
+  g_uart.begin(SERIAL_TUNNEL_BAUD, SERIAL_8N1, SERIAL_TUNNEL_RX_PIN, SERIAL_TUNNEL_TX_PIN);
+  if (SERIAL_TUNNEL_RTS_PIN >= 0 && SERIAL_TUNNEL_CTS_PIN >= 0) {
+    g_uart.setPins(SERIAL_TUNNEL_RX_PIN, SERIAL_TUNNEL_TX_PIN, SERIAL_TUNNEL_CTS_PIN,
+                   SERIAL_TUNNEL_RTS_PIN);
+    g_uart.setHwFlowCtrlMode(UART_HW_FLOWCTRL_CTS_RTS, 100);
+  }
+  g_uart.onReceive(tasks::event_loop::wake);
+  Serial.printf("Serial tunnel on UART2 at %lu baud\n",
+                static_cast<unsigned long>(SERIAL_TUNNEL_BAUD));
+#endif
+}
+
+void loop() {
+#if SERIAL_TUNNEL_ENABLED
+  const bool connected = tasks::mqtt::isConnected();
+  if (connected && !g_wasConnected) {
+    startSession();
+  }
+  g_wasConnected = connected;
+
+  // The downlink drains even while MQTT is down: those bytes were credited.
+  drainDown();
+  const uint32_t now = millis();
+  if (connected) {
+    pumpUp(now);
+    publishCredit(now);
+  }
+  armWakeups(now);
+#endif
+}
+
+bool handleMessage(const char *topic, const uint8_t *payload, size_t length) {
+#if SERIAL_TUNNEL_ENABLED
+  if (topicIs(topic, MQTT_TUNNEL_DOWN_TOPIC)) {
+    acceptDown(payload, length);
+    return true;
+  }
+  if (topicIs(topic, MQTT_TUNNEL_HOST_CREDIT_TOPIC)) {
+    acceptHostCredit(payload, length);
+    return true;
+  }
+#else
+  (void)topic;
+  (void)payload;
+  (void)length;
+#endif
+  return false;
+}
+
+size_t subscriptions(const char **out, size_t capacity) {
+#if SERIAL_TUNNEL_ENABLED
+  if (capacity < 2) {
+    return 0;
+  }
+  out[0] = MQTT_TUNNEL_DOWN_TOPIC;
+  out[1] = MQTT_TUNNEL_HOST_CREDIT_TOPIC;
+  return 2;
+#else
+  (void)out;
+  (void)capacity;
+  return 0;
+#endif
+}
+
+Stats stats() { return g_stats; }
+
+}  // namespace tasks::tunnel
@@ -0,0 +1,106 @@
+#include "tasks/telemetry.h"
+
+#include <Arduino.h>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "diag/latency_trace.h"
+#include "net/state_stream.h"
+#include "tasks/event_loop.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+
+namespace tasks::telemetry {
+namespace {
+constexpr uint32_t MAX_RATE_HZ = 100;
+
+net::StateEncoder g_encoder;
+uint8_t g_batch[STATE_BATCH_BYTES];
+bool g_batchOpen = false;
+uint32_t g_batchStartMs = 0;
+// State as the last pass left it.
+int32_t g_state[net::StateEncoder::MAX_CHANNELS];
+size_t g_channels = 0;
+uint32_t g_nextSampleMs = 0;
+uint32_t g_sequence = 0;
+uint32_t g_periodMs = 0;
+uint32_t g_batchMs = STATE_BATCH_MS;
+uint32_t g_lastTuningVersion = 0;
+Stats g_stats{};
+
+void refreshTuning() {
+  const uint32_t version = provisioning::version(provisioning::Owner::Telemetry);
+  if (version == g_lastTuningVersion) {
+    return;
+  }
+  g_lastTuningVersion = version;
+  const provisioning::Tuning tuning = provisioning::tuning();
+  const uint32_t hz = tuning.stateStreamHz < MAX_RATE_HZ ? tuning.stateStreamHz : MAX_RATE_HZ;
+  g_periodMs = hz == 0 ? 0 : 1000 / hz;
+  g_batchMs = tuning.stateBatchMs;
+  // The period is part of the batch header, so a new rate starts a new batch.
+  g_batchOpen = false;
+}
+
+size_t sample(int32_t *values) {
+  size_t count = sampleActuators(values, net::StateEncoder::MAX_CHANNELS - 1);
+  values[count++] = static_cast<int32_t>(diag::trace::lastCommandId());
+  return count;
+}
+
+void startBatch(uint32_t startMs) {
+  g_encoder.begin(g_batch, sizeof(g_batch), g_channels, static_cast<uint16_t>(g_periodMs), startMs,
+                  g_sequence++);
+  g_batchStartMs = millis();
+  g_batchOpen = true;
+}
+
+void publishBatch() {
+  const size_t length = g_encoder.finish();
+  if (tasks::mqtt::publish(MQTT_STATE_TOPIC, g_batch, length)) {
+    ++g_stats.batches;
+    g_stats.bytes += static_cast<uint32_t>(length);
+  }
+  g_batchOpen = false;
+}
+
+}  // namespace
+
+void loop() {
+  refreshTuning();
+  if (g_periodMs == 0 || MQTT_STATE_TOPIC[0] == '\0' || !tasks::mqtt::isConnected()) {
+    g_batchOpen = false;
+    return;
+  }
+
+  const uint32_t now = millis();
+  if (!g_batchOpen) {
+    g_channels = sample(g_state);
+    g_nextSampleMs = now;
+    startBatch(now);
+  }
+
+  // Actuators only change inside loop passes, so every slot up to now saw
+  // the state the previous pass left behind. Filling them in here is right
+  // to within one pass, and the loop never wakes just to take a sample.
+  while (static_cast<int32_t>(now - g_nextSampleMs) >= 0) {
+    if (!g_encoder.add(g_state)) {
+      publishBatch();
+      startBatch(g_nextSampleMs);
+      g_encoder.add(g_state);
+    }
+    ++g_stats.samples;
+    g_nextSampleMs += g_periodMs;
+  }
+  g_channels = sample(g_state);
+
+  if ((now - g_batchStartMs) >= g_batchMs) {
+    publishBatch();
+    startBatch(g_nextSampleMs);
+  }
+  tasks::event_loop::setDeadline(tasks::event_loop::Source::Telemetry, g_batchStartMs + g_batchMs);
+}
+
+Stats stats() { return g_stats; }
+
+}  // namespace tasks::telemetry
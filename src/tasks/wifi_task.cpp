@@ -1,6 +1,7 @@
 #include "tasks/wifi_task.h"
 
 #include <Arduino.h>
+#include <string.h>
 
 #if defined(ESP8266)
 #include <ESP8266WiFi.h>
@@ -8,19 +9,47 @@
 #include <WiFi.h>
 #endif
 
+#include "config/defaults.h"
 #include "config/provisioning_store.h"
+#include "diag/boot_timeline.h"
+#include "diag/stall_detector.h"
+#include "net/wifi_roamer.h"
+#include "tasks/event_loop.h"
 
 namespace tasks::wifi {
 namespace {
-constexpr uint32_t WIFI_RETRY_DELAY_MS = 5000;
+constexpr uint32_t RSSI_SAMPLE_MS = 1000;
+constexpr net::WifiRoamer::Config ROAM_CONFIG{
+    WIFI_ROAM_RSSI_DBM,        WIFI_ROAM_HYSTERESIS_DB,   WIFI_ROAM_SCAN_INTERVAL_MS,
+    WIFI_ROAM_FULL_SCAN_EVERY, WIFI_ROAM_MIN_INTERVAL_MS, WIFI_ROAM_CACHE_TTL_MS};
 
 provisioning::WifiCredentials g_activeCreds{};
+net::WifiRoamer g_roamer(ROAM_CONFIG);
+Stats g_stats{};
+// Network the next plain (SSID only) attempt goes to.
+size_t g_slot = 0;
+// After an unplanned drop the first attempt goes to the best cached access
+// point; later ones walk the provisioned networks in priority order.
+bool g_tryCached = false;
+bool g_scanRunning = false;
+bool g_gapOpen = false;
+uint32_t g_gapStartMs = 0;
+uint32_t g_lastRssiMs = 0;
+uint32_t g_retryDelayMs = WIFI_RETRY_DELAY_MS;
+uint32_t g_lastTimingVersion = 0;
 uint32_t g_lastAttemptMs = 0;
 uint32_t g_lastWifiVersion = 0;
 bool g_hasCredentials = false;
 bool g_connectionInFlight = false;
 bool g_connected = false;
 
+#if !defined(ESP8266)
+void onWifiEvent(WiFiEvent_t event) {
+  (void)event;
+  tasks::event_loop::wake();
+}
+#endif
+
 void configureStation() {
 #if defined(ESP8266)
   WiFi.persistent(false);
@@ -28,11 +57,28 @@ void configureStation() {
   WiFi.mode(WIFI_STA);
   WiFi.setAutoReconnect(true);
   WiFi.disconnect();
+#if !defined(ESP8266)
+  WiFi.onEvent(onWifiEvent);
+#endif
 }
 
 void refreshCredentials() {
   g_activeCreds = provisioning::wifi();
-  g_hasCredentials = g_activeCreds.valid && g_activeCreds.ssid[0] != '\0';
+  g_hasCredentials = g_activeCreds.valid;
+  g_slot = 0;
+  g_tryCached = false;
+  g_roamer.reset();
+}
+
+bool slotUsable(size_t slot) { return g_activeCreds.networks[slot].ssid[0] != '\0'; }
+
+int slotForSsid(const char *ssid) {
+  for (size_t slot = 0; slot < provisioning::WIFI_NETWORK_SLOTS; ++slot) {
+    if (slotUsable(slot) && strcmp(g_activeCreds.networks[slot].ssid, ssid) == 0) {
+      return static_cast<int>(slot);
+    }
+  }
+  return -1;
 }
 
 void logCredentialsMissing() {
@@ -41,17 +87,156 @@ void logCredentialsMissing() {
   }
 }
 
+void connectToAccessPoint(const net::WifiRoamer::AccessPoint &ap) {
+  const provisioning::WifiNetwork &network = g_activeCreds.networks[ap.slot];
+  Serial.printf("Joining WiFi SSID '%s' via %02x:%02x:%02x:%02x:%02x:%02x ch %u (%d dBm)\n",
+                network.ssid, ap.bssid[0], ap.bssid[1], ap.bssid[2], ap.bssid[3], ap.bssid[4],
+                ap.bssid[5], ap.channel, ap.rssi);
+  WiFi.begin(network.ssid, network.password, ap.channel, ap.bssid);
+}
+
 void beginConnectionAttempt() {
   if (!g_hasCredentials) {
     return;
   }
 
-  Serial.printf("Connecting to WiFi SSID '%s'\n", g_activeCreds.ssid);
-  WiFi.begin(g_activeCreds.ssid, g_activeCreds.password);
-  g_lastAttemptMs = millis();
+  const uint32_t now = millis();
+  diag::stall::mark(diag::stall::Marker::WifiBegin);
+  net::WifiRoamer::AccessPoint ap{};
+  if (g_tryCached && g_roamer.bestCandidate(now, &ap)) {
+    connectToAccessPoint(ap);
+  } else {
+    while (!slotUsable(g_slot)) {
+      g_slot = (g_slot + 1) % provisioning::WIFI_NETWORK_SLOTS;
+    }
+    const provisioning::WifiNetwork &network = g_activeCreds.networks[g_slot];
+    Serial.printf("Connecting to WiFi SSID '%s'\n", network.ssid);
+    WiFi.begin(network.ssid, network.password);
+    g_slot = (g_slot + 1) % provisioning::WIFI_NETWORK_SLOTS;
+  }
+  g_tryCached = false;
+  g_lastAttemptMs = now;
   g_connectionInFlight = true;
 }
 
+void openGap(uint32_t now) {
+  if (!g_gapOpen) {
+    g_gapOpen = true;
+    g_gapStartMs = now;
+  }
+}
+
+void onLinkUp(uint32_t now) {
+  diag::boot::mark(diag::boot::Stage::WifiConnected);
+  uint8_t *bssid = WiFi.BSSID();
+  if (bssid != nullptr) {
+    g_roamer.onConnected(bssid, now);
+  }
+  if (g_gapOpen) {
+    g_gapOpen = false;
+    g_stats.lastGapMs = now - g_gapStartMs;
+  }
+  g_lastRssiMs = now - RSSI_SAMPLE_MS;
+  Serial.printf("WiFi connected to '%s' ch %ld, IP: %s, gap %lu ms\n", WiFi.SSID().c_str(),
+                static_cast<long>(WiFi.channel()), WiFi.localIP().toString().c_str(),
+                static_cast<unsigned long>(g_stats.lastGapMs));
+}
+
+void startScan(uint8_t channel) {
+#if defined(ESP8266)
+  const int16_t result = WiFi.scanNetworks(true, false, channel);
+#else
+  const int16_t result = WiFi.scanNetworks(true, false, false, WIFI_SCAN_DWELL_MS, channel);
+#endif
+  if (result == WIFI_SCAN_FAILED) {
+    g_roamer.onScanDone(millis());
+    return;
+  }
+  g_scanRunning = true;
+}
+
+void collectScan(uint32_t now) {
+  if (!g_scanRunning) {
+    return;
+  }
+  const int16_t found = WiFi.scanComplete();
+  if (found == WIFI_SCAN_RUNNING) {
+    return;
+  }
+
+  for (int16_t i = 0; i < found; ++i) {
+    const int slot = slotForSsid(WiFi.SSID(i).c_str());
+    const uint8_t *bssid = WiFi.BSSID(i);
+    if (slot < 0 || bssid == nullptr) {
+      continue;
+    }
+    net::WifiRoamer::AccessPoint ap{};
+    memcpy(ap.bssid, bssid, sizeof(ap.bssid));
+    ap.rssi = static_cast<int8_t>(WiFi.RSSI(i));
+    ap.channel = static_cast<uint8_t>(WiFi.channel(i));
+    ap.slot = static_cast<uint8_t>(slot);
+    g_roamer.onScanResult(ap, now);
+  }
+  WiFi.scanDelete();
+  g_roamer.onScanDone(now);
+  g_scanRunning = false;
+}
+
+// Runs while associated: samples RSSI and carries out what the roamer asks
+// for. The station leaves the current AP only once a stronger one has been
+// seen, so a roam costs one association rather than a scan plus one.
+void serviceRoaming(uint32_t now) {
+  if ((now - g_lastRssiMs) >= RSSI_SAMPLE_MS) {
+    g_lastRssiMs = now;
+    g_stats.rssi = static_cast<int8_t>(WiFi.RSSI());
+    g_roamer.onRssi(g_stats.rssi, now);
+  }
+
+  const net::WifiRoamer::Decision decision = g_roamer.poll(now);
+  if (decision.action == net::WifiRoamer::Action::Scan) {
+    startScan(decision.channel);
+  } else if (decision.action == net::WifiRoamer::Action::Roam) {
+    Serial.printf("WiFi link at %d dBm; roaming\n", g_roamer.smoothedRssi());
+    ++g_stats.roams;
+    openGap(now);
+    g_roamer.onDisconnected();
+    g_connected = false;
+    connectToAccessPoint(decision.target);
+    g_lastAttemptMs = now;
+    g_connectionInFlight = true;
+    return;
+  }
+  tasks::event_loop::setDeadline(tasks::event_loop::Source::WifiRoam,
+                                 g_lastRssiMs + RSSI_SAMPLE_MS);
+}
+
+void handleTimingUpdates() {
+  const uint32_t version = provisioning::version(provisioning::Owner::WifiTiming);
+  if (version == g_lastTimingVersion) {
+    return;
+  }
+
+  g_lastTimingVersion = version;
+  g_retryDelayMs = provisioning::tuning().wifiRetryDelayMs;
+}
+
+bool credentialsChanged(const provisioning::WifiChanges &changes) {
+  bool changed = changes.valid;
+  for (bool network : changes.networks) {
+    changed |= network;
+  }
+  return changed;
+}
+
+bool provisioned(const provisioning::WifiCredentials &creds, const provisioning::WifiNetwork &network) {
+  for (const provisioning::WifiNetwork &candidate : creds.networks) {
+    if (strcmp(candidate.ssid, network.ssid) == 0 && strcmp(candidate.password, network.password) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void handleCredentialUpdates() {
   const uint32_t version = provisioning::wifiVersion();
   if (version == g_lastWifiVersion) {
@@ -59,7 +244,24 @@ void handleCredentialUpdates() {
   }
 
   g_lastWifiVersion = version;
+  const provisioning::WifiCredentials next = provisioning::wifi();
+  if (!credentialsChanged(provisioning::diff(g_activeCreds, next))) {
+    return;
+  }
+  // The link survives as long as the network it is on is still provisioned,
+  // whatever slot it moved to.
+  const int slot = g_connected ? slotForSsid(WiFi.SSID().c_str()) : -1;
+  const bool keepLink = slot >= 0 && next.valid && provisioned(next, g_activeCreds.networks[slot]);
   refreshCredentials();
+  if (keepLink) {
+    uint8_t *bssid = WiFi.BSSID();
+    if (bssid != nullptr) {
+      g_roamer.onConnected(bssid, millis());
+    }
+    Serial.printf("WiFi credentials updated, staying on '%s'\n", WiFi.SSID().c_str());
+    return;
+  }
+
   g_connected = false;
   g_connectionInFlight = false;
   WiFi.disconnect();
@@ -86,35 +288,52 @@ void init() {
 }
 
 void loop() {
+  handleTimingUpdates();
   handleCredentialUpdates();
 
   if (!g_hasCredentials) {
     return;
   }
 
+  const uint32_t now = millis();
+  collectScan(now);
+
   const wl_status_t status = WiFi.status();
   if (status == WL_CONNECTED) {
     if (!g_connected) {
       g_connected = true;
       g_connectionInFlight = false;
-      Serial.printf("WiFi connected, IP: %s\n", WiFi.localIP().toString().c_str());
+      onLinkUp(now);
     }
+    serviceRoaming(now);
     return;
   }
 
   if (g_connected) {
     g_connected = false;
+    g_tryCached = true;
+    openGap(now);
+    g_roamer.onDisconnected();
     Serial.println("WiFi disconnected");
   }
 
-  const uint32_t now = millis();
-  if (!g_connectionInFlight || (now - g_lastAttemptMs) >= WIFI_RETRY_DELAY_MS) {
+  if (!g_connectionInFlight || (now - g_lastAttemptMs) >= g_retryDelayMs) {
     beginConnectionAttempt();
   }
+  tasks::event_loop::setDeadline(tasks::event_loop::Source::WifiRetry,
+                                 g_lastAttemptMs + g_retryDelayMs);
 }
 
 bool isConnected() { return WiFi.status() == WL_CONNECTED; }
 
+Stats stats() {
+  Stats snapshot = g_stats;
+  const net::WifiRoamer::Stats &roamer = g_roamer.stats();
+  snapshot.channelScans = roamer.channelScans;
+  snapshot.fullScans = roamer.fullScans;
+  return snapshot;
+}
+
 void requestReconnect() {
   g_connectionInFlight = false;
   g_connected = false;
@@ -0,0 +1,120 @@
+// The firmware's loop on the host, for driving with tools/load_soak.py and
+// the other bench tools without a board: `pio run -e native_device`, then
+//
+//   .pio/build/native_device/program [--port 1883]
+//       serves a host::Broker on 127.0.0.1:<port> that passes publishes on
+//       between its clients, and connects the device to it;
+//   .pio/build/native_device/program --broker <host>:<port>
+//       connects the device to a broker that is already running.
+//
+// The radio is left out: WiFi reports connected and ESP-NOW does not run.
+// The clock is the wall clock, and heap_free follows the process heap.
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "config/provisioning_store.h"
+#include "diag/event_log.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/emergency_stop.h"
+#include "tasks/event_loop.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+#include "tasks/scheduled_commands.h"
+#include "tasks/serial_tunnel.h"
+#include "tasks/telemetry.h"
+
+namespace {
+constexpr useconds_t BROKER_POLL_US = 200;
+
+host::Broker g_broker;
+std::atomic<bool> g_brokerRunning{false};
+
+// The broker gets a thread of its own so it keeps serving while the device
+// sleeps in the event loop. Only this thread touches g_broker.
+void runBroker() {
+  while (g_brokerRunning.load()) {
+    g_broker.poll();
+    usleep(BROKER_POLL_US);
+  }
+}
+
+int usage(const char *program) {
+  fprintf(stderr, "usage: %s [--port <port>] [--broker <host>:<port>]\n", program);
+  return 2;
+}
+
+void loopOnce() {
+  tasks::estop::loop();
+  tasks::mqtt::loop();
+  tasks::schedule::loop();
+  tasks::tunnel::loop();
+  serviceActuators(millis());
+  tasks::telemetry::loop();
+  diag::log::drain(8);
+  if (diag::log::pending()) {
+    tasks::event_loop::setDeadline(tasks::event_loop::Source::SerialOutput, millis() + 2);
+  }
+  host::runDueTimers();
+  const std::string output = host::takeSerialOutput();
+  fwrite(output.data(), 1, output.size(), stdout);
+  fflush(stdout);
+  tasks::event_loop::waitForWork();
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  unsigned port = 1883;
+  std::string broker;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+      port = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+    } else if (strcmp(argv[i], "--broker") == 0 && i + 1 < argc) {
+      broker = argv[++i];
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  std::string host = "127.0.0.1";
+  if (!broker.empty()) {
+    const size_t colon = broker.rfind(':');
+    if (colon == std::string::npos) {
+      return usage(argv[0]);
+    }
+    host = broker.substr(0, colon);
+    port = static_cast<unsigned>(strtoul(broker.c_str() + colon + 1, nullptr, 10));
+  } else {
+    g_broker.forwardPublishes(true);
+    if (g_broker.start(10, static_cast<uint16_t>(port)) == 0) {
+      fprintf(stderr, "cannot listen on 127.0.0.1:%u\n", port);
+      return 1;
+    }
+    g_brokerRunning.store(true);
+  }
+  std::thread brokerThread(runBroker);
+
+  host::followWallClock(true);
+  host::setWifiConnected(true);
+  tasks::event_loop::init();
+  provisioning::initDefaults();
+  char portText[8];
+  snprintf(portText, sizeof(portText), "%u", port);
+  provisioning::applyKeyValue("MQTT_HOST", host.c_str());
+  provisioning::applyKeyValue("MQTT_PORT", portText);
+  initActuators();
+  tasks::mqtt::init();
+  tasks::tunnel::init();
+  printf("device on MQTT broker %s:%u\n", host.c_str(), port);
+
+  for (;;) {
+    loopOnce();
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// Just enough of the Arduino core for the firmware sources to build and run
+// on the host. Time is simulated; see host_fakes.h.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define SERIAL_8N1 0x800001c
+#define UART_HW_FLOWCTRL_CTS_RTS 3
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class String {
+ public:
+  String() = default;
+  String(const char *text) : text_(text != nullptr ? text : "") {}
+  const char *c_str() const { return text_.c_str(); }
+  unsigned length() const { return static_cast<unsigned>(text_.size()); }
+
+ private:
+  std::string text_;
+};
+
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud);
+  void begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin);
+  bool setPins(int8_t rxPin, int8_t txPin, int8_t ctsPin, int8_t rtsPin);
+  bool setHwFlowCtrlMode(uint8_t mode, uint8_t threshold);
+  void setRxBufferSize(size_t size);
+  void setTxBufferSize(size_t size);
+  void onReceive(void (*callback)(void));
+
+  int available();
+  int read();
+  size_t read(uint8_t *buffer, size_t size);
+  int availableForWrite();
+  size_t write(uint8_t byte);
+  size_t write(const uint8_t *data, size_t length);
+  size_t print(const char *text);
+  size_t println(const char *text = "");
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  void flush();
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+double ledcSetup(uint8_t channel, double frequency, uint8_t resolution);
+double ledcChangeFrequency(uint8_t channel, double frequency, uint8_t resolution);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcWrite(uint8_t channel, uint32_t duty);
+
+class EspClass {
+ public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+};
+
+extern EspClass ESP;
@@ -0,0 +1,11 @@
+#pragma once
+
+class Servo {
+ public:
+  int attach(int pin);
+  void write(int angle);
+  int read() const { return angle_; }
+
+ private:
+  int angle_ = 0;
+};
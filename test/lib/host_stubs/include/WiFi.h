@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Arduino.h"
+
+typedef int wl_status_t;
+typedef int WiFiEvent_t;
+
+enum { WL_CONNECTED = 3, WL_DISCONNECTED = 6 };
+enum { WIFI_SCAN_RUNNING = -1, WIFI_SCAN_FAILED = -2 };
+enum { WIFI_STA = 1 };
+
+struct IPAddress {
+  String toString() const { return String("127.0.0.1"); }
+};
+
+// A station without a radio; the host tests drive the WiFi logic through
+// net::WifiRoamer instead. status() reports whatever host::setWifiConnected()
+// last set, so the MQTT task can run against host::Broker, or joins a while
+// after begin() under host::setAssociationMs(). disconnect() is counted for
+// host::wifiDisconnects().
+class WiFiClass {
+ public:
+  void mode(int) {}
+  void persistent(bool) {}
+  void setAutoReconnect(bool) {}
+  void disconnect(bool = false);
+  void onEvent(void (*)(WiFiEvent_t)) {}
+  void begin(const char *, const char *, int32_t = 0, const uint8_t * = nullptr, bool = true);
+  wl_status_t status();
+  IPAddress localIP() { return {}; }
+  String SSID() { return String(); }
+  String SSID(uint8_t) { return String(); }
+  uint8_t *BSSID() { return bssid_; }
+  uint8_t *BSSID(uint8_t) { return bssid_; }
+  int8_t RSSI() { return 0; }
+  int32_t RSSI(uint8_t) { return 0; }
+  int32_t channel() { return 1; }
+  int32_t channel(uint8_t) { return 1; }
+  int16_t scanNetworks(bool = false, bool = false, bool = false, uint32_t = 300, uint8_t = 0,
+                       const char * = nullptr, const uint8_t * = nullptr) {
+    return WIFI_SCAN_FAILED;
+  }
+  int16_t scanComplete() { return WIFI_SCAN_FAILED; }
+  void scanDelete() {}
+
+ private:
+  uint8_t bssid_[6] = {};
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef struct {
+  int max_fds;
+} esp_vfs_eventfd_config_t;
+
+#define ESP_VFS_EVENTD_CONFIG_DEFAULT() {5}
+
+esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t *config);
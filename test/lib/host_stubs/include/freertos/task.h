@@ -0,0 +1,5 @@
+#pragma once
+
+typedef void *TaskHandle_t;
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace host {
+// MQTT 3.1.1 / 5 broker on 127.0.0.1 for running net::MqttClient and
+// tasks::mqtt against in host tests; a single threaded take on
+// tools/standin_broker.py. Nothing happens between calls: poll() accepts
+// connections, answers CONNECT, SUBSCRIBE, UNSUBSCRIBE and PINGREQ, records
+// every PUBLISH the clients send and writes out what publish() queued.
+//
+// The codec is written out here rather than shared with net::codec, so the
+// client is checked against an independent reading of the protocol.
+class Broker {
+ public:
+  struct Message {
+    size_t connection;
+    std::string topic;
+    std::string payload;
+    // MQTT 5: the client sent only a topic alias in place of the topic.
+    bool aliased;
+    // MQTT 5: the message expiry interval it carried; 0 for none.
+    uint32_t expirySeconds;
+  };
+
+  struct Stats {
+    uint64_t rxBytes;
+    uint64_t txBytes;
+    uint32_t publishesIn;
+    uint32_t publishesOut;
+    uint32_t pubAcks;
+  };
+
+  Broker() = default;
+  ~Broker();
+  Broker(const Broker &) = delete;
+  Broker &operator=(const Broker &) = delete;
+
+  // Listens on `port`, or an ephemeral one for 0, and offers MQTT 5 clients
+  // `topicAliases` aliases. Returns the port, or 0 when it could not listen.
+  uint16_t start(uint16_t topicAliases = 10, uint16_t port = 0);
+  void stop();
+  void poll();
+
+  // Queues a QoS 1 PUBLISH to every live connection subscribed to `topic`,
+  // using a topic alias when the client accepts them. Everything queued
+  // between two poll() calls reaches a client in one write, so a burst lands
+  // in its receive buffer at once. Returns the connections it was queued for.
+  size_t publish(const std::string &topic, const std::string &payload);
+
+  // Closes every connection, as a broker restart or a dead link would.
+  void dropAll();
+
+  // While set, each PUBLISH a client sends is passed on to the subscribers
+  // of its topic, as a real broker would, instead of kept for takeMessages().
+  void forwardPublishes(bool forward) { forwardPublishes_ = forward; }
+
+  // While set, CONNECT or SUBSCRIBE goes unanswered, as on a broker that
+  // accepts connections but is wedged behind them.
+  void withholdConnack(bool withhold) { withholdConnack_ = withhold; }
+  void withholdSuback(bool withhold) { withholdSuback_ = withhold; }
+
+  // Connections that completed CONNECT and are still open.
+  size_t liveConnections() const;
+  // Every connection accepted since the broker was created, open or not.
+  size_t acceptedConnections() const { return connections_.size(); }
+  size_t subscribers(const std::string &topic) const;
+  const std::string &clientId(size_t connection) const { return connections_[connection].clientId; }
+  bool isV5(size_t connection) const { return connections_[connection].v5; }
+  // MQTT 5: the receive maximum the client announced; 0 when it sent none.
+  uint16_t receiveMaximum(size_t connection) const {
+    return connections_[connection].receiveMaximum;
+  }
+
+  // Publishes received from the clients since the last call.
+  std::vector<Message> takeMessages();
+  Stats stats() const { return stats_; }
+
+ private:
+  struct Connection {
+    int fd = -1;
+    bool connected = false;
+    bool v5 = false;
+    std::string clientId;
+    std::string input;
+    std::string output;
+    std::vector<std::string> subscriptions;
+    // Aliases the client bound for its publishes.
+    std::map<uint16_t, std::string> clientAliases;
+    // Aliases bound for publishes to the client, and how many it accepts.
+    std::map<std::string, uint16_t> brokerAliases;
+    uint16_t aliasLimit = 0;
+    uint16_t receiveMaximum = 0;
+    uint16_t nextPacketId = 1;
+  };
+
+  void accept();
+  void read(Connection &connection);
+  void write(Connection &connection);
+  void close(Connection &connection);
+  void handle(size_t index, uint8_t type, uint8_t flags, const std::string &body);
+  void onConnect(Connection &connection, const std::string &body);
+  void onSubscribe(Connection &connection, const std::string &body);
+  void onUnsubscribe(Connection &connection, const std::string &body);
+  void onPublish(size_t index, uint8_t flags, const std::string &body);
+  void send(Connection &connection, uint8_t firstByte, const std::string &body);
+
+  int listenFd_ = -1;
+  uint16_t topicAliases_ = 0;
+  bool forwardPublishes_ = false;
+  bool withholdConnack_ = false;
+  bool withholdSuback_ = false;
+  std::vector<Connection> connections_;
+  std::vector<Message> messages_;
+  Stats stats_{};
+};
+}  // namespace host
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// Knobs for the simulated platform behind the host stubs.
+namespace host {
+// millis(), micros(), esp_timer_get_time() and delay() share one simulated
+// clock. It only moves when a test moves it, when delay() is called, or when
+// Serial blocks, unless followWallClock() lets real time pass through too.
+void setMicros(uint64_t us);
+void advanceMicros(uint64_t us);
+uint64_t nowMicros();
+void followWallClock(bool enabled);
+
+// Models Serial as a UART at `baud` with a `fifoBytes` TX FIFO: a write that
+// does not fit blocks, advancing the clock, until the FIFO has drained
+// enough. Without a model Serial swallows everything instantly.
+void setSerialModel(uint32_t baud, size_t fifoBytes);
+uint64_t serialBytesWritten();
+// Wires Serial2's TX to its RX, as a jumper across the pins would, carrying
+// bytes at `baud` on the simulated clock. Each side holds what
+// setTxBufferSize() and setRxBufferSize() gave it; a full RX buffer stops
+// the line and TX backs up behind it. 0 unplugs it: Serial2 then takes
+// every write and never receives.
+void setSerial2Loopback(uint32_t baud);
+// Everything written to Serial since the last call.
+std::string takeSerialOutput();
+
+// Runs the callback of every started esp_timer whose period has elapsed on
+// the simulated clock. Returns the number of callbacks run.
+size_t runDueTimers();
+
+// Last duty written to each LEDC channel.
+uint32_t ledcDuty(uint8_t channel);
+
+// What WiFi.status() reports: WL_CONNECTED or WL_DISCONNECTED (the default).
+void setWifiConnected(bool connected);
+// Calls to WiFi.disconnect() so far.
+size_t wifiDisconnects();
+// With a non-zero `ms`, WiFi.begin() starts a join that completes `ms` later
+// on the simulated clock, as the driver's would in the background;
+// WiFi.disconnect() abandons it.
+void setAssociationMs(uint32_t ms);
+
+// Lookups of `hostname` get no answer, as with a DNS server that is down:
+// they stay in progress until lwIP gives up on them. "" answers everything.
+void setDnsUnanswered(const char *hostname);
+
+// Simulated time ledcSetup() and each Servo::attach() take, for costing the
+// actuator setup.
+void setActuatorSetupUs(uint32_t us);
+uint32_t actuatorSetupUs();
+
+// What esp_reset_reason() reports, for simulating the boot after a reset.
+void setResetReason(int reason);
+}  // namespace host
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+#define LWIP_DNS_ADDRTYPE_IPV4 0
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *address, void *arg);
+
+// Resolved synchronously with getaddrinfo(), except for the name
+// host::setDnsUnanswered() picks: that returns ERR_INPROGRESS and calls back
+// with no address once lwIP would have given up.
+err_t dns_gethostbyname_addrtype(const char *hostname, ip_addr_t *address,
+                                 dns_found_callback found, void *arg, uint8_t addrtype);
@@ -0,0 +1,5 @@
+#pragma once
+
+typedef int err_t;
+
+enum { ERR_OK = 0, ERR_MEM = -1, ERR_INPROGRESS = -5, ERR_ARG = -16 };
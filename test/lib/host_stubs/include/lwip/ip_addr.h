@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t addr;
+} ip4_addr_t;
+
+typedef struct {
+  ip4_addr_t u_addr;
+  uint8_t type;
+} ip_addr_t;
+
+#define IPADDR_TYPE_V4 0
+#define IP_IS_V4(address) ((address)->type == IPADDR_TYPE_V4)
+#define ip_2_ip4(address) (&(address)->u_addr)
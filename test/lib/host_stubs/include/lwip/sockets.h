@@ -0,0 +1,21 @@
+#pragma once
+
+// The host's BSD sockets stand in for lwIP's.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define lwip_socket socket
+#define lwip_fcntl fcntl
+#define lwip_setsockopt setsockopt
+#define lwip_getsockopt getsockopt
+#define lwip_connect connect
+#define lwip_select select
+#define lwip_recv recv
+#define lwip_send send
+#define lwip_close ::close
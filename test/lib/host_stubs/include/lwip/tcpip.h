@@ -0,0 +1,8 @@
+#pragma once
+
+#include "lwip/err.h"
+
+typedef void (*tcpip_callback_fn)(void *ctx);
+
+// There is no tcpip thread on the host; the job runs before this returns.
+err_t tcpip_callback(tcpip_callback_fn function, void *ctx);
@@ -0,0 +1,6 @@
+#pragma once
+
+// Types only: TLS is not available on the host (see tls_session.cpp here).
+typedef struct {
+  int unused;
+} mbedtls_ctr_drbg_context;
@@ -0,0 +1,5 @@
+#pragma once
+
+typedef struct {
+  int unused;
+} mbedtls_entropy_context;
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "mbedtls/x509_crt.h"
+
+typedef struct {
+  int unused;
+} mbedtls_ssl_context;
+
+typedef struct {
+  int unused;
+} mbedtls_ssl_config;
+
+typedef struct {
+  int unused;
+} mbedtls_ssl_session;
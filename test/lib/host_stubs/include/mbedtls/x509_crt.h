@@ -0,0 +1,5 @@
+#pragma once
+
+typedef struct mbedtls_x509_crt {
+  int unused;
+} mbedtls_x509_crt;
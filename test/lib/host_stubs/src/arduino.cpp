@@ -0,0 +1,276 @@
+#include <Arduino.h>
+#include <malloc.h>
+#include <stdarg.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+
+#include "host_fakes.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial2;
+EspClass ESP;
+
+namespace {
+constexpr size_t LEDC_CHANNELS = 16;
+constexpr int UNMODELLED_ROOM = 4096;
+// Heap a WROOM module has free once the WiFi stack is up.
+constexpr size_t HOST_HEAP_BYTES = 200000;
+
+uint64_t g_simUs = 0;
+uint32_t g_minFreeHeap = HOST_HEAP_BYTES;
+bool g_followWall = false;
+std::chrono::steady_clock::time_point g_wallBase;
+
+uint32_t g_baud = 0;
+size_t g_fifoBytes = 0;
+double g_fifoLevel = 0;
+uint64_t g_fifoUpdatedUs = 0;
+uint64_t g_serialBytes = 0;
+std::string g_serialOutput;
+
+// Serial2 with its TX wired to its RX. The sizes are the ESP32 core's
+// defaults until setRxBufferSize()/setTxBufferSize() change them.
+uint32_t g_loopBaud = 0;
+size_t g_loopRxBytes = 256;
+size_t g_loopTxBytes = 128;
+std::deque<uint8_t> g_loopTx;
+std::deque<uint8_t> g_loopRx;
+double g_loopBudget = 0;
+uint64_t g_loopUpdatedUs = 0;
+
+uint32_t g_ledcDuty[LEDC_CHANNELS];
+uint32_t g_actuatorSetupUs = 0;
+
+uint64_t wallElapsedUs() {
+  const auto elapsed = std::chrono::steady_clock::now() - g_wallBase;
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+bool modelled(const HardwareSerial *port) { return port == &Serial && g_baud != 0; }
+
+double bytesPerUs(uint32_t baud) { return baud / 10.0 / 1e6; }
+
+void drainFifo() {
+  const uint64_t now = host::nowMicros();
+  g_fifoLevel -= static_cast<double>(now - g_fifoUpdatedUs) * bytesPerUs(g_baud);
+  if (g_fifoLevel < 0) {
+    g_fifoLevel = 0;
+  }
+  g_fifoUpdatedUs = now;
+}
+
+bool looped(const HardwareSerial *port) { return port == &Serial2 && g_loopBaud != 0; }
+
+// Moves what the line has carried since the last call from TX to RX. A full
+// RX buffer stops the line, as RTS would, and an idle line banks nothing.
+void carryLoopback() {
+  const uint64_t now = host::nowMicros();
+  g_loopBudget += static_cast<double>(now - g_loopUpdatedUs) * bytesPerUs(g_loopBaud);
+  g_loopUpdatedUs = now;
+  size_t moved = static_cast<size_t>(g_loopBudget);
+  const size_t rxRoom = g_loopRxBytes - g_loopRx.size();
+  if (moved >= g_loopTx.size() || moved >= rxRoom) {
+    moved = g_loopTx.size() < rxRoom ? g_loopTx.size() : rxRoom;
+    g_loopBudget = 0;
+  } else {
+    g_loopBudget -= static_cast<double>(moved);
+  }
+  g_loopRx.insert(g_loopRx.end(), g_loopTx.begin(),
+                  g_loopTx.begin() + static_cast<std::ptrdiff_t>(moved));
+  g_loopTx.erase(g_loopTx.begin(), g_loopTx.begin() + static_cast<std::ptrdiff_t>(moved));
+}
+}  // namespace
+
+namespace host {
+void setMicros(uint64_t us) {
+  g_simUs = us;
+  g_wallBase = std::chrono::steady_clock::now();
+  g_fifoUpdatedUs = us;
+}
+
+void advanceMicros(uint64_t us) { g_simUs += us; }
+
+uint64_t nowMicros() { return g_simUs + (g_followWall ? wallElapsedUs() : 0); }
+
+void followWallClock(bool enabled) {
+  g_simUs = nowMicros();
+  g_wallBase = std::chrono::steady_clock::now();
+  g_followWall = enabled;
+}
+
+void setSerialModel(uint32_t baud, size_t fifoBytes) {
+  g_baud = baud;
+  g_fifoBytes = fifoBytes;
+  g_fifoLevel = 0;
+  g_fifoUpdatedUs = nowMicros();
+}
+
+void setSerial2Loopback(uint32_t baud) {
+  g_loopBaud = baud;
+  g_loopTx.clear();
+  g_loopRx.clear();
+  g_loopBudget = 0;
+  g_loopUpdatedUs = nowMicros();
+}
+
+uint64_t serialBytesWritten() { return g_serialBytes; }
+
+std::string takeSerialOutput() {
+  std::string output;
+  output.swap(g_serialOutput);
+  return output;
+}
+
+uint32_t ledcDuty(uint8_t channel) { return channel < LEDC_CHANNELS ? g_ledcDuty[channel] : 0; }
+
+void setActuatorSetupUs(uint32_t us) { g_actuatorSetupUs = us; }
+
+uint32_t actuatorSetupUs() { return g_actuatorSetupUs; }
+}  // namespace host
+
+uint32_t millis() { return static_cast<uint32_t>(host::nowMicros() / 1000); }
+uint32_t micros() { return static_cast<uint32_t>(host::nowMicros()); }
+void delay(uint32_t ms) { host::advanceMicros(static_cast<uint64_t>(ms) * 1000); }
+
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+double ledcSetup(uint8_t, double frequency, uint8_t) {
+  host::advanceMicros(g_actuatorSetupUs);
+  return frequency;
+}
+double ledcChangeFrequency(uint8_t, double frequency, uint8_t) { return frequency; }
+void ledcAttachPin(uint8_t, uint8_t) {}
+
+void ledcWrite(uint8_t channel, uint32_t duty) {
+  if (channel < LEDC_CHANNELS) {
+    g_ledcDuty[channel] = duty;
+  }
+}
+
+void HardwareSerial::begin(unsigned long) {}
+void HardwareSerial::begin(unsigned long, uint32_t, int8_t, int8_t) {}
+bool HardwareSerial::setPins(int8_t, int8_t, int8_t, int8_t) { return true; }
+bool HardwareSerial::setHwFlowCtrlMode(uint8_t, uint8_t) { return true; }
+void HardwareSerial::onReceive(void (*)(void)) {}
+void HardwareSerial::flush() {}
+
+void HardwareSerial::setRxBufferSize(size_t size) {
+  if (this == &Serial2) {
+    g_loopRxBytes = size;
+  }
+}
+
+void HardwareSerial::setTxBufferSize(size_t size) {
+  if (this == &Serial2) {
+    g_loopTxBytes = size;
+  }
+}
+
+int HardwareSerial::available() {
+  if (!looped(this)) {
+    return 0;
+  }
+  carryLoopback();
+  return static_cast<int>(g_loopRx.size());
+}
+
+int HardwareSerial::read() {
+  uint8_t byte = 0;
+  return read(&byte, 1) == 1 ? byte : -1;
+}
+
+size_t HardwareSerial::read(uint8_t *buffer, size_t size) {
+  if (!looped(this)) {
+    return 0;
+  }
+  carryLoopback();
+  const size_t length = size < g_loopRx.size() ? size : g_loopRx.size();
+  std::copy(g_loopRx.begin(), g_loopRx.begin() + static_cast<std::ptrdiff_t>(length), buffer);
+  g_loopRx.erase(g_loopRx.begin(), g_loopRx.begin() + static_cast<std::ptrdiff_t>(length));
+  return length;
+}
+
+int HardwareSerial::availableForWrite() {
+  if (looped(this)) {
+    carryLoopback();
+    return static_cast<int>(g_loopTxBytes - g_loopTx.size());
+  }
+  if (!modelled(this)) {
+    return UNMODELLED_ROOM;
+  }
+  drainFifo();
+  return static_cast<int>(g_fifoBytes - static_cast<size_t>(g_fifoLevel + 0.999));
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length) {
+  if (this == &Serial) {
+    g_serialBytes += length;
+    g_serialOutput.append(reinterpret_cast<const char *>(data), length);
+  }
+  if (looped(this)) {
+    // Takes what fits rather than blocking: with the far end stalled the
+    // core's write would never return.
+    carryLoopback();
+    const size_t room = g_loopTxBytes - g_loopTx.size();
+    const size_t taken = length < room ? length : room;
+    g_loopTx.insert(g_loopTx.end(), data, data + taken);
+    return taken;
+  }
+  if (!modelled(this)) {
+    return length;
+  }
+  drainFifo();
+  const double room = static_cast<double>(g_fifoBytes) - g_fifoLevel;
+  if (static_cast<double>(length) > room) {
+    // The Arduino core blocks until the FIFO takes the rest.
+    const double waitUs = (static_cast<double>(length) - room) / bytesPerUs(g_baud);
+    host::advanceMicros(static_cast<uint64_t>(waitUs + 0.5));
+    drainFifo();
+  }
+  g_fifoLevel += static_cast<double>(length);
+  if (g_fifoLevel > static_cast<double>(g_fifoBytes)) {
+    g_fifoLevel = static_cast<double>(g_fifoBytes);
+  }
+  return length;
+}
+
+size_t HardwareSerial::write(uint8_t byte) { return write(&byte, 1); }
+
+size_t HardwareSerial::print(const char *text) {
+  return write(reinterpret_cast<const uint8_t *>(text), strlen(text));
+}
+
+size_t HardwareSerial::println(const char *text) { return print(text) + print("\r\n"); }
+
+size_t HardwareSerial::printf(const char *format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  const int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (length <= 0) {
+    return 0;
+  }
+  return write(reinterpret_cast<const uint8_t *>(line),
+               static_cast<size_t>(length) < sizeof(line) ? static_cast<size_t>(length)
+                                                          : sizeof(line) - 1);
+}
+
+// HOST_HEAP_BYTES less whatever the process has allocated since the first
+// call, so a leak shows up in heap_free as it would on the device.
+uint32_t EspClass::getFreeHeap() {
+  static const size_t baseline = mallinfo2().uordblks;
+  const size_t limit = HOST_HEAP_BYTES + baseline;
+  const size_t used = mallinfo2().uordblks;
+  const uint32_t free = used < limit ? static_cast<uint32_t>(limit - used) : 0;
+  if (free < g_minFreeHeap) {
+    g_minFreeHeap = free;
+  }
+  return free;
+}
+
+uint32_t EspClass::getMinFreeHeap() { return g_minFreeHeap; }
+uint32_t EspClass::getMaxAllocHeap() { return 110000; }
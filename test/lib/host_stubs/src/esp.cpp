@@ -0,0 +1,77 @@
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_vfs_eventfd.h>
+#include <freertos/task.h>
+
+#include <memory>
+#include <vector>
+
+#include "host_fakes.h"
+
+struct esp_timer {
+  esp_timer_create_args_t args;
+  uint64_t periodUs;
+  uint64_t dueUs;
+  bool running;
+};
+
+namespace {
+std::vector<std::unique_ptr<esp_timer>> g_timers;
+esp_reset_reason_t g_resetReason = ESP_RST_POWERON;
+uint32_t g_randomState = 0x2545F491;
+}  // namespace
+
+namespace host {
+size_t runDueTimers() {
+  size_t fired = 0;
+  for (const auto &timer : g_timers) {
+    if (timer->running && nowMicros() >= timer->dueUs) {
+      // Like skip_unhandled_events: periods missed while nobody ran the
+      // timers collapse into one callback.
+      timer->dueUs = nowMicros() + timer->periodUs;
+      timer->args.callback(timer->args.arg);
+      ++fired;
+    }
+  }
+  return fired;
+}
+
+void setResetReason(int reason) { g_resetReason = static_cast<esp_reset_reason_t>(reason); }
+}  // namespace host
+
+int64_t esp_timer_get_time() { return static_cast<int64_t>(host::nowMicros()); }
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out) {
+  g_timers.push_back(std::unique_ptr<esp_timer>(new esp_timer{*args, 0, 0, false}));
+  *out = g_timers.back().get();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+  timer->periodUs = periodUs;
+  timer->dueUs = host::nowMicros() + periodUs;
+  timer->running = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  timer->running = false;
+  return ESP_OK;
+}
+
+uint32_t esp_random() {
+  g_randomState ^= g_randomState << 13;
+  g_randomState ^= g_randomState >> 17;
+  g_randomState ^= g_randomState << 5;
+  return g_randomState;
+}
+
+esp_reset_reason_t esp_reset_reason() { return g_resetReason; }
+
+// Linux has eventfd() natively.
+esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t *) { return ESP_OK; }
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  static thread_local char task;
+  return &task;
+}
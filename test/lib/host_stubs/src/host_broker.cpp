@@ -0,0 +1,434 @@
+#include "host_broker.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace host {
+namespace {
+constexpr uint8_t CONNECT = 1;
+constexpr uint8_t CONNACK = 2;
+constexpr uint8_t PUBLISH = 3;
+constexpr uint8_t PUBACK = 4;
+constexpr uint8_t SUBSCRIBE = 8;
+constexpr uint8_t SUBACK = 9;
+constexpr uint8_t UNSUBSCRIBE = 10;
+constexpr uint8_t UNSUBACK = 11;
+constexpr uint8_t PINGREQ = 12;
+constexpr uint8_t PINGRESP = 13;
+constexpr uint8_t DISCONNECT = 14;
+
+constexpr uint8_t MESSAGE_EXPIRY = 0x02;
+constexpr uint8_t RECEIVE_MAXIMUM = 0x21;
+constexpr uint8_t TOPIC_ALIAS_MAXIMUM = 0x22;
+constexpr uint8_t TOPIC_ALIAS = 0x23;
+
+std::string encodeVarint(size_t value) {
+  std::string out;
+  do {
+    uint8_t byte = value % 128;
+    value /= 128;
+    out.push_back(static_cast<char>(byte | (value > 0 ? 0x80 : 0)));
+  } while (value > 0);
+  return out;
+}
+
+// False when the varint runs past `data`.
+bool decodeVarint(const std::string &data, size_t *offset, size_t *value) {
+  *value = 0;
+  size_t multiplier = 1;
+  for (int i = 0; i < 4 && *offset < data.size(); ++i) {
+    const uint8_t byte = static_cast<uint8_t>(data[(*offset)++]);
+    *value += (byte & 0x7F) * multiplier;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+    multiplier *= 128;
+  }
+  return false;
+}
+
+uint16_t readU16(const std::string &data, size_t offset) {
+  if (offset + 2 > data.size()) {
+    return 0;
+  }
+  return static_cast<uint16_t>(static_cast<uint8_t>(data[offset]) << 8 |
+                               static_cast<uint8_t>(data[offset + 1]));
+}
+
+std::string u16(uint16_t value) {
+  return std::string{static_cast<char>(value >> 8), static_cast<char>(value & 0xFF)};
+}
+
+std::string lengthPrefixed(const std::string &text) { return u16(text.size()) + text; }
+
+// The 1, 2 and 4 byte MQTT 5 properties by id; the rest are length prefixed
+// except the subscription identifier, a varint.
+size_t propertySize(uint8_t id) {
+  switch (id) {
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+      return 1;
+    case 0x13: case 0x21: case 0x22: case 0x23:
+      return 2;
+    case 0x02: case 0x11: case 0x18: case 0x27:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+// Decodes the property block at `*offset`, keeping the numeric ones.
+std::map<uint8_t, uint32_t> decodeProperties(const std::string &data, size_t *offset) {
+  std::map<uint8_t, uint32_t> properties;
+  size_t length = 0;
+  if (!decodeVarint(data, offset, &length)) {
+    return properties;
+  }
+  const size_t end = std::min(data.size(), *offset + length);
+  while (*offset < end) {
+    const uint8_t id = static_cast<uint8_t>(data[(*offset)++]);
+    const size_t size = propertySize(id);
+    if (size > 0) {
+      uint32_t value = 0;
+      for (size_t i = 0; i < size && *offset < end; ++i) {
+        value = value << 8 | static_cast<uint8_t>(data[(*offset)++]);
+      }
+      properties[id] = value;
+    } else if (id == 0x0B) {
+      size_t value = 0;
+      decodeVarint(data, offset, &value);
+    } else {
+      // User properties are a pair of strings, the rest a single one.
+      for (int i = 0; i < (id == 0x26 ? 2 : 1); ++i) {
+        *offset += 2 + readU16(data, *offset);
+      }
+    }
+  }
+  *offset = end;
+  return properties;
+}
+}  // namespace
+
+Broker::~Broker() { stop(); }
+
+uint16_t Broker::start(uint16_t topicAliases, uint16_t port) {
+  stop();
+  topicAliases_ = topicAliases;
+  listenFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd_ < 0) {
+    return 0;
+  }
+  const int reuse = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  socklen_t length = sizeof(address);
+  if (::bind(listenFd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      ::listen(listenFd_, 8) != 0 ||
+      ::getsockname(listenFd_, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+    stop();
+    return 0;
+  }
+  fcntl(listenFd_, F_SETFL, fcntl(listenFd_, F_GETFL) | O_NONBLOCK);
+  return ntohs(address.sin_port);
+}
+
+void Broker::stop() {
+  dropAll();
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+    listenFd_ = -1;
+  }
+}
+
+void Broker::poll() {
+  if (listenFd_ < 0) {
+    return;
+  }
+  accept();
+  for (size_t i = 0; i < connections_.size(); ++i) {
+    Connection &connection = connections_[i];
+    if (connection.fd < 0) {
+      continue;
+    }
+    read(connection);
+    while (connection.fd >= 0) {
+      size_t offset = 1;
+      size_t remaining = 0;
+      if (connection.input.size() < 2 || !decodeVarint(connection.input, &offset, &remaining) ||
+          connection.input.size() < offset + remaining) {
+        break;
+      }
+      const uint8_t first = static_cast<uint8_t>(connection.input[0]);
+      const std::string body = connection.input.substr(offset, remaining);
+      connection.input.erase(0, offset + remaining);
+      stats_.rxBytes += offset + remaining;
+      handle(i, first >> 4, first & 0x0F, body);
+    }
+    write(connections_[i]);
+  }
+}
+
+size_t Broker::publish(const std::string &topic, const std::string &payload) {
+  size_t queued = 0;
+  for (Connection &connection : connections_) {
+    if (connection.fd < 0 || !connection.connected ||
+        std::find(connection.subscriptions.begin(), connection.subscriptions.end(), topic) ==
+            connection.subscriptions.end()) {
+      continue;
+    }
+    const uint16_t packetId = connection.nextPacketId;
+    connection.nextPacketId = packetId == 0xFFFF ? 1 : packetId + 1;
+    std::string name = topic;
+    std::string properties;
+    if (connection.v5) {
+      auto bound = connection.brokerAliases.find(topic);
+      if (bound != connection.brokerAliases.end()) {
+        name.clear();
+        properties = std::string(1, static_cast<char>(TOPIC_ALIAS)) + u16(bound->second);
+      } else if (connection.brokerAliases.size() < connection.aliasLimit) {
+        const uint16_t alias = static_cast<uint16_t>(connection.brokerAliases.size() + 1);
+        connection.brokerAliases[topic] = alias;
+        properties = std::string(1, static_cast<char>(TOPIC_ALIAS)) + u16(alias);
+      }
+      properties = encodeVarint(properties.size()) + properties;
+    }
+    send(connection, PUBLISH << 4 | 0x02,
+         lengthPrefixed(name) + u16(packetId) + properties + payload);
+    ++stats_.publishesOut;
+    ++queued;
+  }
+  return queued;
+}
+
+void Broker::dropAll() {
+  for (Connection &connection : connections_) {
+    close(connection);
+  }
+}
+
+size_t Broker::liveConnections() const {
+  return std::count_if(connections_.begin(), connections_.end(), [](const Connection &connection) {
+    return connection.fd >= 0 && connection.connected;
+  });
+}
+
+size_t Broker::subscribers(const std::string &topic) const {
+  return std::count_if(connections_.begin(), connections_.end(), [&](const Connection &connection) {
+    return connection.fd >= 0 &&
+           std::find(connection.subscriptions.begin(), connection.subscriptions.end(), topic) !=
+               connection.subscriptions.end();
+  });
+}
+
+std::vector<Broker::Message> Broker::takeMessages() {
+  std::vector<Message> messages;
+  messages.swap(messages_);
+  return messages;
+}
+
+void Broker::accept() {
+  for (;;) {
+    const int fd = ::accept(listenFd_, nullptr, nullptr);
+    if (fd < 0) {
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    // Like the firmware's own socket: a PUBLISH right behind a SUBACK must not
+    // wait for the client's delayed ACK.
+    const int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    Connection connection;
+    connection.fd = fd;
+    connections_.push_back(connection);
+  }
+}
+
+void Broker::read(Connection &connection) {
+  char buffer[2048];
+  for (;;) {
+    const ssize_t received = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+    if (received > 0) {
+      connection.input.append(buffer, static_cast<size_t>(received));
+      continue;
+    }
+    if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      close(connection);
+    }
+    return;
+  }
+}
+
+void Broker::write(Connection &connection) {
+  while (connection.fd >= 0 && !connection.output.empty()) {
+    const ssize_t sent =
+        ::send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        close(connection);
+      }
+      return;
+    }
+    connection.output.erase(0, static_cast<size_t>(sent));
+  }
+}
+
+void Broker::close(Connection &connection) {
+  if (connection.fd >= 0) {
+    ::close(connection.fd);
+  }
+  connection.fd = -1;
+  connection.output.clear();
+  connection.input.clear();
+}
+
+void Broker::handle(size_t index, uint8_t type, uint8_t flags, const std::string &body) {
+  Connection &connection = connections_[index];
+  switch (type) {
+    case CONNECT:
+      if (!withholdConnack_) {
+        onConnect(connection, body);
+      }
+      break;
+    case SUBSCRIBE:
+      if (!withholdSuback_) {
+        onSubscribe(connection, body);
+      }
+      break;
+    case UNSUBSCRIBE:
+      onUnsubscribe(connection, body);
+      break;
+    case PUBLISH:
+      onPublish(index, flags, body);
+      break;
+    case PUBACK:
+      ++stats_.pubAcks;
+      break;
+    case PINGREQ:
+      send(connection, PINGRESP << 4, std::string());
+      break;
+    case DISCONNECT:
+      write(connection);
+      close(connection);
+      break;
+    default:
+      close(connection);
+      break;
+  }
+}
+
+void Broker::onConnect(Connection &connection, const std::string &body) {
+  if (body.size() < 10) {
+    close(connection);
+    return;
+  }
+  connection.v5 = body[6] == 5;
+  size_t offset = 10;
+  if (connection.v5) {
+    const std::map<uint8_t, uint32_t> properties = decodeProperties(body, &offset);
+    const auto limit = properties.find(TOPIC_ALIAS_MAXIMUM);
+    connection.aliasLimit = limit != properties.end() ? static_cast<uint16_t>(limit->second) : 0;
+    const auto receive = properties.find(RECEIVE_MAXIMUM);
+    connection.receiveMaximum =
+        receive != properties.end() ? static_cast<uint16_t>(receive->second) : 0;
+  }
+  connection.clientId = body.substr(offset + 2, readU16(body, offset));
+  connection.connected = true;
+  std::string connack = std::string(2, '\0');
+  if (connection.v5) {
+    const std::string properties =
+        std::string(1, static_cast<char>(TOPIC_ALIAS_MAXIMUM)) + u16(topicAliases_);
+    connack += encodeVarint(properties.size()) + properties;
+  }
+  send(connection, CONNACK << 4, connack);
+}
+
+void Broker::onSubscribe(Connection &connection, const std::string &body) {
+  size_t offset = 2;
+  if (connection.v5) {
+    decodeProperties(body, &offset);
+  }
+  std::string granted;
+  while (offset + 2 < body.size()) {
+    const uint16_t length = readU16(body, offset);
+    const std::string topic = body.substr(offset + 2, length);
+    offset += 2 + length;
+    if (std::find(connection.subscriptions.begin(), connection.subscriptions.end(), topic) ==
+        connection.subscriptions.end()) {
+      connection.subscriptions.push_back(topic);
+    }
+    granted.push_back(static_cast<char>(offset < body.size() ? body[offset] & 0x03 : 0));
+    ++offset;
+  }
+  send(connection, SUBACK << 4,
+       body.substr(0, 2) + (connection.v5 ? std::string(1, '\0') : "") + granted);
+}
+
+void Broker::onUnsubscribe(Connection &connection, const std::string &body) {
+  size_t offset = 2;
+  if (connection.v5) {
+    decodeProperties(body, &offset);
+  }
+  std::string reasons;
+  while (offset + 2 <= body.size()) {
+    const uint16_t length = readU16(body, offset);
+    const std::string topic = body.substr(offset + 2, length);
+    offset += 2 + length;
+    auto &topics = connection.subscriptions;
+    topics.erase(std::remove(topics.begin(), topics.end(), topic), topics.end());
+    reasons.push_back('\0');
+  }
+  send(connection, UNSUBACK << 4,
+       body.substr(0, 2) + (connection.v5 ? std::string(1, '\0') + reasons : ""));
+}
+
+void Broker::onPublish(size_t index, uint8_t flags, const std::string &body) {
+  Connection &connection = connections_[index];
+  const uint16_t length = readU16(body, 0);
+  Message message{index, body.substr(2, length), std::string(), false, 0};
+  size_t offset = 2 + length;
+  const uint8_t qos = (flags >> 1) & 0x03;
+  const uint16_t packetId = qos > 0 ? readU16(body, offset) : 0;
+  if (qos > 0) {
+    offset += 2;
+  }
+  if (connection.v5) {
+    const std::map<uint8_t, uint32_t> properties = decodeProperties(body, &offset);
+    const auto expiry = properties.find(MESSAGE_EXPIRY);
+    message.expirySeconds = expiry != properties.end() ? expiry->second : 0;
+    const auto alias = properties.find(TOPIC_ALIAS);
+    if (alias != properties.end() && !message.topic.empty()) {
+      connection.clientAliases[static_cast<uint16_t>(alias->second)] = message.topic;
+    } else if (alias != properties.end()) {
+      const auto bound = connection.clientAliases.find(static_cast<uint16_t>(alias->second));
+      message.topic = bound != connection.clientAliases.end() ? bound->second : "<unbound alias>";
+      message.aliased = true;
+    }
+  }
+  message.payload = body.substr(std::min(offset, body.size()));
+  ++stats_.publishesIn;
+  if (qos == 1) {
+    send(connection, PUBACK << 4, u16(packetId));
+  }
+  if (forwardPublishes_) {
+    publish(message.topic, message.payload);
+  } else {
+    messages_.push_back(message);
+  }
+}
+
+void Broker::send(Connection &connection, uint8_t firstByte, const std::string &body) {
+  const std::string packet = std::string(1, static_cast<char>(firstByte)) +
+                             encodeVarint(body.size()) + body;
+  stats_.txBytes += packet.size();
+  connection.output += packet;
+}
+}  // namespace host
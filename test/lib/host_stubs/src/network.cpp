@@ -0,0 +1,120 @@
+#include <WiFi.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#include <netdb.h>
+#include <netinet/in.h>
+
+#include <string>
+#include <vector>
+
+#include "host_fakes.h"
+#include "net/tls_session.h"
+
+WiFiClass WiFi;
+
+namespace {
+bool g_wifiConnected = false;
+size_t g_wifiDisconnects = 0;
+uint64_t g_associationUs = 0;
+bool g_joining = false;
+uint64_t g_joinedAtUs = 0;
+
+// Roughly when lwIP gives up on a server that never answers and calls back
+// with no address.
+constexpr uint64_t DNS_GIVE_UP_US = 5000000;
+
+struct PendingLookup {
+  std::string hostname;
+  dns_found_callback found;
+  void *arg;
+  uint64_t failsAtUs;
+};
+
+std::string g_unansweredHost;
+std::vector<PendingLookup> g_pendingLookups;
+
+void failDueLookups() {
+  for (size_t i = 0; i < g_pendingLookups.size();) {
+    if (host::nowMicros() < g_pendingLookups[i].failsAtUs) {
+      ++i;
+      continue;
+    }
+    const PendingLookup lookup = g_pendingLookups[i];
+    g_pendingLookups.erase(g_pendingLookups.begin() + i);
+    lookup.found(lookup.hostname.c_str(), nullptr, lookup.arg);
+  }
+}
+}  // namespace
+
+namespace host {
+void setWifiConnected(bool connected) {
+  g_wifiConnected = connected;
+  g_joining = false;
+}
+
+size_t wifiDisconnects() { return g_wifiDisconnects; }
+
+void setAssociationMs(uint32_t ms) { g_associationUs = static_cast<uint64_t>(ms) * 1000; }
+
+void setDnsUnanswered(const char *hostname) { g_unansweredHost = hostname; }
+}  // namespace host
+
+void WiFiClass::disconnect(bool) {
+  ++g_wifiDisconnects;
+  g_joining = false;
+}
+
+void WiFiClass::begin(const char *, const char *, int32_t, const uint8_t *, bool) {
+  if (g_associationUs == 0) {
+    return;
+  }
+  g_joining = true;
+  g_joinedAtUs = host::nowMicros() + g_associationUs;
+}
+
+wl_status_t WiFiClass::status() {
+  if (g_joining && host::nowMicros() >= g_joinedAtUs) {
+    g_joining = false;
+    g_wifiConnected = true;
+  }
+  return g_wifiConnected ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+err_t dns_gethostbyname_addrtype(const char *hostname, ip_addr_t *address,
+                                 dns_found_callback callback, void *arg, uint8_t) {
+  if (!g_unansweredHost.empty() && g_unansweredHost == hostname) {
+    g_pendingLookups.push_back({hostname, callback, arg, host::nowMicros() + DNS_GIVE_UP_US});
+    return ERR_INPROGRESS;
+  }
+  addrinfo hints{};
+  hints.ai_family = AF_INET;
+  addrinfo *found = nullptr;
+  if (getaddrinfo(hostname, nullptr, &hints, &found) != 0 || found == nullptr) {
+    return ERR_ARG;
+  }
+  address->type = IPADDR_TYPE_V4;
+  address->u_addr.addr = reinterpret_cast<const sockaddr_in *>(found->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(found);
+  return ERR_OK;
+}
+
+err_t tcpip_callback(tcpip_callback_fn function, void *ctx) {
+  // The tcpip thread only gets to run, and time out lookups, when asked to.
+  failDueLookups();
+  function(ctx);
+  return ERR_OK;
+}
+
+// There is no mbedTLS on the host: every TLS connection fails its handshake,
+// which the MQTT client handles like any other failed connect.
+namespace net {
+TlsSession::TlsSession() {}
+TlsSession::~TlsSession() {}
+bool TlsSession::begin(Socket *, const char *, const TlsOptions &) { return false; }
+Socket::Progress TlsSession::pollHandshake() { return Socket::Progress::Failed; }
+int TlsSession::read(uint8_t *, size_t) { return -1; }
+int TlsSession::write(const uint8_t *, size_t) { return -1; }
+bool TlsSession::hasBufferedInput() { return false; }
+void TlsSession::close() {}
+void TlsSession::forgetSession() {}
+}  // namespace net
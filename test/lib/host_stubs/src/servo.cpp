@@ -0,0 +1,10 @@
+#include <ESP32Servo.h>
+
+#include "host_fakes.h"
+
+int Servo::attach(int) {
+  host::advanceMicros(host::actuatorSetupUs());
+  return 1;
+}
+
+void Servo::write(int angle) { angle_ = angle; }
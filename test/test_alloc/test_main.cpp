@@ -0,0 +1,146 @@
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <new>
+#include <string>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "diag/alloc_counter.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/command_window.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+
+#if !DIAG_ALLOC_COUNT
+#error "test_alloc needs the allocation counter; run it with `pio test -e native_alloccheck`"
+#endif
+
+// libstdc++ allocates from inside the shared library, out of reach of
+// --wrap=malloc, so operator new is routed through the wrapped malloc here.
+void *operator new(size_t size) {
+  void *pointer = malloc(size > 0 ? size : 1);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void operator delete(void *pointer) noexcept { free(pointer); }
+
+void operator delete(void *pointer, size_t) noexcept { free(pointer); }
+
+namespace {
+host::Broker g_broker;
+// Keeps the compiler from dropping the allocations in the control test.
+void *volatile g_sink = nullptr;
+
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    g_broker.poll();
+    tasks::mqtt::loop();
+    if (done()) {
+      return true;
+    }
+    host::advanceMicros(1000);
+    usleep(100);
+  }
+  return false;
+}
+
+void pump(int steps) {
+  pumpUntil([] { return false; }, steps);
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_counter_sees_allocations_inside_a_scope() {
+  const uint32_t before = diag::alloc::scopedAllocations();
+  g_sink = malloc(32);
+  free(g_sink);
+  TEST_ASSERT_EQUAL_UINT32(before, diag::alloc::scopedAllocations());
+
+  {
+    const diag::alloc::Scope scope;
+    g_sink = malloc(32);
+    free(g_sink);
+    std::string text(64, 'x');
+    g_sink = &text[0];
+  }
+  TEST_ASSERT_EQUAL_UINT32(before + 2, diag::alloc::scopedAllocations());
+}
+
+// Every command kind goes from the broker through the real client, envelope
+// parsing, the command window, tracing and dispatch.
+void test_mqtt_command_path_does_not_allocate() {
+  const uint16_t port = g_broker.start();
+  TEST_ASSERT_NOT_EQUAL(0, port);
+  provisioning::initDefaults();
+  char portText[8];
+  snprintf(portText, sizeof(portText), "%u", static_cast<unsigned>(port));
+  TEST_ASSERT_TRUE(provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1"));
+  TEST_ASSERT_TRUE(provisioning::applyKeyValue("MQTT_PORT", portText));
+  initActuators();
+  host::setWifiConnected(true);
+  tasks::mqtt::init();
+  TEST_ASSERT_TRUE(pumpUntil([] { return g_broker.subscribers(MQTT_CMD_TOPIC) == 1; }));
+  g_broker.takeMessages();
+
+  const char *const commands[] = {
+      "forward:200",
+      "backward:120",
+      "left:80",
+      "right:80",
+      "speed_up:10",
+      "twist:150,300",
+      "servo1:90",
+      "stop",
+      "unknown:1",
+      "@id=1,src=21,seq=1,age=500;forward:100",
+      "@id=2,src=21,seq=1,age=500;forward:100",
+      "@id=3,src=21,seq=2;stop",
+      "@broken",
+  };
+  const uint32_t allocationsBefore = diag::alloc::scopedAllocations();
+  const tasks::command_window::Counters before = tasks::command_window::counters();
+  for (const char *command : commands) {
+    TEST_ASSERT_EQUAL(1, g_broker.publish(MQTT_CMD_TOPIC, command));
+  }
+  pump(50);
+
+  // All but the replayed sequence number and the malformed envelope.
+  const tasks::command_window::Counters after = tasks::command_window::counters();
+  TEST_ASSERT_EQUAL_UINT32(before.accepted + 11, after.accepted);
+  TEST_ASSERT_EQUAL_UINT32(before.duplicate + 1, after.duplicate);
+  TEST_ASSERT_EQUAL_UINT32(allocationsBefore, diag::alloc::scopedAllocations());
+
+  // The heartbeat counts from boot, including the control test's two.
+  char field[32];
+  snprintf(field, sizeof(field), " cmd_allocs=%lu",
+           static_cast<unsigned long>(diag::alloc::scopedAllocations()));
+  host::advanceMicros(static_cast<uint64_t>(MQTT_HEARTBEAT_INTERVAL_MS) * 1000);
+  bool reported = false;
+  TEST_ASSERT_TRUE(pumpUntil([&] {
+    for (const host::Broker::Message &message : g_broker.takeMessages()) {
+      reported |= message.payload.rfind("comm-robot heartbeat", 0) == 0 &&
+                  message.payload.find(field) != std::string::npos;
+    }
+    return reported;
+  }));
+  g_broker.stop();
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_counter_sees_allocations_inside_a_scope);
+  RUN_TEST(test_mqtt_command_path_does_not_allocate);
+  return UNITY_END();
+}
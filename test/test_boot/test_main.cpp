@@ -0,0 +1,152 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <string>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "diag/boot_timeline.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+#include "tasks/wifi_task.h"
+
+using diag::boot::Stage;
+
+namespace {
+// Rough costs on the device; what the tests check is which path pays them.
+constexpr uint32_t ASSOCIATION_MS = 1500;
+constexpr uint32_t ACTUATOR_SETUP_US = 15000;
+// ROM bootloader and app start before setup() runs.
+constexpr uint64_t SETUP_STARTS_US = 250000;
+
+host::Broker g_broker;
+char g_port[8];
+std::string g_lastReport;
+size_t g_reports = 0;
+
+void collectReports() {
+  for (const host::Broker::Message &message : g_broker.takeMessages()) {
+    if (message.topic == MQTT_HEARTBEAT_TOPIC && message.payload.rfind("comm-robot boot", 0) == 0) {
+      g_lastReport = message.payload;
+      ++g_reports;
+    }
+  }
+}
+
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    g_broker.poll();
+    collectReports();
+    tasks::wifi::loop();
+    tasks::mqtt::loop();
+    serviceActuators(millis());
+    if (done()) {
+      return true;
+    }
+    host::advanceMicros(1000);
+    usleep(100);
+  }
+  return false;
+}
+
+bool contains(const std::string &text, const char *part) {
+  return text.find(part) != std::string::npos;
+}
+
+uint32_t sinceStage(Stage from, Stage to) { return diag::boot::at(to) - diag::boot::at(from); }
+
+// setup() in the order src/main.cpp runs it, without the parts the host does
+// not build (ESP-NOW) or need (Serial, the event loop, the stall detector).
+void bootDevice() {
+  diag::boot::mark(Stage::Setup);
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("WIFI_SSID", "warehouse");
+  provisioning::applyKeyValue("WIFI_PASSWORD", "forklift");
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", g_port);
+  diag::boot::mark(Stage::Provisioned);
+
+  tasks::wifi::init();
+  diag::boot::mark(Stage::WifiStarted);
+  initActuators();
+  diag::boot::mark(Stage::ActuatorsReady);
+  diag::boot::mark(Stage::EspNowReady);
+  tasks::mqtt::init();
+  diag::boot::mark(Stage::SetupDone);
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// The actuator setup runs while the driver associates, so it costs nothing
+// on the way to the first command.
+void test_setup_overlaps_the_association() {
+  TEST_ASSERT_TRUE(diag::boot::at(Stage::SetupDone) != 0);
+  TEST_ASSERT_EQUAL_UINT32(0, diag::boot::at(Stage::WifiConnected));
+  TEST_ASSERT_TRUE(sinceStage(Stage::WifiStarted, Stage::ActuatorsReady) >= ACTUATOR_SETUP_US);
+
+  TEST_ASSERT_TRUE(pumpUntil([] { return diag::boot::at(Stage::MqttConnected) != 0; }));
+  const uint32_t association = sinceStage(Stage::WifiStarted, Stage::WifiConnected);
+  TEST_ASSERT_TRUE(association >= ASSOCIATION_MS * 1000);
+  TEST_ASSERT_TRUE(association <= ASSOCIATION_MS * 1000 + 1000);
+  TEST_ASSERT_TRUE(diag::boot::at(Stage::SetupDone) < diag::boot::at(Stage::WifiConnected));
+  // No retry delay to sit out: the first connect goes out with the link.
+  TEST_ASSERT_TRUE(sinceStage(Stage::WifiConnected, Stage::MqttConnected) < 50000);
+}
+
+void test_timeline_goes_out_once_connected() {
+  TEST_ASSERT_TRUE(pumpUntil([] { return g_reports > 0; }));
+  TEST_MESSAGE(g_lastReport.c_str());
+  TEST_ASSERT_TRUE(contains(g_lastReport, " setup_us=250000 "));
+  TEST_ASSERT_TRUE(contains(g_lastReport, " mqtt_up_us="));
+  TEST_ASSERT_FALSE(contains(g_lastReport, "first_cmd_us"));
+
+  // Nothing new to report, nothing sent.
+  pumpUntil([] { return false; }, 200);
+  TEST_ASSERT_EQUAL(1, g_reports);
+}
+
+// The first command actuates without setting anything up, and the timeline
+// goes out again with it.
+void test_first_command_actuates_without_setup() {
+  TEST_ASSERT_TRUE(pumpUntil(
+      [] { return g_broker.subscribers(provisioning::mqtt().commandTopic) == 1; }));
+  const uint32_t sentUs = micros();
+  g_broker.publish(provisioning::mqtt().commandTopic, "@id=1;forward:200");
+  TEST_ASSERT_TRUE(pumpUntil([] { return diag::boot::at(Stage::FirstCommand) != 0; }));
+  TEST_ASSERT_TRUE(diag::boot::at(Stage::FirstCommand) - sentUs < ACTUATOR_SETUP_US);
+
+  TEST_ASSERT_TRUE(pumpUntil([] { return g_reports == 2; }));
+  TEST_ASSERT_TRUE(contains(g_lastReport, " first_cmd_us="));
+
+  char message[160];
+  snprintf(message, sizeof(message),
+           "setup %lu us, WiFi up %lu us after begin, MQTT up %lu us after WiFi, "
+           "first command actuated %lu us after it was sent",
+           static_cast<unsigned long>(sinceStage(Stage::Setup, Stage::SetupDone)),
+           static_cast<unsigned long>(sinceStage(Stage::WifiStarted, Stage::WifiConnected)),
+           static_cast<unsigned long>(sinceStage(Stage::WifiConnected, Stage::MqttConnected)),
+           static_cast<unsigned long>(diag::boot::at(Stage::FirstCommand) - sentUs));
+  TEST_MESSAGE(message);
+}
+
+int main() {
+  snprintf(g_port, sizeof(g_port), "%u", static_cast<unsigned>(g_broker.start()));
+  host::setAssociationMs(ASSOCIATION_MS);
+  host::setActuatorSetupUs(ACTUATOR_SETUP_US);
+  host::setMicros(SETUP_STARTS_US);
+  bootDevice();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_setup_overlaps_the_association);
+  RUN_TEST(test_timeline_goes_out_once_connected);
+  RUN_TEST(test_first_command_actuates_without_setup);
+  return UNITY_END();
+}
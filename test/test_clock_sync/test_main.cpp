@@ -0,0 +1,125 @@
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+
+#include <random>
+
+#include "net/clock_sync.h"
+
+namespace {
+constexpr double SYNC_INTERVAL_US = 2e6;
+constexpr double ONE_WAY_US = 1500;
+constexpr double TURNAROUND_US = 200;
+// Mean of the exponential queueing delay added to each leg.
+constexpr double QUEUEING_US = 4000;
+constexpr int EXCHANGES = 300;
+// Past this many exchanges the drift fit has settled.
+constexpr int WARMUP = 30;
+
+struct Result {
+  int32_t driftPpb;
+  double meanErrorUs;
+  double maxErrorUs;
+  double worstRoundTripUs;
+  int64_t errorBoundUs;
+};
+
+// Ten minutes of exchanges at MQTT_SYNC_INTERVAL_MS against a controller
+// whose clock runs `skewPpm` fast and is far ahead of ours, over a link with
+// random queueing on both legs. After each exchange the estimate is asked to
+// predict the controller's clock up to 1.6 s ahead, as a scheduled command
+// due before the next exchange would.
+Result simulate(double skewPpm) {
+  net::ClockSync sync;
+  std::mt19937 rng(1);
+  std::exponential_distribution<double> queueing(1 / QUEUEING_US);
+  const auto remote = [&](double localUs) {
+    return static_cast<int64_t>(1.7e15 + localUs * (1 + skewPpm * 1e-6));
+  };
+
+  Result result{};
+  double sumError = 0;
+  int samples = 0;
+  double local = 5e6;
+  for (int i = 0; i < EXCHANGES; ++i) {
+    const double t1 = local;
+    const double t2 = t1 + ONE_WAY_US + queueing(rng);
+    const double t3 = t2 + TURNAROUND_US;
+    const double t4 = t3 + ONE_WAY_US + queueing(rng);
+    TEST_ASSERT_TRUE(sync.addExchange(static_cast<int64_t>(t1), remote(t2), remote(t3),
+                                      static_cast<int64_t>(t4)));
+    TEST_ASSERT_TRUE(sync.synced());
+
+    for (int k = 1; k <= 4; ++k) {
+      const int64_t probe = static_cast<int64_t>(t4 + k * 400000);
+      const double error = fabs(static_cast<double>(sync.toRemote(probe) - remote(probe)));
+      if (i >= WARMUP) {
+        result.maxErrorUs = fmax(result.maxErrorUs, error);
+        sumError += error;
+        ++samples;
+      }
+      TEST_ASSERT_TRUE(llabs(sync.toLocal(sync.toRemote(probe)) - probe) <= 2);
+    }
+    result.worstRoundTripUs = fmax(result.worstRoundTripUs, t4 - t1 - TURNAROUND_US);
+    local = t4 + SYNC_INTERVAL_US;
+  }
+  result.driftPpb = sync.driftPpb();
+  result.meanErrorUs = sumError / samples;
+  result.errorBoundUs = sync.errorBoundUs();
+
+  char message[128];
+  snprintf(message, sizeof(message),
+           "skew %+.0f ppm: drift %ld ppb, error mean %.0f us max %.0f us, bound %lld us", skewPpm,
+           static_cast<long>(result.driftPpb), result.meanErrorUs, result.maxErrorUs,
+           static_cast<long long>(result.errorBoundUs));
+  TEST_MESSAGE(message);
+  return result;
+}
+
+void checkSkew(double skewPpm) {
+  const Result result = simulate(skewPpm);
+  // Within 2 ppm of the real rate: 3 us of error over the 1.6 s look-ahead.
+  TEST_ASSERT_TRUE(fabs(result.driftPpb - skewPpm * 1000) < 2000);
+  // The minimum round trip filter keeps the error near the link's floor,
+  // far below the typical queueing.
+  TEST_ASSERT_TRUE(result.meanErrorUs < QUEUEING_US / 2);
+  TEST_ASSERT_TRUE(result.maxErrorUs < QUEUEING_US);
+  TEST_ASSERT_TRUE(result.errorBoundUs > 0);
+  TEST_ASSERT_TRUE(result.errorBoundUs < result.worstRoundTripUs / 2);
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_matched_clocks() { checkSkew(0); }
+
+void test_controller_clock_runs_fast() { checkSkew(40); }
+
+void test_controller_clock_runs_slow() { checkSkew(-120); }
+
+void test_inconsistent_exchanges_are_dropped() {
+  net::ClockSync sync;
+  // Reply sent before it was received, and a round trip shorter than the
+  // controller's own turnaround.
+  TEST_ASSERT_FALSE(sync.addExchange(1000, 5000, 4000, 9000));
+  TEST_ASSERT_FALSE(sync.addExchange(1000, 5000, 9000, 2000));
+  TEST_ASSERT_FALSE(sync.synced());
+  TEST_ASSERT_EQUAL_UINT32(0, sync.exchanges());
+
+  // 1 ms each way to a clock 500 ms ahead.
+  TEST_ASSERT_TRUE(sync.addExchange(1000, 502000, 502100, 3100));
+  TEST_ASSERT_TRUE(sync.synced());
+  TEST_ASSERT_EQUAL(1000, sync.errorBoundUs());
+  TEST_ASSERT_EQUAL(500000 + 3100, sync.toRemote(3100));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_matched_clocks);
+  RUN_TEST(test_controller_clock_runs_fast);
+  RUN_TEST(test_controller_clock_runs_slow);
+  RUN_TEST(test_inconsistent_exchanges_are_dropped);
+  return UNITY_END();
+}
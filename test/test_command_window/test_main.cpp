@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "tasks/command_envelope.h"
+#include "tasks/command_window.h"
+
+using tasks::command_window::Verdict;
+
+namespace {
+constexpr uint32_t PERIOD_MS = 50;
+constexpr uint32_t MAX_AGE_MS = 150;
+constexpr uint32_t LINK_DELAY_MS = 4;
+
+// One controller streaming enveloped commands. Its clock is `skewMs` off
+// ours; each test uses its own source id, as the window keeps per-source
+// state for the life of the program.
+struct Controller {
+  uint32_t source;
+  uint32_t skewMs;
+  uint32_t sequence;
+  char payload[96];
+
+  // Builds the next command, stamped at sender time `senderMs`.
+  const char *next(uint32_t senderMs) {
+    snprintf(payload, sizeof(payload), "@src=%lu,seq=%lu,ts=%lu,age=%lu;forward:200",
+             static_cast<unsigned long>(source), static_cast<unsigned long>(++sequence),
+             static_cast<unsigned long>(senderMs + skewMs), static_cast<unsigned long>(MAX_AGE_MS));
+    return payload;
+  }
+};
+
+Verdict deliver(const char *payload, uint32_t nowMs) {
+  tasks::envelope::CommandEnvelope envelope{};
+  TEST_ASSERT_TRUE(tasks::envelope::parse(payload, strlen(payload), &envelope));
+  return tasks::command_window::check(envelope, nowMs);
+}
+
+Verdict deliverSequence(uint32_t source, uint32_t sequence, uint32_t nowMs) {
+  char payload[48];
+  snprintf(payload, sizeof(payload), "@src=%lu,seq=%lu;stop", static_cast<unsigned long>(source),
+           static_cast<unsigned long>(sequence));
+  return deliver(payload, nowMs);
+}
+
+// Streams `count` commands on time and returns how many were accepted.
+uint32_t stream(Controller &controller, uint32_t *nowMs, uint32_t count) {
+  uint32_t accepted = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    *nowMs += PERIOD_MS;
+    if (deliver(controller.next(*nowMs - LINK_DELAY_MS), *nowMs) == Verdict::Accept) {
+      ++accepted;
+    }
+  }
+  return accepted;
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_in_order_commands_are_accepted() {
+  for (uint32_t seq = 1; seq <= 40; ++seq) {
+    TEST_ASSERT_TRUE(deliverSequence(1, seq, 1000 + seq * PERIOD_MS) == Verdict::Accept);
+  }
+}
+
+void test_duplicates_and_reordered_commands_are_dropped() {
+  const tasks::command_window::Counters before = tasks::command_window::counters();
+  uint32_t now = 2000;
+  TEST_ASSERT_TRUE(deliverSequence(2, 10, now) == Verdict::Accept);
+  TEST_ASSERT_TRUE(deliverSequence(2, 12, ++now) == Verdict::Accept);
+  // 11 overtaken by 12: motion is only meaningful in order.
+  TEST_ASSERT_TRUE(deliverSequence(2, 11, ++now) == Verdict::Stale);
+  TEST_ASSERT_TRUE(deliverSequence(2, 12, ++now) == Verdict::Duplicate);
+  TEST_ASSERT_TRUE(deliverSequence(2, 10, ++now) == Verdict::Duplicate);
+  TEST_ASSERT_TRUE(deliverSequence(2, 13, ++now) == Verdict::Accept);
+  // Far behind the window: no longer provably a duplicate, still stale.
+  TEST_ASSERT_TRUE(deliverSequence(2, 13 + 100, ++now) == Verdict::Accept);
+  TEST_ASSERT_TRUE(deliverSequence(2, 13, ++now) == Verdict::Stale);
+
+  const tasks::command_window::Counters after = tasks::command_window::counters();
+  TEST_ASSERT_EQUAL_UINT32(4, after.accepted - before.accepted);
+  TEST_ASSERT_EQUAL_UINT32(2, after.duplicate - before.duplicate);
+  TEST_ASSERT_EQUAL_UINT32(2, after.stale - before.stale);
+}
+
+void test_commands_without_sequence_bypass_the_window() {
+  const char payload[] = "@id=5;stop";
+  TEST_ASSERT_TRUE(deliver(payload, 3000) == Verdict::Accept);
+  TEST_ASSERT_TRUE(deliver(payload, 3001) == Verdict::Accept);
+  TEST_ASSERT_TRUE(deliver("stop", 3002) == Verdict::Accept);
+}
+
+// A 12 s outage: the controller keeps sending, the broker and TCP hold the
+// commands, and they all arrive in one burst when the link comes back.
+void test_replay_burst_after_an_outage_expires() {
+  Controller controller{3, 734000, 0, {}};
+  uint32_t now = 10000;
+  TEST_ASSERT_EQUAL_UINT32(40, stream(controller, &now, 40));
+
+  const uint32_t outageMs = 12000;
+  const uint32_t queued = outageMs / PERIOD_MS;
+  char burst[outageMs / PERIOD_MS][96];
+  for (uint32_t i = 0; i < queued; ++i) {
+    strcpy(burst[i], controller.next(now + (i + 1) * PERIOD_MS));
+  }
+  now += outageMs + LINK_DELAY_MS;
+
+  uint32_t accepted = 0;
+  uint32_t expired = 0;
+  for (uint32_t i = 0; i < queued; ++i) {
+    const Verdict verdict = deliver(burst[i], now + i / 10);
+    accepted += verdict == Verdict::Accept;
+    expired += verdict == Verdict::Expired;
+  }
+  // Only what was sent within the last max-age of the outage may run.
+  TEST_ASSERT_LESS_OR_EQUAL(MAX_AGE_MS / PERIOD_MS + 1, accepted);
+  TEST_ASSERT_EQUAL_UINT32(queued, accepted + expired);
+
+  // Live traffic afterwards is unaffected.
+  TEST_ASSERT_EQUAL_UINT32(20, stream(controller, &now, 20));
+}
+
+void test_restarted_controller_is_relearned() {
+  Controller controller{4, 500000, 0, {}};
+  uint32_t now = 40000;
+  TEST_ASSERT_EQUAL_UINT32(20, stream(controller, &now, 20));
+
+  // Rebooted after 15 s: sequence numbers and clock both start over.
+  now += 15000;
+  controller.sequence = 0;
+  controller.skewMs = 0u - now;
+  TEST_ASSERT_EQUAL_UINT32(20, stream(controller, &now, 20));
+}
+
+void test_sender_clock_drift_is_tolerated() {
+  // The controller's clock runs 60 ppm slow, so over an hour the observed
+  // offset grows by more than the max age.
+  Controller controller{5, 100, 0, {}};
+  uint32_t now = 60000;
+  uint32_t accepted = 0;
+  const uint32_t commands = 3600000 / PERIOD_MS;
+  for (uint32_t i = 0; i < commands; ++i) {
+    now += PERIOD_MS;
+    const uint32_t senderMs = now - LINK_DELAY_MS - (now - 60000) / 16667;
+    accepted += deliver(controller.next(senderMs), now) == Verdict::Accept;
+  }
+  TEST_ASSERT_EQUAL_UINT32(commands, accepted);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_in_order_commands_are_accepted);
+  RUN_TEST(test_duplicates_and_reordered_commands_are_dropped);
+  RUN_TEST(test_commands_without_sequence_bypass_the_window);
+  RUN_TEST(test_replay_burst_after_an_outage_expires);
+  RUN_TEST(test_restarted_controller_is_relearned);
+  RUN_TEST(test_sender_clock_drift_is_tolerated);
+  return UNITY_END();
+}
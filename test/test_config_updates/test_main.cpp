@@ -0,0 +1,116 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+#include "tasks/wifi_task.h"
+
+namespace {
+host::Broker g_broker;
+char g_port[8];
+
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    g_broker.poll();
+    tasks::wifi::loop();
+    tasks::mqtt::loop();
+    if (done()) {
+      return true;
+    }
+    host::advanceMicros(1000);
+    usleep(100);
+  }
+  return false;
+}
+
+void runFor(int steps) {
+  pumpUntil([] { return false; }, steps);
+}
+
+// Applies `text` the way the serial console and NVS do, with every key in
+// reach, and gives both tasks time to react.
+void provision(const char *text) {
+  char buffer[256];
+  snprintf(buffer, sizeof(buffer), "%s", text);
+  TEST_ASSERT_TRUE(provisioning::applyConfigText(buffer) > 0);
+  runFor(50);
+}
+
+bool sessionUp() { return g_broker.subscribers(provisioning::mqtt().commandTopic) == 1; }
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_reapplying_the_current_settings_keeps_both_links() {
+  TEST_ASSERT_TRUE(pumpUntil(sessionUp));
+  const size_t sessions = g_broker.acceptedConnections();
+  const size_t wifiDrops = host::wifiDisconnects();
+
+  char text[256];
+  const provisioning::WifiCredentials wifi = provisioning::wifi();
+  snprintf(text, sizeof(text), "WIFI_SSID=%s\nWIFI_PASSWORD=%s\nMQTT_HOST=127.0.0.1\nMQTT_PORT=%s",
+           wifi.networks[0].ssid, wifi.networks[0].password, g_port);
+  provision(text);
+
+  TEST_ASSERT_EQUAL(sessions, g_broker.acceptedConnections());
+  TEST_ASSERT_EQUAL(1, g_broker.liveConnections());
+  TEST_ASSERT_EQUAL(wifiDrops, host::wifiDisconnects());
+}
+
+// Publish topics are read on every publish; nothing is redone for them.
+void test_publish_topic_changes_keep_the_session() {
+  const size_t sessions = g_broker.acceptedConnections();
+  provision("MQTT_PUB_TOPIC=robot/out\nMQTT_HEARTBEAT_TOPIC=robot/hb\nMQTT_ACK_TOPIC=robot/ack");
+
+  TEST_ASSERT_EQUAL(sessions, g_broker.acceptedConnections());
+  TEST_ASSERT_EQUAL(1, g_broker.liveConnections());
+}
+
+void test_command_topic_change_resubscribes_in_place() {
+  const size_t sessions = g_broker.acceptedConnections();
+  const char *const previous = MQTT_CMD_TOPIC;
+  provision("MQTT_CMD_TOPIC=robot/in");
+
+  TEST_ASSERT_TRUE(pumpUntil([] { return g_broker.subscribers("robot/in") == 1; }));
+  TEST_ASSERT_EQUAL(0, g_broker.subscribers(previous));
+  TEST_ASSERT_EQUAL(sessions, g_broker.acceptedConnections());
+}
+
+// The control: a new client identity does rebuild the session.
+void test_client_id_change_reconnects() {
+  const size_t sessions = g_broker.acceptedConnections();
+  provision("MQTT_CLIENT_ID=robot-7");
+
+  TEST_ASSERT_TRUE(pumpUntil([&] { return g_broker.acceptedConnections() > sessions; }));
+  TEST_ASSERT_TRUE(pumpUntil(sessionUp));
+  TEST_ASSERT_EQUAL(1, g_broker.liveConnections());
+}
+
+int main() {
+  snprintf(g_port, sizeof(g_port), "%u", static_cast<unsigned>(g_broker.start()));
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("WIFI_SSID", "warehouse");
+  provisioning::applyKeyValue("WIFI_PASSWORD", "forklift");
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", g_port);
+  initActuators();
+  host::setWifiConnected(true);
+  tasks::wifi::init();
+  tasks::mqtt::init();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_reapplying_the_current_settings_keeps_both_links);
+  RUN_TEST(test_publish_topic_changes_keep_the_session);
+  RUN_TEST(test_command_topic_change_resubscribes_in_place);
+  RUN_TEST(test_client_id_change_reconnects);
+  return UNITY_END();
+}
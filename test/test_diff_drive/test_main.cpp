@@ -0,0 +1,192 @@
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+
+#include <chrono>
+
+#include "config/actuator_topology.h"
+#include "tasks/diff_drive.h"
+
+using topology::FourWheelDrive;
+using topology::TwoWheelDrive;
+
+namespace {
+// Float reference for what the integer path approximates: the duty that the
+// calibration curve says gives `speedMmS`.
+template <typename Topology>
+double referenceDuty(double speedMmS) {
+  constexpr size_t points = topology::wheelCurveCount<Topology>();
+  size_t segment = 0;
+  while (segment + 2 < points && Topology::wheelCurve[segment + 1].speedMmS < speedMmS) {
+    ++segment;
+  }
+  const topology::WheelCurvePoint &lo = Topology::wheelCurve[segment];
+  const topology::WheelCurvePoint &hi = Topology::wheelCurve[segment + 1];
+  return lo.duty + (hi.duty - lo.duty) * (speedMmS - lo.speedMmS) / (hi.speedMmS - lo.speedMmS);
+}
+
+template <typename Topology>
+void referenceWheels(double linear, double angular, double *left, double *right) {
+  const double turn = angular * Topology::drive.trackWidthMm / 2000.0;
+  *left = linear - turn;
+  *right = linear + turn;
+  const double peak = fmax(fabs(*left), fabs(*right));
+  const double top = tasks::drive::topSpeedMmS<Topology>();
+  if (peak > top) {
+    *left *= top / peak;
+    *right *= top / peak;
+  }
+}
+
+// Wheel speed between two entries of the duty table.
+template <typename Topology>
+double tableStep() {
+  return static_cast<double>(tasks::drive::topSpeedMmS<Topology>()) /
+         (tasks::drive::DUTY_TABLE_SIZE - 1);
+}
+
+template <typename Topology>
+int8_t expectedDirection(double speedMmS) {
+  if (fabs(speedMmS) < 0.5 * tableStep<Topology>()) {
+    return diag::log::DIR_STOP;
+  }
+  return speedMmS < 0 ? diag::log::DIR_BACKWARD : diag::log::DIR_FORWARD;
+}
+
+// Worst duty error against the float reference over a grid of twists,
+// including ones far past the top speed. The bound is half a duty step of
+// rounding plus half a table step on the steepest segment of the curve.
+template <typename Topology>
+double worstDutyError() {
+  double worst = 0;
+  for (int linear = -900; linear <= 900; linear += 15) {
+    for (int angular = -6000; angular <= 6000; angular += 125) {
+      const tasks::drive::WheelPair wheels = tasks::drive::fromTwist<Topology>(linear, angular);
+      double left = 0;
+      double right = 0;
+      referenceWheels<Topology>(linear, angular, &left, &right);
+
+      const tasks::drive::WheelCommand commands[] = {wheels.left, wheels.right};
+      const double speeds[] = {left, right};
+      for (int side = 0; side < 2; ++side) {
+        // Truncation in the turn term and in the saturation scaling; still
+        // under one duty table step.
+        TEST_ASSERT_TRUE(fabs(commands[side].speedMmS - speeds[side]) < tableStep<Topology>());
+        if (commands[side].direction == diag::log::DIR_STOP) {
+          TEST_ASSERT_EQUAL(0, commands[side].duty);
+          TEST_ASSERT_TRUE(fabs(speeds[side]) < tableStep<Topology>());
+          continue;
+        }
+        if (fabs(speeds[side]) >= tableStep<Topology>()) {
+          TEST_ASSERT_EQUAL(expectedDirection<Topology>(speeds[side]), commands[side].direction);
+        }
+        // The table against the curve, at the speed the kinematics settled on.
+        const double commanded = fabs(static_cast<double>(commands[side].speedMmS));
+        const double error = fabs(commands[side].duty - referenceDuty<Topology>(commanded));
+        worst = error > worst ? error : worst;
+      }
+    }
+  }
+  return worst;
+}
+
+template <typename Topology>
+void checkDeadband() {
+  const uint8_t deadband = Topology::wheelCurve[0].duty;
+  for (int speed = 1; speed <= 20; ++speed) {
+    const tasks::drive::WheelCommand command = tasks::drive::wheelCommand<Topology>(speed);
+    if (command.direction != diag::log::DIR_STOP) {
+      TEST_ASSERT_TRUE(command.duty >= deadband);
+    }
+  }
+  TEST_ASSERT_EQUAL(255, tasks::drive::wheelCommand<Topology>(-32767).duty);
+}
+
+// Cost of one fromTwist() call, and of the float reference for scale, in
+// nanoseconds on the build host.
+template <typename Topology>
+void benchmark(const char *name) {
+  constexpr int CALLS = 2000000;
+  volatile uint32_t sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < CALLS; ++i) {
+    const tasks::drive::WheelPair wheels =
+        tasks::drive::fromTwist<Topology>(i % 1200 - 600, (i * 7) % 8000 - 4000);
+    sink = sink + wheels.left.duty + wheels.right.duty;
+  }
+  const double fixedNs =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+      CALLS;
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < CALLS; ++i) {
+    double left = 0;
+    double right = 0;
+    referenceWheels<Topology>(i % 1200 - 600, (i * 7) % 8000 - 4000, &left, &right);
+    sink = sink + static_cast<uint32_t>(referenceDuty<Topology>(fabs(left)) +
+                                        referenceDuty<Topology>(fabs(right)));
+  }
+  const double floatNs =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+      CALLS;
+
+  char message[128];
+  snprintf(message, sizeof(message), "%s fromTwist %.1f ns/call, float reference %.1f ns/call",
+           name, fixedNs, floatNs);
+  TEST_MESSAGE(message);
+  // Generous: only catches the hot path growing a loop or a division per call.
+  TEST_ASSERT_LESS_THAN(500.0, fixedNs);
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_two_wheel_twist_matches_the_float_reference() {
+  const double worst = worstDutyError<TwoWheelDrive>();
+  char message[64];
+  snprintf(message, sizeof(message), "worst duty error %.2f", worst);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(worst <= 1.5);
+}
+
+void test_four_wheel_twist_matches_the_float_reference() {
+  const double worst = worstDutyError<FourWheelDrive>();
+  char message[64];
+  snprintf(message, sizeof(message), "worst duty error %.2f", worst);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(worst <= 1.5);
+}
+
+void test_slow_requests_clear_the_deadband() {
+  checkDeadband<TwoWheelDrive>();
+  checkDeadband<FourWheelDrive>();
+}
+
+void test_saturation_keeps_the_turning_radius() {
+  const tasks::drive::WheelPair wheels = tasks::drive::fromTwist<TwoWheelDrive>(900, 2000);
+  const int32_t top = tasks::drive::topSpeedMmS<TwoWheelDrive>();
+  TEST_ASSERT_EQUAL(top, wheels.right.speedMmS);
+  // 900 -/+ 2000 mrad/s over the track: the same ratio, scaled to the top speed.
+  double left = 0;
+  double right = 0;
+  referenceWheels<TwoWheelDrive>(900, 2000, &left, &right);
+  TEST_ASSERT_TRUE(fabs(wheels.left.speedMmS - left) < tableStep<TwoWheelDrive>());
+}
+
+void test_benchmark_fixed_point_against_float() {
+  benchmark<TwoWheelDrive>("2WD");
+  benchmark<FourWheelDrive>("4WD");
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_two_wheel_twist_matches_the_float_reference);
+  RUN_TEST(test_four_wheel_twist_matches_the_float_reference);
+  RUN_TEST(test_slow_requests_clear_the_deadband);
+  RUN_TEST(test_saturation_keeps_the_turning_radius);
+  RUN_TEST(test_benchmark_fixed_point_against_float);
+  return UNITY_END();
+}
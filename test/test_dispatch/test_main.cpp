@@ -0,0 +1,142 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "config/actuator_topology.h"
+#include "host_fakes.h"
+#include "tasks/message_handler.h"
+#include "tasks/robot.h"
+
+using tasks::Direction;
+
+namespace {
+using ActiveRobot = tasks::Robot<topology::Active>;
+
+// Same FNV-1a as the dispatch switch, to prove the colliding names below
+// really collide.
+uint32_t fnv1a(const char *text) {
+  uint32_t hash = 2166136261u;
+  for (; *text != '\0'; ++text) {
+    hash = (hash ^ static_cast<uint8_t>(*text)) * 16777619u;
+  }
+  return hash;
+}
+
+void send(const char *command) { onMessage(command, strlen(command)); }
+
+int32_t signedDuty(size_t motor) {
+  int32_t values[ActiveRobot::MOTOR_COUNT + ActiveRobot::SERVO_COUNT];
+  sampleActuators(values, ActiveRobot::MOTOR_COUNT + ActiveRobot::SERVO_COUNT);
+  return values[motor];
+}
+
+template <typename Topology>
+void expectDuty(topology::Side side, uint32_t duty) {
+  for (const topology::MotorSpec &motor : Topology::motors) {
+    if (motor.side == side) {
+      TEST_ASSERT_EQUAL_UINT32(duty, host::ledcDuty(motor.pwmChannel));
+    }
+  }
+}
+}  // namespace
+
+void setUp() { send("stop"); }
+
+void tearDown() {}
+
+void test_commands_reach_every_motor_of_the_active_topology() {
+  send("forward:200");
+  expectDuty<topology::Active>(topology::Side::Left, 200);
+  expectDuty<topology::Active>(topology::Side::Right, 200);
+
+  send(" left:120\r\n");
+  for (size_t i = 0; i < ActiveRobot::MOTOR_COUNT; ++i) {
+    const bool isLeft = topology::Active::motors[i].side == topology::Side::Left;
+    TEST_ASSERT_EQUAL_INT32(isLeft ? -120 : 120, signedDuty(i));
+  }
+
+  send("speed_up:-20");
+  TEST_ASSERT_EQUAL_INT32(100, signedDuty(ActiveRobot::MOTOR_COUNT - 1));
+  send("stop");
+  expectDuty<topology::Active>(topology::Side::Left, 0);
+}
+
+void test_hash_collisions_do_not_dispatch() {
+  TEST_ASSERT_EQUAL_UINT32(fnv1a("stop"), fnv1a("bjfrlvxn"));
+  TEST_ASSERT_EQUAL_UINT32(fnv1a("forward"), fnv1a("adtxzmyj"));
+
+  send("forward:150");
+  send("bjfrlvxn");
+  expectDuty<topology::Active>(topology::Side::Left, 150);
+
+  send("stop");
+  send("adtxzmyj:150");
+  expectDuty<topology::Active>(topology::Side::Left, 0);
+}
+
+void test_unknown_and_out_of_range_commands_are_ignored() {
+  send("forward:80");
+  send("forwards:200");
+  send("servo9:10");
+  send("servo:10");
+  send("");
+  expectDuty<topology::Active>(topology::Side::Right, 80);
+}
+
+void test_two_wheel_drive() {
+  using Robot = tasks::Robot<topology::TwoWheelDrive>;
+  static_assert(Robot::MOTOR_COUNT == 2 && Robot::SERVO_COUNT == 2, "2WD layout");
+  Robot robot;
+  robot.begin();
+
+  robot.move(Direction::Forward, Direction::Backward, 100, 50);
+  expectDuty<topology::TwoWheelDrive>(topology::Side::Left, 100);
+  expectDuty<topology::TwoWheelDrive>(topology::Side::Right, 50);
+  TEST_ASSERT_TRUE(robot.direction(1) == Direction::Backward);
+
+  robot.commandServo(0, 200);
+  TEST_ASSERT_EQUAL(180, robot.servoAngle(0));
+  robot.commandServo(2, 45);
+  TEST_ASSERT_EQUAL(90, robot.servoAngle(1));
+
+  // Servo 2 is a spin servo: out to its end, home again once serviced.
+  robot.commandServo(1, 0);
+  TEST_ASSERT_EQUAL(180, robot.servoAngle(1));
+  uint32_t nextMs = 0;
+  TEST_ASSERT_TRUE(robot.service(millis(), &nextMs));
+  TEST_ASSERT_FALSE(robot.service(nextMs, &nextMs));
+  TEST_ASSERT_EQUAL(90, robot.servoAngle(1));
+}
+
+void test_four_wheel_drive() {
+  using Robot = tasks::Robot<topology::FourWheelDrive>;
+  static_assert(Robot::MOTOR_COUNT == 4 && Robot::SERVO_COUNT == 3, "4WD layout");
+  Robot robot;
+  robot.begin();
+
+  robot.move(Direction::Forward, Direction::Backward, 100, 50);
+  expectDuty<topology::FourWheelDrive>(topology::Side::Left, 100);
+  expectDuty<topology::FourWheelDrive>(topology::Side::Right, 50);
+  TEST_ASSERT_TRUE(robot.direction(2) == Direction::Forward);
+  TEST_ASSERT_TRUE(robot.direction(3) == Direction::Backward);
+
+  robot.adjustSpeed(300);
+  expectDuty<topology::FourWheelDrive>(topology::Side::Right, 255);
+
+  robot.commandServo(2, 45);
+  TEST_ASSERT_EQUAL(45, robot.servoAngle(2));
+
+  Robot::cutMotors();
+  expectDuty<topology::FourWheelDrive>(topology::Side::Left, 0);
+  expectDuty<topology::FourWheelDrive>(topology::Side::Right, 0);
+}
+
+int main() {
+  initActuators();
+  UNITY_BEGIN();
+  RUN_TEST(test_commands_reach_every_motor_of_the_active_topology);
+  RUN_TEST(test_hash_collisions_do_not_dispatch);
+  RUN_TEST(test_unknown_and_out_of_range_commands_are_ignored);
+  RUN_TEST(test_two_wheel_drive);
+  RUN_TEST(test_four_wheel_drive);
+  return UNITY_END();
+}
@@ -0,0 +1,150 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/command_window.h"
+#include "tasks/emergency_stop.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+
+using tasks::estop::Origin;
+
+namespace {
+// "forward:200" plus the PUBLISH framing comes to 42 bytes; this many and a
+// stop fill most of the MQTT_RX_BUFFER in one read.
+constexpr int QUEUED_COMMANDS = 10;
+
+host::Broker g_broker;
+
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    g_broker.poll();
+    tasks::mqtt::loop();
+    if (done()) {
+      return true;
+    }
+    host::advanceMicros(1000);
+    usleep(100);
+  }
+  return false;
+}
+
+// Gives the kernel a moment to move what the broker wrote to the client.
+void settle() { usleep(2000); }
+
+bool motorsRunning() {
+  int32_t values[8];
+  const size_t count = sampleActuators(values, sizeof(values) / sizeof(values[0]));
+  for (size_t i = 0; i < count && i < 2; ++i) {
+    if (values[i] != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool connect() {
+  return pumpUntil([] { return g_broker.subscribers(MQTT_STOP_TOPIC) == 1; });
+}
+
+void queueMotion(int count) {
+  for (int i = 0; i < count; ++i) {
+    g_broker.publish(MQTT_CMD_TOPIC, "forward:200");
+  }
+}
+
+// Runs a command through on its own and returns whether it moved the motors.
+bool commandRuns(const char *command) {
+  onMessage("stop", 4);
+  g_broker.publish(MQTT_CMD_TOPIC, command);
+  g_broker.poll();
+  settle();
+  tasks::mqtt::loop();
+  return motorsRunning();
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// Every motion command queued ahead of the stop in the same receive buffer is
+// dropped, and the motors are cut before any of them could run.
+void test_mqtt_stop_overtakes_a_saturated_queue() {
+  TEST_ASSERT_TRUE(connect());
+  TEST_ASSERT_TRUE(commandRuns("forward:100"));
+  onMessage("stop", 4);
+
+  const tasks::estop::Stats before = tasks::estop::stats();
+  const uint32_t acceptedBefore = tasks::command_window::counters().accepted;
+  queueMotion(QUEUED_COMMANDS);
+  g_broker.publish(MQTT_STOP_TOPIC, "stop");
+  g_broker.poll();
+  settle();
+  tasks::mqtt::loop();
+
+  const tasks::estop::Stats after = tasks::estop::stats();
+  TEST_ASSERT_EQUAL_UINT32(before.stops + 1, after.stops);
+  TEST_ASSERT_EQUAL_UINT32(before.flushedCommands + QUEUED_COMMANDS, after.flushedCommands);
+  TEST_ASSERT_EQUAL_UINT32(acceptedBefore, tasks::command_window::counters().accepted);
+  TEST_ASSERT_FALSE(motorsRunning());
+  TEST_ASSERT_FALSE(tasks::estop::flushing());
+
+  // Commands sent after the stop run as usual.
+  TEST_ASSERT_TRUE(commandRuns("forward:100"));
+}
+
+// An ESP-NOW stop has no place in the MQTT stream, so everything the session
+// already holds is flushed, and the flush ends once the session is drained.
+void test_espnow_stop_flushes_commands_already_received() {
+  onMessage("stop", 4);
+  const tasks::estop::Stats before = tasks::estop::stats();
+  queueMotion(QUEUED_COMMANDS);
+  g_broker.poll();
+  settle();
+  tasks::estop::trigger(Origin::EspNow, micros());
+  TEST_ASSERT_TRUE(tasks::estop::flushing(Origin::EspNow));
+
+  tasks::mqtt::loop();
+  tasks::mqtt::loop();
+
+  const tasks::estop::Stats after = tasks::estop::stats();
+  TEST_ASSERT_EQUAL_UINT32(before.flushedCommands + QUEUED_COMMANDS, after.flushedCommands);
+  TEST_ASSERT_FALSE(motorsRunning());
+  TEST_ASSERT_FALSE(tasks::estop::flushing());
+  TEST_ASSERT_TRUE(commandRuns("forward:100"));
+}
+
+// A stop whose own delivery is lost with the session must not keep dropping
+// commands on the next one.
+void test_flush_ends_with_the_session() {
+  tasks::estop::trigger(Origin::Mqtt, micros());
+  g_broker.dropAll();
+  TEST_ASSERT_TRUE(connect());
+
+  TEST_ASSERT_FALSE(tasks::estop::flushing());
+  TEST_ASSERT_TRUE(commandRuns("forward:100"));
+}
+
+int main() {
+  char port[8];
+  snprintf(port, sizeof(port), "%u", static_cast<unsigned>(g_broker.start()));
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", port);
+  initActuators();
+  host::setWifiConnected(true);
+  tasks::mqtt::init();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_mqtt_stop_overtakes_a_saturated_queue);
+  RUN_TEST(test_espnow_stop_flushes_commands_already_received);
+  RUN_TEST(test_flush_ends_with_the_session);
+  return UNITY_END();
+}
@@ -0,0 +1,152 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include <string>
+
+#include "diag/event_log.h"
+#include "diag/latency_trace.h"
+#include "host_fakes.h"
+#include "tasks/message_handler.h"
+
+namespace {
+constexpr uint32_t UART_BAUD = 115200;
+constexpr size_t UART_FIFO_BYTES = 128;
+constexpr size_t BURSTS = 20;
+constexpr size_t BURST_COMMANDS = 16;
+constexpr uint32_t BURST_GAP_US = 100000;
+constexpr char COMMAND[] = "forward:200";
+
+struct Phase {
+  uint32_t count;
+  uint32_t p50Us;
+  uint32_t p99Us;
+  uint32_t maxUs;
+};
+
+// Upper bound of the histogram bucket holding the given quantile.
+uint32_t quantileUs(const uint32_t *buckets, uint32_t count, uint32_t permille) {
+  const uint32_t rank = (count * permille + 999) / 1000;
+  uint32_t seen = 0;
+  for (size_t i = 0; i < diag::trace::HISTOGRAM_BUCKETS; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return 1u << i;
+    }
+  }
+  return UINT32_MAX;
+}
+
+// What mqttMessageCallback and Robot::move printed per command before the
+// event ring: the echo and the move line, synchronously.
+void logSynchronously() {
+  Serial.println(COMMAND);
+  Serial.printf("Robot Move: L=%s(%d) R=%s(%d)\n", "forward", 200, "forward", 200);
+}
+
+// Bursts of commands handled back to back in one loop pass, as after a
+// reconnect or a slow iteration, traced the way mqttMessageCallback does.
+Phase runBursts(bool synchronousLog) {
+  const diag::trace::LatencyHistogram before = diag::trace::histogram();
+  for (size_t burst = 0; burst < BURSTS; ++burst) {
+    for (size_t i = 0; i < BURST_COMMANDS; ++i) {
+      tasks::envelope::CommandEnvelope envelope{};
+      diag::trace::beginCommand(envelope, micros());
+      if (synchronousLog) {
+        logSynchronously();
+      }
+      onMessage(COMMAND, sizeof(COMMAND) - 1);
+      diag::trace::endCommand();
+    }
+    // The end of loop() drains the ring with whatever the FIFO can take.
+    host::advanceMicros(BURST_GAP_US);
+    while (diag::log::drain(8) > 0) {
+      host::advanceMicros(BURST_GAP_US / 10);
+    }
+  }
+
+  const diag::trace::LatencyHistogram &after = diag::trace::histogram();
+  uint32_t buckets[diag::trace::HISTOGRAM_BUCKETS];
+  for (size_t i = 0; i < diag::trace::HISTOGRAM_BUCKETS; ++i) {
+    buckets[i] = after.buckets[i] - before.buckets[i];
+  }
+  Phase phase{};
+  phase.count = after.count - before.count;
+  phase.p50Us = quantileUs(buckets, phase.count, 500);
+  phase.p99Us = quantileUs(buckets, phase.count, 990);
+  phase.maxUs = after.maxUs;
+  return phase;
+}
+
+void report(const char *name, const Phase &phase) {
+  char line[128];
+  snprintf(line, sizeof(line), "%s: %lu commands, p50 <%lu us, p99 <%lu us, max %lu us", name,
+           static_cast<unsigned long>(phase.count), static_cast<unsigned long>(phase.p50Us),
+           static_cast<unsigned long>(phase.p99Us), static_cast<unsigned long>(phase.maxUs));
+  TEST_MESSAGE(line);
+}
+}  // namespace
+
+void setUp() {
+  host::setSerialModel(UART_BAUD, UART_FIFO_BYTES);
+  host::takeSerialOutput();
+}
+
+void tearDown() {
+  while (diag::log::drain(DIAG_LOG_CAPACITY) > 0) {
+    host::advanceMicros(BURST_GAP_US);
+  }
+  host::setSerialModel(0, 0);
+}
+
+void test_drain_formats_records_as_text() {
+  DIAG_LOG(ROBOT_MOVE, diag::log::DIR_FORWARD, 120, diag::log::DIR_BACKWARD, 80);
+  TEST_ASSERT_TRUE(diag::log::pending());
+  TEST_ASSERT_EQUAL(1, diag::log::drain(8));
+  const std::string text = host::takeSerialOutput();
+  TEST_ASSERT_TRUE(text.find("Robot Move: L=1(120) R=-1(80)") != std::string::npos);
+  TEST_ASSERT_FALSE(diag::log::pending());
+}
+
+void test_drain_never_blocks_on_a_full_fifo() {
+  for (int i = 0; i < 16; ++i) {
+    DIAG_LOG(ROBOT_SPEED_ADJUST, i, 100 + i, 100 + i);
+  }
+  const uint64_t start = host::nowMicros();
+  const size_t emitted = diag::log::drain(16);
+  TEST_ASSERT_EQUAL(start, host::nowMicros());
+  TEST_ASSERT_GREATER_THAN(0, emitted);
+  TEST_ASSERT_LESS_THAN(16, emitted);
+  TEST_ASSERT_TRUE(diag::log::pending());
+}
+
+void test_filtered_levels_cost_nothing() {
+  const diag::log::Stats before = diag::log::stats();
+  DIAG_LOG(MQTT_COMMAND, 1, 2);
+  TEST_ASSERT_EQUAL(before.written, diag::log::stats().written);
+}
+
+// Receive-to-actuate latency from the user-026 histogram, with the UART
+// modelled at 115200 baud: synchronous Serial.printf against the event ring.
+void test_command_latency_before_and_after() {
+  host::followWallClock(true);
+  const Phase deferred = runBursts(false);
+  const Phase synchronous = runBursts(true);
+  host::followWallClock(false);
+
+  report("event ring", deferred);
+  report("Serial.printf", synchronous);
+  TEST_ASSERT_EQUAL(BURSTS * BURST_COMMANDS, deferred.count);
+  TEST_ASSERT_EQUAL(BURSTS * BURST_COMMANDS, synchronous.count);
+  TEST_ASSERT_LESS_THAN(synchronous.p50Us, deferred.p99Us);
+  TEST_ASSERT_LESS_THAN(synchronous.maxUs / 10, deferred.maxUs);
+}
+
+int main() {
+  initActuators();
+  UNITY_BEGIN();
+  RUN_TEST(test_drain_formats_records_as_text);
+  RUN_TEST(test_drain_never_blocks_on_a_full_fifo);
+  RUN_TEST(test_filtered_levels_cost_nothing);
+  RUN_TEST(test_command_latency_before_and_after);
+  return UNITY_END();
+}
@@ -0,0 +1,201 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "diag/latency_trace.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/event_loop.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+
+namespace {
+// The loop main.cpp ran before the event loop: a pass every 10 ms whether
+// or not anything was due.
+constexpr uint32_t OLD_POLL_MS = 10;
+constexpr uint32_t COMMAND_HZ = 20;
+constexpr uint32_t MAX_COMMANDS = 1000;
+
+uint64_t wallMicros() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+// The broker runs on its own thread, as a real one would across the network:
+// nothing it does waits for the device's loop. Only it touches g_broker.
+host::Broker g_broker;
+std::atomic<bool> g_brokerRunning{false};
+std::atomic<bool> g_commanding{false};
+std::atomic<uint32_t> g_commandsSent{0};
+std::atomic<uint64_t> g_sentUs[MAX_COMMANDS + 1];
+
+void runBroker(const std::string topic) {
+  uint64_t nextCommandUs = 0;
+  while (g_brokerRunning.load()) {
+    const uint64_t now = wallMicros();
+    if (g_commanding.load() && now >= nextCommandUs && g_commandsSent.load() < MAX_COMMANDS) {
+      const uint32_t id = g_commandsSent.load() + 1;
+      char command[40];
+      snprintf(command, sizeof(command), "@id=%lu;forward:%d", static_cast<unsigned long>(id),
+               id % 2 == 0 ? 200 : 120);
+      g_broker.publish(topic, command);
+      g_sentUs[id].store(wallMicros());
+      g_commandsSent.store(id);
+      nextCommandUs = now + 1000000 / COMMAND_HZ;
+    }
+    g_broker.poll();
+    usleep(200);
+  }
+}
+
+struct Run {
+  bool eventLoop;
+  double wakeupsPerSecond;
+  // What the heartbeat's wakeups_per_s would say at the end of the run.
+  uint32_t reportedWakeupsPerSecond;
+  size_t commands;
+  double meanLatencyUs;
+  uint32_t maxLatencyUs;
+};
+
+// Runs the device loop for `seconds` of wall time, sleeping with the event
+// loop or the old fixed poll, and times each command from the broker's write
+// to the end of the pass that actuated it.
+Run runFor(uint32_t seconds, bool eventLoop) {
+  Run run{};
+  run.eventLoop = eventLoop;
+  uint32_t lastId = diag::trace::lastCommandId();
+  uint64_t latencyTotalUs = 0;
+  size_t passes = 0;
+  const uint64_t startUs = wallMicros();
+  while (wallMicros() - startUs < static_cast<uint64_t>(seconds) * 1000000) {
+    tasks::mqtt::loop();
+    serviceActuators(millis());
+    const uint32_t id = diag::trace::lastCommandId();
+    if (id != lastId) {
+      const uint32_t latency = static_cast<uint32_t>(wallMicros() - g_sentUs[id].load());
+      latencyTotalUs += latency;
+      run.maxLatencyUs = std::max(run.maxLatencyUs, latency);
+      ++run.commands;
+      lastId = id;
+    }
+    ++passes;
+    if (eventLoop) {
+      tasks::event_loop::waitForWork();
+    } else {
+      usleep(OLD_POLL_MS * 1000);
+    }
+  }
+  const double elapsed = static_cast<double>(wallMicros() - startUs) / 1e6;
+  run.wakeupsPerSecond = static_cast<double>(passes) / elapsed;
+  run.reportedWakeupsPerSecond = tasks::event_loop::wakeupsPerSecond();
+  run.meanLatencyUs =
+      run.commands > 0 ? static_cast<double>(latencyTotalUs) / static_cast<double>(run.commands)
+                       : 0;
+  return run;
+}
+
+void report(const char *name, const Run &run) {
+  char reported[32] = "";
+  if (run.eventLoop) {
+    snprintf(reported, sizeof(reported), " (wakeups_per_s=%lu)",
+             static_cast<unsigned long>(run.reportedWakeupsPerSecond));
+  }
+  char message[160];
+  snprintf(message, sizeof(message),
+           "%s: %.1f wakeups/s%s, %u commands, receive to actuate mean %.0f us max %lu us", name,
+           run.wakeupsPerSecond, reported, static_cast<unsigned>(run.commands), run.meanLatencyUs,
+           static_cast<unsigned long>(run.maxLatencyUs));
+  TEST_MESSAGE(message);
+}
+
+Run g_idle;
+Run g_idlePoll;
+Run g_commands;
+Run g_commandsPoll;
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_connects_through_the_event_loop() {
+  const uint64_t startUs = wallMicros();
+  while (!tasks::mqtt::isConnected() && wallMicros() - startUs < 5000000) {
+    tasks::mqtt::loop();
+    tasks::event_loop::waitForWork();
+  }
+  TEST_ASSERT_TRUE(tasks::mqtt::isConnected());
+}
+
+// Idle, the loop only wakes for what it armed: the sleep cap, the heartbeat
+// and the keepalive ping with its response. The old poll woke 100 times a
+// second regardless.
+void test_idle_wakeups_follow_the_deadlines() {
+  constexpr uint32_t SECONDS = 6;
+  g_idle = runFor(SECONDS, true);
+  report("idle, event loop", g_idle);
+  g_idlePoll = runFor(2, false);
+  report("idle, delay(10) poll", g_idlePoll);
+
+  const double armedPerSecond = 1000.0 / EVENT_LOOP_MAX_SLEEP_MS +
+                                2 * 1000.0 / MQTT_HEARTBEAT_INTERVAL_MS +
+                                2 * 2000.0 / (MQTT_KEEPALIVE_S * 1000);
+  // One extra for the pass that starts the run.
+  TEST_ASSERT_TRUE(g_idle.wakeupsPerSecond <= armedPerSecond + 1.0 / SECONDS);
+  TEST_ASSERT_TRUE(g_idle.reportedWakeupsPerSecond >= 1);
+  TEST_ASSERT_TRUE(g_idle.reportedWakeupsPerSecond <= armedPerSecond + 1);
+  TEST_ASSERT_TRUE(g_idlePoll.wakeupsPerSecond > 10 * g_idle.wakeupsPerSecond);
+}
+
+// Under a 20 Hz command stream each command wakes the loop as it lands,
+// where the poll leaves it in the socket for up to 10 ms.
+void test_commands_wake_the_loop() {
+  g_commanding.store(true);
+  g_commands = runFor(3, true);
+  report("20 Hz commands, event loop", g_commands);
+  g_commandsPoll = runFor(3, false);
+  report("20 Hz commands, delay(10) poll", g_commandsPoll);
+  g_commanding.store(false);
+
+  TEST_ASSERT_TRUE(g_commands.commands >= 2 * COMMAND_HZ);
+  TEST_ASSERT_TRUE(g_commandsPoll.commands >= 2 * COMMAND_HZ);
+  TEST_ASSERT_TRUE(g_commands.meanLatencyUs < g_commandsPoll.meanLatencyUs);
+  TEST_ASSERT_TRUE(g_commands.wakeupsPerSecond < g_commandsPoll.wakeupsPerSecond);
+}
+
+int main() {
+  char port[8];
+  snprintf(port, sizeof(port), "%u", static_cast<unsigned>(g_broker.start()));
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", port);
+  initActuators();
+  host::setWifiConnected(true);
+  // select() sleeps in real time, so the simulated clock must keep up.
+  host::followWallClock(true);
+  tasks::event_loop::init();
+  tasks::mqtt::init();
+  g_brokerRunning.store(true);
+  std::thread broker(runBroker, std::string(provisioning::mqtt().commandTopic));
+
+  UNITY_BEGIN();
+  RUN_TEST(test_connects_through_the_event_loop);
+  RUN_TEST(test_idle_wakeups_follow_the_deadlines);
+  RUN_TEST(test_commands_wake_the_loop);
+  const int failures = UNITY_END();
+  g_brokerRunning.store(false);
+  broker.join();
+  return failures;
+}
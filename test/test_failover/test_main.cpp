@@ -0,0 +1,146 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <string>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/command_window.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+
+namespace {
+host::Broker g_primary;
+host::Broker g_fallback;
+// Until set, the primary takes connections but never answers them.
+bool g_primaryUp = false;
+
+void pollBrokers() {
+  if (g_primaryUp) {
+    g_primary.poll();
+  }
+  g_fallback.poll();
+}
+
+// Advances `stepMs` of simulated time per pass; short of the keepalive, so
+// a live session answers its pings in between.
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000, uint32_t stepMs = 1) {
+  for (int i = 0; i < steps; ++i) {
+    pollBrokers();
+    tasks::mqtt::loop();
+    if (done()) {
+      return true;
+    }
+    host::advanceMicros(static_cast<uint64_t>(stepMs) * 1000);
+    usleep(100);
+  }
+  return false;
+}
+
+uint32_t accepted() { return tasks::command_window::counters().accepted; }
+
+// failover_ms from the next heartbeat the primary receives.
+long nextFailoverMs() {
+  long failoverMs = -1;
+  pumpUntil(
+      [&] {
+        for (const host::Broker::Message &message : g_primary.takeMessages()) {
+          const size_t field = message.payload.find(" failover_ms=");
+          if (message.payload.rfind("comm-robot heartbeat", 0) == 0 &&
+              field != std::string::npos) {
+            failoverMs = strtol(message.payload.c_str() + field + 13, nullptr, 10);
+          }
+        }
+        return failoverMs >= 0;
+      },
+      static_cast<int>(MQTT_HEARTBEAT_INTERVAL_MS) + 1000);
+  return failoverMs;
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_fails_over_from_an_unresponsive_primary() {
+  TEST_ASSERT_TRUE(pumpUntil([] { return g_fallback.subscribers(MQTT_CMD_TOPIC) == 1; }));
+
+  const uint32_t before = accepted();
+  g_fallback.publish(MQTT_CMD_TOPIC, "forward:100");
+  TEST_ASSERT_TRUE(pumpUntil([&] { return accepted() == before + 1; }, 100));
+}
+
+// The probe to the recovered primary is fully subscribed while the fallback
+// session still runs. A command that reaches both in the same pass, as it
+// would through a bridge, runs once: through the live session, not again
+// through the probe.
+void test_failback_probe_does_not_run_commands() {
+  g_primaryUp = true;
+  // Stops right after the primary has answered the probe's SUBSCRIBE, so the
+  // SUBACK and the command land in the probe's receive buffer together.
+  bool subscribed = false;
+  for (int i = 0; i < 2000 && !subscribed; ++i) {
+    pollBrokers();
+    subscribed = g_primary.subscribers(MQTT_CMD_TOPIC) == 1;
+    if (!subscribed) {
+      tasks::mqtt::loop();
+      host::advanceMicros(50000);
+      usleep(100);
+    }
+  }
+  TEST_ASSERT_TRUE(subscribed);
+  TEST_ASSERT_EQUAL(1, g_fallback.liveConnections());
+
+  const uint32_t before = accepted();
+  TEST_ASSERT_EQUAL(1, g_primary.publish(MQTT_CMD_TOPIC, "forward:100"));
+  TEST_ASSERT_EQUAL(1, g_fallback.publish(MQTT_CMD_TOPIC, "forward:100"));
+  pumpUntil([] { return false; }, 20);
+  TEST_ASSERT_EQUAL_UINT32(before + 1, accepted());
+
+  // Failed back: the fallback session is gone and the primary carries commands.
+  TEST_ASSERT_EQUAL(0, g_fallback.liveConnections());
+  g_primary.publish(MQTT_CMD_TOPIC, "forward:100");
+  TEST_ASSERT_TRUE(pumpUntil([&] { return accepted() == before + 2; }, 100));
+}
+
+// A session lost with the WiFi link counts from the drop, not from the
+// link coming back.
+void test_failover_time_covers_a_wifi_outage() {
+  constexpr uint32_t OUTAGE_MS = 4000;
+  host::setWifiConnected(false);
+  pumpUntil([] { return false; }, OUTAGE_MS / 50, 50);
+  host::setWifiConnected(true);
+  TEST_ASSERT_TRUE(pumpUntil([] { return g_primary.subscribers(MQTT_CMD_TOPIC) == 1; }));
+  g_primary.takeMessages();
+
+  const long failoverMs = nextFailoverMs();
+  TEST_ASSERT_TRUE(failoverMs >= static_cast<long>(OUTAGE_MS));
+  TEST_ASSERT_TRUE(failoverMs < static_cast<long>(OUTAGE_MS) + 1000);
+}
+
+int main() {
+  char primaryPort[8];
+  char fallbackPort[8];
+  snprintf(primaryPort, sizeof(primaryPort), "%u", static_cast<unsigned>(g_primary.start()));
+  snprintf(fallbackPort, sizeof(fallbackPort), "%u", static_cast<unsigned>(g_fallback.start()));
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", primaryPort);
+  provisioning::applyKeyValue("MQTT_HOST_2", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT_2", fallbackPort);
+  initActuators();
+  host::setWifiConnected(true);
+  tasks::mqtt::init();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_fails_over_from_an_unresponsive_primary);
+  RUN_TEST(test_failback_probe_does_not_run_commands);
+  RUN_TEST(test_failover_time_covers_a_wifi_outage);
+  return UNITY_END();
+}
@@ -0,0 +1,283 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+
+// tools/load_soak.py's stages and mixes on the simulated clock: the same
+// enveloped commands at stepped rates, matched against the device's acks,
+// with heap_free followed through the heartbeat.
+namespace {
+constexpr uint32_t SOURCE_ID = 7;
+// Larger than MQTT_RX_BUFFER: the client discards these unread.
+constexpr size_t OVERSIZE_BYTES = 600;
+constexpr uint32_t MAX_COMMANDS = 1 << 16;
+
+enum class Kind { Motion, Servo, Spin, Oversize };
+
+struct Weights {
+  int motion;
+  int servo;
+  int spin;
+  int oversize;
+};
+
+// The command picker of load_soak.py's CommandMix.
+class CommandMix {
+ public:
+  CommandMix(const Weights &weights, uint32_t seed) : weights_(weights), rng_(seed) {}
+
+  Kind next(std::string *body) {
+    const int total = weights_.motion + weights_.servo + weights_.spin + weights_.oversize;
+    int roll = std::uniform_int_distribution<int>(0, total - 1)(rng_);
+    if ((roll -= weights_.motion) < 0) {
+      if (burst_.empty()) {
+        const int speed = std::uniform_int_distribution<int>(80, 255)(rng_);
+        std::vector<std::string> directions = {"forward", "backward", "left", "right"};
+        std::shuffle(directions.begin(), directions.end(), rng_);
+        for (size_t i = 0; i < 3; ++i) {
+          burst_.push_back(directions[i] + ":" + std::to_string(speed));
+        }
+        burst_.push_back("stop:0");
+      }
+      *body = burst_.front();
+      burst_.erase(burst_.begin());
+      return Kind::Motion;
+    }
+    if ((roll -= weights_.servo) < 0) {
+      *body = "servo1:" + std::to_string(std::uniform_int_distribution<int>(0, 180)(rng_));
+      return Kind::Servo;
+    }
+    if ((roll -= weights_.spin) < 0) {
+      *body = "servo2:0";
+      return Kind::Spin;
+    }
+    *body = "forward:1" + std::string(OVERSIZE_BYTES, ' ');
+    return Kind::Oversize;
+  }
+
+ private:
+  Weights weights_;
+  std::mt19937 rng_;
+  std::vector<std::string> burst_;
+};
+
+struct HeapSample {
+  uint32_t ms;
+  uint32_t heapFree;
+};
+
+struct Stage {
+  uint32_t rate;
+  uint32_t sent;
+  uint32_t oversize;
+  uint32_t acked;
+  uint32_t rejected;
+};
+
+host::Broker g_broker;
+uint32_t g_nextId = 1;
+// Sized up front so the harness allocates nothing while heap_free is read.
+std::vector<bool> g_awaitingAck(MAX_COMMANDS, false);
+std::vector<HeapSample> g_heap;
+uint32_t g_acked = 0;
+uint32_t g_rejected = 0;
+
+uint32_t field(const std::string &text, const char *name) {
+  const size_t at = text.find(std::string(" ") + name + "=");
+  return at == std::string::npos
+             ? 0
+             : static_cast<uint32_t>(strtoul(text.c_str() + at + strlen(name) + 2, nullptr, 10));
+}
+
+void collect() {
+  for (const host::Broker::Message &message : g_broker.takeMessages()) {
+    if (message.topic == MQTT_HEARTBEAT_TOPIC &&
+        message.payload.rfind("comm-robot heartbeat", 0) == 0) {
+      g_heap.push_back({millis(), field(message.payload, "heap_free")});
+      g_rejected = field(message.payload, "cmd_dup") + field(message.payload, "cmd_stale") +
+                   field(message.payload, "cmd_expired");
+    } else if (message.topic == MQTT_ACK_TOPIC && message.payload.rfind("hist,", 0) != 0) {
+      const uint32_t id = static_cast<uint32_t>(strtoul(message.payload.c_str(), nullptr, 10));
+      if (id < MAX_COMMANDS && g_awaitingAck[id]) {
+        g_awaitingAck[id] = false;
+        ++g_acked;
+      }
+    }
+  }
+}
+
+void step() {
+  g_broker.poll();
+  collect();
+  tasks::mqtt::loop();
+  serviceActuators(millis());
+  host::runDueTimers();
+  host::takeSerialOutput();
+  host::advanceMicros(1000);
+}
+
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    step();
+    if (done()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Sends `rate` commands a second for `seconds`, then waits a second for the
+// last acks, as load_soak.py's --settle does.
+Stage runStage(uint32_t rate, uint32_t seconds, CommandMix &mix) {
+  Stage stage{rate, 0, 0, 0, 0};
+  const uint32_t ackedBefore = g_acked;
+  const uint32_t rejectedBefore = g_rejected;
+  const std::string &topic = provisioning::mqtt().commandTopic;
+  std::string body;
+  char envelope[64];
+  for (uint32_t ms = 0; ms < seconds * 1000; ++ms) {
+    // Absolute schedule: command n goes out in millisecond n * 1000 / rate.
+    while (static_cast<uint64_t>(stage.sent) * 1000 < static_cast<uint64_t>(ms + 1) * rate) {
+      const Kind kind = mix.next(&body);
+      const uint32_t id = g_nextId++;
+      snprintf(envelope, sizeof(envelope), "@id=%lu,ts=%lu,src=%lu,seq=%lu;",
+               static_cast<unsigned long>(id), static_cast<unsigned long>(millis()),
+               static_cast<unsigned long>(SOURCE_ID), static_cast<unsigned long>(id));
+      if (kind == Kind::Oversize) {
+        ++stage.oversize;
+      } else {
+        g_awaitingAck[id] = true;
+      }
+      TEST_ASSERT_EQUAL(1, g_broker.publish(topic, envelope + body));
+      ++stage.sent;
+    }
+    step();
+  }
+  pumpUntil([] { return false; }, 1000);
+  stage.acked = g_acked - ackedBefore;
+  stage.rejected = g_rejected - rejectedBefore;
+  return stage;
+}
+
+// One line per stage in load_soak.py's JSON shape, for the fields that mean
+// something on the simulated clock.
+void report(const Stage &stage) {
+  const uint32_t expected = stage.sent - stage.oversize;
+  char message[256];
+  snprintf(message, sizeof(message),
+           "{\"type\": \"stage\", \"rate\": %lu, \"drops\": {\"sent\": %lu, \"expected_acks\": "
+           "%lu, \"acked\": %lu, \"unacked\": %lu, \"oversize_sent\": %lu, \"window_rejected\": "
+           "%lu}}",
+           static_cast<unsigned long>(stage.rate), static_cast<unsigned long>(stage.sent),
+           static_cast<unsigned long>(expected), static_cast<unsigned long>(stage.acked),
+           static_cast<unsigned long>(expected - stage.acked),
+           static_cast<unsigned long>(stage.oversize), static_cast<unsigned long>(stage.rejected));
+  TEST_MESSAGE(message);
+}
+
+// Least squares slope of heap_free, in bytes per hour, as load_soak.py
+// computes it.
+double slopePerHour(const std::vector<HeapSample> &samples) {
+  double meanX = 0;
+  double meanY = 0;
+  for (const HeapSample &sample : samples) {
+    meanX += sample.ms / 1000.0;
+    meanY += sample.heapFree;
+  }
+  meanX /= static_cast<double>(samples.size());
+  meanY /= static_cast<double>(samples.size());
+  double covariance = 0;
+  double variance = 0;
+  for (const HeapSample &sample : samples) {
+    const double dx = sample.ms / 1000.0 - meanX;
+    covariance += dx * (sample.heapFree - meanY);
+    variance += dx * dx;
+  }
+  return variance > 0 ? covariance / variance * 3600.0 : 0;
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// load_soak.py's default stages and mix, with oversized payloads mixed in:
+// every command that fits is acked, and the oversized ones are dropped
+// without costing the session.
+void test_stepped_rates_are_fully_acked() {
+  TEST_ASSERT_TRUE(pumpUntil([] { return tasks::mqtt::isConnected(); }));
+  TEST_ASSERT_TRUE(pumpUntil([] { return g_broker.subscribers(MQTT_CMD_TOPIC) == 1; }));
+  const size_t connections = g_broker.acceptedConnections();
+
+  CommandMix mix({8, 2, 1, 1}, 1);
+  for (uint32_t rate : {10u, 25u, 50u, 100u}) {
+    const Stage stage = runStage(rate, 10, mix);
+    report(stage);
+    TEST_ASSERT_EQUAL_UINT32(rate * 10, stage.sent);
+    TEST_ASSERT_TRUE(stage.oversize > 0);
+    TEST_ASSERT_EQUAL_UINT32(stage.sent - stage.oversize, stage.acked);
+    TEST_ASSERT_EQUAL_UINT32(0, stage.rejected);
+  }
+  TEST_ASSERT_EQUAL(connections, g_broker.acceptedConnections());
+  TEST_ASSERT_TRUE(tasks::mqtt::isConnected());
+}
+
+// Two simulated minutes at 50 commands a second: heap_free holds steady.
+// The first heartbeats are left out; buffers are still reaching their size.
+void test_soak_heap_stays_flat() {
+  CommandMix mix({8, 2, 1, 1}, 2);
+  const size_t warm = g_heap.size();
+  const Stage stage = runStage(50, 120, mix);
+  report(stage);
+  TEST_ASSERT_EQUAL_UINT32(stage.sent - stage.oversize, stage.acked);
+
+  const std::vector<HeapSample> soak(g_heap.begin() + static_cast<std::ptrdiff_t>(warm) + 2,
+                                     g_heap.end());
+  TEST_ASSERT_TRUE(soak.size() >= 20);
+  uint32_t lowest = soak.front().heapFree;
+  uint32_t highest = lowest;
+  for (const HeapSample &sample : soak) {
+    lowest = std::min(lowest, sample.heapFree);
+    highest = std::max(highest, sample.heapFree);
+  }
+  char message[160];
+  snprintf(message, sizeof(message),
+           "{\"type\": \"summary\", \"heap\": {\"samples\": %u, \"first\": %lu, \"last\": %lu, "
+           "\"min\": %lu, \"slope_bytes_per_hour\": %.1f}}",
+           static_cast<unsigned>(soak.size()), static_cast<unsigned long>(soak.front().heapFree),
+           static_cast<unsigned long>(soak.back().heapFree), static_cast<unsigned long>(lowest),
+           slopePerHour(soak));
+  TEST_MESSAGE(message);
+  // What the broker and harness happen to hold when a heartbeat is built.
+  TEST_ASSERT_TRUE(highest - lowest < 2048);
+}
+
+int main() {
+  char port[8];
+  snprintf(port, sizeof(port), "%u", static_cast<unsigned>(g_broker.start()));
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", port);
+  initActuators();
+  host::setWifiConnected(true);
+  tasks::mqtt::init();
+  g_heap.reserve(256);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_stepped_rates_are_fully_acked);
+  RUN_TEST(test_soak_heap_stays_flat);
+  return UNITY_END();
+}
@@ -0,0 +1,244 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "net/mqtt_client.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+
+namespace {
+constexpr const char *STOP_TOPIC = "esp32/commrobot/stop";
+constexpr const char *SERIAL_IN_TOPIC = "esp32/commrobot/serial_in";
+const char *const TOPICS[] = {STOP_TOPIC, SERIAL_IN_TOPIC, "esp32/commrobot/config"};
+
+host::Broker g_broker;
+uint16_t g_port = 0;
+std::vector<std::string> g_received;
+size_t g_priority = 0;
+
+void onMessage(const char *topic, const uint8_t *, size_t) { g_received.push_back(topic); }
+
+void onPriority(uint32_t) { ++g_priority; }
+
+template <typename Step, typename Done>
+bool pumpUntil(Step step, Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    g_broker.poll();
+    step();
+    if (done()) {
+      return true;
+    }
+    host::advanceMicros(1000);
+    usleep(100);
+  }
+  return false;
+}
+
+template <typename Done>
+bool pumpClient(net::MqttClient &client, Done done, int steps = 5000) {
+  return pumpUntil([&] { client.loop(millis()); }, done, steps);
+}
+
+// Connects `client` as `clientId` and returns its connection on the broker.
+size_t connect(net::MqttClient &client, const char *clientId, bool v5) {
+  net::MqttClient::Session session{};
+  session.host = "127.0.0.1";
+  session.port = g_port;
+  session.clientId = clientId;
+  session.topics = TOPICS;
+  session.topicCount = sizeof(TOPICS) / sizeof(TOPICS[0]);
+  session.v5 = v5;
+  client.setCallback(onMessage);
+  client.setPriorityTopic(SERIAL_IN_TOPIC, onPriority);
+  TEST_ASSERT_TRUE(client.beginConnect(session, millis()));
+  TEST_ASSERT_TRUE(pumpClient(client, [&] { return client.connected(); }));
+  const size_t connection = g_broker.acceptedConnections() - 1;
+  TEST_ASSERT_EQUAL_STRING(clientId, g_broker.clientId(connection).c_str());
+  TEST_ASSERT_EQUAL(v5, g_broker.isV5(connection));
+  return connection;
+}
+
+// A minute of the device's regular traffic: the heartbeat on two topics every
+// 5 s, a state batch every 500 ms and an ack for each of 100 commands.
+// Returns the MQTT bytes the client sent for it.
+uint32_t sendDeviceTraffic(net::MqttClient &client) {
+  std::string heartbeat(620, 'h');
+  const uint8_t state[40] = {1, 5, 50};
+  const char *ack = "1700000123,1700000000,123456789,180,420";
+  const uint32_t txBefore = client.wireStats().txBytes;
+  g_broker.takeMessages();
+
+  size_t published = 0;
+  for (int tick = 0; tick < 120; ++tick) {
+    if (tick % 10 == 0) {
+      TEST_ASSERT_TRUE(client.publish(MQTT_PUB_TOPIC, heartbeat.c_str()));
+      client.flush(millis());
+      TEST_ASSERT_TRUE(client.publish(MQTT_HEARTBEAT_TOPIC, heartbeat.c_str()));
+      published += 2;
+    }
+    TEST_ASSERT_TRUE(client.publish(MQTT_STATE_TOPIC, state, sizeof(state)));
+    ++published;
+    if (tick < 100) {
+      TEST_ASSERT_TRUE(client.publish(MQTT_ACK_TOPIC, ack));
+      ++published;
+    }
+    client.flush(millis());
+    g_broker.poll();
+  }
+  client.flush(millis());
+  g_broker.poll();
+
+  const std::vector<host::Broker::Message> messages = g_broker.takeMessages();
+  TEST_ASSERT_EQUAL(published, messages.size());
+  for (const host::Broker::Message &message : messages) {
+    TEST_ASSERT_TRUE(message.topic == MQTT_PUB_TOPIC || message.topic == MQTT_HEARTBEAT_TOPIC ||
+                     message.topic == MQTT_STATE_TOPIC || message.topic == MQTT_ACK_TOPIC);
+  }
+  return client.wireStats().txBytes - txBefore;
+}
+}  // namespace
+
+void setUp() {
+  g_received.clear();
+  g_priority = 0;
+}
+
+void tearDown() {}
+
+// The session announces our limits, binds each publish topic to an alias the
+// first time and sends only the alias after that, with an expiry on every
+// message.
+void test_publishes_use_topic_aliases() {
+  net::MqttClient client;
+  const size_t connection = connect(client, "robot-v5", true);
+  TEST_ASSERT_EQUAL_UINT16(MQTT_RECEIVE_MAXIMUM, g_broker.receiveMaximum(connection));
+  g_broker.takeMessages();
+
+  for (int i = 0; i < 3; ++i) {
+    TEST_ASSERT_TRUE(client.publish(MQTT_PUB_TOPIC, "out"));
+    TEST_ASSERT_TRUE(client.publish(MQTT_ACK_TOPIC, "ack"));
+  }
+  client.flush(millis());
+  TEST_ASSERT_TRUE(pumpClient(client, [] { return g_broker.stats().publishesIn >= 6; }));
+
+  const std::vector<host::Broker::Message> messages = g_broker.takeMessages();
+  TEST_ASSERT_EQUAL(6, messages.size());
+  for (size_t i = 0; i < messages.size(); ++i) {
+    TEST_ASSERT_EQUAL_STRING(i % 2 == 0 ? MQTT_PUB_TOPIC : MQTT_ACK_TOPIC,
+                             messages[i].topic.c_str());
+    TEST_ASSERT_EQUAL(i >= 2, messages[i].aliased);
+    TEST_ASSERT_EQUAL_UINT32(MQTT_MESSAGE_EXPIRY_S, messages[i].expirySeconds);
+  }
+  TEST_ASSERT_EQUAL_UINT32(4, client.wireStats().aliasedPublishes);
+  client.disconnect();
+}
+
+// The broker aliases the topics it sends to us; each still arrives under its
+// full name, and the priority topic is spotted by its alias too.
+void test_inbound_aliases_resolve() {
+  net::MqttClient client;
+  connect(client, "robot-inbound", true);
+
+  for (int i = 0; i < 3; ++i) {
+    TEST_ASSERT_EQUAL(1, g_broker.publish(STOP_TOPIC, "stop"));
+    TEST_ASSERT_EQUAL(1, g_broker.publish(SERIAL_IN_TOPIC, "hello"));
+  }
+  TEST_ASSERT_TRUE(pumpClient(client, [] { return g_received.size() >= 6; }));
+  for (size_t i = 0; i < g_received.size(); ++i) {
+    TEST_ASSERT_EQUAL_STRING(i % 2 == 0 ? STOP_TOPIC : SERIAL_IN_TOPIC, g_received[i].c_str());
+  }
+  TEST_ASSERT_EQUAL(3, g_priority);
+  client.disconnect();
+}
+
+// A burst of QoS 1 commands far past the receive maximum lands in one read;
+// every one is delivered and acknowledged.
+void test_burst_past_receive_maximum_is_acknowledged() {
+  net::MqttClient client;
+  connect(client, "robot-burst", true);
+  const uint32_t acksBefore = g_broker.stats().pubAcks;
+
+  constexpr size_t BURST = MQTT_RECEIVE_MAXIMUM * 4;
+  for (size_t i = 0; i < BURST; ++i) {
+    TEST_ASSERT_EQUAL(1, g_broker.publish(STOP_TOPIC, "stop"));
+  }
+  TEST_ASSERT_TRUE(pumpClient(client, [&] {
+    return g_broker.stats().pubAcks >= acksBefore + BURST && g_received.size() >= BURST;
+  }));
+  TEST_ASSERT_EQUAL(BURST, g_received.size());
+  client.disconnect();
+}
+
+void test_v5_sends_fewer_bytes_than_311() {
+  net::MqttClient v311;
+  connect(v311, "robot-311", false);
+  const uint32_t bytes311 = sendDeviceTraffic(v311);
+  TEST_ASSERT_EQUAL_UINT32(0, v311.wireStats().aliasedPublishes);
+  v311.disconnect();
+
+  net::MqttClient v5;
+  connect(v5, "robot-5", true);
+  const uint32_t bytes5 = sendDeviceTraffic(v5);
+  v5.disconnect();
+
+  char message[96];
+  snprintf(message, sizeof(message), "one minute of traffic: 3.1.1 %lu bytes, 5 %lu bytes",
+           static_cast<unsigned long>(bytes311), static_cast<unsigned long>(bytes5));
+  TEST_MESSAGE(message);
+  // Aliases save more than the expiry property and property lengths cost.
+  TEST_ASSERT_TRUE(bytes5 < bytes311);
+}
+
+// The heartbeat goes out on the publish and heartbeat topics back to back;
+// two copies do not fit in the transmit buffer at once.
+void test_heartbeat_reaches_both_topics() {
+  provisioning::applyKeyValue("MQTT_V5", "1");
+  tasks::mqtt::init();
+  const auto step = [] { tasks::mqtt::loop(); };
+  TEST_ASSERT_TRUE(pumpUntil(step, [] { return tasks::mqtt::isConnected(); }));
+  g_broker.takeMessages();
+
+  bool onPublishTopic = false;
+  bool onHeartbeatTopic = false;
+  const bool both = pumpUntil(step, [&] {
+    for (const host::Broker::Message &message : g_broker.takeMessages()) {
+      if (message.payload.rfind("comm-robot heartbeat", 0) != 0) {
+        continue;
+      }
+      onPublishTopic |= message.topic == MQTT_PUB_TOPIC;
+      onHeartbeatTopic |= message.topic == MQTT_HEARTBEAT_TOPIC;
+    }
+    return onPublishTopic && onHeartbeatTopic;
+  }, static_cast<int>(MQTT_HEARTBEAT_INTERVAL_MS) + 1000);
+  TEST_ASSERT_TRUE(onPublishTopic);
+  TEST_ASSERT_TRUE(onHeartbeatTopic);
+  TEST_ASSERT_TRUE(both);
+}
+
+int main() {
+  g_port = g_broker.start();
+  char port[8];
+  snprintf(port, sizeof(port), "%u", static_cast<unsigned>(g_port));
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", port);
+  initActuators();
+  host::setWifiConnected(true);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_publishes_use_topic_aliases);
+  RUN_TEST(test_inbound_aliases_resolve);
+  RUN_TEST(test_burst_past_receive_maximum_is_acknowledged);
+  RUN_TEST(test_v5_sends_fewer_bytes_than_311);
+  RUN_TEST(test_heartbeat_reaches_both_topics);
+  return UNITY_END();
+}
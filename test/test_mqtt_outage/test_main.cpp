@@ -0,0 +1,192 @@
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <string>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+
+namespace {
+// Nothing in a pass may wait on the network: every stage is polled and
+// abandoned on its own timeout. A blocking connect or lookup would cost
+// seconds, so this bound, far under LOOP_STALL_BUDGET_MS, only fails for
+// that.
+constexpr uint32_t PASS_BOUND_US = 10000;
+constexpr const char *UNRESOLVABLE_HOST = "broker.invalid";
+
+host::Broker g_broker;
+int g_blackholeFd = -1;
+int g_blackholeFiller = -1;
+std::string g_serial;
+uint32_t g_passMaxUs = 0;
+
+uint64_t wallMicros() {
+  timespec now{};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000 + static_cast<uint64_t>(now.tv_nsec) / 1000;
+}
+
+// One tasks::mqtt::loop() pass, timed on the wall clock: the simulated clock
+// does not move during a pass.
+void pass() {
+  const uint64_t startUs = wallMicros();
+  tasks::mqtt::loop();
+  const uint32_t elapsed = static_cast<uint32_t>(wallMicros() - startUs);
+  if (elapsed > g_passMaxUs) {
+    g_passMaxUs = elapsed;
+  }
+}
+
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    g_broker.poll();
+    pass();
+    g_serial += host::takeSerialOutput();
+    if (done()) {
+      return true;
+    }
+    host::advanceMicros(1000);
+    usleep(100);
+  }
+  return false;
+}
+
+size_t count(const std::string &text, const std::string &part) {
+  size_t found = 0;
+  for (size_t at = text.find(part); at != std::string::npos; at = text.find(part, at + 1)) {
+    ++found;
+  }
+  return found;
+}
+
+void useBroker(const char *hostname, uint16_t port) {
+  char text[8];
+  snprintf(text, sizeof(text), "%u", static_cast<unsigned>(port));
+  provisioning::applyKeyValue("MQTT_HOST", hostname);
+  provisioning::applyKeyValue("MQTT_PORT", text);
+}
+
+// A listener whose accept queue is full and never drained: the kernel drops
+// every further SYN, so a connect to it neither completes nor fails.
+uint16_t openBlackhole() {
+  g_blackholeFd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  TEST_ASSERT_EQUAL(0, ::bind(g_blackholeFd, reinterpret_cast<sockaddr *>(&address),
+                              sizeof(address)));
+  TEST_ASSERT_EQUAL(0, ::listen(g_blackholeFd, 0));
+  TEST_ASSERT_EQUAL(0, ::getsockname(g_blackholeFd, reinterpret_cast<sockaddr *>(&address),
+                                     &length));
+  g_blackholeFiller = ::socket(AF_INET, SOCK_STREAM, 0);
+  TEST_ASSERT_EQUAL(0, ::connect(g_blackholeFiller, reinterpret_cast<sockaddr *>(&address),
+                                 sizeof(address)));
+  return ntohs(address.sin_port);
+}
+
+// Back on the healthy broker with a live session, ready for the next outage.
+void recover() {
+  host::setDnsUnanswered("");
+  g_broker.withholdConnack(false);
+  g_broker.withholdSuback(false);
+  uint16_t port = g_broker.start();
+  TEST_ASSERT_TRUE(port != 0);
+  useBroker("127.0.0.1", port);
+  TEST_ASSERT_TRUE(pumpUntil([] { return tasks::mqtt::isConnected(); }, 20000));
+  g_serial.clear();
+  g_passMaxUs = 0;
+}
+
+// Pumps until `failures` attempts have ended at `stage`, checking the first
+// took the stage's whole timeout, and returns the slowest pass.
+uint32_t rideOut(const char *stage, uint32_t timeoutMs, size_t failures) {
+  const std::string failed = std::string("failed at ") + stage + " stage";
+  const uint32_t startMs = millis();
+  TEST_ASSERT_TRUE(pumpUntil([&] { return count(g_serial, failed) >= 1; }, 20000));
+  TEST_ASSERT_TRUE(millis() - startMs >= timeoutMs);
+  TEST_ASSERT_TRUE(pumpUntil([&] { return count(g_serial, failed) >= failures; },
+                             static_cast<int>(failures) * 10000));
+  TEST_ASSERT_FALSE(tasks::mqtt::isConnected());
+  return g_passMaxUs;
+}
+
+void report(const char *outage, uint32_t passMaxUs) {
+  char message[96];
+  snprintf(message, sizeof(message), "%s: slowest loop pass %lu us (bound %lu us)", outage,
+           static_cast<unsigned long>(passMaxUs), static_cast<unsigned long>(PASS_BOUND_US));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(passMaxUs < PASS_BOUND_US);
+}
+}  // namespace
+
+void setUp() { recover(); }
+
+void tearDown() {}
+
+// The broker process is gone: every connect is refused at once.
+void test_stopped_broker() {
+  g_broker.stop();
+  report("broker stopped", rideOut("tcp", 0, 3));
+}
+
+// Six lookups outlive their timeout, more than there are DNS slots: each is
+// recycled when lwIP finally gives up on it.
+void test_unanswered_dns() {
+  host::setDnsUnanswered(UNRESOLVABLE_HOST);
+  useBroker(UNRESOLVABLE_HOST, MQTT_PORT);
+  report("DNS unanswered", rideOut("dns", MQTT_DNS_TIMEOUT_MS, 6));
+}
+
+void test_blackholed_broker() {
+  useBroker("127.0.0.1", openBlackhole());
+  report("SYN blackholed", rideOut("tcp", MQTT_TCP_TIMEOUT_MS, 2));
+  ::close(g_blackholeFiller);
+  ::close(g_blackholeFd);
+}
+
+void test_connack_withheld() {
+  g_broker.withholdConnack(true);
+  g_broker.dropAll();
+  report("CONNACK withheld", rideOut("connack", MQTT_CONNACK_TIMEOUT_MS, 2));
+}
+
+// The race is won at CONNACK, so a withheld SUBACK shows as the session being
+// dropped and a new connection made once the stage times out.
+void test_suback_withheld() {
+  g_broker.withholdSuback(true);
+  g_broker.dropAll();
+  const size_t before = g_broker.acceptedConnections();
+  const uint32_t startMs = millis();
+  TEST_ASSERT_TRUE(pumpUntil([&] { return g_broker.acceptedConnections() >= before + 2; }, 20000));
+  TEST_ASSERT_TRUE(millis() - startMs >= MQTT_SUBACK_TIMEOUT_MS);
+  TEST_ASSERT_TRUE(pumpUntil([&] { return g_broker.acceptedConnections() >= before + 3; }, 20000));
+  TEST_ASSERT_FALSE(tasks::mqtt::isConnected());
+  report("SUBACK withheld", g_passMaxUs);
+}
+
+int main() {
+  provisioning::initDefaults();
+  initActuators();
+  host::setWifiConnected(true);
+  tasks::mqtt::init();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_stopped_broker);
+  RUN_TEST(test_unanswered_dns);
+  RUN_TEST(test_blackholed_broker);
+  RUN_TEST(test_connack_withheld);
+  RUN_TEST(test_suback_withheld);
+  return UNITY_END();
+}
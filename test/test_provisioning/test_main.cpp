@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "config/provisioning_store.h"
+
+using provisioning::KeyScope;
+using provisioning::Owner;
+
+namespace {
+size_t applyText(const char *text, KeyScope scope) {
+  char buffer[256];
+  strncpy(buffer, text, sizeof(buffer) - 1);
+  buffer[sizeof(buffer) - 1] = '\0';
+  return provisioning::applyConfigText(buffer, scope);
+}
+}  // namespace
+
+void setUp() { provisioning::initDefaults(); }
+
+void tearDown() {}
+
+void test_broker_updates_only_reach_tuning_keys() {
+  const provisioning::MqttInitParams mqttBefore = provisioning::mqtt();
+  const provisioning::WifiCredentials wifiBefore = provisioning::wifi();
+  const uint32_t linkVersion = provisioning::version(Owner::MqttLink);
+
+  const size_t applied = applyText(
+      "MQTT_TLS=0\nMQTT_TLS_PIN=00\nMQTT_HOST=evil.example\nWIFI_SSID=evil\n"
+      "MQTT_CONFIG_TOPIC=x\nPWM_FREQ=1000\nSTATE_STREAM_HZ=5\n",
+      KeyScope::TuningOnly);
+
+  TEST_ASSERT_EQUAL(2, applied);
+  TEST_ASSERT_EQUAL_UINT32(1000, provisioning::tuning().pwmFrequency);
+  TEST_ASSERT_EQUAL_UINT32(5, provisioning::tuning().stateStreamHz);
+  TEST_ASSERT_EQUAL_UINT32(linkVersion, provisioning::version(Owner::MqttLink));
+  const provisioning::MqttInitParams mqttAfter = provisioning::mqtt();
+  const provisioning::WifiCredentials wifiAfter = provisioning::wifi();
+  TEST_ASSERT_EQUAL(0, memcmp(&mqttBefore, &mqttAfter, sizeof(mqttBefore)));
+  TEST_ASSERT_EQUAL(0, memcmp(&wifiBefore, &wifiAfter, sizeof(wifiBefore)));
+}
+
+void test_provisioning_paths_reach_every_key() {
+  TEST_ASSERT_EQUAL(3, applyText("MQTT_TLS=1\nMQTT_HOST=broker.lan\nPWM_FREQ=2000", KeyScope::All));
+  const provisioning::MqttInitParams mqtt = provisioning::mqtt();
+  TEST_ASSERT_TRUE(mqtt.tls);
+  TEST_ASSERT_EQUAL_STRING("broker.lan", mqtt.brokers[0].host);
+  TEST_ASSERT_FALSE(provisioning::applyKeyValue("WIFI_SSID", "x", KeyScope::TuningOnly));
+  TEST_ASSERT_TRUE(provisioning::applyKeyValue("WIFI_SSID", "x"));
+}
+
+// Re-sending the values already in place, or only a publish topic, leaves
+// nothing for the WiFi or MQTT task to redo.
+void test_no_op_updates_diff_to_nothing() {
+  const provisioning::WifiCredentials wifiBefore = provisioning::wifi();
+  const provisioning::MqttInitParams mqttBefore = provisioning::mqtt();
+  char text[320];
+  snprintf(text, sizeof(text),
+           "WIFI_SSID=%s\nWIFI_PASSWORD=%s\nMQTT_HOST=%s\nMQTT_PUB_TOPIC=a/pub\n"
+           "MQTT_HEARTBEAT_TOPIC=a/hb\nMQTT_ACK_TOPIC=a/ack",
+           wifiBefore.networks[0].ssid, wifiBefore.networks[0].password,
+           mqttBefore.brokers[0].host);
+  provisioning::applyConfigText(text);
+
+  const provisioning::WifiChanges wifi = provisioning::diff(wifiBefore, provisioning::wifi());
+  for (bool changed : wifi.networks) {
+    TEST_ASSERT_FALSE(changed);
+  }
+  TEST_ASSERT_FALSE(wifi.valid);
+  const provisioning::MqttChanges mqtt = provisioning::diff(mqttBefore, provisioning::mqtt());
+  for (bool changed : mqtt.brokers) {
+    TEST_ASSERT_FALSE(changed);
+  }
+  TEST_ASSERT_FALSE(mqtt.session);
+  TEST_ASSERT_FALSE(mqtt.subscriptions);
+  TEST_ASSERT_FALSE(mqtt.valid);
+}
+
+void test_changes_map_to_the_step_they_need() {
+  const provisioning::MqttInitParams before = provisioning::mqtt();
+  provisioning::applyKeyValue("MQTT_CMD_TOPIC", "a/cmd");
+  provisioning::MqttChanges changes = provisioning::diff(before, provisioning::mqtt());
+  TEST_ASSERT_TRUE(changes.subscriptions);
+  TEST_ASSERT_FALSE(changes.session);
+  TEST_ASSERT_FALSE(changes.brokers[0]);
+
+  const provisioning::MqttInitParams topics = provisioning::mqtt();
+  provisioning::applyKeyValue("MQTT_PORT_2", "1884");
+  changes = provisioning::diff(topics, provisioning::mqtt());
+  TEST_ASSERT_TRUE(changes.brokers[1]);
+  TEST_ASSERT_FALSE(changes.brokers[0]);
+  TEST_ASSERT_FALSE(changes.session);
+  TEST_ASSERT_FALSE(changes.subscriptions);
+
+  const provisioning::MqttInitParams ports = provisioning::mqtt();
+  provisioning::applyKeyValue("MQTT_PASSWORD", "secret");
+  changes = provisioning::diff(ports, provisioning::mqtt());
+  TEST_ASSERT_TRUE(changes.session);
+
+  const provisioning::WifiCredentials wifiBefore = provisioning::wifi();
+  provisioning::applyKeyValue("WIFI_PASSWORD_2", "secret");
+  const provisioning::WifiChanges wifi = provisioning::diff(wifiBefore, provisioning::wifi());
+  TEST_ASSERT_FALSE(wifi.networks[0]);
+  TEST_ASSERT_TRUE(wifi.networks[1]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_broker_updates_only_reach_tuning_keys);
+  RUN_TEST(test_provisioning_paths_reach_every_key);
+  RUN_TEST(test_no_op_updates_diff_to_nothing);
+  RUN_TEST(test_changes_map_to_the_step_they_need);
+  return UNITY_END();
+}
@@ -0,0 +1,151 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <string>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/emergency_stop.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+#include "tasks/scheduled_commands.h"
+
+using tasks::estop::Origin;
+
+namespace {
+// The controller's clock, well apart from ours.
+constexpr int64_t CONTROLLER_OFFSET_US = 1700000000000000LL;
+constexpr uint32_t DUE_IN_MS = 300;
+
+host::Broker g_broker;
+uint32_t g_nextId = 1;
+
+int64_t controllerUs() { return static_cast<int64_t>(host::nowMicros()) + CONTROLLER_OFFSET_US; }
+
+// Plays the controller's side of the clock sync exchange.
+void answerSyncRequests() {
+  for (const host::Broker::Message &message : g_broker.takeMessages()) {
+    if (message.topic != MQTT_SYNC_TOPIC) {
+      continue;
+    }
+    const size_t comma = message.payload.find(',');
+    TEST_ASSERT_TRUE(comma != std::string::npos);
+    const int64_t received = controllerUs();
+    const std::string reply = message.payload.substr(comma + 1) + "," +
+                              std::to_string(received) + "," + std::to_string(received + 100);
+    g_broker.publish(message.payload.substr(0, comma), reply);
+  }
+}
+
+// One pass of the main loop, as far as the schedule is concerned.
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    g_broker.poll();
+    answerSyncRequests();
+    tasks::estop::loop();
+    tasks::mqtt::loop();
+    tasks::schedule::loop();
+    if (done()) {
+      return true;
+    }
+    host::advanceMicros(1000);
+    usleep(100);
+  }
+  return false;
+}
+
+void runFor(int steps) {
+  pumpUntil([] { return false; }, steps);
+}
+
+bool motorsRunning() {
+  int32_t values[8];
+  const size_t count = sampleActuators(values, sizeof(values) / sizeof(values[0]));
+  for (size_t i = 0; i < count && i < 2; ++i) {
+    if (values[i] != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Asks for `command` DUE_IN_MS from now on the controller's clock.
+void schedule(const char *command) {
+  const uint32_t atMs = static_cast<uint32_t>(controllerUs() / 1000) + DUE_IN_MS;
+  char payload[64];
+  snprintf(payload, sizeof(payload), "@id=%lu,at=%lu;%s", static_cast<unsigned long>(g_nextId++),
+           static_cast<unsigned long>(atMs), command);
+  g_broker.publish(MQTT_CMD_TOPIC, payload);
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() { onMessage("stop", 4); }
+
+void test_scheduled_command_runs_on_time() {
+  TEST_ASSERT_TRUE(pumpUntil([] { return tasks::schedule::stats().syncExchanges > 0; }));
+  const tasks::schedule::Stats before = tasks::schedule::stats();
+
+  schedule("forward:200");
+  runFor(DUE_IN_MS / 2);
+  TEST_ASSERT_FALSE(motorsRunning());
+  TEST_ASSERT_TRUE(pumpUntil([&] { return tasks::schedule::stats().fired == before.fired + 1; }));
+
+  TEST_ASSERT_TRUE(motorsRunning());
+  TEST_ASSERT_EQUAL_UINT32(before.rejected, tasks::schedule::stats().rejected);
+  TEST_ASSERT_TRUE(tasks::schedule::stats().lastLateUs < SCHEDULE_LATE_LIMIT_MS * 1000);
+}
+
+// A stop from any origin empties the queue: nothing scheduled ahead of it
+// starts the motors again once it falls due.
+void test_emergency_stop_cancels_scheduled_commands() {
+  const tasks::schedule::Stats before = tasks::schedule::stats();
+  schedule("forward:200");
+  schedule("left:200");
+  runFor(DUE_IN_MS / 2);
+  TEST_ASSERT_EQUAL_UINT32(before.rejected, tasks::schedule::stats().rejected);
+
+  tasks::estop::trigger(Origin::EspNow, micros());
+  runFor(DUE_IN_MS * 2);
+
+  const tasks::schedule::Stats after = tasks::schedule::stats();
+  TEST_ASSERT_EQUAL_UINT32(before.fired, after.fired);
+  TEST_ASSERT_EQUAL_UINT32(before.cancelled + 2, after.cancelled);
+  TEST_ASSERT_FALSE(motorsRunning());
+}
+
+void test_commands_scheduled_after_a_stop_still_run() {
+  tasks::estop::trigger(Origin::EspNow, micros());
+  runFor(10);
+  const tasks::schedule::Stats before = tasks::schedule::stats();
+
+  schedule("forward:200");
+  TEST_ASSERT_TRUE(pumpUntil([&] { return tasks::schedule::stats().fired == before.fired + 1; }));
+  TEST_ASSERT_EQUAL_UINT32(before.cancelled, tasks::schedule::stats().cancelled);
+  TEST_ASSERT_TRUE(motorsRunning());
+}
+
+int main() {
+  char port[8];
+  snprintf(port, sizeof(port), "%u", static_cast<unsigned>(g_broker.start()));
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", port);
+  initActuators();
+  host::setWifiConnected(true);
+  // fireDue() spins out the last stretch before a due time on the clock.
+  host::followWallClock(true);
+  tasks::mqtt::init();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_scheduled_command_runs_on_time);
+  RUN_TEST(test_emergency_stop_cancels_scheduled_commands);
+  RUN_TEST(test_commands_scheduled_after_a_stop_still_run);
+  return UNITY_END();
+}
@@ -0,0 +1,264 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+#include "tasks/serial_tunnel.h"
+
+// tools/tunnel_bench.py's host side against the tunnel, with a jumper across
+// UART2 so every byte sent down comes back up.
+namespace {
+// Fits MQTT_RX_BUFFER with the topic, as tunnel_bench.py's --chunk.
+constexpr size_t CHUNK_BYTES = 400;
+constexpr size_t STREAM_BYTES = 64 * 1024;
+// Line rate of the 8N1 UART, in bytes per second.
+constexpr uint32_t LINE_BYTES_PER_S = SERIAL_TUNNEL_BAUD / 10;
+
+host::Broker g_broker;
+std::mt19937 g_rng(1);
+
+// What the host knows of the current epoch, as tunnel_bench.py keeps it.
+bool g_haveEpoch = false;
+uint32_t g_epoch = 0;
+uint32_t g_downSent = 0;
+uint32_t g_downAcked = 0;
+uint32_t g_overruns = 0;
+uint32_t g_upSentReported = 0;
+std::string g_received;
+bool g_ackUp = true;
+
+uint32_t field(const std::string &text, const char *name) {
+  const size_t at = text.find(std::string(name) + "=");
+  return at == std::string::npos
+             ? 0
+             : static_cast<uint32_t>(strtoul(text.c_str() + at + strlen(name) + 1, nullptr, 10));
+}
+
+void ackUp() {
+  char credit[48];
+  snprintf(credit, sizeof(credit), "epoch=%lu,up_acked=%lu", static_cast<unsigned long>(g_epoch),
+           static_cast<unsigned long>(g_received.size()));
+  g_broker.publish(MQTT_TUNNEL_HOST_CREDIT_TOPIC, credit);
+}
+
+void collect() {
+  for (const host::Broker::Message &message : g_broker.takeMessages()) {
+    if (message.topic == MQTT_TUNNEL_DEVICE_CREDIT_TOPIC) {
+      const uint32_t epoch = field(message.payload, "epoch");
+      if (!g_haveEpoch || epoch != g_epoch) {
+        g_haveEpoch = true;
+        g_epoch = epoch;
+        g_downSent = 0;
+        g_downAcked = 0;
+        g_received.clear();
+      }
+      g_downAcked = field(message.payload, "down_acked");
+      g_upSentReported = field(message.payload, "up_sent");
+      g_overruns = field(message.payload, "overruns");
+    } else if (message.topic == MQTT_TUNNEL_UP_TOPIC) {
+      g_received += message.payload;
+      if (g_ackUp) {
+        ackUp();
+      }
+    }
+  }
+}
+
+void step() {
+  g_broker.poll();
+  collect();
+  tasks::mqtt::loop();
+  tasks::tunnel::loop();
+  host::runDueTimers();
+  host::takeSerialOutput();
+  host::advanceMicros(1000);
+}
+
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    step();
+    if (done()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string randomChunk() {
+  std::string chunk(CHUNK_BYTES, '\0');
+  for (char &byte : chunk) {
+    byte = static_cast<char>(std::uniform_int_distribution<int>(0, 255)(g_rng));
+  }
+  return chunk;
+}
+
+void sendDown(const std::string &chunk) {
+  TEST_ASSERT_EQUAL(1, g_broker.publish(MQTT_TUNNEL_DOWN_TOPIC, chunk));
+  g_downSent += static_cast<uint32_t>(chunk.size());
+}
+
+bool credited() { return g_downSent + CHUNK_BYTES <= g_downAcked + SERIAL_TUNNEL_DOWN_BUFFER; }
+
+// Everything the device accepted has come back up and been acknowledged.
+bool drained() {
+  const tasks::tunnel::Stats stats = tasks::tunnel::stats();
+  return stats.downWritten == stats.downAccepted && stats.upSent == stats.downAccepted &&
+         stats.upAcked == stats.upSent && g_received.size() == stats.upSent &&
+         g_downAcked == stats.downWritten;
+}
+
+bool connected() {
+  return tasks::mqtt::isConnected() && g_broker.subscribers(MQTT_TUNNEL_DOWN_TOPIC) == 1 &&
+         g_broker.subscribers(MQTT_TUNNEL_HOST_CREDIT_TOPIC) == 1 && g_haveEpoch &&
+         g_epoch == tasks::tunnel::stats().epoch;
+}
+
+// Streams `bytes` down within the credit the device returns and checks they
+// come back up byte for byte. Returns the simulated milliseconds it took.
+uint32_t streamWithinCredit(size_t bytes) {
+  std::string sent;
+  const uint32_t overruns = tasks::tunnel::stats().downOverruns;
+  const uint32_t startMs = millis();
+  TEST_ASSERT_TRUE(pumpUntil(
+      [&] {
+        while (sent.size() < bytes && credited()) {
+          const std::string chunk = randomChunk();
+          sendDown(chunk);
+          sent += chunk;
+        }
+        return sent.size() >= bytes && g_received.size() >= sent.size();
+      },
+      static_cast<int>(bytes)));
+  const uint32_t elapsedMs = millis() - startMs;
+  TEST_ASSERT_TRUE(pumpUntil(drained));
+  TEST_ASSERT_EQUAL(sent.size(), g_received.size());
+  TEST_ASSERT_TRUE(sent == g_received);
+  TEST_ASSERT_EQUAL_UINT32(overruns, tasks::tunnel::stats().downOverruns);
+  return elapsedMs;
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// 64 KiB, sixteen times the down buffer and the up window, each way: the
+// credits keep every buffer from overflowing, and the line stays busy.
+void test_stream_returns_byte_exact() {
+  TEST_ASSERT_TRUE(pumpUntil(connected));
+  const uint32_t elapsedMs = streamWithinCredit(STREAM_BYTES);
+  const uint32_t bytesPerS = static_cast<uint32_t>(STREAM_BYTES * 1000 / elapsedMs);
+  char message[128];
+  snprintf(message, sizeof(message),
+           "%u bytes down and back in %lu ms: %lu B/s each way (line %lu B/s)",
+           static_cast<unsigned>(STREAM_BYTES), static_cast<unsigned long>(elapsedMs),
+           static_cast<unsigned long>(bytesPerS), static_cast<unsigned long>(LINE_BYTES_PER_S));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(bytesPerS >= LINE_BYTES_PER_S * 3 / 4);
+}
+
+// A host that ignores its credit both ways: the up window closes, the UART
+// and the down buffer fill, and the chunks that no longer fit are dropped
+// whole and counted. Once the host acknowledges again, what comes back is
+// exactly the chunks the device kept, in order.
+void test_ignored_credit_counts_overruns() {
+  constexpr size_t BURST_CHUNKS = 60;
+  const uint32_t overrunsBefore = tasks::tunnel::stats().downOverruns;
+  const size_t receivedBefore = g_received.size();
+  std::vector<std::string> chunks;
+  g_ackUp = false;
+  for (size_t i = 0; i < BURST_CHUNKS; ++i) {
+    chunks.push_back(randomChunk());
+    sendDown(chunks.back());
+    step();
+  }
+  TEST_ASSERT_TRUE(pumpUntil([&] { return g_overruns > overrunsBefore; }));
+  TEST_ASSERT_TRUE(tasks::tunnel::stats().upSent - tasks::tunnel::stats().upAcked <=
+                   SERIAL_TUNNEL_UP_WINDOW);
+
+  g_ackUp = true;
+  ackUp();
+  TEST_ASSERT_TRUE(pumpUntil(drained));
+  const tasks::tunnel::Stats stats = tasks::tunnel::stats();
+  const uint32_t overruns = stats.downOverruns - overrunsBefore;
+  TEST_ASSERT_EQUAL_UINT32(stats.downOverruns, g_overruns);
+  TEST_ASSERT_TRUE(overruns > 0);
+  TEST_ASSERT_EQUAL_UINT32(g_downSent - overruns * CHUNK_BYTES, stats.downAccepted);
+
+  size_t at = receivedBefore;
+  uint32_t skipped = 0;
+  for (const std::string &chunk : chunks) {
+    if (g_received.compare(at, chunk.size(), chunk) == 0) {
+      at += chunk.size();
+    } else {
+      ++skipped;
+    }
+  }
+  TEST_ASSERT_EQUAL(g_received.size(), at);
+  TEST_ASSERT_EQUAL_UINT32(overruns, skipped);
+  char message[96];
+  snprintf(message, sizeof(message), "%u chunks sent without credit, %lu dropped as overruns",
+           static_cast<unsigned>(BURST_CHUNKS), static_cast<unsigned long>(overruns));
+  TEST_MESSAGE(message);
+}
+
+// A new session starts a new epoch with the byte counters back at zero;
+// credit left over from the old epoch is ignored, and the stream picks up
+// again in the new one.
+void test_reconnect_resets_the_epoch() {
+  const uint32_t epoch = tasks::tunnel::stats().epoch;
+  const uint32_t overruns = tasks::tunnel::stats().downOverruns;
+  g_broker.dropAll();
+  TEST_ASSERT_TRUE(pumpUntil([&] { return connected() && g_epoch == epoch + 1; }, 20000));
+
+  const tasks::tunnel::Stats stats = tasks::tunnel::stats();
+  TEST_ASSERT_EQUAL_UINT32(epoch + 1, stats.epoch);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.downAccepted);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.downWritten);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.upSent);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.upAcked);
+  TEST_ASSERT_EQUAL_UINT32(overruns, stats.downOverruns);
+  TEST_ASSERT_EQUAL_UINT32(0, g_downAcked);
+  TEST_ASSERT_EQUAL_UINT32(0, g_upSentReported);
+
+  char stale[48];
+  snprintf(stale, sizeof(stale), "epoch=%lu,up_acked=%lu", static_cast<unsigned long>(epoch),
+           static_cast<unsigned long>(CHUNK_BYTES));
+  g_broker.publish(MQTT_TUNNEL_HOST_CREDIT_TOPIC, stale);
+  pumpUntil([] { return false; }, 50);
+  TEST_ASSERT_EQUAL_UINT32(0, tasks::tunnel::stats().upAcked);
+
+  streamWithinCredit(4 * SERIAL_TUNNEL_DOWN_BUFFER);
+  TEST_ASSERT_EQUAL_UINT32(epoch + 1, tasks::tunnel::stats().epoch);
+}
+
+int main() {
+  char port[8];
+  snprintf(port, sizeof(port), "%u", static_cast<unsigned>(g_broker.start()));
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", port);
+  initActuators();
+  host::setWifiConnected(true);
+  host::setSerial2Loopback(SERIAL_TUNNEL_BAUD);
+  tasks::mqtt::init();
+  tasks::tunnel::init();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_stream_returns_byte_exact);
+  RUN_TEST(test_ignored_credit_counts_overruns);
+  RUN_TEST(test_reconnect_resets_the_epoch);
+  return UNITY_END();
+}
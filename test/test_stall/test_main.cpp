@@ -0,0 +1,199 @@
+#include <Arduino.h>
+#include <esp_system.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include <chrono>
+#include <string>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "diag/stall_detector.h"
+#include "host_fakes.h"
+
+using diag::stall::Marker;
+
+namespace {
+constexpr uint32_t BUDGET_US = LOOP_STALL_BUDGET_MS * 1000;
+// Records the RTC ring holds before the oldest is overwritten.
+constexpr int RECORD_DEPTH = 4;
+
+// Lets `us` pass with the stall watcher running as it would on the other
+// core, every millisecond.
+void spend(uint32_t us) {
+  while (us > 0) {
+    const uint32_t step = us < 1000 ? us : 1000;
+    host::advanceMicros(step);
+    host::runDueTimers();
+    us -= step;
+  }
+}
+
+std::string nextReport() {
+  char report[320];
+  if (!diag::stall::peekReport(report, sizeof(report))) {
+    return std::string();
+  }
+  return report;
+}
+
+void drainReports() {
+  while (!nextReport().empty()) {
+    diag::stall::popReport();
+  }
+}
+
+bool contains(const std::string &text, const char *part) {
+  return text.find(part) != std::string::npos;
+}
+}  // namespace
+
+void setUp() { drainReports(); }
+
+void tearDown() {}
+
+void test_passes_within_budget_leave_no_record() {
+  const uint32_t stalls = diag::stall::stalls();
+  for (int i = 0; i < 100; ++i) {
+    diag::stall::beginPass();
+    diag::stall::mark(Marker::Wifi);
+    spend(BUDGET_US / 4);
+    diag::stall::mark(Marker::Mqtt);
+    spend(BUDGET_US / 2);
+    diag::stall::endPass();
+  }
+  TEST_ASSERT_EQUAL_UINT32(stalls, diag::stall::stalls());
+  TEST_ASSERT_TRUE(nextReport().empty());
+}
+
+// A blocking connect: the watcher catches it while the loop is stuck, and the
+// record names the stage and the commands that came before it.
+void test_watcher_records_the_stage_a_pass_stalled_in() {
+  const uint32_t stalls = diag::stall::stalls();
+  diag::stall::beginPass();
+  diag::stall::mark(Marker::Wifi);
+  spend(200);
+  diag::stall::noteCommand(41);
+  diag::stall::noteCommand(42);
+  diag::stall::mark(Marker::Mqtt);
+  spend(30);
+  diag::stall::mark(Marker::MqttConnect);
+  spend(BUDGET_US + BUDGET_US / 2);
+
+  TEST_ASSERT_EQUAL_UINT32(stalls + 1, diag::stall::stalls());
+  // Still open: not published before the pass is over.
+  TEST_ASSERT_TRUE(nextReport().empty());
+  diag::stall::endPass();
+
+  const std::string report = nextReport();
+  TEST_MESSAGE(report.c_str());
+  TEST_ASSERT_TRUE(contains(report, "boots_ago=0 reset=none"));
+  TEST_ASSERT_TRUE(
+      contains(report, "trail=wifi@0,command@200,command@200,mqtt@200,mqtt.connect@230"));
+  TEST_ASSERT_TRUE(contains(report, " cmds=41,42"));
+  char elapsed[32];
+  snprintf(elapsed, sizeof(elapsed), "elapsed_us=%lu ",
+           static_cast<unsigned long>(230 + BUDGET_US + BUDGET_US / 2));
+  TEST_ASSERT_TRUE(contains(report, elapsed));
+
+  diag::stall::popReport();
+  TEST_ASSERT_TRUE(nextReport().empty());
+}
+
+// With the watcher held up too, e.g. both cores blocked on flash, endPass()
+// still records the overrun.
+void test_end_of_pass_catches_what_the_watcher_missed() {
+  diag::stall::beginPass();
+  diag::stall::mark(Marker::Actuators);
+  host::advanceMicros(BUDGET_US * 2);
+  diag::stall::endPass();
+
+  const std::string report = nextReport();
+  TEST_ASSERT_TRUE(contains(report, "trail=actuators@0 "));
+  TEST_ASSERT_TRUE(contains(report, "cmds=41,42"));
+}
+
+// A stall that ends in the task watchdog: the record of the stage it was
+// stuck in is published after the reboot, blamed for the reset.
+void test_record_survives_a_watchdog_reset() {
+  diag::stall::beginPass();
+  diag::stall::mark(Marker::MqttIo);
+  diag::stall::mark(Marker::WifiBegin);
+  spend(BUDGET_US * 3);
+
+  host::setResetReason(ESP_RST_TASK_WDT);
+  diag::stall::init();
+
+  const std::string report = nextReport();
+  TEST_MESSAGE(report.c_str());
+  TEST_ASSERT_TRUE(contains(report, "boots_ago=1 reset=task_wdt"));
+  TEST_ASSERT_TRUE(contains(report, "trail=mqtt.io@0,wifi.begin@0 "));
+  diag::stall::popReport();
+  TEST_ASSERT_TRUE(nextReport().empty());
+}
+
+void test_ring_keeps_the_latest_stalls() {
+  for (uint32_t i = 0; i < RECORD_DEPTH + 2; ++i) {
+    diag::stall::beginPass();
+    diag::stall::noteCommand(100 + i);
+    host::advanceMicros(BUDGET_US);
+    diag::stall::endPass();
+  }
+
+  // Oldest first; the command list ends with the one noted in that pass.
+  for (uint32_t i = 2; i < RECORD_DEPTH + 2; ++i) {
+    const std::string report = nextReport();
+    const std::string last = "," + std::to_string(100 + i);
+    TEST_ASSERT_TRUE(report.size() > last.size());
+    TEST_ASSERT_EQUAL_STRING(last.c_str(),
+                             report.substr(report.size() - last.size()).c_str());
+    diag::stall::popReport();
+  }
+  TEST_ASSERT_TRUE(nextReport().empty());
+}
+
+void test_budget_follows_provisioning() {
+  provisioning::applyKeyValue("LOOP_STALL_BUDGET_MS", "20");
+  diag::stall::beginPass();
+  spend(25000);
+  diag::stall::endPass();
+  const std::string report = nextReport();
+  TEST_ASSERT_TRUE(contains(report, "budget_ms=20 "));
+  const std::string budget = std::to_string(LOOP_STALL_BUDGET_MS);
+  provisioning::applyKeyValue("LOOP_STALL_BUDGET_MS", budget.c_str());
+}
+
+// mark() runs a dozen times per pass on the hot path.
+void test_marker_cost() {
+  constexpr int CALLS = 10000000;
+  diag::stall::beginPass();
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < CALLS; ++i) {
+    diag::stall::mark(static_cast<Marker>(i % static_cast<int>(Marker::COUNT)));
+  }
+  const double ns =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+      CALLS;
+  diag::stall::endPass();
+
+  char message[64];
+  snprintf(message, sizeof(message), "mark() %.1f ns/call", ns);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_THAN(100.0, ns);
+}
+
+int main() {
+  provisioning::initDefaults();
+  diag::stall::init();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_passes_within_budget_leave_no_record);
+  RUN_TEST(test_watcher_records_the_stage_a_pass_stalled_in);
+  RUN_TEST(test_end_of_pass_catches_what_the_watcher_missed);
+  RUN_TEST(test_record_survives_a_watchdog_reset);
+  RUN_TEST(test_ring_keeps_the_latest_stalls);
+  RUN_TEST(test_budget_follows_provisioning);
+  RUN_TEST(test_marker_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,320 @@
+#include <Arduino.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "config/defaults.h"
+#include "config/provisioning_store.h"
+#include "host_broker.h"
+#include "host_fakes.h"
+#include "net/state_stream.h"
+#include "tasks/message_handler.h"
+#include "tasks/mqtt_task.h"
+#include "tasks/telemetry.h"
+
+namespace {
+// The highest rate the telemetry task samples at.
+constexpr uint32_t STREAM_HZ = 100;
+
+struct Batch {
+  uint32_t channels;
+  uint32_t periodMs;
+  uint32_t startMs;
+  uint32_t sequence;
+  std::vector<std::vector<int32_t>> samples;
+};
+
+// A decoder written from the format in state_stream.h, as tools/state_dash.py
+// reads it.
+class Reader {
+ public:
+  Reader(const uint8_t *data, size_t length) : data_(data), length_(length) {}
+
+  bool done() const { return offset_ >= length_; }
+
+  uint32_t varint() {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      TEST_ASSERT_TRUE(offset_ < length_);
+      const uint8_t byte = data_[offset_++];
+      value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+      if (byte < 0x80) {
+        return value;
+      }
+    }
+    TEST_FAIL_MESSAGE("varint too long");
+    return 0;
+  }
+
+  int32_t zigzag() {
+    const uint32_t value = varint();
+    return static_cast<int32_t>((value >> 1) ^ (0u - (value & 1)));
+  }
+
+ private:
+  const uint8_t *data_;
+  size_t length_;
+  size_t offset_ = 0;
+};
+
+Batch decode(const uint8_t *data, size_t length) {
+  TEST_ASSERT_TRUE(length > 0);
+  TEST_ASSERT_EQUAL_UINT8(net::StateEncoder::VERSION, data[0]);
+  Reader reader(data + 1, length - 1);
+  Batch batch;
+  batch.channels = reader.varint();
+  batch.periodMs = reader.varint();
+  batch.startMs = reader.varint();
+  batch.sequence = reader.varint();
+
+  std::vector<int32_t> state(batch.channels);
+  for (int32_t &value : state) {
+    value = reader.zigzag();
+  }
+  batch.samples.push_back(state);
+  while (!reader.done()) {
+    const uint32_t token = reader.varint();
+    if ((token & 1) != 0) {
+      batch.samples.insert(batch.samples.end(), token >> 1, state);
+      continue;
+    }
+    const uint32_t mask = token >> 1;
+    TEST_ASSERT_TRUE(mask != 0);
+    for (uint32_t i = 0; i < batch.channels; ++i) {
+      if ((mask & (1u << i)) != 0) {
+        state[i] = static_cast<int32_t>(static_cast<uint32_t>(state[i]) +
+                                        static_cast<uint32_t>(reader.zigzag()));
+      }
+    }
+    batch.samples.push_back(state);
+  }
+  return batch;
+}
+
+Batch decode(const std::string &payload) {
+  return decode(reinterpret_cast<const uint8_t *>(payload.data()), payload.size());
+}
+
+host::Broker g_broker;
+
+template <typename Done>
+bool pumpUntil(Done done, int steps = 5000) {
+  for (int i = 0; i < steps; ++i) {
+    g_broker.poll();
+    tasks::mqtt::loop();
+    tasks::telemetry::loop();
+    if (done()) {
+      return true;
+    }
+    host::advanceMicros(1000);
+    usleep(100);
+  }
+  return false;
+}
+
+void drainStateTopic() {
+  g_broker.poll();
+  g_broker.takeMessages();
+}
+
+struct Bandwidth {
+  double payloadPerSecond;
+  // With the QoS 0 PUBLISH framing around each batch.
+  double framedPerSecond;
+  size_t samples;
+};
+
+// Runs the stream for `seconds`, calling `drive(ms)` every millisecond, and
+// decodes what reached the broker. Every sample slot must arrive exactly once.
+template <typename Drive>
+Bandwidth measure(uint32_t seconds, Drive drive) {
+  drainStateTopic();
+  uint32_t ms = 0;
+  pumpUntil(
+      [&] {
+        drive(ms++);
+        return false;
+      },
+      static_cast<int>(seconds * 1000));
+
+  Bandwidth result{};
+  size_t payload = 0;
+  size_t framed = 0;
+  bool first = true;
+  uint32_t nextSlotMs = 0;
+  uint32_t nextSequence = 0;
+  for (const host::Broker::Message &message : g_broker.takeMessages()) {
+    if (message.topic != MQTT_STATE_TOPIC) {
+      continue;
+    }
+    const Batch batch = decode(message.payload);
+    TEST_ASSERT_EQUAL_UINT32(1000 / STREAM_HZ, batch.periodMs);
+    if (!first) {
+      TEST_ASSERT_EQUAL_UINT32(nextSequence, batch.sequence);
+      TEST_ASSERT_EQUAL_UINT32(nextSlotMs, batch.startMs);
+    }
+    first = false;
+    nextSequence = batch.sequence + 1;
+    nextSlotMs = batch.startMs + batch.periodMs * static_cast<uint32_t>(batch.samples.size());
+    payload += message.payload.size();
+    const size_t remaining = 2 + message.topic.size() + message.payload.size();
+    framed += 1 + (remaining < 128 ? 1 : 2) + remaining;
+    result.samples += batch.samples.size();
+  }
+  result.payloadPerSecond = static_cast<double>(payload) / seconds;
+  result.framedPerSecond = static_cast<double>(framed) / seconds;
+  return result;
+}
+
+void report(const char *name, const Bandwidth &bandwidth) {
+  char message[128];
+  snprintf(message, sizeof(message), "%s: %.0f B/s payload, %.0f B/s framed, %u samples",
+           name, bandwidth.payloadPerSecond, bandwidth.framedPerSecond,
+           static_cast<unsigned>(bandwidth.samples));
+  TEST_MESSAGE(message);
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// Pinned so the dashboard's decoder and the encoder cannot drift apart.
+void test_wire_format() {
+  net::StateEncoder encoder;
+  uint8_t buffer[64];
+  encoder.begin(buffer, sizeof(buffer), 3, 10, 123456, 7);
+  int32_t values[3] = {0, 90, 5};
+  for (int i = 0; i < 3; ++i) {
+    TEST_ASSERT_TRUE(encoder.add(values));
+  }
+  values[0] = -200;
+  TEST_ASSERT_TRUE(encoder.add(values));
+  TEST_ASSERT_TRUE(encoder.add(values));
+  values[1] = -2000000000;
+  values[2] = 2000000000;
+  TEST_ASSERT_TRUE(encoder.add(values));
+
+  const uint8_t expected[] = {0x01, 0x03, 0x0a, 0xc0, 0xc4, 0x07, 0x07, 0x00, 0xb4, 0x01,
+                              0x0a, 0x05, 0x02, 0x8f, 0x03, 0x03, 0x0c, 0xb3, 0xd1, 0xac,
+                              0xf3, 0x0e, 0xf6, 0xcf, 0xac, 0xf3, 0x0e};
+  TEST_ASSERT_EQUAL(sizeof(expected), encoder.finish());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+  TEST_ASSERT_EQUAL(6, encoder.samples());
+}
+
+// Random walks with long holds, full-range jumps and full batches: whatever
+// went in comes back out, split across however many batches it took.
+void test_round_trip() {
+  std::mt19937 rng(44);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<int32_t> any(INT32_MIN, INT32_MAX);
+  std::uniform_int_distribution<int32_t> step(-300, 300);
+  constexpr size_t CHANNELS = 7;
+  constexpr int SAMPLES = 20000;
+
+  std::vector<std::vector<int32_t>> sent;
+  std::vector<std::vector<int32_t>> received;
+  int32_t values[CHANNELS] = {};
+  net::StateEncoder encoder;
+  uint8_t buffer[96];
+  uint32_t sequence = 0;
+  encoder.begin(buffer, sizeof(buffer), CHANNELS, 10, 0, sequence++);
+  const auto flush = [&] {
+    const size_t length = encoder.finish();
+    const Batch batch = decode(buffer, length);
+    TEST_ASSERT_EQUAL_UINT32(CHANNELS, batch.channels);
+    TEST_ASSERT_EQUAL_UINT32(received.size() * 10, batch.startMs);
+    TEST_ASSERT_EQUAL(encoder.samples(), batch.samples.size());
+    received.insert(received.end(), batch.samples.begin(), batch.samples.end());
+  };
+
+  for (int i = 0; i < SAMPLES; ++i) {
+    if (percent(rng) < 30) {
+      for (int32_t &value : values) {
+        const int roll = percent(rng);
+        if (roll < 5) {
+          value = any(rng);
+        } else if (roll < 40) {
+          value = static_cast<int32_t>(static_cast<uint32_t>(value) +
+                                       static_cast<uint32_t>(step(rng)));
+        }
+      }
+    }
+    sent.emplace_back(values, values + CHANNELS);
+    if (!encoder.add(values)) {
+      flush();
+      encoder.begin(buffer, sizeof(buffer), CHANNELS, 10, static_cast<uint32_t>(i) * 10,
+                    sequence++);
+      TEST_ASSERT_TRUE(encoder.add(values));
+    }
+    TEST_ASSERT_TRUE(encoder.length() <= sizeof(buffer));
+  }
+  flush();
+
+  TEST_ASSERT_TRUE(sequence > 100);
+  TEST_ASSERT_EQUAL(sent.size(), received.size());
+  for (size_t i = 0; i < sent.size(); ++i) {
+    TEST_ASSERT_TRUE(sent[i] == received[i]);
+  }
+}
+
+// The stream as the dashboard sees it, at the full 100 Hz, standing still and
+// under a 20 Hz twist stream. Raw int32 samples would be 400 B/s per channel
+// at this rate.
+void test_stream_bandwidth() {
+  TEST_ASSERT_TRUE(pumpUntil([] { return tasks::mqtt::isConnected(); }));
+  int32_t state[net::StateEncoder::MAX_CHANNELS];
+  const size_t channels = sampleActuators(state, net::StateEncoder::MAX_CHANNELS - 1) + 1;
+  const double raw = 4.0 * channels * STREAM_HZ;
+
+  const Bandwidth steady = measure(10, [](uint32_t) {});
+  report("steady", steady);
+
+  const Bandwidth motion = measure(10, [](uint32_t ms) {
+    if (ms % 50 != 0) {
+      return;
+    }
+    char command[32];
+    const int linear = static_cast<int>(150 + 60 * sin(ms / 1000.0));
+    const int angular = static_cast<int>(400 * cos(ms / 700.0));
+    const int length = snprintf(command, sizeof(command), "twist:%d,%d", linear, angular);
+    onMessage(command, static_cast<unsigned>(length));
+  });
+  report("motion, 20 Hz twist", motion);
+
+  // Every slot of both runs arrived, give or take the batch still open.
+  const size_t slots = 10 * STREAM_HZ;
+  TEST_ASSERT_TRUE(steady.samples + STREAM_HZ >= slots && steady.samples <= slots);
+  TEST_ASSERT_TRUE(motion.samples + STREAM_HZ >= slots && motion.samples <= slots);
+  // Steady state costs the batch header and keyframe, nothing per sample.
+  TEST_ASSERT_TRUE(steady.payloadPerSecond < raw / 20);
+  TEST_ASSERT_TRUE(motion.payloadPerSecond > steady.payloadPerSecond);
+  TEST_ASSERT_TRUE(motion.payloadPerSecond < raw / 4);
+}
+
+int main() {
+  char port[8];
+  snprintf(port, sizeof(port), "%u", static_cast<unsigned>(g_broker.start()));
+  provisioning::initDefaults();
+  provisioning::applyKeyValue("MQTT_HOST", "127.0.0.1");
+  provisioning::applyKeyValue("MQTT_PORT", port);
+  char rate[8];
+  snprintf(rate, sizeof(rate), "%u", static_cast<unsigned>(STREAM_HZ));
+  provisioning::applyKeyValue("STATE_STREAM_HZ", rate);
+  initActuators();
+  host::setWifiConnected(true);
+  tasks::mqtt::init();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_wire_format);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_stream_bandwidth);
+  return UNITY_END();
+}
@@ -0,0 +1,223 @@
+#include <string.h>
+#include <unity.h>
+
+#include <vector>
+
+#include "config/defaults.h"
+#include "net/wifi_roamer.h"
+
+using net::WifiRoamer;
+
+namespace {
+// Same policy as tasks::wifi.
+constexpr WifiRoamer::Config CONFIG{WIFI_ROAM_RSSI_DBM,        WIFI_ROAM_HYSTERESIS_DB,
+                                    WIFI_ROAM_SCAN_INTERVAL_MS, WIFI_ROAM_FULL_SCAN_EVERY,
+                                    WIFI_ROAM_MIN_INTERVAL_MS,  WIFI_ROAM_CACHE_TTL_MS};
+constexpr uint32_t RSSI_SAMPLE_MS = 1000;
+constexpr uint32_t ASSOCIATION_MS = 120;
+// Quieter than this an access point is out of range.
+constexpr int NOISE_FLOOR_DBM = -90;
+
+struct Site {
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t slot;
+  // Position along the aisle, in metres.
+  int position;
+};
+
+// A station driving down an aisle of access points. Signal falls off by
+// 2 dB per metre from -40 dBm, and the radio does what the roamer decides
+// the way tasks::wifi does: scans answer with whatever is audible on the
+// probed channels, and a roam costs one association time off the air.
+class FakeRadio {
+ public:
+  explicit FakeRadio(std::vector<Site> sites) : sites_(sites) {}
+
+  int rssiOf(size_t site, int positionM) const {
+    const int distance = positionM > sites_[site].position ? positionM - sites_[site].position
+                                                           : sites_[site].position - positionM;
+    return -40 - 2 * distance;
+  }
+
+  void connect(WifiRoamer &roamer, size_t site, uint32_t now) {
+    current_ = site;
+    roamer.onConnected(sites_[site].bssid, now);
+  }
+
+  // Runs one RSSI sample period at `positionM` and carries out the decision.
+  void step(WifiRoamer &roamer, int positionM, uint32_t now) {
+    const int rssi = rssiOf(current_, positionM);
+    weakest_ = rssi < weakest_ ? rssi : weakest_;
+    roamer.onRssi(static_cast<int8_t>(rssi), now);
+    const WifiRoamer::Decision decision = roamer.poll(now);
+    if (decision.action == WifiRoamer::Action::Scan) {
+      probed_.push_back(decision.channel);
+      for (size_t site = 0; site < sites_.size(); ++site) {
+        const int heard = rssiOf(site, positionM);
+        if ((decision.channel == 0 || decision.channel == sites_[site].channel) &&
+            heard > NOISE_FLOOR_DBM) {
+          WifiRoamer::AccessPoint ap{};
+          memcpy(ap.bssid, sites_[site].bssid, sizeof(ap.bssid));
+          ap.rssi = static_cast<int8_t>(heard);
+          ap.channel = sites_[site].channel;
+          ap.slot = sites_[site].slot;
+          roamer.onScanResult(ap, now + WIFI_SCAN_DWELL_MS);
+        }
+      }
+      roamer.onScanDone(now + WIFI_SCAN_DWELL_MS);
+    } else if (decision.action == WifiRoamer::Action::Roam) {
+      roamer.onDisconnected();
+      for (size_t site = 0; site < sites_.size(); ++site) {
+        if (memcmp(sites_[site].bssid, decision.target.bssid, 6) == 0) {
+          roamPositions_.push_back(positionM);
+          connect(roamer, site, now + ASSOCIATION_MS);
+        }
+      }
+    }
+  }
+
+  size_t current() const { return current_; }
+  int weakest() const { return weakest_; }
+  const std::vector<uint8_t> &probed() const { return probed_; }
+  const std::vector<int> &roamPositions() const { return roamPositions_; }
+
+ private:
+  std::vector<Site> sites_;
+  size_t current_ = 0;
+  int weakest_ = 0;
+  std::vector<uint8_t> probed_;
+  std::vector<int> roamPositions_;
+};
+
+const Site AP_A{{0xA0, 0, 0, 0, 0, 1}, 1, 0, 0};
+const Site AP_B{{0xB0, 0, 0, 0, 0, 2}, 11, 1, 30};
+const Site AP_C{{0xC0, 0, 0, 0, 0, 3}, 6, 2, 60};
+
+// Drives from `from` to `to` metres at 1 m/s, one RSSI sample per metre.
+uint32_t drive(FakeRadio &radio, WifiRoamer &roamer, int from, int to, uint32_t now) {
+  const int stepM = from <= to ? 1 : -1;
+  for (int position = from; position != to + stepM; position += stepM) {
+    now += RSSI_SAMPLE_MS;
+    radio.step(roamer, position, now);
+  }
+  return now;
+}
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_hands_over_before_the_link_degrades() {
+  FakeRadio radio({AP_A, AP_B, AP_C});
+  WifiRoamer roamer(CONFIG);
+  radio.connect(roamer, 0, 0);
+
+  drive(radio, roamer, 0, 70, 0);
+
+  TEST_ASSERT_EQUAL(2, roamer.stats().roams);
+  TEST_ASSERT_EQUAL(2, radio.current());
+  TEST_ASSERT_EQUAL(2, radio.roamPositions().size());
+  // Each handover happens past the midpoint between two access points, but
+  // long before the serving one fades into the noise.
+  TEST_ASSERT_GREATER_THAN(15, radio.roamPositions()[0]);
+  TEST_ASSERT_LESS_THAN(25, radio.roamPositions()[0]);
+  TEST_ASSERT_GREATER_THAN(45, radio.roamPositions()[1]);
+  TEST_ASSERT_LESS_THAN(55, radio.roamPositions()[1]);
+  TEST_ASSERT_GREATER_THAN(-82, radio.weakest());
+}
+
+void test_scans_only_cached_channels_between_full_sweeps() {
+  FakeRadio radio({AP_A, AP_B});
+  WifiRoamer roamer(CONFIG);
+  radio.connect(roamer, 0, 0);
+
+  // Parked where A is weak but B is not enough better to roam to.
+  uint32_t now = 0;
+  for (int i = 0; i < 60; ++i) {
+    now += RSSI_SAMPLE_MS;
+    radio.step(roamer, 16, now);
+  }
+
+  TEST_ASSERT_EQUAL(0, roamer.stats().roams);
+  const std::vector<uint8_t> &probed = radio.probed();
+  TEST_ASSERT_TRUE(probed.size() >= 10);
+  // Nothing but A is cached at first, so the first scan is a sweep.
+  TEST_ASSERT_EQUAL(0, probed[0]);
+  size_t sweeps = 0;
+  for (uint8_t channel : probed) {
+    TEST_ASSERT_TRUE(channel == 0 || channel == AP_B.channel);
+    sweeps += channel == 0 ? 1 : 0;
+  }
+  TEST_ASSERT_EQUAL(roamer.stats().fullScans, sweeps);
+  TEST_ASSERT_EQUAL(probed.size() - sweeps, roamer.stats().channelScans);
+  TEST_ASSERT_TRUE(sweeps <= 1 + probed.size() / WIFI_ROAM_FULL_SCAN_EVERY);
+}
+
+void test_strong_link_never_scans() {
+  FakeRadio radio({AP_A, AP_B});
+  WifiRoamer roamer(CONFIG);
+  radio.connect(roamer, 0, 0);
+
+  drive(radio, roamer, 0, 10, 0);
+
+  TEST_ASSERT_EQUAL(0, radio.probed().size());
+  TEST_ASSERT_EQUAL(0, roamer.stats().roams);
+}
+
+void test_does_not_ping_pong_between_equal_access_points() {
+  FakeRadio radio({AP_A, AP_B});
+  WifiRoamer roamer(CONFIG);
+  radio.connect(roamer, 0, 0);
+
+  // Back and forth around the midpoint, where neither is ever
+  // WIFI_ROAM_HYSTERESIS_DB ahead for long.
+  uint32_t now = drive(radio, roamer, 0, 19, 0);
+  for (int lap = 0; lap < 5; ++lap) {
+    now = drive(radio, roamer, 19, 11, now);
+    now = drive(radio, roamer, 11, 19, now);
+  }
+
+  const std::vector<int> &roams = radio.roamPositions();
+  TEST_ASSERT_TRUE(roams.size() <= 1 + (now / WIFI_ROAM_MIN_INTERVAL_MS));
+  TEST_ASSERT_TRUE(roams.size() <= 6);
+}
+
+void test_stale_cache_entries_are_not_roamed_to() {
+  WifiRoamer roamer(CONFIG);
+  WifiRoamer::AccessPoint b{{0xB0, 0, 0, 0, 0, 2}, -50, 11, 1};
+  roamer.onScanResult(b, 0);
+  roamer.onConnected(AP_A.bssid, 0);
+
+  const uint32_t late = WIFI_ROAM_CACHE_TTL_MS + 1000;
+  roamer.onRssi(-80, late);
+  const WifiRoamer::Decision decision = roamer.poll(late);
+  TEST_ASSERT_TRUE(decision.action != WifiRoamer::Action::Roam);
+
+  WifiRoamer::AccessPoint candidate{};
+  TEST_ASSERT_FALSE(roamer.bestCandidate(late, &candidate));
+  TEST_ASSERT_TRUE(roamer.bestCandidate(WIFI_ROAM_CACHE_TTL_MS, &candidate));
+}
+
+void test_equal_signal_prefers_the_higher_priority_network() {
+  WifiRoamer roamer(CONFIG);
+  roamer.onScanResult({{0xB0, 0, 0, 0, 0, 2}, -55, 11, 2}, 0);
+  roamer.onScanResult({{0xC0, 0, 0, 0, 0, 3}, -55, 6, 0}, 0);
+  roamer.onScanResult({{0xD0, 0, 0, 0, 0, 4}, -60, 1, 0}, 0);
+
+  WifiRoamer::AccessPoint candidate{};
+  TEST_ASSERT_TRUE(roamer.bestCandidate(0, &candidate));
+  TEST_ASSERT_EQUAL(0xC0, candidate.bssid[0]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_hands_over_before_the_link_degrades);
+  RUN_TEST(test_scans_only_cached_channels_between_full_sweeps);
+  RUN_TEST(test_strong_link_never_scans);
+  RUN_TEST(test_does_not_ping_pong_between_equal_access_points);
+  RUN_TEST(test_stale_cache_entries_are_not_roamed_to);
+  RUN_TEST(test_equal_signal_prefers_the_higher_priority_network);
+  return UNITY_END();
+}
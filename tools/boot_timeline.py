@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Collects boot timelines from the device and reports them as JSON.
+
+After every reset the device publishes a "comm-robot boot" line on the
+heartbeat topic with the micros() stamp of each startup stage (see
+include/diag/boot_timeline.h). The tool answers the first report of a boot
+with a "stop" command, so the device also stamps the first actuated command,
+and prints one JSON object per boot with each stage in milliseconds since
+reset. Reset the device between boots; after --boots boots a summary with
+the median of every stage is printed, for comparing builds.
+
+    pip install paho-mqtt
+    python3 tools/boot_timeline.py --host 127.0.0.1 --boots 5
+"""
+
+import argparse
+import json
+import re
+import statistics
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+BOOT_PREFIX = "comm-robot boot"
+STAGE_FIELD = re.compile(r"(\w+)_us=(\d+)")
+
+
+class Collector:
+    def __init__(self, args):
+        self.args = args
+        self.cond = threading.Condition()
+        self.boots = []
+        self.current = None
+        self.client = mqtt.Client(client_id=f"boot-timeline-{int(time.time())}")
+        self.client.on_message = self.on_message
+
+    def on_message(self, _client, _userdata, msg):
+        text = msg.payload.decode(errors="replace")
+        if not text.startswith(BOOT_PREFIX):
+            return
+        stages = {name: int(us) for name, us in STAGE_FIELD.findall(text)}
+        with self.cond:
+            # A report without the first command opens a new boot; the one
+            # that follows completes it.
+            if "first_cmd" not in stages:
+                self.current = stages
+                self.client.publish(self.args.command_topic, "stop")
+                return
+            if self.current is None or stages.get("setup") != self.current.get("setup"):
+                self.current = stages
+            self.current.update(stages)
+            self.boots.append({name: us / 1000.0 for name, us in self.current.items()})
+            self.current = None
+            self.cond.notify_all()
+
+    def run(self):
+        args = self.args
+        self.client.connect(args.host, args.port)
+        self.client.subscribe(args.heartbeat_topic)
+        self.client.loop_start()
+        reported = 0
+        try:
+            while reported < args.boots:
+                with self.cond:
+                    self.cond.wait_for(lambda: len(self.boots) > reported)
+                    boot = self.boots[reported]
+                reported += 1
+                print(json.dumps({"type": "boot", "boot": reported, "stages_ms": boot}), flush=True)
+        except KeyboardInterrupt:
+            pass
+        self.client.loop_stop()
+        self.client.disconnect()
+
+        if self.boots:
+            names = [name for name in self.boots[0] if all(name in boot for boot in self.boots)]
+            medians = {name: round(statistics.median(boot[name] for boot in self.boots), 1)
+                       for name in names}
+            print(json.dumps({"type": "summary", "boots": len(self.boots), "median_ms": medians}))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--command-topic", default="esp32/commrobot/serial_in")
+    parser.add_argument("--heartbeat-topic", default="esp32/commrobot/heartbeat")
+    parser.add_argument("--boots", type=int, default=1, help="boots to collect before the summary")
+    Collector(parser.parse_args()).run()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Checks that a stop overtakes a saturated command queue; reports JSON.
+
+Every trial publishes a back to back burst of enveloped motion commands and
+then one message on the stop topic, so the stop reaches the device behind
+the whole burst. The device acts on the stop as soon as it is in the MQTT
+receive buffer and drops the burst commands still queued ahead of it. After
+each trial the tool waits for a heartbeat and reports:
+
+  acked      burst commands the device executed (it acks each one)
+  flushed    burst commands dropped because of the stop (estop_flushed)
+  stop_us    time from the stop's bytes arriving to the motors being cut
+  overtook   true when the stop ran before the end of the burst
+
+One JSON object per trial, then a summary object.
+
+    pip install paho-mqtt
+    python3 tools/estop_probe.py --host 127.0.0.1 --trials 10 --burst 40
+"""
+
+import argparse
+import json
+import re
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+HEARTBEAT_FIELD = re.compile(r"(\w+)=(\d+)")
+
+
+class Probe:
+    def __init__(self, args):
+        self.args = args
+        self.cond = threading.Condition()
+        self.heartbeat = None
+        self.heartbeat_count = 0
+        self.acked = set()
+        self.next_id = int(time.time()) * 1000
+        self.client = mqtt.Client(client_id=f"estop-probe-{int(time.time())}")
+        self.client.on_message = self.on_message
+
+    def on_message(self, _client, _userdata, msg):
+        text = msg.payload.decode(errors="replace")
+        with self.cond:
+            if msg.topic == self.args.heartbeat_topic:
+                self.heartbeat = {k: int(v) for k, v in HEARTBEAT_FIELD.findall(text)}
+                self.heartbeat_count += 1
+                self.cond.notify_all()
+                return
+            fields = text.split(",")
+            if len(fields) == 5 and fields[0].isdigit():
+                self.acked.add(int(fields[0]))
+
+    def wait_heartbeat(self):
+        with self.cond:
+            seen = self.heartbeat_count
+            if not self.cond.wait_for(lambda: self.heartbeat_count > seen, timeout=self.args.heartbeat_timeout):
+                raise SystemExit("no heartbeat from the device")
+            return dict(self.heartbeat)
+
+    def trial(self, index):
+        before = self.wait_heartbeat()
+        ids = []
+        for _ in range(self.args.burst):
+            self.next_id += 1
+            ids.append(self.next_id)
+            ts = int(time.time() * 1000)
+            body = f"@id={self.next_id},ts={ts},src={self.args.source},seq={self.next_id};forward:{self.args.speed}"
+            self.client.publish(self.args.command_topic, body)
+        self.client.publish(self.args.stop_topic, b"stop")
+        after = self.wait_heartbeat()
+
+        with self.cond:
+            acked = sum(1 for cmd_id in ids if cmd_id in self.acked)
+        flushed = after.get("estop_flushed", 0) - before.get("estop_flushed", 0)
+        stops = after.get("estop", 0) - before.get("estop", 0)
+        return {
+            "type": "trial",
+            "trial": index,
+            "burst": self.args.burst,
+            "acked": acked,
+            "flushed": flushed,
+            "stops": stops,
+            "stop_us": after.get("estop_us"),
+            "overtook": stops > 0 and acked < self.args.burst,
+        }
+
+    def run(self):
+        args = self.args
+        self.client.connect(args.host, args.port)
+        self.client.subscribe([(args.heartbeat_topic, 0), (args.ack_topic, 0)])
+        self.client.loop_start()
+        trials = []
+        for index in range(args.trials):
+            result = self.trial(index)
+            trials.append(result)
+            print(json.dumps(result), flush=True)
+        self.client.loop_stop()
+        self.client.disconnect()
+
+        latencies = sorted(t["stop_us"] for t in trials if t["stop_us"] is not None)
+        return {
+            "type": "summary",
+            "trials": len(trials),
+            "overtook": sum(1 for t in trials if t["overtook"]),
+            "stop_us_median": latencies[len(latencies) // 2] if latencies else None,
+            "stop_us_max": latencies[-1] if latencies else None,
+        }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--command-topic", default="esp32/commrobot/serial_in")
+    parser.add_argument("--stop-topic", default="esp32/commrobot/stop")
+    parser.add_argument("--ack-topic", default="esp32/commrobot/ack")
+    parser.add_argument("--heartbeat-topic", default="esp32/commrobot/heartbeat")
+    parser.add_argument("--trials", type=int, default=10)
+    parser.add_argument("--burst", type=int, default=40, help="commands queued ahead of each stop")
+    parser.add_argument("--speed", type=int, default=120)
+    parser.add_argument("--source", type=int, default=9, help="envelope src id")
+    parser.add_argument("--heartbeat-timeout", type=float, default=15.0)
+    args = parser.parse_args()
+
+    print(json.dumps(Probe(args).run()))
+
+
+if __name__ == "__main__":
+    main()
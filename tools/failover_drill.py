@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Broker failover drill against two local mosquitto instances; reports JSON.
+
+Starts a primary and a fallback mosquitto on this host, waits for the device
+heartbeat on the primary, then kills the primary, waits for the heartbeat to
+show up on the fallback, restarts the primary and waits for the device to
+fail back. Provision the device with both brokers first, e.g.
+
+    MQTT_HOST=<this host> MQTT_PORT=1883 MQTT_HOST_2=<this host> MQTT_PORT_2=1884
+
+Each step prints a JSON object: the time the host saw the switch and the
+device's own failover_ms / failovers / failbacks heartbeat fields. Fail-back
+is only attempted every MQTT_FAILBACK_PROBE_MS (30 s by default), so give
+--failback-timeout some headroom.
+
+    python3 tools/failover_drill.py --rounds 3
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import tempfile
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+HEARTBEAT_FIELD = re.compile(r"(\w+)=(\d+)")
+
+
+class Broker:
+    def __init__(self, binary, port, workdir):
+        self.binary = binary
+        self.port = port
+        self.config = os.path.join(workdir, f"mosquitto-{port}.conf")
+        with open(self.config, "w") as config:
+            config.write(f"listener {port} 0.0.0.0\nallow_anonymous true\npersistence false\n")
+        self.process = None
+
+    def start(self):
+        self.process = subprocess.Popen(
+            [self.binary, "-c", self.config], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL
+        )
+        time.sleep(0.3)
+
+    def stop(self):
+        if self.process is not None:
+            self.process.kill()
+            self.process.wait()
+            self.process = None
+
+
+class Watcher:
+    """Collects device heartbeats seen on one broker."""
+
+    def __init__(self, name, port, topic, cond):
+        self.name = name
+        self.port = port
+        self.topic = topic
+        self.cond = cond
+        self.last = None
+        self.count = 0
+        self.client = None
+
+    def on_message(self, _client, _userdata, msg):
+        fields = {k: int(v) for k, v in HEARTBEAT_FIELD.findall(msg.payload.decode(errors="replace"))}
+        with self.cond:
+            self.last = (time.monotonic(), fields)
+            self.count += 1
+            self.cond.notify_all()
+
+    def on_connect(self, client, _userdata, _flags, _rc):
+        client.subscribe(self.topic)
+
+    def attach(self):
+        self.client = mqtt.Client(client_id=f"failover-drill-{self.name}-{int(time.time())}")
+        self.client.on_message = self.on_message
+        self.client.on_connect = self.on_connect
+        self.client.connect_async("127.0.0.1", self.port)
+        self.client.reconnect_delay_set(0.2, 0.5)
+        self.client.loop_start()
+
+    def detach(self):
+        if self.client is not None:
+            self.client.loop_stop()
+            self.client.disconnect()
+            self.client = None
+
+
+def wait_for_heartbeat(cond, watcher, timeout):
+    """Returns (seconds waited, heartbeat fields) for the next heartbeat on `watcher`."""
+    started = time.monotonic()
+    with cond:
+        seen = watcher.count
+        if not cond.wait_for(lambda: watcher.count > seen, timeout=timeout):
+            return None, None
+        return time.monotonic() - started, watcher.last[1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--mosquitto", default="mosquitto")
+    parser.add_argument("--primary-port", type=int, default=1883)
+    parser.add_argument("--fallback-port", type=int, default=1884)
+    parser.add_argument("--heartbeat-topic", default="esp32/commrobot/heartbeat")
+    parser.add_argument("--rounds", type=int, default=3)
+    parser.add_argument("--failover-timeout", type=float, default=30.0)
+    parser.add_argument("--failback-timeout", type=float, default=90.0)
+    args = parser.parse_args()
+
+    cond = threading.Condition()
+    with tempfile.TemporaryDirectory() as workdir:
+        primary = Broker(args.mosquitto, args.primary_port, workdir)
+        fallback = Broker(args.mosquitto, args.fallback_port, workdir)
+        on_primary = Watcher("primary", args.primary_port, args.heartbeat_topic, cond)
+        on_fallback = Watcher("fallback", args.fallback_port, args.heartbeat_topic, cond)
+        primary.start()
+        fallback.start()
+        on_primary.attach()
+        on_fallback.attach()
+        try:
+            waited, _ = wait_for_heartbeat(cond, on_primary, args.failover_timeout)
+            if waited is None:
+                raise SystemExit("no heartbeat on the primary broker; is the device provisioned?")
+
+            for round_index in range(args.rounds):
+                primary.stop()
+                seconds, fields = wait_for_heartbeat(cond, on_fallback, args.failover_timeout)
+                print(json.dumps({
+                    "type": "failover",
+                    "round": round_index,
+                    "seen_after_s": round(seconds, 3) if seconds is not None else None,
+                    "device": {k: fields.get(k) for k in ("broker", "failover_ms", "failovers")} if fields else None,
+                }), flush=True)
+
+                primary.start()
+                seconds, fields = wait_for_heartbeat(cond, on_primary, args.failback_timeout)
+                print(json.dumps({
+                    "type": "failback",
+                    "round": round_index,
+                    "seen_after_s": round(seconds, 3) if seconds is not None else None,
+                    "device": {k: fields.get(k) for k in ("broker", "failbacks")} if fields else None,
+                }), flush=True)
+        finally:
+            on_primary.detach()
+            on_fallback.detach()
+            primary.stop()
+            fallback.stop()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Sends enveloped commands to the robot and reports latency percentiles.
+
+Every command is wrapped as ``@id=<n>,ts=<ms>;<command>`` and the device
+answers on the ack topic with ``id,ts,receiveUs,dispatchUs,actuateUs``.
+Round trip is measured on this host; the dispatch/actuate columns come from
+the device clock and are relative to the moment the MQTT callback ran.
+
+    pip install paho-mqtt
+    python3 tools/latency_probe.py --host 127.0.0.1 --count 200 --rate 20
+"""
+
+import argparse
+import statistics
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+
+def percentile(values, pct):
+    if not values:
+        return float("nan")
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, int(round(pct / 100.0 * (len(ordered) - 1))))
+    return ordered[index]
+
+
+def summarize(label, values, unit):
+    if not values:
+        print(f"{label:>10}: no samples")
+        return
+    print(
+        f"{label:>10}: n={len(values)} p50={percentile(values, 50):.1f}{unit} "
+        f"p90={percentile(values, 90):.1f}{unit} p99={percentile(values, 99):.1f}{unit} "
+        f"max={max(values):.1f}{unit} mean={statistics.fmean(values):.1f}{unit}"
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--command-topic", default="esp32/commrobot/serial_in")
+    parser.add_argument("--ack-topic", default="esp32/commrobot/ack")
+    parser.add_argument("--command", default="forward:120")
+    parser.add_argument("--count", type=int, default=100)
+    parser.add_argument("--rate", type=float, default=10.0, help="commands per second")
+    parser.add_argument("--settle", type=float, default=2.0, help="seconds to wait for late acks")
+    args = parser.parse_args()
+
+    sent = {}
+    rtt_ms = []
+    dispatch_us = []
+    actuate_us = []
+    histogram = []
+    lock = threading.Lock()
+
+    def on_message(_client, _userdata, msg):
+        text = msg.payload.decode(errors="replace")
+        now = time.monotonic()
+        fields = text.split(",")
+        if fields[0] == "hist":
+            histogram[:] = fields[1:]
+            return
+        if len(fields) != 5:
+            return
+        ack_id, _ts, _rx, dispatch, actuate = (int(f) for f in fields)
+        with lock:
+            started = sent.pop(ack_id, None)
+        if started is None:
+            return
+        rtt_ms.append((now - started) * 1000.0)
+        dispatch_us.append(dispatch)
+        if actuate:
+            actuate_us.append(actuate)
+
+    client = mqtt.Client(client_id=f"latency-probe-{int(time.time())}")
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.subscribe(args.ack_topic)
+    client.loop_start()
+    time.sleep(0.5)
+
+    interval = 1.0 / args.rate
+    epoch = time.monotonic()
+    for cmd_id in range(1, args.count + 1):
+        sender_ts = int((time.monotonic() - epoch) * 1000)
+        with lock:
+            sent[cmd_id] = time.monotonic()
+        client.publish(args.command_topic, f"@id={cmd_id},ts={sender_ts};{args.command}")
+        time.sleep(interval)
+
+    time.sleep(args.settle)
+    client.loop_stop()
+    client.disconnect()
+
+    print(f"sent={args.count} acked={len(rtt_ms)} lost={len(sent)}")
+    summarize("rtt", rtt_ms, "ms")
+    summarize("dispatch", dispatch_us, "us")
+    summarize("actuate", actuate_us, "us")
+    if histogram:
+        count, max_us, dropped, *buckets = histogram
+        print(f"device histogram: count={count} max={max_us}us acks_dropped={dropped}")
+        for index, bucket in enumerate(buckets):
+            if not int(bucket):
+                continue
+            if index == len(buckets) - 1:
+                print(f"  >={1 << (index - 1):>5}us: {bucket}")
+            else:
+                print(f"  <{1 << index:>6}us: {bucket}")
+
+
+if __name__ == "__main__":
+    main()
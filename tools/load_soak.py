@@ -0,0 +1,316 @@
+#!/usr/bin/env python3
+"""Drives the command topic at stepped rates and mixes; reports JSON.
+
+Each stage sends enveloped commands (``@id=..,ts=..,src=..,seq=..;cmd``) at a
+fixed rate for a fixed time, matches them against the device acks and
+records the heartbeat fields while it runs. One JSON object per stage is
+printed as soon as the stage ends, followed by a summary object:
+
+  throughput   commands sent / acked per second
+  latency      round trip p50/p90/p99/max in ms, device dispatch p99 in us
+  drops        unacked commands, oversized payloads sent (never acked by
+               design), acks the device itself dropped, window rejections
+  heap         heap_free first/last/min and the slope in bytes per hour
+  knee         first rate whose p99 exceeds --knee-factor x the first
+               stage's p99, or whose loss exceeds --knee-loss
+
+Mix weights pick the command for every slot:
+
+  motion     forward/backward/left/right/stop bursts with changing speeds
+  servo      position servo sweeps
+  spin       spin servo (holds, then returns home off a timer)
+  oversize   payloads larger than MQTT_RX_BUFFER; the client discards them
+
+    pip install paho-mqtt
+    python3 tools/load_soak.py --host 127.0.0.1 --rates 10,25,50,100 --stage-seconds 20
+    python3 tools/load_soak.py --rates 20 --stage-seconds 21600 --mix motion=1 --json soak.json
+
+Without a board, the host build of the firmware stands in for the device. It
+serves its own broker on --port, or joins a running one with --broker
+host:port:
+
+    pio run -e native_device
+    .pio/build/native_device/program --port 1883 &
+    python3 tools/load_soak.py --port 1883 --mix motion=8,servo=2,spin=1,oversize=1
+
+There heap_free is the host process's heap, which settles within the first
+minute. test/test_load_soak runs the same stages and mixes on the simulated
+clock as part of `pio test -e native`.
+"""
+
+import argparse
+import json
+import random
+import re
+import statistics
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+HEARTBEAT_FIELD = re.compile(r"(\w+)=(\d+)")
+MOTION = ["forward", "backward", "left", "right"]
+
+
+def percentile(values, pct):
+    if not values:
+        return None
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, int(round(pct / 100.0 * (len(ordered) - 1))))
+    return ordered[index]
+
+
+def rounded(value, digits=3):
+    return round(value, digits) if value is not None else None
+
+
+def slope_per_hour(samples):
+    """Least squares slope of (seconds, value) samples, scaled to one hour."""
+    if len(samples) < 2:
+        return None
+    xs = [t for t, _ in samples]
+    ys = [v for _, v in samples]
+    mean_x, mean_y = statistics.fmean(xs), statistics.fmean(ys)
+    denom = sum((x - mean_x) ** 2 for x in xs)
+    if denom == 0:
+        return None
+    return sum((x - mean_x) * (y - mean_y) for x, y in samples) / denom * 3600.0
+
+
+def parse_mix(text):
+    weights = {}
+    for part in text.split(","):
+        name, _, weight = part.partition("=")
+        if name not in ("motion", "servo", "spin", "oversize"):
+            raise argparse.ArgumentTypeError(f"unknown mix entry {name!r}")
+        weights[name] = float(weight or 1)
+    return weights
+
+
+class CommandMix:
+    def __init__(self, weights, oversize_bytes, seed):
+        self.names = list(weights)
+        self.weights = [weights[n] for n in self.names]
+        self.oversize_bytes = oversize_bytes
+        self.random = random.Random(seed)
+        self.burst = []
+
+    def next(self):
+        """Returns (kind, body)."""
+        kind = self.random.choices(self.names, self.weights)[0]
+        if kind == "motion":
+            if not self.burst:
+                speed = self.random.randrange(80, 256)
+                self.burst = [f"{d}:{speed}" for d in self.random.sample(MOTION, 3)] + ["stop:0"]
+            return kind, self.burst.pop(0)
+        if kind == "servo":
+            return kind, f"servo1:{self.random.randrange(0, 181)}"
+        if kind == "spin":
+            return kind, "servo2:0"
+        return kind, "forward:1" + " " * self.oversize_bytes
+
+
+class Stage:
+    def __init__(self, rate):
+        self.rate = rate
+        self.sent = 0
+        self.oversize = 0
+        self.pending = {}
+        self.rtt_ms = []
+        self.dispatch_us = []
+        self.started = None
+        self.ended = None
+
+
+class Harness:
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.stages = []
+        self.heartbeats = []
+        self.acks_dropped = None
+        self.epoch = time.monotonic()
+        self.next_id = 1
+        self.client = mqtt.Client(client_id=f"load-soak-{int(time.time())}")
+        self.client.on_message = self.on_message
+
+    def now(self):
+        return time.monotonic() - self.epoch
+
+    def on_message(self, _client, _userdata, msg):
+        arrived = self.now()
+        text = msg.payload.decode(errors="replace")
+        if msg.topic == self.args.heartbeat_topic:
+            fields = {k: int(v) for k, v in HEARTBEAT_FIELD.findall(text)}
+            with self.lock:
+                self.heartbeats.append((arrived, fields))
+            return
+
+        fields = text.split(",")
+        if fields[0] == "hist":
+            if len(fields) > 3:
+                self.acks_dropped = int(fields[3])
+            return
+        if len(fields) != 5:
+            return
+        ack_id, _ts, _rx, dispatch, _actuate = (int(f) for f in fields)
+        with self.lock:
+            for stage in reversed(self.stages):
+                started = stage.pending.pop(ack_id, None)
+                if started is not None:
+                    stage.rtt_ms.append((arrived - started) * 1000.0)
+                    stage.dispatch_us.append(dispatch)
+                    break
+
+    def run_stage(self, rate, mix):
+        stage = Stage(rate)
+        with self.lock:
+            self.stages.append(stage)
+        stage.started = self.now()
+        interval = 1.0 / rate
+        deadline = stage.started + self.args.stage_seconds
+        slot = stage.started
+        while slot < deadline:
+            # Send on an absolute schedule so a slow publish does not lower the rate.
+            delay = slot - self.now()
+            if delay > 0:
+                time.sleep(delay)
+            kind, body = mix.next()
+            cmd_id = self.next_id
+            self.next_id += 1
+            sent_at = self.now()
+            envelope = f"@id={cmd_id},ts={int(sent_at * 1000)},src={self.args.source},seq={cmd_id};"
+            if kind == "oversize":
+                stage.oversize += 1
+            else:
+                with self.lock:
+                    stage.pending[cmd_id] = sent_at
+            self.client.publish(self.args.command_topic, envelope + body)
+            stage.sent += 1
+            slot += interval
+        stage.ended = self.now()
+        time.sleep(self.args.settle)
+        return stage
+
+    def heartbeats_between(self, start, end):
+        with self.lock:
+            return [(t, f) for t, f in self.heartbeats if start <= t <= end]
+
+    def report(self, stage):
+        duration = stage.ended - stage.started
+        beats = self.heartbeats_between(stage.started, stage.ended + self.args.settle)
+        heap = [(t, f["heap_free"]) for t, f in beats if "heap_free" in f]
+        expected = stage.sent - stage.oversize
+        acked = len(stage.rtt_ms)
+        rejected = None
+        if len(beats) >= 2:
+            first, last = beats[0][1], beats[-1][1]
+            rejected = sum(last.get(k, 0) - first.get(k, 0) for k in ("cmd_dup", "cmd_stale", "cmd_expired"))
+        return {
+            "type": "stage",
+            "rate": stage.rate,
+            "seconds": round(duration, 3),
+            "throughput": {
+                "sent_per_s": round(stage.sent / duration, 2) if duration else None,
+                "acked_per_s": round(acked / duration, 2) if duration else None,
+            },
+            "latency": {
+                "rtt_p50_ms": rounded(percentile(stage.rtt_ms, 50)),
+                "rtt_p90_ms": rounded(percentile(stage.rtt_ms, 90)),
+                "rtt_p99_ms": rounded(percentile(stage.rtt_ms, 99)),
+                "rtt_max_ms": rounded(max(stage.rtt_ms) if stage.rtt_ms else None),
+                "dispatch_p99_us": percentile(stage.dispatch_us, 99),
+            },
+            "drops": {
+                "sent": stage.sent,
+                "expected_acks": expected,
+                "acked": acked,
+                "unacked": expected - acked,
+                "loss": round((expected - acked) / expected, 4) if expected else 0.0,
+                "oversize_sent": stage.oversize,
+                "window_rejected": rejected,
+            },
+            "device": {
+                "loop_max_us": max((f.get("loop_max_us", 0) for _, f in beats), default=None),
+                "heap_free_first": heap[0][1] if heap else None,
+                "heap_free_last": heap[-1][1] if heap else None,
+                "heap_free_min": min(v for _, v in heap) if heap else None,
+            },
+        }
+
+    def summary(self, reports):
+        heap = [(t, f["heap_free"]) for t, f in self.heartbeats if "heap_free" in f]
+        knee = None
+        baseline = reports[0]["latency"]["rtt_p99_ms"] if reports else None
+        for report in reports:
+            p99 = report["latency"]["rtt_p99_ms"]
+            slow = baseline is not None and p99 is not None and p99 > baseline * self.args.knee_factor
+            lossy = report["drops"]["loss"] > self.args.knee_loss
+            if slow or lossy:
+                knee = report["rate"]
+                break
+        slope = slope_per_hour(heap)
+        return {
+            "type": "summary",
+            "stages": len(reports),
+            "max_clean_rate": max((r["rate"] for r in reports if knee is None or r["rate"] < knee), default=None),
+            "knee_rate": knee,
+            "device_acks_dropped": self.acks_dropped,
+            "heap": {
+                "samples": len(heap),
+                "first": heap[0][1] if heap else None,
+                "last": heap[-1][1] if heap else None,
+                "min": min(v for _, v in heap) if heap else None,
+                "slope_bytes_per_hour": round(slope, 1) if slope is not None else None,
+            },
+        }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--command-topic", default="esp32/commrobot/serial_in")
+    parser.add_argument("--ack-topic", default="esp32/commrobot/ack")
+    parser.add_argument("--heartbeat-topic", default="esp32/commrobot/heartbeat")
+    parser.add_argument("--rates", default="10,25,50,100", help="commands per second, one stage each")
+    parser.add_argument("--stage-seconds", type=float, default=20.0)
+    parser.add_argument("--settle", type=float, default=2.0, help="seconds to wait for late acks")
+    parser.add_argument("--mix", type=parse_mix, default=parse_mix("motion=8,servo=2,spin=0,oversize=0"))
+    parser.add_argument("--oversize-bytes", type=int, default=600)
+    parser.add_argument("--source", type=int, default=7, help="envelope src id")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--knee-factor", type=float, default=2.0)
+    parser.add_argument("--knee-loss", type=float, default=0.01)
+    parser.add_argument("--json", help="also write all objects to this file as a JSON array")
+    args = parser.parse_args()
+
+    harness = Harness(args)
+    harness.client.connect(args.host, args.port)
+    harness.client.subscribe([(args.ack_topic, 0), (args.heartbeat_topic, 0)])
+    harness.client.loop_start()
+    time.sleep(0.5)
+
+    mix = CommandMix(args.mix, args.oversize_bytes, args.seed)
+    reports = []
+    try:
+        for rate in (float(r) for r in args.rates.split(",")):
+            report = harness.report(harness.run_stage(rate, mix))
+            reports.append(report)
+            print(json.dumps(report), flush=True)
+    except KeyboardInterrupt:
+        print("interrupted; summarizing finished stages", file=sys.stderr)
+    finally:
+        harness.client.loop_stop()
+        harness.client.disconnect()
+
+    summary = harness.summary(reports)
+    print(json.dumps(summary), flush=True)
+    if args.json:
+        with open(args.json, "w", encoding="utf-8") as out:
+            json.dump(reports + [summary], out, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Decodes binary event-log frames captured from the device's serial port.
+
+Build with -D DIAG_LOG_BINARY=1, capture the raw UART stream (for example
+``pio device monitor --raw > capture.bin`` or any serial logger) and run:
+
+    python3 tools/log_decode.py capture.bin
+
+Event names and formats are read from include/diag/event_log.h, so the
+decoder always matches the firmware built from the same tree. Bytes that do
+not belong to a frame (boot banner, bridged serial data) are skipped.
+"""
+
+import argparse
+import pathlib
+import re
+import struct
+import sys
+
+SYNC = b"\xA5\x5A"
+RECORD = struct.Struct("<IHBB4i")
+FRAME_LENGTH = len(SYNC) + RECORD.size + 1
+LEVELS = {0: "D", 1: "I", 2: "W"}
+EVENT_PATTERN = re.compile(r'^\s*X\((\w+),\s*(\d+),\s*"((?:[^"\\]|\\.)*)"\)')
+
+
+def load_events(header):
+    events = []
+    in_table = False
+    for line in header.read_text().splitlines():
+        if line.startswith("#define DIAG_EVENTS("):
+            in_table = True
+            continue
+        if not in_table:
+            continue
+        match = EVENT_PATTERN.match(line)
+        if match:
+            name, _level, fmt = match.groups()
+            events.append((name, fmt.encode().decode("unicode_escape")))
+        if not line.rstrip().endswith("\\"):
+            break
+    return events
+
+
+def frames(data):
+    index = 0
+    while True:
+        index = data.find(SYNC, index)
+        if index < 0 or index + FRAME_LENGTH > len(data):
+            return
+        body = data[index + len(SYNC):index + FRAME_LENGTH - 1]
+        checksum = data[index + FRAME_LENGTH - 1]
+        if sum(body) & 0xFF == checksum:
+            yield RECORD.unpack(body)
+            index += FRAME_LENGTH
+        else:
+            index += 1
+
+
+def main():
+    default_header = pathlib.Path(__file__).resolve().parent.parent / "include" / "diag" / "event_log.h"
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", type=pathlib.Path, help="raw serial capture, '-' for stdin")
+    parser.add_argument("--header", type=pathlib.Path, default=default_header)
+    args = parser.parse_args()
+
+    events = load_events(args.header)
+    data = sys.stdin.buffer.read() if str(args.capture) == "-" else args.capture.read_bytes()
+
+    for timestamp, event, level, argc, *values in frames(data):
+        if event < len(events):
+            name, fmt = events[event]
+            try:
+                text = fmt % tuple(values[:fmt.count("%ld")])
+            except (TypeError, ValueError):
+                text = f"{fmt} {values[:argc]}"
+        else:
+            name, text = f"EVENT_{event}", str(values[:argc])
+        print(f"[{timestamp} {LEVELS.get(level, '?')}] {name}: {text}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""Minimal MQTT 3.1.1 / 5 stand-in broker for exercising the device's client.
+
+Modes:
+  normal     answer CONNACK/SUBACK/PINGRESP, print every PUBLISH
+  blackhole  accept TCP but never answer (CONNACK timeout)
+  slow       delay CONNACK by --delay seconds
+  refuse     reject CONNECT with return code 5 (not authorized)
+  reset      close the socket as soon as CONNECT arrives
+
+The protocol version follows the client's CONNECT. MQTT 5 clients are
+offered --topic-aliases topic aliases, and their own aliases are resolved
+before a PUBLISH is printed. With --push N the broker sends N QoS 1 messages
+to --push-topic after the subscription, never more unacknowledged than the
+client's receive maximum, and reusing one topic alias when the client allows
+it. Every connection ends with a JSON line of the bytes it moved each way,
+for comparing MQTT 5 against 3.1.1 on the same traffic.
+
+Point the device at it with MQTT_HOST/MQTT_PORT and watch the
+"loop_max_us" field of the heartbeat or the "MQTT connect to ... failed" log line.
+
+    python3 tools/standin_broker.py --port 1883 --mode blackhole
+    python3 tools/standin_broker.py --port 1883 --push 20 --push-expiry 5
+"""
+
+import argparse
+import asyncio
+import json
+
+CONNECT, CONNACK, PUBLISH, PUBACK, SUBSCRIBE, SUBACK = 1, 2, 3, 4, 8, 9
+UNSUBSCRIBE, UNSUBACK, PINGREQ, PINGRESP, DISCONNECT = 10, 11, 12, 13, 14
+
+MESSAGE_EXPIRY, RECEIVE_MAXIMUM, TOPIC_ALIAS_MAXIMUM, TOPIC_ALIAS = 0x02, 0x21, 0x22, 0x23
+MAXIMUM_PACKET_SIZE = 0x27
+# Value sizes of the fixed size properties; the rest are length prefixed.
+PROPERTY_SIZES = {0x01: 1, 0x17: 1, 0x19: 1, 0x24: 1, 0x25: 1, 0x28: 1, 0x29: 1, 0x2A: 1,
+                  0x13: 2, 0x21: 2, 0x22: 2, 0x23: 2, 0x02: 4, 0x11: 4, 0x18: 4, 0x27: 4}
+
+
+def encode_varint(value):
+    out = bytearray()
+    while True:
+        byte = value % 128
+        value //= 128
+        out.append(byte | (0x80 if value else 0))
+        if not value:
+            return bytes(out)
+
+
+def decode_varint(data, offset):
+    value, multiplier = 0, 1
+    while True:
+        byte = data[offset]
+        offset += 1
+        value += (byte & 0x7F) * multiplier
+        if not byte & 0x80:
+            return value, offset
+        multiplier *= 128
+
+
+def decode_properties(data, offset):
+    length, offset = decode_varint(data, offset)
+    end = offset + length
+    properties = {}
+    while offset < end:
+        key = data[offset]
+        offset += 1
+        if key in PROPERTY_SIZES:
+            size = PROPERTY_SIZES[key]
+            properties[key] = int.from_bytes(data[offset:offset + size], "big")
+            offset += size
+        elif key == 0x0B:
+            properties[key], offset = decode_varint(data, offset)
+        elif key == 0x26:
+            for _ in range(2):
+                offset += 2 + int.from_bytes(data[offset:offset + 2], "big")
+        else:
+            offset += 2 + int.from_bytes(data[offset:offset + 2], "big")
+    return properties, end
+
+
+def packet(kind, flags, body):
+    return bytes([kind << 4 | flags]) + encode_varint(len(body)) + body
+
+
+async def read_packet(reader, counters):
+    first = await reader.readexactly(1)
+    remaining, multiplier, header = 0, 1, 1
+    while True:
+        byte = (await reader.readexactly(1))[0]
+        header += 1
+        remaining += (byte & 0x7F) * multiplier
+        if not byte & 0x80:
+            break
+        multiplier *= 128
+    body = await reader.readexactly(remaining)
+    counters["rx"] += header + remaining
+    return first[0] >> 4, first[0] & 0x0F, body
+
+
+class Connection:
+    def __init__(self, reader, writer, args):
+        self.reader = reader
+        self.writer = writer
+        self.args = args
+        self.peer = writer.get_extra_info("peername")
+        self.v5 = False
+        self.counters = {"rx": 0, "tx": 0, "publishes": 0, "aliased": 0}
+        self.client_aliases = {}
+        self.receive_maximum = 65535
+        self.alias_limit = 0
+        self.window = None
+        self.in_flight = 0
+        self.max_in_flight = 0
+        self.pusher = None
+
+    def send(self, data):
+        self.counters["tx"] += len(data)
+        self.writer.write(data)
+
+    def on_connect(self, body):
+        self.v5 = body[6] == 5
+        if self.v5:
+            properties, _ = decode_properties(body, 10)
+            self.receive_maximum = properties.get(RECEIVE_MAXIMUM, 65535)
+            self.alias_limit = properties.get(TOPIC_ALIAS_MAXIMUM, 0)
+            print(f"[{self.peer}] MQTT 5 receive_max={self.receive_maximum} "
+                  f"topic_alias_max={self.alias_limit} "
+                  f"max_packet={properties.get(MAXIMUM_PACKET_SIZE, 'none')}")
+        self.window = asyncio.Semaphore(self.receive_maximum)
+        code = 0
+        if self.args.mode == "refuse":
+            code = 0x87 if self.v5 else 5
+        if self.v5:
+            properties = bytes([TOPIC_ALIAS_MAXIMUM]) + self.args.topic_aliases.to_bytes(2, "big")
+            body = bytes([0, code]) + encode_varint(len(properties)) + properties
+            self.send(packet(CONNACK, 0, body))
+        else:
+            self.send(packet(CONNACK, 0, bytes([0, code])))
+
+    def on_subscribe(self, body):
+        offset = 2
+        if self.v5:
+            _, offset = decode_properties(body, offset)
+        granted = []
+        while offset < len(body):
+            length = int.from_bytes(body[offset:offset + 2], "big")
+            offset += 2 + length
+            granted.append(body[offset] & 0x03)
+            offset += 1
+        properties = b"\x00" if self.v5 else b""
+        self.send(packet(SUBACK, 0, body[:2] + properties + bytes(granted)))
+        if self.args.push and self.pusher is None:
+            self.pusher = asyncio.create_task(self.push())
+
+    def on_publish(self, flags, body):
+        length = int.from_bytes(body[:2], "big")
+        topic = body[2:2 + length].decode(errors="replace")
+        offset = 2 + length + (2 if (flags >> 1) & 0x03 else 0)
+        expiry = None
+        if self.v5:
+            properties, offset = decode_properties(body, offset)
+            expiry = properties.get(MESSAGE_EXPIRY)
+            alias = properties.get(TOPIC_ALIAS)
+            if alias is not None and topic:
+                self.client_aliases[alias] = topic
+            elif alias is not None:
+                topic = self.client_aliases.get(alias, f"<unbound alias {alias}>")
+                self.counters["aliased"] += 1
+        self.counters["publishes"] += 1
+        suffix = f" (expires in {expiry} s)" if expiry is not None else ""
+        print(f"[{self.peer}] {topic}: {body[offset:]!r}{suffix}")
+
+    async def push(self):
+        args = self.args
+        aliased = self.v5 and self.alias_limit > 0
+        for number in range(args.push):
+            await self.window.acquire()
+            self.in_flight += 1
+            self.max_in_flight = max(self.max_in_flight, self.in_flight)
+            topic = args.push_topic.encode()
+            properties = b""
+            if self.v5:
+                if args.push_expiry:
+                    properties += bytes([MESSAGE_EXPIRY]) + args.push_expiry.to_bytes(4, "big")
+                if aliased:
+                    properties += bytes([TOPIC_ALIAS]) + (1).to_bytes(2, "big")
+                properties = encode_varint(len(properties)) + properties
+            if aliased and number > 0:
+                topic = b""
+            packet_id = (number % 65535 + 1).to_bytes(2, "big")
+            body = len(topic).to_bytes(2, "big") + topic + packet_id + properties
+            self.send(packet(PUBLISH, 0x02, body + args.push_payload.encode()))
+            await self.writer.drain()
+
+    async def run(self):
+        print(f"[{self.peer}] connected ({self.args.mode})")
+        try:
+            while True:
+                kind, flags, body = await read_packet(self.reader, self.counters)
+                if kind == CONNECT:
+                    if self.args.mode == "blackhole":
+                        await self.reader.read()
+                        return
+                    if self.args.mode == "reset":
+                        return
+                    if self.args.mode == "slow":
+                        await asyncio.sleep(self.args.delay)
+                    self.on_connect(body)
+                elif kind == SUBSCRIBE:
+                    self.on_subscribe(body)
+                elif kind == UNSUBSCRIBE:
+                    properties = b"\x00" if self.v5 else b""
+                    self.send(packet(UNSUBACK, 0, body[:2] + properties))
+                elif kind == PINGREQ:
+                    self.send(packet(PINGRESP, 0, b""))
+                elif kind == PUBLISH:
+                    self.on_publish(flags, body)
+                elif kind == PUBACK:
+                    self.in_flight -= 1
+                    self.window.release()
+                elif kind == DISCONNECT:
+                    return
+                await self.writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionResetError):
+            pass
+        finally:
+            if self.pusher is not None:
+                self.pusher.cancel()
+            report = dict(self.counters, protocol=5 if self.v5 else 4)
+            if self.args.push:
+                report["max_in_flight"] = self.max_in_flight
+            print(f"[{self.peer}] closed {json.dumps(report)}")
+            self.writer.close()
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--mode", choices=["normal", "blackhole", "slow", "refuse", "reset"],
+                        default="normal")
+    parser.add_argument("--delay", type=float, default=5.0)
+    parser.add_argument("--topic-aliases", type=int, default=10,
+                        help="topic aliases MQTT 5 clients may use")
+    parser.add_argument("--push", type=int, default=0, help="QoS 1 messages sent after SUBSCRIBE")
+    parser.add_argument("--push-topic", default="esp32/commrobot/serial_in")
+    parser.add_argument("--push-payload", default="stop")
+    parser.add_argument("--push-expiry", type=int, default=0, help="message expiry in seconds")
+    args = parser.parse_args()
+
+    server = await asyncio.start_server(lambda r, w: Connection(r, w, args).run(), args.bind,
+                                        args.port)
+    print(f"stand-in broker on {args.bind}:{args.port} mode={args.mode}")
+    async with server:
+        await server.serve_forever()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Decodes the actuator state stream and reports it as JSON.
+
+The device publishes binary batches on the state topic (see
+include/net/state_stream.h). Each batch is decoded into samples of
+
+  motors   signed duty per motor, negative is backward
+  servos   servo angles
+  command  id of the last enveloped command
+
+Every batch is printed as one JSON object with its samples (or, with
+--summary-only, just the counts), and every --window seconds a summary of
+the stream's bandwidth including MQTT framing.
+
+    pip install paho-mqtt
+    python3 tools/state_dash.py --host 127.0.0.1 --motors 2
+"""
+
+import argparse
+import json
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+SUPPORTED_VERSION = 1
+
+
+def read_varint(data, offset):
+    value = 0
+    shift = 0
+    while True:
+        if offset >= len(data):
+            raise ValueError("truncated varint")
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, offset
+        shift += 7
+
+
+def read_signed(data, offset):
+    value, offset = read_varint(data, offset)
+    return (value >> 1) ^ -(value & 1), offset
+
+
+def to_int32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def decode_batch(data):
+    if not data or data[0] != SUPPORTED_VERSION:
+        raise ValueError("unsupported batch version")
+    offset = 1
+    channels, offset = read_varint(data, offset)
+    period_ms, offset = read_varint(data, offset)
+    start_ms, offset = read_varint(data, offset)
+    sequence, offset = read_varint(data, offset)
+
+    state = []
+    for _ in range(channels):
+        value, offset = read_signed(data, offset)
+        state.append(value)
+    samples = [list(state)]
+    while offset < len(data):
+        token, offset = read_varint(data, offset)
+        if token & 1:
+            samples.extend(list(state) for _ in range(token >> 1))
+            continue
+        mask = token >> 1
+        for channel in range(channels):
+            if mask & (1 << channel):
+                delta, offset = read_signed(data, offset)
+                state[channel] = to_int32(state[channel] + delta)
+        samples.append(list(state))
+    return {"sequence": sequence, "start_ms": start_ms, "period_ms": period_ms, "samples": samples}
+
+
+class Dashboard:
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.window_start = time.monotonic()
+        self.window_bytes = 0
+        self.window_samples = 0
+        self.last_sequence = None
+        self.lost = 0
+        self.client = mqtt.Client(client_id=f"state-dash-{int(time.time())}")
+        self.client.on_message = self.on_message
+
+    def split(self, sample):
+        motors = self.args.motors
+        return {"motors": sample[:motors], "servos": sample[motors:-1], "command": sample[-1]}
+
+    def on_message(self, _client, _userdata, msg):
+        try:
+            batch = decode_batch(msg.payload)
+        except ValueError as error:
+            print(json.dumps({"type": "error", "error": str(error)}), flush=True)
+            return
+
+        with self.lock:
+            if self.last_sequence is not None and batch["sequence"] != self.last_sequence + 1:
+                self.lost += 1
+            self.last_sequence = batch["sequence"]
+            # PUBLISH fixed header, topic length and topic on top of the payload.
+            self.window_bytes += len(msg.payload) + 2 + 2 + len(msg.topic)
+            self.window_samples += len(batch["samples"])
+
+        report = {
+            "type": "batch",
+            "sequence": batch["sequence"],
+            "start_ms": batch["start_ms"],
+            "period_ms": batch["period_ms"],
+            "bytes": len(msg.payload),
+            "count": len(batch["samples"]),
+        }
+        if not self.args.summary_only:
+            report["samples"] = [self.split(sample) for sample in batch["samples"]]
+        print(json.dumps(report), flush=True)
+
+    def summary(self):
+        with self.lock:
+            elapsed = time.monotonic() - self.window_start
+            report = {
+                "type": "summary",
+                "seconds": round(elapsed, 1),
+                "bytes_per_s": round(self.window_bytes / elapsed, 1),
+                "samples_per_s": round(self.window_samples / elapsed, 1),
+                "lost_batches": self.lost,
+            }
+            self.window_start = time.monotonic()
+            self.window_bytes = 0
+            self.window_samples = 0
+        return report
+
+    def run(self):
+        args = self.args
+        self.client.connect(args.host, args.port)
+        self.client.subscribe(args.state_topic)
+        self.client.loop_start()
+        try:
+            while True:
+                time.sleep(args.window)
+                print(json.dumps(self.summary()), flush=True)
+        except KeyboardInterrupt:
+            pass
+        self.client.loop_stop()
+        self.client.disconnect()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--state-topic", default="esp32/commrobot/state")
+    parser.add_argument("--motors", type=int, default=2, help="motor channels before the servos")
+    parser.add_argument("--window", type=float, default=10.0, help="seconds per bandwidth summary")
+    parser.add_argument("--summary-only", action="store_true", help="omit per-sample output")
+    Dashboard(parser.parse_args()).run()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Serves clock sync to the fleet and sends it scheduled group commands; reports JSON.
+
+Answers every request on the sync topic with this host's receive and send
+times, so devices can track its clock. With --command it also publishes that
+command on the group topic every --every seconds, stamped to run --lead-ms
+in the future; every robot in the group runs it at that instant on its own
+corrected clock.
+
+Each heartbeat seen is reported as one JSON object:
+
+  device          the heartbeat topic it came from
+  sync_err_us     bound on the device's clock offset error
+  sync_drift_ppb  device clock rate against this host
+  sched_*         scheduled commands fired, rejected, missed and how late
+
+Stop with Ctrl-C; a summary object follows.
+
+    pip install paho-mqtt
+    python3 tools/sync_controller.py --host 127.0.0.1 --command forward:120 --lead-ms 500
+"""
+
+import argparse
+import json
+import re
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+HEARTBEAT_FIELD = re.compile(r"(\w+)=(-?\d+)")
+REPORTED = ("sync_err_us", "sync_drift_ppb", "sched_fired", "sched_rejected", "sched_missed",
+            "sched_late_us", "sched_late_max_us")
+
+
+def now_us():
+    return time.time_ns() // 1000
+
+
+class Controller:
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.replies = 0
+        self.sent = 0
+        self.errors = {}
+        self.next_id = int(time.time()) * 1000
+        self.client = mqtt.Client(client_id=f"sync-controller-{int(time.time())}")
+        self.client.on_message = self.on_message
+
+    def on_message(self, _client, _userdata, msg):
+        t2 = now_us()
+        if msg.topic == self.args.sync_topic:
+            # "<reply topic>,<seq>,<t1>"
+            fields = msg.payload.decode(errors="replace").rsplit(",", 2)
+            if len(fields) != 3:
+                return
+            reply_topic, seq, t1 = fields
+            self.client.publish(reply_topic, f"{seq},{t1},{t2},{now_us()}")
+            with self.lock:
+                self.replies += 1
+            return
+
+        stats = {k: int(v) for k, v in HEARTBEAT_FIELD.findall(msg.payload.decode(errors="replace"))}
+        if "sync_err_us" not in stats:
+            return
+        report = {"type": "heartbeat", "device": msg.topic}
+        report.update({k: stats.get(k) for k in REPORTED})
+        with self.lock:
+            self.errors[msg.topic] = stats["sync_err_us"]
+        print(json.dumps(report), flush=True)
+
+    def send_command(self):
+        self.next_id += 1
+        now_ms = time.time_ns() // 1_000_000
+        at = (now_ms + self.args.lead_ms) & 0xFFFFFFFF
+        body = (f"@id={self.next_id},ts={now_ms & 0xFFFFFFFF},src={self.args.source},"
+                f"seq={self.next_id},at={at};{self.args.command}")
+        self.client.publish(self.args.group_topic, body)
+        with self.lock:
+            self.sent += 1
+
+    def run(self):
+        args = self.args
+        self.client.connect(args.host, args.port)
+        self.client.subscribe([(args.sync_topic, 0), (args.heartbeat_topic, 0)])
+        self.client.loop_start()
+        try:
+            while True:
+                time.sleep(args.every)
+                if args.command:
+                    self.send_command()
+        except KeyboardInterrupt:
+            pass
+        self.client.loop_stop()
+        self.client.disconnect()
+
+        with self.lock:
+            errors = sorted(self.errors.values())
+            return {
+                "type": "summary",
+                "sync_replies": self.replies,
+                "commands_sent": self.sent,
+                "devices": len(errors),
+                "sync_err_us_max": errors[-1] if errors else None,
+            }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--sync-topic", default="esp32/commrobot/sync")
+    parser.add_argument("--group-topic", default="esp32/commrobot/group")
+    parser.add_argument("--heartbeat-topic", default="esp32/commrobot/heartbeat",
+                        help="may be a wildcard to watch a whole fleet")
+    parser.add_argument("--command", help="command body to schedule, e.g. forward:120")
+    parser.add_argument("--lead-ms", type=int, default=500, help="how far ahead commands are stamped")
+    parser.add_argument("--every", type=float, default=5.0, help="seconds between commands")
+    parser.add_argument("--source", type=int, default=11, help="envelope src id")
+    args = parser.parse_args()
+
+    print(json.dumps(Controller(args).run()))
+
+
+if __name__ == "__main__":
+    main()
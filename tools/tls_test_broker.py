@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Generate a self-signed CA + broker certificate and a mosquitto TLS config.
+
+Writes into --out (default ./tls-broker):
+  ca.crt / ca.key          throwaway CA
+  server.crt / server.key  broker certificate for --host (IP or DNS name)
+  mosquitto.conf           TLS listener on --port
+  ca_pem.h                 -DMQTT_TLS_CA_PEM=... ready header for the firmware
+
+and prints the provisioning lines for the robot. Then:
+
+    mosquitto -c tls-broker/mosquitto.conf -v
+
+Watch the device log for "MQTT connected over TLS (full|resumed handshake, N ms)"
+and the tls_* fields of the heartbeat; restart the broker (or drop WiFi) to
+force reconnects. mosquitto keeps session tickets valid across client
+reconnects, so every connect after the first should report "resumed".
+"""
+
+import argparse
+import hashlib
+import pathlib
+import subprocess
+
+
+def openssl(*args):
+    subprocess.run(["openssl", *args], check=True, capture_output=True)
+
+
+def der_sha256(pem_path):
+    der = subprocess.run(
+        ["openssl", "x509", "-in", str(pem_path), "-outform", "DER"], check=True, capture_output=True
+    ).stdout
+    return hashlib.sha256(der).hexdigest()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", required=True, help="broker address the robot connects to")
+    parser.add_argument("--port", type=int, default=8883)
+    parser.add_argument("--out", default="tls-broker")
+    parser.add_argument("--days", type=int, default=365)
+    args = parser.parse_args()
+
+    out = pathlib.Path(args.out)
+    out.mkdir(parents=True, exist_ok=True)
+    ca_key, ca_crt = out / "ca.key", out / "ca.crt"
+    key, csr, crt = out / "server.key", out / "server.csr", out / "server.crt"
+
+    openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", str(ca_key))
+    openssl("req", "-x509", "-new", "-key", str(ca_key), "-sha256", "-days", str(args.days),
+            "-subj", "/CN=comm-robot test CA", "-out", str(ca_crt))
+
+    kind = "IP" if args.host.replace(".", "").isdigit() else "DNS"
+    ext = out / "server.ext"
+    ext.write_text(f"subjectAltName={kind}:{args.host}\nbasicConstraints=CA:FALSE\n")
+    openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", str(key))
+    openssl("req", "-new", "-key", str(key), "-subj", f"/CN={args.host}", "-out", str(csr))
+    openssl("x509", "-req", "-in", str(csr), "-CA", str(ca_crt), "-CAkey", str(ca_key),
+            "-CAcreateserial", "-days", str(args.days), "-sha256", "-extfile", str(ext),
+            "-out", str(crt))
+
+    (out / "mosquitto.conf").write_text(
+        f"listener {args.port}\n"
+        "allow_anonymous true\n"
+        f"cafile {ca_crt.resolve()}\n"
+        f"certfile {crt.resolve()}\n"
+        f"keyfile {key.resolve()}\n"
+    )
+
+    pem_lines = ca_crt.read_text().strip().splitlines()
+    literal = " \\\n".join(f'  "{line}\\n"' for line in pem_lines)
+    (out / "ca_pem.h").write_text(f"#pragma once\n#define MQTT_TLS_CA_PEM \\\n{literal}\n")
+
+    print(f"broker config: {out / 'mosquitto.conf'}")
+    print(f"CA header:     {out / 'ca_pem.h'} (build with -include {out / 'ca_pem.h'})")
+    print()
+    print("Provision the robot over ESP-NOW (the MQTT config topic only takes tuning keys):")
+    print(f"MQTT_HOST={args.host}")
+    print(f"MQTT_PORT={args.port}")
+    print("MQTT_TLS=1")
+    print(f"MQTT_TLS_PIN={der_sha256(crt)}")
+    print()
+    print("The pin above is the broker certificate and works without the CA header.")
+    print(f"With the CA header built in, the CA itself can be pinned: {der_sha256(ca_crt)}")
+
+
+if __name__ == "__main__":
+    main()